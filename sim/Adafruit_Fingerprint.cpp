@@ -0,0 +1,32 @@
+// Adafruit_Fingerprint.cpp
+
+#include "Adafruit_Fingerprint.h"
+
+/* Send VfyPwd and wait for the acknowledge, as the library's handshake does */
+bool Adafruit_Fingerprint::verifyPassword() {
+  uint8_t packet[] = {0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, FINGERPRINT_COMMANDPACKET, 0x00, 0x07,
+                      FINGERPRINT_VERIFYPASSWORD, (uint8_t)(password_ >> 24),
+                      (uint8_t)(password_ >> 16), (uint8_t)(password_ >> 8), (uint8_t)password_,
+                      0, 0};
+  uint16_t sum = 0;
+  for (int i = 6; i < 14; i++) sum += packet[i];
+  packet[14] = sum >> 8;
+  packet[15] = sum & 0xFF;
+
+  while (serial_->available()) serial_->read();
+  serial_->write(packet, sizeof(packet));
+
+  uint8_t reply[12];
+  size_t received = 0;
+  uint32_t started = millis();
+  while (received < sizeof(reply) && millis() - started < FINGERPRINT_DEFAULTTIMEOUT) {
+    int byte = serial_->read();
+    if (byte < 0) {
+      delay(1);
+      continue;
+    }
+    reply[received++] = (uint8_t)byte;
+  }
+  return received == sizeof(reply) && reply[6] == FINGERPRINT_ACKPACKET &&
+         reply[9] == FINGERPRINT_OK;
+}
@@ -0,0 +1,81 @@
+// Adafruit_Fingerprint.h
+//
+// Host stand-in for the Adafruit fingerprint library: the protocol constants
+// the firmware frames packets with, plus the boot-time handshake. Runtime
+// commands go through SensorClient to the simulated sensor (sim_sensor.h).
+
+#ifndef SIM_ADAFRUIT_FINGERPRINT_H_
+#define SIM_ADAFRUIT_FINGERPRINT_H_
+
+#include "Arduino.h"
+
+// Confirmation codes
+#define FINGERPRINT_OK 0x00
+#define FINGERPRINT_PACKETRECIEVEERR 0x01
+#define FINGERPRINT_NOFINGER 0x02
+#define FINGERPRINT_IMAGEFAIL 0x03
+#define FINGERPRINT_IMAGEMESS 0x06
+#define FINGERPRINT_FEATUREFAIL 0x07
+#define FINGERPRINT_NOMATCH 0x08
+#define FINGERPRINT_NOTFOUND 0x09
+#define FINGERPRINT_ENROLLMISMATCH 0x0A
+#define FINGERPRINT_BADLOCATION 0x0B
+#define FINGERPRINT_DBREADFAIL 0x0C
+#define FINGERPRINT_UPLOADFEATUREFAIL 0x0D
+#define FINGERPRINT_PACKETRESPONSEFAIL 0x0E
+#define FINGERPRINT_UPLOADFAIL 0x0F
+#define FINGERPRINT_DELETEFAIL 0x10
+#define FINGERPRINT_DBCLEARFAIL 0x11
+#define FINGERPRINT_PASSFAIL 0x13
+#define FINGERPRINT_INVALIDIMAGE 0x15
+#define FINGERPRINT_FLASHERR 0x18
+#define FINGERPRINT_INVALIDREG 0x1A
+#define FINGERPRINT_ADDRCODE 0x20
+#define FINGERPRINT_PASSVERIFY 0x21
+#define FINGERPRINT_TIMEOUT 0xFF
+#define FINGERPRINT_BADPACKET 0xFE
+
+// Packet framing
+#define FINGERPRINT_STARTCODE 0xEF01
+#define FINGERPRINT_COMMANDPACKET 0x1
+#define FINGERPRINT_DATAPACKET 0x2
+#define FINGERPRINT_ACKPACKET 0x7
+#define FINGERPRINT_ENDDATAPACKET 0x8
+
+// Instruction codes
+#define FINGERPRINT_GETIMAGE 0x01
+#define FINGERPRINT_IMAGE2TZ 0x02
+#define FINGERPRINT_MATCH 0x03
+#define FINGERPRINT_SEARCH 0x04
+#define FINGERPRINT_REGMODEL 0x05
+#define FINGERPRINT_STORE 0x06
+#define FINGERPRINT_LOAD 0x07
+#define FINGERPRINT_UPLOAD 0x08
+#define FINGERPRINT_DOWNCHAR 0x09
+#define FINGERPRINT_UPIMAGE 0x0A
+#define FINGERPRINT_DELETE 0x0C
+#define FINGERPRINT_EMPTY 0x0D
+#define FINGERPRINT_SETSYSPARAM 0x0E
+#define FINGERPRINT_READSYSPARAM 0x0F
+#define FINGERPRINT_SETPASSWORD 0x12
+#define FINGERPRINT_VERIFYPASSWORD 0x13
+#define FINGERPRINT_HISPEEDSEARCH 0x1B
+#define FINGERPRINT_TEMPLATECOUNT 0x1D
+
+#define FINGERPRINT_BAUD_REG_ADDR 0x4
+#define FINGERPRINT_DEFAULTTIMEOUT 1000
+
+class Adafruit_Fingerprint {
+ public:
+  Adafruit_Fingerprint(HardwareSerial* serial, uint32_t password = 0x0)
+      : serial_(serial), password_(password) {}
+
+  void begin(uint32_t baud) { serial_->begin(baud); }
+  bool verifyPassword();
+
+ private:
+  HardwareSerial* serial_;
+  uint32_t password_;
+};
+
+#endif  // SIM_ADAFRUIT_FINGERPRINT_H_
@@ -0,0 +1,225 @@
+// Arduino.cpp
+
+#include "Arduino.h"
+
+#include <malloc.h>
+#include <stdarg.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+SimConsole Serial;
+EspClass ESP;
+
+static const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+// Console input typed by the host, read by the UI task
+static std::mutex console_mutex;
+static std::deque<uint8_t> console_input;
+
+int SimConsole::available() {
+  std::lock_guard<std::mutex> lock(console_mutex);
+  return (int)console_input.size();
+}
+
+int SimConsole::read() {
+  std::lock_guard<std::mutex> lock(console_mutex);
+  if (console_input.empty()) return -1;
+  uint8_t byte = console_input.front();
+  console_input.pop_front();
+  return byte;
+}
+
+void SimConsole::SimType(const uint8_t* data, size_t size) {
+  std::lock_guard<std::mutex> lock(console_mutex);
+  console_input.insert(console_input.end(), data, data + size);
+}
+
+// Heap accounting: every C++ allocation of the process goes through these two
+static std::atomic<size_t> heap_in_use(0);
+static std::atomic<size_t> heap_peak(0);
+
+void* operator new(size_t size) {
+  void* block = malloc(size != 0 ? size : 1);
+  if (block == NULL) throw std::bad_alloc();
+  size_t in_use = heap_in_use += malloc_usable_size(block);
+  size_t peak = heap_peak.load();
+  while (in_use > peak && !heap_peak.compare_exchange_weak(peak, in_use)) {
+  }
+  return block;
+}
+
+void operator delete(void* block) noexcept {
+  if (block == NULL) return;
+  heap_in_use -= malloc_usable_size(block);
+  free(block);
+}
+
+void operator delete(void* block, size_t size) noexcept {
+  (void)size;
+  operator delete(block);
+}
+
+static uint32_t SimFreeHeap(size_t in_use) {
+  return in_use < kSimHeapSize ? (uint32_t)(kSimHeapSize - in_use) : 0;
+}
+
+uint32_t EspClass::getFreeHeap() { return SimFreeHeap(heap_in_use.load()); }
+
+uint32_t EspClass::getMaxAllocHeap() { return getFreeHeap(); }
+
+uint32_t EspClass::getMinFreeHeap() { return SimFreeHeap(heap_peak.load()); }
+
+uint32_t EspClass::getCycleCount() {
+  uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start_time).count();
+  return (uint32_t)(ns * getCpuFreqMHz() / 1000);
+}
+
+uint32_t millis(void) {
+  return (uint32_t)(micros() / 1000);
+}
+
+uint32_t micros(void) {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start_time).count();
+}
+
+void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield(void) {
+  std::this_thread::yield();
+}
+
+// Interrupt handlers by pin
+static void (*interrupt_handlers[64])() = {};
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+int digitalPinToInterrupt(uint8_t pin) {
+  return pin;
+}
+
+void attachInterrupt(int interrupt, void (*isr)(), int mode) {
+  (void)mode;
+  if (interrupt >= 0 && interrupt < 64) interrupt_handlers[interrupt] = isr;
+}
+
+/* Run the handler attached to a pin, as a GPIO edge would */
+void SimFireInterrupt(uint8_t pin) {
+  if (pin < 64 && interrupt_handlers[pin] != NULL) interrupt_handlers[pin]();
+}
+
+// Input levels by pin, LOW when set; pins start out HIGH
+static volatile bool pin_low[64] = {};
+
+int digitalRead(uint8_t pin) {
+  return pin < 64 && pin_low[pin] ? LOW : HIGH;
+}
+
+void SimSetPin(uint8_t pin, int level) {
+  if (pin < 64) pin_low[pin] = level == LOW;
+}
+
+size_t Stream::readBytes(char* buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    uint32_t started = millis();
+    int byte = read();
+    while (byte < 0 && millis() - started < timeout_ms_) {
+      delay(1);
+      byte = read();
+    }
+    if (byte < 0) break;
+    buffer[count++] = (char)byte;
+  }
+  return count;
+}
+
+size_t SimConsole::printf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int n = vfprintf(stderr, format, args);
+  va_end(args);
+  return n > 0 ? n : 0;
+}
+
+/* Fixed-depth FIFO of fixed-size items */
+struct SimQueue {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::vector<uint8_t> > items;
+  UBaseType_t length;
+  UBaseType_t item_size;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  SimQueue* queue = new SimQueue();
+  queue->length = length;
+  queue->item_size = item_size;
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  auto has_room = [queue] { return queue->items.size() < queue->length; };
+  if (wait == portMAX_DELAY) {
+    queue->changed.wait(lock, has_room);
+  } else if (!queue->changed.wait_for(lock, std::chrono::milliseconds(wait), has_room)) {
+    return pdFALSE;
+  }
+
+  const uint8_t* bytes = (const uint8_t*)item;
+  queue->items.push_back(std::vector<uint8_t>(bytes, bytes + queue->item_size));
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken) {
+  if (woken != NULL) *woken = pdFALSE;
+  return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  auto has_item = [queue] { return !queue->items.empty(); };
+  if (wait == portMAX_DELAY) {
+    queue->changed.wait(lock, has_item);
+  } else if (!queue->changed.wait_for(lock, std::chrono::milliseconds(wait), has_item)) {
+    return pdFALSE;
+  }
+
+  memcpy(item, queue->items.front().data(), queue->item_size);
+  queue->items.pop_front();
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+// Host thread stacks are not ours to inspect; 0 reads as "unknown"
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  (void)task;
+  return 0;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack,
+                                   void* param, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core) {
+  (void)name;
+  (void)stack;
+  (void)priority;
+  (void)core;
+  std::thread(function, param).detach();
+  if (handle != NULL) *handle = NULL;
+  return pdPASS;
+}
@@ -0,0 +1,154 @@
+// Arduino.h
+//
+// Host stand-in for the parts of the Arduino-ESP32 core the firmware uses:
+// timing, GPIO interrupts, String, Serial, Stream and the FreeRTOS queue and
+// task calls. Only compiled into the native simulator environment.
+
+#ifndef SIM_ARDUINO_H_
+#define SIM_ARDUINO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#define IRAM_ATTR
+#define F(text) (text)
+
+// GPIO constants
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define SERIAL_8N1 0x800001c
+
+// Timing, measured on the host's monotonic clock from process start
+#include "sim_hal.h"
+
+// GPIO interrupts; SimFireInterrupt() plays the role of an edge on a pin
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(int interrupt, void (*isr)(), int mode);
+void SimFireInterrupt(uint8_t pin);
+
+// Input levels; every pin reads HIGH, as if pulled up, until SimSetPin() changes it
+int digitalRead(uint8_t pin);
+void SimSetPin(uint8_t pin, int level);
+
+/* Minimal Arduino String backed by std::string */
+class String {
+ public:
+  String(const char* text = "") : value_(text != NULL ? text : "") {}
+  String(const std::string& text) : value_(text) {}
+  String(int value) : value_(std::to_string(value)) {}
+  String(unsigned int value) : value_(std::to_string(value)) {}
+  String(long value) : value_(std::to_string(value)) {}
+  String(unsigned long value) : value_(std::to_string(value)) {}
+
+  const char* c_str() const { return value_.c_str(); }
+  unsigned int length() const { return (unsigned int)value_.size(); }
+  String& operator+=(const String& other) { value_ += other.value_; return *this; }
+  bool operator==(const String& other) const { return value_ == other.value_; }
+
+  friend String operator+(const String& a, const String& b) { return String(a.value_ + b.value_); }
+
+ private:
+  std::string value_;
+};
+
+/* Byte stream interface shared by Serial ports */
+class Stream {
+ public:
+  virtual ~Stream() {}
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual size_t write(uint8_t byte) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) write(buffer[i]);
+    return size;
+  }
+  virtual size_t readBytes(char* buffer, size_t length);  // Waits up to the timeout per byte
+  virtual int availableForWrite() { return 0; }  // Bytes write() takes without waiting
+  void setTimeout(uint32_t timeout_ms) { timeout_ms_ = timeout_ms; }
+
+ protected:
+  uint32_t timeout_ms_ = 1000;
+};
+
+/* USB serial console, written to stderr so benchmark results own stdout */
+class SimConsole : public Stream {
+ public:
+  void begin(unsigned long baud) { (void)baud; }
+  int available() override;
+  int read() override;
+  size_t write(uint8_t byte) override { return fputc(byte, stderr) == EOF ? 0 : 1; }
+  using Stream::write;
+
+  size_t print(const char* text) { return fputs(text, stderr) >= 0 ? strlen(text) : 0; }
+  size_t print(const String& text) { return print(text.c_str()); }
+  size_t print(long value) { return fprintf(stderr, "%ld", value); }
+  size_t print(unsigned long value) { return fprintf(stderr, "%lu", value); }
+  size_t print(int value) { return print((long)value); }
+  size_t print(unsigned int value) { return print((unsigned long)value); }
+  template <typename T>
+  size_t println(const T& value) { size_t n = print(value); return n + print("\n"); }
+  size_t println() { return print("\n"); }
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+  // Simulator hook: bytes the host "types" into the console
+  void SimType(const uint8_t* data, size_t size);
+  void SimType(const char* text) { SimType((const uint8_t*)text, strlen(text)); }
+};
+
+extern SimConsole Serial;
+
+/* Chip queries; the cycle counter runs at the nominal 240 MHz of the host clock */
+class EspClass {
+ public:
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz() { return 240; }
+  uint32_t getFreeHeap();      // kSimHeapSize less the bytes held by live C++ allocations
+  uint32_t getMaxAllocHeap();  // Same as getFreeHeap(); the host allocator has no block map
+  uint32_t getMinFreeHeap();   // kSimHeapSize less the most bytes ever held
+};
+
+// Heap the simulator pretends to have, the free DRAM of an ESP32 after boot
+const uint32_t kSimHeapSize = 320 * 1024;
+
+extern EspClass ESP;
+
+#include "HardwareSerial.h"
+
+// FreeRTOS subset: queues are mutex/condition-variable rings, tasks are threads
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef struct SimQueue* QueueHandle_t;
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFFu
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))  // 1 kHz tick, as on the ESP32
+#define portYIELD_FROM_ISR() \
+  do {                       \
+  } while (0)
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait);
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);  // Host threads: always 0
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack,
+                                   void* param, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core);
+
+#endif  // SIM_ARDUINO_H_
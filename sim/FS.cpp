@@ -0,0 +1,165 @@
+// FS.cpp
+
+#include "FS.h"
+#include "SPIFFS.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <stdio.h>
+
+#include <atomic>
+
+// Every call into the file system or an open file, for tests that must see none
+static std::atomic<uint32_t> fs_calls(0);
+
+uint32_t SimFsCalls() {
+  return fs_calls.load();
+}
+
+// Bytes the next write may store, -1 when writes are not limited
+static std::atomic<long> short_write(-1);
+
+void SimFsShortWrite(size_t bytes) {
+  short_write = (long)bytes;
+}
+
+namespace fs {
+
+File::File(FILE* file, const char* path) : file_(file), path_(path) {}
+
+int File::available() {
+  fs_calls++;
+  if (file_ == NULL) return 0;
+  return (int)(size() - position());
+}
+
+int File::read() {
+  fs_calls++;
+  if (file_ == NULL) return -1;
+  return fgetc(file_);
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  fs_calls++;
+  if (file_ == NULL) return 0;
+  return fread(buffer, 1, size, file_);
+}
+
+size_t File::write(uint8_t byte) {
+  return write(&byte, 1);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  fs_calls++;
+  if (file_ == NULL) return 0;
+  long limit = short_write.exchange(-1);
+  if (limit >= 0 && (size_t)limit < size) size = (size_t)limit;
+  return fwrite(buffer, 1, size, file_);
+}
+
+bool File::seek(uint32_t position) {
+  fs_calls++;
+  return file_ != NULL && fseek(file_, position, SEEK_SET) == 0;
+}
+
+size_t File::position() const {
+  fs_calls++;
+  return file_ != NULL ? (size_t)ftell(file_) : 0;
+}
+
+size_t File::size() const {
+  fs_calls++;
+  if (file_ == NULL) return 0;
+  long here = ftell(file_);
+  fseek(file_, 0, SEEK_END);
+  long end = ftell(file_);
+  fseek(file_, here, SEEK_SET);
+  return (size_t)end;
+}
+
+void File::flush() {
+  fs_calls++;
+  if (file_ != NULL) fflush(file_);
+}
+
+void File::close() {
+  fs_calls++;
+  if (file_ != NULL) fclose(file_);
+  file_ = NULL;
+}
+
+std::string FS::HostPath(const char* path) const {
+  return root_ + (path[0] == '/' ? "" : "/") + path;
+}
+
+File FS::open(const char* path, const char* mode) {
+  fs_calls++;
+  // Arduino modes are "r", "w" and "a"; always use binary on the host
+  std::string host_mode = std::string(mode) + "b";
+  FILE* file = fopen(HostPath(path).c_str(), host_mode.c_str());
+  return File(file, path);
+}
+
+bool FS::exists(const char* path) {
+  fs_calls++;
+  struct stat info;
+  return stat(HostPath(path).c_str(), &info) == 0;
+}
+
+bool FS::remove(const char* path) {
+  fs_calls++;
+  return ::remove(HostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+  fs_calls++;
+  return ::rename(HostPath(from).c_str(), HostPath(to).c_str()) == 0;
+}
+
+}  // namespace fs
+
+static const char* SimFsRoot() {
+  const char* root = getenv("SIM_FS_ROOT");
+  return root != NULL ? root : ".sim_fs";
+}
+
+SPIFFSFS SPIFFS;
+
+SPIFFSFS::SPIFFSFS() : fs::FS(SimFsRoot()) {}
+
+bool SPIFFSFS::begin(bool format_on_fail) {
+  fs_calls++;
+  (void)format_on_fail;
+  mkdir(root_.c_str(), 0755);
+  struct stat info;
+  return stat(root_.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+/* Delete every file in the partition directory */
+bool SPIFFSFS::format() {
+  fs_calls++;
+  DIR* dir = opendir(root_.c_str());
+  if (dir == NULL) return begin();
+  while (struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] == '.') continue;
+    ::remove((root_ + "/" + entry->d_name).c_str());
+  }
+  closedir(dir);
+  return true;
+}
+
+size_t SPIFFSFS::usedBytes() const {
+  fs_calls++;
+  size_t used = 0;
+  DIR* dir = opendir(root_.c_str());
+  if (dir == NULL) return 0;
+  while (struct dirent* entry = readdir(dir)) {
+    struct stat info;
+    if (entry->d_name[0] != '.' && stat((root_ + "/" + entry->d_name).c_str(), &info) == 0) {
+      used += info.st_size;
+    }
+  }
+  closedir(dir);
+  return used;
+}
@@ -0,0 +1,66 @@
+// FS.h
+//
+// Host stand-in for the Arduino fs::FS/File API, backed by stdio files in a
+// directory on the host (SIM_FS_ROOT, default ./.sim_fs).
+
+#ifndef SIM_FS_H_
+#define SIM_FS_H_
+
+#include "Arduino.h"
+
+namespace fs {
+
+/* Open file handle; copies share one stdio stream like the Arduino File */
+class File : public Stream {
+ public:
+  File(FILE* file = NULL, const char* path = "");
+
+  operator bool() const { return file_ != NULL; }
+  int available() override;
+  int read() override;
+  size_t read(uint8_t* buffer, size_t size);
+  size_t readBytes(char* buffer, size_t length) override {
+    return read((uint8_t*)buffer, length);
+  }
+  size_t write(uint8_t byte) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  bool seek(uint32_t position);
+  size_t position() const;
+  size_t size() const;
+  const char* path() const { return path_.c_str(); }
+  void flush();
+  void close();
+
+ private:
+  FILE* file_;
+  std::string path_;
+};
+
+/* File system rooted at a host directory */
+class FS {
+ public:
+  explicit FS(const char* root) : root_(root) {}
+
+  File open(const char* path, const char* mode = "r");
+  File open(const String& path, const char* mode = "r") { return open(path.c_str(), mode); }
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* from, const char* to);
+
+ protected:
+  std::string HostPath(const char* path) const;
+
+  std::string root_;
+};
+
+}  // namespace fs
+
+using fs::File;
+
+// Calls made into the file system and its files so far, for tests that must see none
+uint32_t SimFsCalls();
+
+// Fault injection: the next file write stores at most bytes and reports that, as a full flash does
+void SimFsShortWrite(size_t bytes);
+
+#endif  // SIM_FS_H_
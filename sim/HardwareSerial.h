@@ -0,0 +1,62 @@
+// HardwareSerial.h
+//
+// Host stand-in for an ESP32 UART. Bytes written go to an attached simulated
+// device, and bytes the device has "transmitted" by now are readable. Bytes
+// written but still on the wire fill the transmit FIFO.
+
+#ifndef SIM_HARDWARE_SERIAL_H_
+#define SIM_HARDWARE_SERIAL_H_
+
+/* Peripheral on the far end of a simulated UART */
+class SimUartDevice {
+ public:
+  virtual ~SimUartDevice() {}
+  virtual void Receive(const uint8_t* data, size_t size, uint32_t baud) = 0;
+  virtual int Available() = 0;  // Bytes whose transmission has finished
+  virtual int Read() = 0;
+  virtual size_t Backlog() { return 0; }  // Bytes written to it still on the wire
+};
+
+// Transmit FIFO of an ESP32 UART with no TX ring buffer installed
+static const int kSimUartTxFifoBytes = 128;
+
+class HardwareSerial : public Stream {
+ public:
+  explicit HardwareSerial(int uart) : uart_(uart), baud_(0), device_(NULL) {}
+
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rx_pin = -1,
+             int8_t tx_pin = -1) {
+    (void)config;
+    (void)rx_pin;
+    (void)tx_pin;
+    baud_ = baud;
+  }
+  size_t setRxBufferSize(size_t size) { return size; }  // The host queue is unbounded
+  void updateBaudRate(unsigned long baud) { baud_ = baud; }
+  unsigned long baudRate() const { return baud_; }
+  void end() { baud_ = 0; }
+  void flush() {}
+
+  int available() override { return device_ != NULL && baud_ != 0 ? device_->Available() : 0; }
+  int read() override { return device_ != NULL && baud_ != 0 ? device_->Read() : -1; }
+  int availableForWrite() override {
+    if (device_ == NULL || baud_ == 0) return kSimUartTxFifoBytes;
+    size_t backlog = device_->Backlog();
+    return backlog >= (size_t)kSimUartTxFifoBytes ? 0 : kSimUartTxFifoBytes - (int)backlog;
+  }
+  size_t write(uint8_t byte) override { return write(&byte, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    if (device_ != NULL && baud_ != 0) device_->Receive(buffer, size, baud_);
+    return size;
+  }
+
+  // Simulator hook: connect the peripheral wired to this UART
+  void SimAttach(SimUartDevice* device) { device_ = device; }
+
+ private:
+  int uart_;
+  unsigned long baud_;
+  SimUartDevice* device_;
+};
+
+#endif  // SIM_HARDWARE_SERIAL_H_
@@ -0,0 +1,10 @@
+// SPI.h
+//
+// Host stand-in; the simulated display has no SPI bus.
+
+#ifndef SIM_SPI_H_
+#define SIM_SPI_H_
+
+#include "Arduino.h"
+
+#endif  // SIM_SPI_H_
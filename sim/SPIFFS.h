@@ -0,0 +1,22 @@
+// SPIFFS.h
+
+#ifndef SIM_SPIFFS_H_
+#define SIM_SPIFFS_H_
+
+#include "FS.h"
+
+/* SPIFFS partition simulated as a host directory; sizes mimic a 1.5 MB partition */
+class SPIFFSFS : public fs::FS {
+ public:
+  SPIFFSFS();
+
+  bool begin(bool format_on_fail = false);
+  bool format();
+  size_t totalBytes() const { return 1441792; }
+  size_t usedBytes() const;
+  void end() {}
+};
+
+extern SPIFFSFS SPIFFS;
+
+#endif  // SIM_SPIFFS_H_
@@ -0,0 +1,80 @@
+// TFT_eSPI.cpp
+
+#include "TFT_eSPI.h"
+
+void TFT_eSPI::fillScreen(uint16_t color) {
+  for (int i = 0; i < kSimPanelWidth * kSimPanelHeight; i++) framebuffer_[i] = color;
+}
+
+/* Report a stored calibration; the simulated panel needs none */
+void TFT_eSPI::calibrateTouch(uint16_t* data, uint32_t fg, uint32_t bg, uint8_t size) {
+  (void)fg;
+  (void)bg;
+  (void)size;
+  for (int i = 0; i < 5; i++) data[i] = 0;
+}
+
+bool TFT_eSPI::getTouch(uint16_t* x, uint16_t* y, uint16_t threshold) {
+  (void)threshold;
+  if (!touched_) return false;
+  *x = touch_x_;
+  *y = touch_y_;
+  return true;
+}
+
+/* One touch controller conversion, holding the caller for its bus time */
+void TFT_eSPI::TouchTransfer() {
+  uint32_t started_us = micros();
+  while (micros() - started_us < kSimTouchTransferUs) {
+  }
+  touch_transfers_++;
+}
+
+uint16_t TFT_eSPI::getTouchRawZ() {
+  TouchTransfer();
+  return touched_ ? kSimTouchPressure : 0;
+}
+
+void TFT_eSPI::getTouchRaw(uint16_t* x, uint16_t* y) {
+  TouchTransfer();
+  TouchTransfer();
+  *x = touch_x_;
+  *y = touch_y_;
+}
+
+void TFT_eSPI::SimTouch(uint16_t x, uint16_t y) {
+  touch_x_ = x;
+  touch_y_ = y;
+  touched_ = true;
+  if (pen_irq_pin_ >= 0) {
+    SimSetPin(pen_irq_pin_, LOW);
+    SimFireInterrupt(pen_irq_pin_);
+  }
+}
+
+void TFT_eSPI::SimRelease() {
+  touched_ = false;
+  if (pen_irq_pin_ >= 0) SimSetPin(pen_irq_pin_, HIGH);
+}
+
+void TFT_eSPI::dmaWait() {
+  while (dmaBusy()) yield();
+}
+
+/* Copy a block into the framebuffer, clipped to the panel, and start its bus time */
+void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* data,
+                            uint16_t* buffer) {
+  (void)buffer;
+  dmaWait();  // Like the driver, wait for the previous transfer first
+  for (int32_t row = 0; row < h; row++) {
+    if (y + row < 0 || y + row >= kSimPanelHeight) continue;
+    for (int32_t col = 0; col < w; col++) {
+      if (x + col < 0 || x + col >= kSimPanelWidth) continue;
+      uint16_t pixel = data[row * w + col];
+      if (swap_bytes_) pixel = (uint16_t)((pixel << 8) | (pixel >> 8));
+      framebuffer_[(y + row) * kSimPanelWidth + (x + col)] = pixel;
+    }
+  }
+  pushed_pixels_ += (uint32_t)(w * h);
+  dma_done_us_ = micros() + (uint32_t)(w * h) * 16 / kSimDisplaySpiMHz;
+}
@@ -0,0 +1,78 @@
+// TFT_eSPI.h
+//
+// Headless host stand-in for the ILI9341 driver. Pixels pushed by LVGL land
+// in a RAM framebuffer, touches come from SimTouch(), and the rest of the
+// drawing API is a no-op. DMA transfers and touch controller reads take the
+// time they would on the real bus, so the two can be seen contending.
+
+#ifndef SIM_TFT_ESPI_H_
+#define SIM_TFT_ESPI_H_
+
+#include "Arduino.h"
+
+#define TFT_BLACK 0x0000
+#define TFT_WHITE 0xFFFF
+#define TFT_MAGENTA 0xF81F
+
+// Panel size in the landscape rotation the firmware uses
+static const int kSimPanelWidth = 320;
+static const int kSimPanelHeight = 240;
+
+// Bus timing: 16-bit pixels at 40 MHz; one XPT2046 conversion at 2.5 MHz plus chip select
+static const uint32_t kSimDisplaySpiMHz = 40;
+static const uint32_t kSimTouchTransferUs = 15;
+static const uint16_t kSimTouchPressure = 1200;  // Raw Z reported while pressed
+
+class TFT_eSPI {
+ public:
+  TFT_eSPI() {}
+
+  void begin() {}
+  void setRotation(uint8_t rotation) { (void)rotation; }
+  void fillScreen(uint16_t color);
+  void setCursor(int16_t x, int16_t y) { (void)x; (void)y; }
+  void setTextFont(uint8_t font) { (void)font; }
+  void setTextSize(uint8_t size) { (void)size; }
+  void setTextColor(uint16_t fg, uint16_t bg) { (void)fg; (void)bg; }
+  template <typename T>
+  void println(const T& value) { (void)value; }
+  void setSwapBytes(bool swap) { swap_bytes_ = swap; }
+
+  void setTouch(uint16_t* data) { (void)data; }
+  void calibrateTouch(uint16_t* data, uint32_t fg, uint32_t bg, uint8_t size);
+  bool getTouch(uint16_t* x, uint16_t* y, uint16_t threshold = 600);
+  uint16_t getTouchRawZ();
+  void getTouchRaw(uint16_t* x, uint16_t* y);
+  void convertRawXY(uint16_t* x, uint16_t* y) { (void)x; (void)y; }  // Raw is screen space
+
+  bool initDMA(bool ctrl_cs = false) { (void)ctrl_cs; return true; }
+  void startWrite() {}
+  void endWrite() {}
+  void dmaWait();
+  bool dmaBusy() { return (int32_t)(dma_done_us_ - micros()) > 0; }
+  void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* data,
+                    uint16_t* buffer = NULL);
+
+  // Simulator hooks; with a pen IRQ pin, touches also pull it low and fire its interrupt
+  void SimTouch(uint16_t x, uint16_t y);
+  void SimRelease();
+  void SetPenIrqPin(int pin) { pen_irq_pin_ = pin; }
+  uint16_t SimPixel(int x, int y) const { return framebuffer_[y * kSimPanelWidth + x]; }
+  uint32_t sim_pushed_pixels() const { return pushed_pixels_; }
+  uint32_t sim_touch_transfers() const { return touch_transfers_; }
+
+ private:
+  void TouchTransfer();
+
+  uint16_t framebuffer_[kSimPanelWidth * kSimPanelHeight];
+  uint32_t pushed_pixels_ = 0;
+  uint32_t dma_done_us_ = 0;     // micros() when the transfer in flight completes
+  uint32_t touch_transfers_ = 0;  // Conversions read from the touch controller
+  int pen_irq_pin_ = -1;
+  bool swap_bytes_ = false;
+  volatile bool touched_ = false;
+  volatile uint16_t touch_x_ = 0;
+  volatile uint16_t touch_y_ = 0;
+};
+
+#endif  // SIM_TFT_ESPI_H_
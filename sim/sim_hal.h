@@ -0,0 +1,25 @@
+/* sim_hal.h
+ *
+ * C-linkage timing calls, so LVGL's C sources can take their tick from the
+ * same clock as the firmware (LV_TICK_CUSTOM_INCLUDE).
+ */
+
+#ifndef SIM_HAL_H_
+#define SIM_HAL_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(uint32_t ms);
+void yield(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SIM_HAL_H_ */
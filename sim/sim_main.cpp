@@ -0,0 +1,1245 @@
+// sim_main.cpp
+//
+// Entry point of the native simulator build. Runs the firmware's setup() and
+// loop() against the simulated sensor, display and flash, drives the UI the
+// way a user would, and prints one JSON line per benchmark on stdout. Results
+// with a known answer are checked with SIM_CHECK; the exit status is
+// non-zero if any check failed.
+// Firmware logging goes to stderr.
+//
+// With --console the benchmarks are skipped and stdin is fed to the admin
+// console one request at a time, so a scripted session can be piped in;
+// replies go to stderr with the rest of the firmware output.
+//
+// With --test the tests in sim_tests.cpp run instead, before setup(); the
+// exit status is non-zero if any check failed.
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <SPIFFS.h>
+
+#include <string>
+
+#include "access_log.h"
+#include "admin_console.h"
+#include "boot_profile.h"
+#include "bulk_delete.h"
+#include "enrollment.h"
+#include "hardware.h"
+#include "image_stream.h"
+#include "match_cache.h"
+#include "render_profile.h"
+#include "sensor_baud.h"
+#include "sensor_shards.h"
+#include "sensor_task.h"
+#include "sim_sensor.h"
+#include "sim_tests.h"
+#include "spi_bus.h"
+#include "template_archive.h"
+#include "touch_input.h"
+#include "ui.h"
+#include "ui_binding.h"
+#include "user_directory.h"
+#include "user_list_view.h"
+#include "user_store.h"
+
+void setup();
+void loop();
+
+// Benchmark sizes
+static const int kScanRuns = 10;
+static const uint8_t kScanFinger = 7;    // Finger (and ID) enrolled before scanning
+static const uint8_t kShardScanFinger = 11;  // Same, stored on the last shard
+static const uint8_t kEnrollFinger = 9;  // Finger (and ID) enrolled through the UI
+static const uint8_t kShardEnrollFinger = 10;  // Next enrollment, placed on another shard
+static const uint32_t kStepTimeoutMs = 5000;
+static const int kSustainedScans = 10;        // Placements per access log run
+static const uint16_t kLogAppends = 4096;     // Records pushed through the access log
+static const uint16_t kAdminFirstId = 20;     // Users imported and deleted over the console
+static const uint16_t kAdminUsers = 100;
+static const uint8_t kAdminFrameUsers = 50;   // User lines per import frame
+static const uint16_t kStorageSizes[] = {10, 127, kMaxUserId};  // Users saved through the log
+static const uint16_t kJsonStorageSizes[] = {10, 127, 1000};    // Users saved through users.json
+static const char* const kJsonBenchPath = "/bench_users.json";  // Not the path the store migrates
+static const int kSoakRounds = 50;            // Scan and screen rounds of the heap soak
+static const uint32_t kTouchIdleMs = 2000;    // Untouched main menu time per touch run
+static const int kTouchTaps = 10;
+static const uint16_t kTapX = 260;            // Centre of the main menu dropdown
+static const uint16_t kTapY = 25;
+static const int kVerifyRuns = 5;             // Placements per verify and search run
+static const uint16_t kTraceRegulars = 40;    // Users behind most scans in the synthetic traces
+static const int kTraceScans = 2000;
+static const int kTraceVisitorPct = 15;       // Scans by someone outside the regulars
+static const int kTraceBurstVisitors = 100;   // One-off visitors arriving together mid-trace
+static const uint16_t kMorningRegulars = 4;   // Users behind the end-to-end cache runs
+static const int kCachePlacements = 24;       // Placements per end-to-end cache run
+static const uint32_t kImageBauds[] = {38400, 57600, 115200};  // Rates raw captures are timed at
+static const uint32_t kImageJobTimeoutMs = 60000;
+static const int kRenderFrames = 20;          // Full redraws timed per screen
+static const int8_t kSimPenIrqPin = TOUCH_IRQ_PIN >= 0 ? TOUCH_IRQ_PIN : 36;
+
+static uint32_t slowest_loop_us = 0;  // Longest loop() pass seen by PumpUntil()
+
+/* Min, mean and max of a set of microsecond samples */
+struct Samples {
+  uint32_t count = 0;
+  uint64_t total_us = 0;
+  uint32_t min_us = 0xFFFFFFFF;
+  uint32_t max_us = 0;
+
+  void Add(uint32_t us) {
+    count++;
+    total_us += us;
+    if (us < min_us) min_us = us;
+    if (us > max_us) max_us = us;
+  }
+  uint32_t MeanUs() const { return count == 0 ? 0 : (uint32_t)(total_us / count); }
+};
+
+/* Run loop() until a condition holds; false on timeout */
+template <typename Condition>
+static bool PumpUntil(Condition done, uint32_t timeout_ms = kStepTimeoutMs) {
+  uint32_t started = millis();
+  while (!done()) {
+    if (millis() - started > timeout_ms) return false;
+    uint32_t loop_started_us = micros();
+    loop();
+    uint32_t loop_us = micros() - loop_started_us;
+    if (loop_us > slowest_loop_us) slowest_loop_us = loop_us;
+  }
+  return true;
+}
+
+static void PumpFor(uint32_t ms) {
+  PumpUntil([] { return false; }, ms);
+}
+
+static void PrintSamples(const char* name, const Samples& samples) {
+  printf("{\"benchmark\":\"%s\",\"runs\":%u,\"mean_us\":%u,\"min_us\":%u,\"max_us\":%u}\n",
+         name, (unsigned)samples.count, (unsigned)samples.MeanUs(),
+         (unsigned)(samples.count ? samples.min_us : 0), (unsigned)samples.max_us);
+}
+
+/* Save a user where the UI would: its current page, else the least loaded shard */
+static void SaveSimUser(uint16_t id, const char* name) {
+  uint8_t shard = 0;
+  uint16_t slot = 0;
+  if (!user_directory.Locate(id, &shard, &slot)) {
+    shard = user_directory.LeastLoadedShard();
+    slot = user_directory.FreeSlot(shard, id);
+  }
+  SaveUser(id, name, shard, slot);
+}
+
+/* Store a finger's template on the page the directory has for a user */
+static void EnrollSimTemplate(uint16_t id, uint8_t finger) {
+  uint8_t shard = 0;
+  uint16_t slot = 0;
+  if (user_directory.Locate(id, &shard, &slot)) sim_sensors[shard].Enroll(slot, finger);
+}
+
+/* Searches run by every simulated module */
+static uint32_t TotalSearches() {
+  uint32_t searches = 0;
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    searches += sim_sensors[shard].stats().searches;
+  }
+  return searches;
+}
+
+/* Finger placed on the sensor until the matched name is on the label */
+static void BenchmarkScanToLabel(const char* name, uint8_t finger, uint8_t shard) {
+  SaveUser(finger, "Sim User", shard, finger);
+  EnrollSimTemplate(finger, finger);
+  SimSensorStats before = sim_sensor.stats();
+  uint32_t searches_before = TotalSearches();
+
+  ScanAction();
+  PumpFor(200);
+
+  char expected[16];
+  snprintf(expected, sizeof(expected), "ID: %u,", (unsigned)finger);
+
+  Samples samples;
+  for (int run = 0; run < kScanRuns; run++) {
+    finger_text.SetText("Scanning...");  // So each match changes the label again
+
+    uint32_t started_us = micros();
+    sim_sensor.PlaceFinger(finger);
+    bool matched = PumpUntil([&] {
+      return strncmp(finger_text.text(), expected, strlen(expected)) == 0;
+    });
+    if (matched) samples.Add(micros() - started_us);
+
+    sim_sensor.LiftFinger();
+    PumpFor(400);  // Let the sensor task see the lift and end the session
+  }
+
+  ReturnToMainMenu();
+  PumpFor(100);
+
+  SimSensorStats sensor = sim_sensor.stats();
+  PrintSamples(name, samples);
+  printf("{\"benchmark\":\"%s_traffic\",\"shard\":%u,\"commands\":%u,\"get_images\":%u,"
+         "\"searches\":%u}\n",
+         name, (unsigned)shard, (unsigned)(sensor.commands - before.commands),
+         (unsigned)(sensor.get_images - before.get_images),
+         (unsigned)(TotalSearches() - searches_before));
+}
+
+/* Boot profile: every phase, the time to first scan, and what a serial boot would take */
+static void ReportBoot() {
+  uint32_t boot_started_us = GetBootPhase(kBootSerial).start_us;
+  uint32_t sequential_us = 0;  // Old order: every phase ran before the first frame
+  printf("{\"benchmark\":\"boot\"");
+  for (uint8_t i = 0; i < kBootPhaseCount; i++) {
+    const BootPhaseTiming& timing = GetBootPhase((BootPhase)i);
+    uint32_t us = timing.end_us - timing.start_us;
+    sequential_us += us;
+    printf(",\"%s_us\":%u", BootPhaseName((BootPhase)i), (unsigned)us);
+  }
+  printf(",\"first_frame_us\":%u,\"ready_us\":%u,\"sequential_first_frame_us\":%u}\n",
+         (unsigned)(GetBootPhase(kBootUi).end_us - boot_started_us),
+         (unsigned)(BootReadyUs() - boot_started_us), (unsigned)sequential_us);
+}
+
+/* LVGL heap in use, in bytes */
+static uint32_t LvglHeapUsed(const lv_mem_monitor_t& mem) {
+  return mem.total_size - mem.free_size;
+}
+
+/* LVGL heap after boot and once every screen was opened, and how long navigating takes */
+static void BenchmarkScreens() {
+  lv_mem_monitor_t boot_mem;
+  lv_mem_monitor(&boot_mem);
+
+  void (*const actions[])() = {EnrollAction, ScanAction, DeleteAction, PasswordAction};
+  Samples first_open;  // First visit of each screen
+  Samples open;        // Later visits
+  Samples back;        // Back to the main menu
+  for (int pass = 0; pass < 2; pass++) {
+    for (void (*action)() : actions) {
+      uint32_t started_us = micros();
+      action();
+      lv_refr_now(NULL);
+      (pass == 0 ? first_open : open).Add(micros() - started_us);
+      PumpFor(50);
+
+      started_us = micros();
+      ReturnToMainMenu();
+      lv_refr_now(NULL);
+      back.Add(micros() - started_us);
+      PumpFor(50);
+    }
+  }
+
+  lv_mem_monitor_t mem;
+  lv_mem_monitor(&mem);
+  printf("{\"benchmark\":\"ui_screens\",\"boot_heap_used\":%u,\"boot_blocks\":%u,"
+         "\"heap_used\":%u,\"heap_max_used\":%u,\"blocks\":%u,\"first_open_us\":%u,"
+         "\"open_us\":%u,\"back_us\":%u}\n",
+         (unsigned)LvglHeapUsed(boot_mem), (unsigned)boot_mem.used_cnt,
+         (unsigned)LvglHeapUsed(mem), (unsigned)mem.max_used, (unsigned)mem.used_cnt,
+         (unsigned)first_open.MeanUs(), (unsigned)open.MeanUs(), (unsigned)back.MeanUs());
+
+  // The firmware's own view of the same, as the "ui" console command reports it
+  Serial.SimType("ui\n");
+  PumpFor(50);
+}
+
+/* Full redraws of every screen, with and without the keyboard, costed per scene and widget */
+static void BenchmarkRenderScenes() {
+  void (*const actions[])() = {ReturnToMainMenu, EnrollAction, ScanAction, DeleteAction,
+                               PasswordAction};
+  render_profiler.Reset();
+  for (void (*action)() : actions) {
+    action();
+    lv_refr_now(NULL);
+    for (int frame = 0; frame < kRenderFrames; frame++) {
+      lv_obj_invalidate(lv_scr_act());
+      lv_refr_now(NULL);
+    }
+  }
+  ReturnToMainMenu();
+  PumpFor(50);
+
+  for (uint8_t i = 0; i < render_profiler.scene_count(); i++) {
+    const RenderSceneStats& scene = render_profiler.scene(i);
+    uint32_t frames = scene.render.count;
+    printf("{\"benchmark\":\"render_scene\",\"scene\":\"%s\",\"frames\":%u,"
+           "\"render_mean_us\":%u,\"render_max_us\":%u,\"flush_mean_us\":%u,"
+           "\"pushed_px_per_frame\":%u}\n",
+           scene.name, (unsigned)frames, (unsigned)scene.render.MeanUs(),
+           (unsigned)scene.render.max_us, (unsigned)scene.flush.MeanUs(),
+           (unsigned)(frames ? scene.pushed_px / frames : 0));
+  }
+  for (uint8_t i = 0; i < render_profiler.widget_count(); i++) {
+    const RenderWidgetStats& widget = render_profiler.widget(i);
+    printf("{\"benchmark\":\"render_widget\",\"widget\":\"%s\",\"frames\":%u,"
+           "\"draw_mean_us\":%u,\"draw_max_us\":%u}\n",
+           widget.name, (unsigned)widget.draw.count, (unsigned)widget.draw.MeanUs(),
+           (unsigned)widget.draw.max_us);
+  }
+
+  // An idle main menu with the overlay up, then the firmware's own report of it all
+  render_profiler.SetOverlay(true);
+  PumpFor(1200);
+  render_profiler.SetOverlay(false);
+  Serial.SimType("render\n");
+  PumpFor(50);
+}
+
+/* Sensor unplugged mid-scan: time to the offline notice, then to scanning again */
+static void BenchmarkSensorOffline() {
+  ScanAction();
+  PumpFor(200);
+
+  uint32_t started_ms = millis();
+  sim_sensor.SetConnected(false);
+  bool noticed = PumpUntil([] {
+    return strcmp(finger_text.text(), "Sensor offline, retrying...") == 0;
+  }, 10000);
+  uint32_t detect_ms = millis() - started_ms;
+
+  // Enrollment is refused while offline
+  SendSensorCommand(kCmdStop);
+  SendEnrollCommand(kEnrollFinger, kCaptureShard, kEnrollFinger, "Sim User");
+  PumpFor(100);
+  bool enroll_refused = !enrollment.active();
+  SendSensorCommand(kCmdStartScan);
+  PumpFor(100);
+
+  started_ms = millis();
+  sim_sensor.SetConnected(true);
+  bool recovered = PumpUntil([] { return strcmp(finger_text.text(), "Scanning...") == 0; },
+                             kSensorRetryMs + kStepTimeoutMs);
+  uint32_t recover_ms = millis() - started_ms;
+
+  // Scans work again without leaving the screen
+  SaveUser(kScanFinger, "Sim User", kCaptureShard, kScanFinger);
+  EnrollSimTemplate(kScanFinger, kScanFinger);
+  sim_sensor.PlaceFinger(kScanFinger);
+  bool matched = PumpUntil([] { return strncmp(finger_text.text(), "ID: ", 4) == 0; });
+  sim_sensor.LiftFinger();
+  PumpFor(400);
+  ReturnToMainMenu();
+  PumpFor(100);
+
+  printf("{\"benchmark\":\"sensor_offline\",\"noticed\":%s,\"detect_ms\":%u,"
+         "\"enroll_refused\":%s,\"recovered\":%s,\"recover_ms\":%u,\"scan_after\":%s}\n",
+         noticed ? "true" : "false", (unsigned)detect_ms, enroll_refused ? "true" : "false",
+         recovered ? "true" : "false", (unsigned)recover_ms, matched ? "true" : "false");
+}
+
+/* Templates stored on every simulated module */
+static uint32_t TotalTemplates() {
+  uint32_t templates = 0;
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    templates += sim_sensors[shard].TemplateCount();
+  }
+  return templates;
+}
+
+/* ID and name typed, then two placements until the user is saved */
+static void BenchmarkEnrollment(const char* name, uint8_t finger) {
+  static uint8_t placed_finger;
+  placed_finger = finger;
+
+  EnrollAction();
+  char typed_id[8];
+  snprintf(typed_id, sizeof(typed_id), "%u", (unsigned)finger);
+  lv_textarea_set_text(input_text_area, typed_id);
+  lv_event_send(keyboard, LV_EVENT_READY, NULL);
+  lv_textarea_set_text(input_text_area, "Sim Enrollee");
+
+  uint32_t started_us = micros();
+  lv_event_send(keyboard, LV_EVENT_READY, NULL);
+
+  // Answer each prompt as soon as it appears on the label
+  bool saved = PumpUntil([] {
+    const char* prompt = finger_text.text();
+    if (strncmp(prompt, "Place", 5) == 0) sim_sensor.PlaceFinger(placed_finger);
+    if (strncmp(prompt, "Remove", 6) == 0) sim_sensor.LiftFinger();
+    return user_directory.Contains(placed_finger);
+  }, 3 * kStepTimeoutMs);
+  uint32_t elapsed_us = micros() - started_us;
+  sim_sensor.LiftFinger();
+
+  uint8_t shard = 0;
+  uint16_t slot = 0;
+  user_directory.Locate(finger, &shard, &slot);
+  bool stored = saved && sim_sensors[shard].TemplateAt(slot) == finger;
+  printf("{\"benchmark\":\"%s\",\"ok\":%s,\"elapsed_us\":%u,\"shard\":%u,"
+         "\"templates\":%u}\n",
+         name, stored ? "true" : "false", (unsigned)elapsed_us, (unsigned)shard,
+         (unsigned)TotalTemplates());
+
+  PumpFor(2500);  // The UI returns to the menu two seconds after success
+}
+
+/* Save and flush users, then replay the log into a fresh directory */
+static void BenchmarkStorage(uint16_t users) {
+  UserStoreStats before = user_store.stats();
+
+  uint32_t started_us = micros();
+  char name[kMaxUserNameLength + 1];
+  for (uint16_t id = 1; id <= users; id++) {
+    snprintf(name, sizeof(name), "Storage User %u", (unsigned)id);
+    SaveSimUser(id, name);
+  }
+  uint32_t save_us = micros() - started_us;
+
+  started_us = micros();
+  user_store.Flush();
+  uint32_t flush_us = micros() - started_us;
+
+  UserDirectory replayed;
+  UserStore replay_store(replayed);
+  started_us = micros();
+  replay_store.Begin(SPIFFS);
+  uint32_t replay_us = micros() - started_us;
+
+  UserStoreStats after = user_store.stats();
+  printf("{\"benchmark\":\"storage\",\"users\":%u,\"save_us\":%u,\"save_per_op_us\":%u,"
+         "\"flush_us\":%u,\"replay_us\":%u,\"replayed\":%u,\"bytes_written\":%u,"
+         "\"flushes\":%u}\n",
+         (unsigned)users, (unsigned)save_us, (unsigned)(save_us / users), (unsigned)flush_us,
+         (unsigned)replay_us, (unsigned)replayed.Count(),
+         (unsigned)(after.bytes_written - before.bytes_written),
+         (unsigned)(after.flushes - before.flushes));
+}
+
+/* Read users.json, change one user and write the whole file back, as the pre-log store did */
+static size_t RewriteJsonUser(uint16_t id, const char* name) {
+  // An elastic document: the old 512-byte one silently dropped users past about ten
+  JsonDocument doc;
+  File file = SPIFFS.open(kJsonBenchPath, "r");
+  if (file) {
+    deserializeJson(doc, file);
+    file.close();
+  }
+
+  char key[8];
+  snprintf(key, sizeof(key), "%u", (unsigned)id);
+  if (name != NULL) {
+    JsonObject user = doc[key].to<JsonObject>();
+    user["id"] = id;
+    user["name"] = name;
+  } else {
+    doc.remove(key);
+  }
+
+  file = SPIFFS.open(kJsonBenchPath, "w");
+  size_t written = serializeJson(doc, file);
+  file.close();
+  return written;
+}
+
+/* The same saves through the pre-log JSON path, then every user deleted again */
+static void BenchmarkJsonStorage(uint16_t users) {
+  SPIFFS.remove(kJsonBenchPath);
+  uint64_t bytes_written = 0;
+
+  uint32_t started_us = micros();
+  char name[kMaxUserNameLength + 1];
+  for (uint16_t id = 1; id <= users; id++) {
+    snprintf(name, sizeof(name), "Storage User %u", (unsigned)id);
+    bytes_written += RewriteJsonUser(id, name);
+  }
+  uint32_t save_us = micros() - started_us;
+
+  File file = SPIFFS.open(kJsonBenchPath, "r");
+  uint32_t file_bytes = file ? file.size() : 0;
+  file.close();
+
+  started_us = micros();
+  for (uint16_t id = 1; id <= users; id++) bytes_written += RewriteJsonUser(id, NULL);
+  uint32_t remove_us = micros() - started_us;
+  SPIFFS.remove(kJsonBenchPath);
+
+  printf("{\"benchmark\":\"storage_json\",\"users\":%u,\"save_us\":%u,\"save_per_op_us\":%u,"
+         "\"remove_per_op_us\":%u,\"file_bytes\":%u,\"bytes_written\":%u}\n",
+         (unsigned)users, (unsigned)save_us, (unsigned)(save_us / users),
+         (unsigned)(remove_us / users), (unsigned)file_bytes, (unsigned)bytes_written);
+}
+
+/* Delete screen opened from the menu, at the current number of users */
+static void BenchmarkDeleteScreen() {
+  Samples samples;
+  for (int run = 0; run < kScanRuns; run++) {
+    uint32_t started_us = micros();
+    DeleteAction();
+    samples.Add(micros() - started_us);
+    ReturnToMainMenu();
+  }
+  PumpFor(100);
+
+  printf("{\"benchmark\":\"delete_screen_open\",\"users\":%u,\"mean_us\":%u,\"max_us\":%u}\n",
+         (unsigned)user_directory.Count(), (unsigned)samples.MeanUs(), (unsigned)samples.max_us);
+}
+
+/* Back-to-back placements with the access log off and on */
+static void BenchmarkSustainedScans(bool logging) {
+  access_log.SetEnabled(logging);
+  AccessLogStats before = access_log.stats();
+
+  ScanAction();
+  PumpFor(200);
+
+  char expected[16];
+  snprintf(expected, sizeof(expected), "ID: %u,", (unsigned)kScanFinger);
+
+  int scans = 0;
+  slowest_loop_us = 0;
+  uint32_t started_us = micros();
+  for (int run = 0; run < kSustainedScans; run++) {
+    finger_text.SetText("Scanning...");
+    sim_sensor.PlaceFinger(kScanFinger);
+    if (PumpUntil([&] { return strncmp(finger_text.text(), expected, strlen(expected)) == 0; })) {
+      scans++;
+    }
+    sim_sensor.LiftFinger();
+    PumpUntil([] { return strcmp(finger_text.text(), "No Finger Detected") == 0; });
+  }
+  uint32_t elapsed_us = micros() - started_us;
+
+  ReturnToMainMenu();
+  PumpFor(100);
+  access_log.Flush();
+
+  AccessLogStats after = access_log.stats();
+  printf("{\"benchmark\":\"sustained_scans\",\"access_log\":%s,\"scans\":%d,"
+         "\"scans_per_min\":%u,\"slowest_loop_us\":%u,\"logged\":%u,\"flushes\":%u}\n",
+         logging ? "true" : "false", scans,
+         (unsigned)(elapsed_us ? (uint64_t)scans * 60000000ULL / elapsed_us : 0),
+         (unsigned)slowest_loop_us, (unsigned)(after.appends - before.appends),
+         (unsigned)(after.flushes - before.flushes));
+  access_log.SetEnabled(ACCESS_LOG != 0);
+}
+
+/* SPI bus use on the idle main menu, and tap to first flush, with or without the pen IRQ */
+static void BenchmarkTouch(int8_t irq_pin) {
+  touch_input.Begin(irq_pin);
+  tft.SetPenIrqPin(irq_pin);
+  ReturnToMainMenu();
+  PumpFor(100);
+
+  spi_bus.ResetStats();
+  uint32_t transfers_before = tft.sim_touch_transfers();
+  uint32_t started_us = micros();
+  PumpFor(kTouchIdleMs);
+  uint32_t idle_us = micros() - started_us;
+  SpiBusStats idle = spi_bus.stats();
+  uint32_t idle_transfers = tft.sim_touch_transfers() - transfers_before;
+
+  // Taps land at different points of the sampling and LVGL read periods
+  Samples latency;
+  for (int tap = 0; tap < kTouchTaps; tap++) {
+    PumpFor(7 + tap * 11 % 30);
+    uint32_t pushed = tft.sim_pushed_pixels();
+    started_us = micros();
+    tft.SimTouch(kTapX, kTapY);
+    if (PumpUntil([&] { return tft.sim_pushed_pixels() != pushed; }, 500)) {
+      latency.Add(micros() - started_us);
+    }
+    PumpFor(60);
+    tft.SimRelease();
+    PumpFor(60);
+  }
+
+  printf("{\"benchmark\":\"touch\",\"pen_irq\":%s,\"idle_touch_reads_per_s\":%u,"
+         "\"idle_touch_transfers\":%u,\"idle_bus_us_per_s\":%u,\"taps\":%u,"
+         "\"tap_to_flush_mean_us\":%u,\"tap_to_flush_max_us\":%u,\"touch_deferred\":%u}\n",
+         irq_pin >= 0 ? "true" : "false",
+         (unsigned)((uint64_t)idle.touch_reads * 1000000 / idle_us), (unsigned)idle_transfers,
+         (unsigned)((uint64_t)(idle.touch_us + idle.DisplayUs()) * 1000000 / idle_us),
+         (unsigned)latency.count, (unsigned)latency.MeanUs(), (unsigned)latency.max_us,
+         (unsigned)spi_bus.stats().touch_deferred);
+}
+
+/* Repeat scans and screen changes and check the heap ends where it started */
+static void BenchmarkHeapSoak() {
+  // The simulated flash lives in host memory, so a growing log would read as a leak
+  access_log.SetEnabled(false);
+
+  char expected[16];
+  snprintf(expected, sizeof(expected), "ID: %u,", (unsigned)kScanFinger);
+
+  uint32_t free_start = 0;
+  int scans = 0;
+  for (int round = 0; round <= kSoakRounds; round++) {
+    ScanAction();
+    finger_text.SetText("Scanning...");
+    sim_sensor.PlaceFinger(kScanFinger);
+    bool matched =
+        PumpUntil([&] { return strncmp(finger_text.text(), expected, strlen(expected)) == 0; });
+    if (matched && round > 0) scans++;
+    sim_sensor.LiftFinger();
+    PumpUntil([] { return strcmp(finger_text.text(), "No Finger Detected") == 0; });
+    ReturnToMainMenu();
+    DeleteAction();
+    ReturnToMainMenu();
+    PumpFor(20);
+
+    // Round 0 warms up; everything it allocates for good is already there
+    if (round == 0) free_start = ESP.getFreeHeap();
+  }
+  uint32_t free_end = ESP.getFreeHeap();
+
+  printf("{\"benchmark\":\"heap_soak\",\"rounds\":%d,\"scans\":%d,\"free_start\":%u,"
+         "\"free_end\":%u,\"drift_bytes\":%d,\"min_free\":%u}\n",
+         kSoakRounds, scans, (unsigned)free_start, (unsigned)free_end,
+         (int)(free_start - free_end), (unsigned)ESP.getMinFreeHeap());
+  Serial.SimType("heap\n");
+  PumpFor(50);
+  access_log.SetEnabled(ACCESS_LOG != 0);
+}
+
+/* Raw append, flush and query cost of the access log across segment rotations */
+static void BenchmarkAccessLog() {
+  AccessLogStats before = access_log.stats();
+
+  uint32_t append_us = 0;
+  uint32_t poll_us = 0;
+  uint32_t slowest_poll_us = 0;
+  for (uint16_t i = 0; i < kLogAppends; i++) {
+    uint32_t started_us = micros();
+    access_log.Append(1 + i % 32, 100, i % 8 ? kAccessGranted : kAccessDenied);
+    append_us += micros() - started_us;
+
+    started_us = micros();
+    access_log.Poll(millis());
+    uint32_t elapsed_us = micros() - started_us;
+    poll_us += elapsed_us;
+    if (elapsed_us > slowest_poll_us) slowest_poll_us = elapsed_us;
+  }
+  access_log.Flush();
+
+  AccessRecord recent[16];
+  uint32_t started_us = micros();
+  uint16_t found = access_log.Recent(kScanFinger, recent, 16);
+  uint32_t query_us = micros() - started_us;
+
+  started_us = micros();
+  uint16_t rare = access_log.Recent(kMaxUserId, recent, 16);  // Never logged: full budget
+  uint32_t miss_query_us = micros() - started_us;
+
+  AccessLogStats after = access_log.stats();
+  printf("{\"benchmark\":\"access_log\",\"appends\":%u,\"append_mean_ns\":%u,"
+         "\"poll_mean_us\":%u,\"slowest_flush_us\":%u,\"flushes\":%u,\"bytes_written\":%u,"
+         "\"rotations\":%u,\"dropped\":%u,\"query_found\":%u,\"query_us\":%u,"
+         "\"miss_found\":%u,\"miss_query_us\":%u}\n",
+         (unsigned)kLogAppends, (unsigned)(append_us * 1000ULL / kLogAppends),
+         (unsigned)(poll_us / kLogAppends), (unsigned)slowest_poll_us,
+         (unsigned)(after.flushes - before.flushes),
+         (unsigned)(after.bytes_written - before.bytes_written),
+         (unsigned)(after.rotations - before.rotations), (unsigned)(after.dropped - before.dropped),
+         (unsigned)found, (unsigned)query_us, (unsigned)rare, (unsigned)miss_query_us);
+}
+
+/* Ask for the stage histograms over the console, the way a host script would */
+static void DumpStagesOverConsole() {
+  Serial.SimType("stages\n");
+  PumpFor(50);
+}
+
+/* Total commands answered by every simulated module */
+static uint32_t TotalSensorCommands() {
+  uint32_t commands = 0;
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    commands += sim_sensors[shard].stats().commands;
+  }
+  return commands;
+}
+
+/* Type a request on the console and run loop() until it has been answered */
+static bool RunConsoleRequest(const char* request, uint32_t timeout_ms = kStepTimeoutMs) {
+  Serial.SimType(request);
+  return PumpUntil([] { return Serial.available() == 0 && !admin_console.busy(); },
+                   timeout_ms);
+}
+
+/* Page the admin benchmarks give a user: alternate shards, page == ID */
+static uint8_t AdminShard(uint16_t id) {
+  return (uint8_t)(id % kSensorShardCount);
+}
+
+/* 100 users added one flush at a time, as the UI does, then imported over the console */
+static void BenchmarkAdminImport() {
+  char name[kMaxUserNameLength + 1];
+  UserStoreStats before = user_store.stats();
+  uint32_t started_us = micros();
+  for (uint16_t id = kAdminFirstId; id < kAdminFirstId + kAdminUsers; id++) {
+    snprintf(name, sizeof(name), "Imported User %u", (unsigned)id);
+    SaveUser(id, name, AdminShard(id), id);
+    user_store.Flush();
+  }
+  uint32_t single_us = micros() - started_us;
+  UserStoreStats single = user_store.stats();
+
+  // Take them out again without timing it
+  user_store.BeginBatch();
+  for (uint16_t id = kAdminFirstId; id < kAdminFirstId + kAdminUsers; id++) user_store.Remove(id);
+  user_store.CommitBatch();
+  UserStoreStats reset = user_store.stats();
+
+  std::string frame;
+  char line[kAdminLineLength + 2];
+  started_us = micros();
+  for (uint16_t first = kAdminFirstId; first < kAdminFirstId + kAdminUsers;
+       first += kAdminFrameUsers) {
+    snprintf(line, sizeof(line), "import %u\n", (unsigned)kAdminFrameUsers);
+    frame = line;
+    for (uint16_t id = first; id < first + kAdminFrameUsers; id++) {
+      snprintf(line, sizeof(line), "user %u %u %u Imported User %u\n", (unsigned)id,
+               (unsigned)AdminShard(id), (unsigned)id, (unsigned)id);
+      frame += line;
+    }
+    RunConsoleRequest(frame.c_str());
+  }
+  uint32_t batch_us = micros() - started_us;
+  UserStoreStats batch = user_store.stats();
+
+  uint16_t imported = 0;
+  for (uint16_t id = kAdminFirstId; id < kAdminFirstId + kAdminUsers; id++) {
+    imported += user_directory.Contains(id);
+  }
+  printf("{\"benchmark\":\"admin_import\",\"users\":%u,\"one_by_one_us\":%u,"
+         "\"one_by_one_writes\":%u,\"one_by_one_bytes\":%u,\"batched_us\":%u,"
+         "\"batched_writes\":%u,\"batched_bytes\":%u,\"imported\":%u}\n",
+         (unsigned)kAdminUsers, (unsigned)single_us,
+         (unsigned)(single.flushes + single.compactions - before.flushes - before.compactions),
+         (unsigned)(single.bytes_written - before.bytes_written), (unsigned)batch_us,
+         (unsigned)(batch.flushes + batch.compactions - reset.flushes - reset.compactions),
+         (unsigned)(batch.bytes_written - reset.bytes_written), (unsigned)imported);
+}
+
+/* The imported users and their templates removed with one console range delete */
+static void BenchmarkAdminRangeDelete() {
+  for (uint16_t id = kAdminFirstId; id < kAdminFirstId + kAdminUsers; id++) {
+    EnrollSimTemplate(id, (uint8_t)id);
+  }
+  RunConsoleRequest("count\n");
+
+  UserStoreStats before = user_store.stats();
+  uint32_t commands_before = TotalSensorCommands();
+  char request[32];
+  snprintf(request, sizeof(request), "delete %u %u\n", (unsigned)kAdminFirstId,
+           (unsigned)(kAdminFirstId + kAdminUsers - 1));
+  uint32_t started_us = micros();
+  bool ok = RunConsoleRequest(request);
+  uint32_t elapsed_us = micros() - started_us;
+  UserStoreStats after = user_store.stats();
+
+  RunConsoleRequest("index 0\n");
+  uint16_t templates_left = 0;
+  for (uint16_t id = kAdminFirstId; id < kAdminFirstId + kAdminUsers; id++) {
+    templates_left += sim_sensors[AdminShard(id)].TemplateAt(id) != 0;
+  }
+  printf("{\"benchmark\":\"admin_range_delete\",\"ok\":%s,\"users\":%u,\"elapsed_us\":%u,"
+         "\"sensor_commands\":%u,\"runs\":%u,\"store_writes\":%u,\"templates_left\":%u,"
+         "\"users_left\":%u}\n",
+         ok ? "true" : "false", (unsigned)bulk_delete.result().users, (unsigned)elapsed_us,
+         (unsigned)(TotalSensorCommands() - commands_before), (unsigned)bulk_delete.result().runs,
+         (unsigned)(after.flushes + after.compactions - before.flushes - before.compactions),
+         (unsigned)templates_left, (unsigned)user_directory.Count());
+}
+
+/* Save the admin benchmark users in one batch, each with a template on its page */
+static void SeedAdminUsers() {
+  char name[kMaxUserNameLength + 1];
+  user_store.BeginBatch();
+  for (uint16_t id = kAdminFirstId; id < kAdminFirstId + kAdminUsers; id++) {
+    snprintf(name, sizeof(name), "Leaver %u", (unsigned)id);
+    user_store.Put(id, name, AdminShard(id), id);
+    EnrollSimTemplate(id, (uint8_t)id);
+  }
+  user_store.CommitBatch();
+}
+
+/* Admin benchmark users left with a template on the sensor */
+static uint16_t AdminTemplatesLeft() {
+  uint16_t templates = 0;
+  for (uint16_t id = kAdminFirstId; id < kAdminFirstId + kAdminUsers; id++) {
+    templates += sim_sensors[AdminShard(id)].TemplateAt(id) != 0;
+  }
+  return templates;
+}
+
+/* 100 users deleted from the Delete screen one at a time as before, then multi-selected */
+static void BenchmarkBulkDelete() {
+  // Before: one sensor delete and one store write per user
+  SeedAdminUsers();
+  UserStoreStats before = user_store.stats();
+  uint32_t commands_before = TotalSensorCommands();
+  uint32_t started_us = micros();
+  for (uint16_t id = kAdminFirstId; id < kAdminFirstId + kAdminUsers; id++) {
+    uint8_t shard = 0;
+    uint16_t slot = 0;
+    user_directory.Locate(id, &shard, &slot);
+    SendSensorCommand(kCmdDelete, id, shard, slot);
+    DeleteUser(id);
+    user_store.Flush();
+    PumpUntil([&] { return sim_sensors[shard].TemplateAt(slot) == 0; });
+  }
+  uint32_t single_us = micros() - started_us;
+  uint32_t single_commands = TotalSensorCommands() - commands_before;
+  UserStoreStats single = user_store.stats();
+  uint16_t single_left = AdminTemplatesLeft();
+
+  // After: every user selected in the list, one delete
+  SeedAdminUsers();
+  DeleteAction();
+  for (uint16_t id = kAdminFirstId; id < kAdminFirstId + kAdminUsers; id++) {
+    user_list_view.Select(id, true);
+  }
+  UserStoreStats batch_before = user_store.stats();
+  commands_before = TotalSensorCommands();
+  started_us = micros();
+  DeleteSelectedUsers();
+  PumpUntil([] { return !bulk_delete.busy(); });
+  uint32_t batch_us = micros() - started_us;
+  uint32_t batch_commands = TotalSensorCommands() - commands_before;
+  UserStoreStats batch = user_store.stats();
+  const BulkDeleteResult& result = bulk_delete.result();
+  ReturnToMainMenu();
+
+  printf("{\"benchmark\":\"bulk_delete\",\"users\":%u,\"one_by_one_us\":%u,"
+         "\"one_by_one_sensor_commands\":%u,\"one_by_one_store_writes\":%u,"
+         "\"one_by_one_left\":%u,\"selected_us\":%u,\"selected_sensor_commands\":%u,"
+         "\"selected_store_writes\":%u,\"selected_runs\":%u,\"selected_left\":%u}\n",
+         (unsigned)kAdminUsers, (unsigned)single_us, (unsigned)single_commands,
+         (unsigned)(single.flushes + single.compactions - before.flushes - before.compactions),
+         (unsigned)single_left, (unsigned)batch_us, (unsigned)batch_commands,
+         (unsigned)(batch.flushes + batch.compactions - batch_before.flushes -
+                    batch_before.compactions),
+         (unsigned)result.runs, (unsigned)AdminTemplatesLeft());
+}
+
+/* Every user selected with the All button and deleted */
+static void BenchmarkDeleteAll() {
+  SeedAdminUsers();
+  uint16_t users = user_directory.Count();
+  DeleteAction();
+  user_list_view.SelectAll(true);
+
+  uint32_t commands_before = TotalSensorCommands();
+  uint32_t started_us = micros();
+  DeleteSelectedUsers();
+  PumpUntil([] { return !bulk_delete.busy(); });
+  uint32_t elapsed_us = micros() - started_us;
+  ReturnToMainMenu();
+
+  printf("{\"benchmark\":\"delete_all\",\"users\":%u,\"elapsed_us\":%u,"
+         "\"sensor_commands\":%u,\"runs\":%u,\"users_left\":%u,\"templates_left\":%u}\n",
+         (unsigned)users, (unsigned)elapsed_us,
+         (unsigned)(TotalSensorCommands() - commands_before), (unsigned)bulk_delete.result().runs,
+         (unsigned)user_directory.Count(), (unsigned)TotalTemplates());
+}
+
+/* Placements of a finger until its user's label shows, after a scan or verify was started */
+static Samples TimePlacements(uint8_t finger) {
+  char expected[16];
+  snprintf(expected, sizeof(expected), "ID: %u,", (unsigned)finger);
+
+  Samples samples;
+  for (int run = 0; run < kVerifyRuns; run++) {
+    finger_text.SetText("Waiting...");  // So each match changes the label again
+    uint32_t started_us = micros();
+    sim_sensor.PlaceFinger(finger);
+    bool matched = PumpUntil([&] {
+      return strncmp(finger_text.text(), expected, strlen(expected)) == 0;
+    }, 10000);
+    if (matched) samples.Add(micros() - started_us);
+    sim_sensor.LiftFinger();
+    PumpFor(400);
+  }
+  return samples;
+}
+
+/* 1:N search against 1:1 verify of the last user stored, as the library grows */
+static void BenchmarkVerify(uint16_t templates) {
+  char name[kMaxUserNameLength + 1];
+  for (uint16_t id = 1; id <= templates; id++) {
+    snprintf(name, sizeof(name), "Verify User %u", (unsigned)id);
+    SaveSimUser(id, name);
+    EnrollSimTemplate(id, (uint8_t)id);
+  }
+  uint8_t finger = (uint8_t)templates;
+
+  ScanAction();
+  PumpFor(200);
+  Samples search = TimePlacements(finger);
+  ReturnToMainMenu();
+
+  char claimed[8];
+  snprintf(claimed, sizeof(claimed), "%u", (unsigned)finger);
+  VerifyAction();
+  lv_textarea_set_text(input_text_area, claimed);
+  lv_event_send(keyboard, LV_EVENT_READY, NULL);
+  PumpFor(200);
+  Samples verify = TimePlacements(finger);
+  ReturnToMainMenu();
+  PumpFor(100);
+
+  for (uint16_t id = 1; id <= templates; id++) DeleteUser(id);
+  user_store.Flush();
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) sim_sensors[shard].EmptyLibrary();
+
+  printf("{\"benchmark\":\"verify\",\"templates\":%u,\"search_runs\":%u,\"search_mean_us\":%u,"
+         "\"verify_runs\":%u,\"verify_mean_us\":%u}\n",
+         (unsigned)templates, (unsigned)search.count, (unsigned)search.MeanUs(),
+         (unsigned)verify.count, (unsigned)verify.MeanUs());
+}
+
+/* Deterministic xorshift generator, so every run replays the same traffic */
+static uint32_t NextRandom(uint32_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/* User of one synthetic scan: a regular, weighted 1/rank, or now and then anyone else */
+static uint16_t TraceUser(uint32_t* state, uint16_t regulars, int visitor_pct) {
+  if ((int)(NextRandom(state) % 100) < visitor_pct) return 1 + NextRandom(state) % kMaxUserId;
+
+  double total = 0;
+  for (uint16_t rank = 1; rank <= regulars; rank++) total += 1.0 / rank;
+  double pick = (NextRandom(state) % 1000000) / 1000000.0 * total;
+  uint16_t rank = 1;
+  while (rank < regulars && (pick -= 1.0 / rank) > 0) rank++;
+
+  // Regulars enrolled at different times, so their pages are scattered over the library
+  return 1 + (uint32_t)rank * 97 % kMaxUserId;
+}
+
+/* Rank of a user in a cache, or -1 when it is not cached */
+static int CacheRank(const MatchCache& cache, uint16_t user) {
+  for (uint8_t rank = 0; rank < cache.count(); rank++) {
+    if (cache.at(rank).slot == user) return rank;
+  }
+  return -1;
+}
+
+/* Counts a trace replays to under the native environment's MAX_USER_ID and cache size */
+struct CacheTraceExpected {
+  bool burst;
+  MatchCachePolicy policy;
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t evictions;
+};
+
+static const CacheTraceExpected kCacheTraceExpected[] = {
+    {false, kMatchCacheRecent, 754, 1246, 1238},
+    {false, kMatchCacheFrequent, 980, 1020, 1012},
+    {true, kMatchCacheRecent, 715, 1285, 1277},
+    {true, kMatchCacheFrequent, 929, 1071, 1063},
+};
+
+/* Replay a synthetic trace through a cache of each policy: hit rate and probes per hit */
+static void BenchmarkCacheTrace(const char* trace, bool burst) {
+  uint32_t policy_hits[2] = {};
+  for (MatchCachePolicy policy : {kMatchCacheRecent, kMatchCacheFrequent}) {
+    MatchCache cache(policy, kMatchCacheSize);
+    uint32_t state = 2463534242u;
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;  // Misses that pushed an entry out of a full cache
+    uint32_t probes = 0;  // 1:1 matches a hit needed, its rank plus one
+    for (int scan = 0; scan < kTraceScans; scan++) {
+      int burst_scan = scan - kTraceScans / 2;  // Visitors take over halfway through
+      bool in_burst = burst && burst_scan >= 0 && burst_scan < kTraceBurstVisitors;
+      uint16_t user = in_burst ? kMaxUserId - burst_scan
+                               : TraceUser(&state, kTraceRegulars, kTraceVisitorPct);
+      int rank = CacheRank(cache, user);
+      if (rank >= 0) {
+        hits++;
+        probes += rank + 1;
+      } else {
+        misses++;
+        if (cache.count() == kMatchCacheSize) evictions++;
+      }
+      cache.OnMatch(0, user, 0);
+      SIM_CHECK(CacheRank(cache, user) >= 0);
+    }
+    printf("{\"benchmark\":\"cache_trace\",\"trace\":\"%s\",\"policy\":\"%s\",\"size\":%u,"
+           "\"scans\":%u,\"hit_pct\":%u,\"probes_per_hit_x10\":%u,\"hits\":%u,\"misses\":%u,"
+           "\"evictions\":%u}\n",
+           trace, policy == kMatchCacheFrequent ? "frequent" : "recent",
+           (unsigned)kMatchCacheSize, (unsigned)kTraceScans,
+           (unsigned)(hits * 100 / kTraceScans), (unsigned)(hits ? probes * 10 / hits : 0),
+           (unsigned)hits, (unsigned)misses, (unsigned)evictions);
+
+    // Every miss inserts; once the cache is full, every insert evicts
+    SIM_CHECK(hits + misses == (uint32_t)kTraceScans);
+    SIM_CHECK(evictions == (misses > kMatchCacheSize ? misses - kMatchCacheSize : 0));
+    SIM_CHECK(cache.count() == (misses < kMatchCacheSize ? misses : kMatchCacheSize));
+    if (kMaxUserId == 254 && kMatchCacheSize == 8) {
+      for (const CacheTraceExpected& expected : kCacheTraceExpected) {
+        if (expected.burst != burst || expected.policy != policy) continue;
+        SIM_CHECK(hits == expected.hits);
+        SIM_CHECK(misses == expected.misses);
+        SIM_CHECK(evictions == expected.evictions);
+      }
+    }
+    policy_hits[policy] = hits;
+  }
+
+  // Regulars keep their places under the frequency policy, visitors or not
+  SIM_CHECK(policy_hits[kMatchCacheFrequent] >= policy_hits[kMatchCacheRecent]);
+}
+
+/* A morning of the same few users scanning, with the cache off and under each policy */
+static void BenchmarkMatchCache() {
+  char name[kMaxUserNameLength + 1];
+  for (uint16_t id = 1; id <= kMaxUserId; id++) {
+    snprintf(name, sizeof(name), "Cache User %u", (unsigned)id);
+    SaveSimUser(id, name);
+    EnrollSimTemplate(id, (uint8_t)id);
+  }
+
+  MatchCachePolicy build_policy = match_cache.policy();
+  for (int run = 0; run < 3; run++) {
+    // Sensor task idle in the menu, so the cache can be swapped under it
+    MatchCachePolicy policy = run == 2 ? kMatchCacheFrequent : kMatchCacheRecent;
+    match_cache.Reset(policy, run == 0 ? 0 : kMatchCacheSize);
+    ScanAction();
+    PumpFor(200);
+
+    Samples samples;
+    uint32_t passes_before = GetScanSessionStats().searches;
+    uint32_t state = 88172645u;
+    for (int placement = 0; placement < kCachePlacements; placement++) {
+      uint8_t finger = (uint8_t)TraceUser(&state, kMorningRegulars, 0);
+      char expected[16];
+      snprintf(expected, sizeof(expected), "ID: %u,", (unsigned)finger);
+      finger_text.SetText("Scanning...");
+
+      uint32_t started_us = micros();
+      sim_sensor.PlaceFinger(finger);
+      bool matched = PumpUntil([&] {
+        return strncmp(finger_text.text(), expected, strlen(expected)) == 0;
+      }, 10000);
+      if (matched) samples.Add(micros() - started_us);
+      sim_sensor.LiftFinger();
+      PumpFor(400);
+    }
+    ReturnToMainMenu();
+    PumpFor(100);
+
+    const MatchCacheStats& stats = match_cache.stats();
+    printf("{\"benchmark\":\"match_cache\",\"policy\":\"%s\",\"templates\":%u,"
+           "\"placements\":%u,\"mean_us\":%u,\"lookups\":%u,\"hits\":%u,\"probes\":%u,"
+           "\"probe_mean_us\":%u,\"search_mean_us\":%u,\"skips\":%u,\"saved_us\":%d}\n",
+           run == 0 ? "off" : policy == kMatchCacheFrequent ? "frequent" : "recent",
+           (unsigned)kMaxUserId, (unsigned)samples.count, (unsigned)samples.MeanUs(),
+           (unsigned)stats.lookups, (unsigned)stats.hits, (unsigned)stats.probes,
+           (unsigned)stats.MeanProbeUs(), (unsigned)stats.MeanSearchUs(), (unsigned)stats.skips,
+           (int)stats.SavedUs());
+
+    // Every pass the cache did not answer, misses included, ran the full search and matched
+    uint32_t passes = GetScanSessionStats().searches - passes_before;
+    SIM_CHECK(samples.count == (uint32_t)kCachePlacements);
+    SIM_CHECK(stats.searches + stats.hits == passes);
+    SIM_CHECK(stats.lookups - stats.hits <= stats.searches);
+    if (run == 0) {
+      SIM_CHECK(stats.lookups == 0 && stats.searches == passes);
+    } else {
+      SIM_CHECK(stats.hits > 0 && stats.lookups > stats.hits);
+    }
+  }
+
+  for (uint16_t id = 1; id <= kMaxUserId; id++) DeleteUser(id);
+  user_store.Flush();
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) sim_sensors[shard].EmptyLibrary();
+  match_cache.Reset(build_policy, kMatchCacheSize);
+}
+
+/* Feed stdin to the console, waiting for each reply the way a host script would */
+static void RunConsoleSession() {
+  char line[256];
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    RunConsoleRequest(line, 60000);
+  }
+  PumpFor(100);
+  user_store.Flush();
+}
+
+/* Templates per shard after least-loaded placement */
+static void ReportShardLoad() {
+  printf("{\"benchmark\":\"shard_load\",\"shards\":%u,\"loads\":[",
+         (unsigned)kSensorShardCount);
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    printf("%s%u", shard ? "," : "", (unsigned)user_directory.ShardLoad(shard));
+  }
+  printf("]}\n");
+}
+
+/* Back up every template, swap in an empty sensor and restore it */
+static void BenchmarkTemplateArchive() {
+  for (uint16_t id = user_directory.NextId(0); id != 0; id = user_directory.NextId(id)) {
+    EnrollSimTemplate(id, (uint8_t)id);
+  }
+
+  uint32_t started_us = micros();
+  bool backed_up = RunConsoleRequest("backup file\n", 60000) &&
+                   strncmp(status_text.text(), "Backed up", 9) == 0;
+  uint32_t backup_us = micros() - started_us;
+
+  // Restore by uploading the archive over the console, as a host does for a replaced module
+  std::string upload;
+  File archive = SPIFFS.open(TEMPLATE_ARCHIVE_PATH, "r");
+  while (archive && archive.available() > 0) upload.push_back((char)archive.read());
+  archive.close();
+  uint32_t archive_bytes = upload.size();
+  upload.insert(0, "restore serial " + std::to_string(archive_bytes) + "\n");
+
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) sim_sensors[shard].EmptyLibrary();
+  started_us = micros();
+  Serial.SimType((const uint8_t*)upload.data(), upload.size());
+  bool restored = PumpUntil([] { return Serial.available() == 0 && !admin_console.busy(); },
+                            60000) &&
+                  strncmp(status_text.text(), "Restored", 8) == 0;
+  uint32_t restore_us = micros() - started_us;
+
+  uint16_t intact = 0;
+  for (uint16_t id = user_directory.NextId(0); id != 0; id = user_directory.NextId(id)) {
+    uint8_t shard = 0;
+    uint16_t slot = 0;
+    user_directory.Locate(id, &shard, &slot);
+    intact += sim_sensors[shard].TemplateAt(slot) == (uint8_t)id;
+  }
+  SIM_CHECK(backed_up && restored);
+  SIM_CHECK(intact == user_directory.Count());
+
+  printf("{\"benchmark\":\"template_archive\",\"ok\":%s,\"users\":%u,\"archive_bytes\":%u,"
+         "\"backup_us\":%u,\"restore_us\":%u,\"restored_intact\":%u}\n",
+         backed_up && restored ? "true" : "false", (unsigned)user_directory.Count(),
+         (unsigned)archive_bytes, (unsigned)backup_us, (unsigned)restore_us, (unsigned)intact);
+}
+
+/* Negotiate the capture sensor up to max_baud, then time a raw image capture to SPIFFS */
+static void BenchmarkImageStream(uint32_t max_baud) {
+  char request[32];
+  snprintf(request, sizeof(request), "baud 0 %u\n", (unsigned)max_baud);
+  RunConsoleRequest(request, kImageJobTimeoutMs);
+
+  sim_sensor.PlaceFinger(kScanFinger);
+  uint32_t started_us = micros();
+  bool answered = RunConsoleRequest("image file\n", kImageJobTimeoutMs);
+  uint32_t elapsed_us = micros() - started_us;
+  sim_sensor.LiftFinger();
+
+  File image = SPIFFS.open(IMAGE_CAPTURE_PATH, "r");
+  uint32_t bytes = image ? image.size() : 0;
+  image.close();
+  printf("{\"benchmark\":\"image_stream\",\"baud\":%u,\"module_baud\":%u,\"ok\":%s,"
+         "\"bytes\":%u,\"elapsed_us\":%u,\"images_per_min_x10\":%u}\n",
+         (unsigned)mySerial.baudRate(), (unsigned)sim_sensor.Baud(),
+         answered && bytes == kSensorImageBytes ? "true" : "false", (unsigned)bytes,
+         (unsigned)elapsed_us, (unsigned)(600000000ULL / elapsed_us));
+}
+
+/* Negotiate over wiring that garbles bytes above 57600, then boot again on the saved rate */
+static void BenchmarkBaudFallback() {
+  const uint32_t kReliableBaud = 57600;
+  sim_sensor.SetReliableBaud(kReliableBaud);
+  uint32_t started_us = micros();
+  RunConsoleRequest("baud 0\n", kImageJobTimeoutMs);
+  uint32_t elapsed_us = micros() - started_us;
+  uint32_t negotiated = mySerial.baudRate();
+  bool in_step = negotiated == sim_sensor.Baud();
+  sim_sensor.SetReliableBaud(0);
+
+  // A reboot opens the UART at the factory rate; the saved rate must bring it back in step
+  mySerial.updateBaudRate(kSensorDefaultBaud);
+  LoadSensorBauds();
+  bool reloaded = mySerial.baudRate() == sim_sensor.Baud();
+
+  printf("{\"benchmark\":\"baud_fallback\",\"reliable_baud\":%u,\"baud\":%u,\"in_step\":%s,"
+         "\"elapsed_us\":%u,\"reloaded\":%s}\n",
+         (unsigned)kReliableBaud, (unsigned)negotiated, in_step ? "true" : "false",
+         (unsigned)elapsed_us, reloaded ? "true" : "false");
+
+  // Leave the module at its factory rate
+  char request[32];
+  snprintf(request, sizeof(request), "baud 0 %u\n", (unsigned)kSensorDefaultBaud);
+  RunConsoleRequest(request, kImageJobTimeoutMs);
+}
+
+int main(int argc, char** argv) {
+  bool console = argc > 1 && strcmp(argv[1], "--console") == 0;
+  bool test = argc > 1 && strcmp(argv[1], "--test") == 0;
+
+  // Start every benchmark run from an empty partition; a console session keeps its users
+  SPIFFS.begin();
+  if (!console) SPIFFS.format();
+
+  mySerial.SimAttach(&sim_sensor);
+  sim_sensor.SetWakePin(FINGER_WAKE_PIN);
+  tft.SetPenIrqPin(TOUCH_IRQ_PIN);
+#if SENSOR_SHARDS > 1
+  shard_serial.SimAttach(&sim_sensors[1]);
+#endif
+
+  // Tests drive the modules themselves, before the sensor task owns the clients
+  if (test) {
+    RunSimTests();
+    fflush(stdout);
+    fflush(stderr);
+    _Exit(SimCheckFailures() ? 1 : 0);
+  }
+
+  setup();
+  PumpFor(200);
+  if (!console) ReportBoot();
+
+  if (console) {
+    RunConsoleSession();
+    fflush(stdout);
+    fflush(stderr);
+    _Exit(0);
+  }
+
+  BenchmarkScreens();
+  BenchmarkRenderScenes();
+  BenchmarkTouch(-1);
+  BenchmarkTouch(kSimPenIrqPin);
+  BenchmarkScanToLabel("scan_to_label", kScanFinger, kCaptureShard);
+  if (kSensorShardCount > 1) {
+    BenchmarkScanToLabel("scan_to_label_other_shard", kShardScanFinger, kSensorShardCount - 1);
+  }
+  BenchmarkEnrollment("enrollment", kEnrollFinger);
+  if (kSensorShardCount > 1) BenchmarkEnrollment("enrollment_other_shard", kShardEnrollFinger);
+  BenchmarkSensorOffline();
+  BenchmarkDeleteScreen();
+  BenchmarkSustainedScans(false);
+  BenchmarkSustainedScans(true);
+  BenchmarkHeapSoak();
+  DumpStagesOverConsole();
+  BenchmarkAccessLog();
+  BenchmarkAdminImport();
+  BenchmarkAdminRangeDelete();
+  BenchmarkBulkDelete();
+  BenchmarkDeleteAll();
+  BenchmarkVerify(10);
+  BenchmarkVerify(100);
+  BenchmarkVerify(kMaxUserId);
+  BenchmarkCacheTrace("regulars", false);
+  BenchmarkCacheTrace("visitor_burst", true);
+  BenchmarkMatchCache();
+  for (uint16_t users : kStorageSizes) BenchmarkStorage(users);
+  for (uint16_t users : kJsonStorageSizes) BenchmarkJsonStorage(users);
+  BenchmarkDeleteScreen();
+  ReportShardLoad();
+  BenchmarkTemplateArchive();
+  for (uint32_t baud : kImageBauds) BenchmarkImageStream(baud);
+  BenchmarkBaudFallback();
+
+  // The sensor task never returns; leave without joining it
+  fflush(stdout);
+  fflush(stderr);
+  _Exit(SimCheckFailures() ? 1 : 0);
+}
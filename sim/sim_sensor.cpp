@@ -0,0 +1,425 @@
+// sim_sensor.cpp
+
+#include "sim_sensor.h"
+
+#include <Adafruit_Fingerprint.h>
+#include "sensor_client.h"  // Instruction codes the Adafruit library lacks
+
+SimSensor sim_sensors[kSimSensorCount];
+SimSensor& sim_sensor = sim_sensors[0];
+
+/* Byte 1 names the finger; the rest is a pattern a restore must reproduce exactly */
+uint8_t SimTemplateByte(uint8_t finger, uint16_t index) {
+  if (index == 0) return 0x03;
+  if (index == 1) return finger;
+  return (uint8_t)(finger * 131 + index * 29);
+}
+
+SimSensor::SimSensor()
+    : connected_(true), wake_pin_(-1), finger_(0), image_(0), fail_command_(0), fail_status_(0),
+      baud_(kSimDefaultBaud), reliable_baud_(0), noise_(0x2545F491), download_slot_(0), download_length_(0), rx_length_(0), rx_wire_us_(0) {
+  memset(char_buffer_, 0, sizeof(char_buffer_));
+  memset(library_, 0, sizeof(library_));
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+/* Take bytes from the host UART and answer each complete command packet */
+void SimSensor::Receive(const uint8_t* data, size_t size, uint32_t baud) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!connected_) return;
+  if (baud != baud_) {
+    rx_length_ = 0;  // Framing errors at the wrong rate; nothing decodes
+    return;
+  }
+
+  // 10 bits per byte on the wire; bytes queue behind ones still arriving
+  uint32_t byte_us = 10000000UL / baud;
+  uint32_t now = micros();
+  if ((int32_t)(now - rx_wire_us_) > 0) rx_wire_us_ = now;
+
+  for (size_t i = 0; i < size; i++) {
+    uint8_t byte = LineNoise(data[i]);
+    rx_wire_us_ += byte_us;
+
+    // Hunt for the start code
+    if (rx_length_ == 0 && byte != (FINGERPRINT_STARTCODE >> 8)) continue;
+    if (rx_length_ == 1 && byte != (FINGERPRINT_STARTCODE & 0xFF)) {
+      rx_length_ = (byte == (FINGERPRINT_STARTCODE >> 8)) ? 1 : 0;
+      continue;
+    }
+    rx_[rx_length_++] = byte;
+
+    if (rx_length_ < 9) continue;
+    uint16_t length = (rx_[7] << 8) | rx_[8];
+    if (length < 3 || 9 + length > (int)sizeof(rx_)) {
+      stats_.bad_packets++;
+      rx_length_ = 0;
+      continue;
+    }
+    if (rx_length_ < 9 + length) continue;
+
+    // Whole packet: PID, length and payload sum to the trailing checksum
+    uint16_t sum = 0;
+    for (uint16_t j = 6; j < rx_length_ - 2; j++) sum += rx_[j];
+    uint16_t expected = (rx_[rx_length_ - 2] << 8) | rx_[rx_length_ - 1];
+    uint8_t pid = rx_[6];
+    bool data = pid == FINGERPRINT_DATAPACKET || pid == FINGERPRINT_ENDDATAPACKET;
+    if (sum != expected || (pid != FINGERPRINT_COMMANDPACKET && !data)) {
+      stats_.bad_packets++;
+      Reply(FINGERPRINT_PACKETRECIEVEERR, NULL, 0, kSimQuickUs, baud);
+    } else if (data) {
+      HandleData(pid, &rx_[9], length - 2);  // Data packets are never acknowledged
+    } else {
+      stats_.commands++;
+      HandlePacket(rx_[9], &rx_[10], length - 3, baud);
+    }
+    rx_length_ = 0;
+  }
+}
+
+int SimSensor::Available() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint32_t now = micros();
+  int ready = 0;
+  for (const Byte& byte : tx_) {
+    if ((int32_t)(now - byte.ready_us) < 0) break;
+    ready++;
+  }
+  return ready;
+}
+
+int SimSensor::Read() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (tx_.empty() || (int32_t)(micros() - tx_.front().ready_us) < 0) return -1;
+  uint8_t value = tx_.front().value;
+  tx_.pop_front();
+  return value;
+}
+
+/* Bytes written to the module that are still on the wire at its baud rate */
+size_t SimSensor::Backlog() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int32_t wire_us = (int32_t)(rx_wire_us_ - micros());
+  if (wire_us <= 0) return 0;
+  uint32_t byte_us = 10000000UL / baud_;
+  return (wire_us + byte_us - 1) / byte_us;
+}
+
+/* Execute one command against the module state */
+void SimSensor::HandlePacket(uint8_t command, const uint8_t* params, uint16_t length,
+                             uint32_t baud) {
+  if (fail_command_ != 0 && command == fail_command_) {
+    fail_command_ = 0;
+    Reply(fail_status_, NULL, 0, kSimQuickUs, baud);
+    return;
+  }
+
+  uint8_t slot = (length > 0 && params[0] == 2) ? 2 : 1;
+  switch (command) {
+    case FINGERPRINT_GETIMAGE:
+      stats_.get_images++;
+      if (finger_ == 0) {
+        Reply(FINGERPRINT_NOFINGER, NULL, 0, kSimNoFingerUs, baud);
+      } else {
+        image_ = finger_;
+        Reply(FINGERPRINT_OK, NULL, 0, kSimGetImageUs, baud);
+      }
+      break;
+
+    case FINGERPRINT_IMAGE2TZ:
+      char_buffer_[slot] = image_;
+      Reply(image_ != 0 ? FINGERPRINT_OK : FINGERPRINT_FEATUREFAIL, NULL, 0, kSimImage2TzUs, baud);
+      break;
+
+    case FINGERPRINT_MATCH: {
+      bool same = char_buffer_[1] != 0 && char_buffer_[1] == char_buffer_[2];
+      uint8_t score[] = {0, (uint8_t)(same ? kSimMatchScore : 0)};
+      Reply(same ? FINGERPRINT_OK : FINGERPRINT_NOMATCH, score, sizeof(score), kSimMatchUs, baud);
+      break;
+    }
+
+    case FINGERPRINT_SEARCH:
+    case FINGERPRINT_HISPEEDSEARCH: {
+      stats_.searches++;
+      uint16_t start = length >= 5 ? (params[1] << 8) | params[2] : 0;
+      uint16_t count = length >= 5 ? (params[3] << 8) | params[4] : kSimSensorCapacity;
+      uint8_t result[4] = {0, 0, 0, 0};
+      uint8_t status = FINGERPRINT_NOTFOUND;
+      uint32_t compared = 0;  // Stored templates matched against, up to the hit
+      for (uint32_t page = start; page < (uint32_t)start + count && page < kSimSensorCapacity;
+           page++) {
+        if (library_[page] != 0) compared++;
+        if (char_buffer_[slot] != 0 && library_[page] == char_buffer_[slot]) {
+          result[0] = page >> 8;
+          result[1] = page & 0xFF;
+          result[3] = kSimMatchScore;
+          status = FINGERPRINT_OK;
+          break;
+        }
+      }
+      Reply(status, result, sizeof(result), kSimSearchBaseUs + compared * kSimSearchPerTemplateUs,
+            baud);
+      break;
+    }
+
+    case FINGERPRINT_REGMODEL:
+      if (char_buffer_[1] != 0 && char_buffer_[1] == char_buffer_[2]) {
+        Reply(FINGERPRINT_OK, NULL, 0, kSimRegModelUs, baud);
+      } else {
+        Reply(FINGERPRINT_ENROLLMISMATCH, NULL, 0, kSimRegModelUs, baud);
+      }
+      break;
+
+    case FINGERPRINT_STORE:
+    case FINGERPRINT_LOAD: {
+      uint16_t page = length >= 3 ? (params[1] << 8) | params[2] : kSimSensorCapacity;
+      if (page >= kSimSensorCapacity) {
+        Reply(FINGERPRINT_BADLOCATION, NULL, 0, kSimQuickUs, baud);
+      } else if (command == FINGERPRINT_STORE) {
+        library_[page] = char_buffer_[slot];
+        Reply(FINGERPRINT_OK, NULL, 0, kSimStoreUs, baud);
+      } else if (library_[page] == 0) {
+        Reply(FINGERPRINT_DBREADFAIL, NULL, 0, kSimLoadUs, baud);
+      } else {
+        char_buffer_[slot] = library_[page];
+        Reply(FINGERPRINT_OK, NULL, 0, kSimLoadUs, baud);
+      }
+      break;
+    }
+
+    case FINGERPRINT_DELETE: {
+      uint16_t page = length >= 4 ? (params[0] << 8) | params[1] : kSimSensorCapacity;
+      uint16_t count = length >= 4 ? (params[2] << 8) | params[3] : 0;
+      if ((uint32_t)page + count > kSimSensorCapacity) {
+        Reply(FINGERPRINT_DELETEFAIL, NULL, 0, kSimQuickUs, baud);
+      } else {
+        memset(&library_[page], 0, count);
+        Reply(FINGERPRINT_OK, NULL, 0, kSimDeleteUs, baud);
+      }
+      break;
+    }
+
+    case FINGERPRINT_UPLOAD: {
+      if (char_buffer_[slot] == 0) {
+        Reply(FINGERPRINT_UPLOADFEATUREFAIL, NULL, 0, kSimQuickUs, baud);
+        break;
+      }
+      Reply(FINGERPRINT_OK, NULL, 0, kSimQuickUs, baud);
+      uint8_t packet[kSimDataPacketBytes];
+      for (uint16_t sent = 0; sent < kSimTemplateBytes; sent += kSimDataPacketBytes) {
+        for (uint16_t i = 0; i < kSimDataPacketBytes; i++) {
+          packet[i] = SimTemplateByte(char_buffer_[slot], sent + i);
+        }
+        bool last = sent + kSimDataPacketBytes >= kSimTemplateBytes;
+        Transmit(last ? FINGERPRINT_ENDDATAPACKET : FINGERPRINT_DATAPACKET, packet,
+                 sizeof(packet), 0, baud);
+      }
+      break;
+    }
+
+    case FINGERPRINT_UPIMAGE: {
+      Reply(FINGERPRINT_OK, NULL, 0, kSimQuickUs, baud);
+      uint8_t packet[kSimDataPacketBytes];
+      for (uint32_t sent = 0; sent < kSimImageBytes; sent += kSimDataPacketBytes) {
+        for (uint16_t i = 0; i < kSimDataPacketBytes; i++) {
+          packet[i] = (uint8_t)(image_ * 17 + (sent + i) * 7);
+        }
+        bool last = sent + kSimDataPacketBytes >= kSimImageBytes;
+        Transmit(last ? FINGERPRINT_ENDDATAPACKET : FINGERPRINT_DATAPACKET, packet,
+                 sizeof(packet), 0, baud);
+      }
+      break;
+    }
+
+    case FINGERPRINT_SETSYSPARAM: {
+      // Only the baud register; the ack goes out at the old rate, then the module switches
+      uint8_t multiple = length >= 2 ? params[1] : 0;
+      if (length < 2 || params[0] != FINGERPRINT_BAUD_REG_ADDR || multiple < 1 || multiple > 12) {
+        Reply(FINGERPRINT_INVALIDREG, NULL, 0, kSimQuickUs, baud);
+        break;
+      }
+      Reply(FINGERPRINT_OK, NULL, 0, kSimQuickUs, baud);
+      baud_ = multiple * 9600;
+      break;
+    }
+
+    case FINGERPRINT_DOWNCHAR:
+      download_slot_ = slot;
+      download_length_ = 0;
+      Reply(FINGERPRINT_OK, NULL, 0, kSimQuickUs, baud);
+      break;
+
+    case FINGERPRINT_EMPTY:
+      memset(library_, 0, sizeof(library_));
+      Reply(FINGERPRINT_OK, NULL, 0, kSimEmptyUs, baud);
+      break;
+
+    case FINGERPRINT_TEMPLATECOUNT: {
+      uint16_t templates = 0;
+      for (uint16_t page = 0; page < kSimSensorCapacity; page++) templates += library_[page] != 0;
+      uint8_t result[] = {(uint8_t)(templates >> 8), (uint8_t)(templates & 0xFF)};
+      Reply(FINGERPRINT_OK, result, sizeof(result), kSimQuickUs, baud);
+      break;
+    }
+
+    case FINGERPRINT_READINDEX: {
+      // One bit per page of the requested 256-page group, lowest page in bit 0
+      uint8_t result[32] = {};
+      uint16_t first = (length > 0 ? params[0] : 0) * 256;
+      for (uint16_t bit = 0; bit < 256 && first + bit < kSimSensorCapacity; bit++) {
+        if (library_[first + bit] != 0) result[bit / 8] |= (uint8_t)(1 << (bit % 8));
+      }
+      Reply(FINGERPRINT_OK, result, sizeof(result), kSimQuickUs, baud);
+      break;
+    }
+
+    case FINGERPRINT_READSYSPARAM: {
+      // Status, system ID, capacity, security level, address, packet size, baud / 9600
+      uint8_t result[] = {0, 0, 0, 0, (uint8_t)(kSimSensorCapacity >> 8),
+                          (uint8_t)(kSimSensorCapacity & 0xFF), 0, 3, 0xFF, 0xFF, 0xFF, 0xFF,
+                          0, 2, 0, (uint8_t)(baud_ / 9600)};
+      Reply(FINGERPRINT_OK, result, sizeof(result), kSimQuickUs, baud);
+      break;
+    }
+
+    case FINGERPRINT_VERIFYPASSWORD:
+      Reply(FINGERPRINT_OK, NULL, 0, kSimQuickUs, baud);
+      break;
+
+    default:
+      Reply(FINGERPRINT_PACKETRECIEVEERR, NULL, 0, kSimQuickUs, baud);
+      break;
+  }
+}
+
+/* Collect a DownChar's data packets; the end packet decides what the buffer holds */
+void SimSensor::HandleData(uint8_t pid, const uint8_t* data, uint16_t length) {
+  if (download_slot_ == 0) return;
+  for (uint16_t i = 0; i < length && download_length_ < kSimTemplateBytes; i++) {
+    download_[download_length_++] = data[i];
+  }
+  if (pid != FINGERPRINT_ENDDATAPACKET) return;
+
+  // A template that does not decode back to a finger is unusable
+  uint8_t finger = download_length_ == kSimTemplateBytes ? download_[1] : 0;
+  for (uint16_t i = 0; finger != 0 && i < kSimTemplateBytes; i++) {
+    if (download_[i] != SimTemplateByte(finger, i)) finger = 0;
+  }
+  char_buffer_[download_slot_] = finger;
+  download_slot_ = 0;
+}
+
+/* Queue an acknowledge packet, timed as the module would send it */
+void SimSensor::Reply(uint8_t status, const uint8_t* data, uint16_t length, uint32_t busy_us,
+                      uint32_t baud) {
+  uint8_t payload[1 + 32];
+  payload[0] = status;
+  if (length > 0) memcpy(&payload[1], data, length);
+  Transmit(FINGERPRINT_ACKPACKET, payload, 1 + length, busy_us, baud);
+}
+
+/* Queue one packet behind anything still being sent */
+void SimSensor::Transmit(uint8_t pid, const uint8_t* payload, uint16_t length, uint32_t busy_us,
+                         uint32_t baud) {
+  uint16_t packet_length = length + 2;  // Payload + checksum
+  uint8_t packet[9 + kSimDataPacketBytes + 2];
+  uint16_t size = 0;
+  packet[size++] = FINGERPRINT_STARTCODE >> 8;
+  packet[size++] = FINGERPRINT_STARTCODE & 0xFF;
+  for (int i = 0; i < 4; i++) packet[size++] = 0xFF;
+  packet[size++] = pid;
+  packet[size++] = packet_length >> 8;
+  packet[size++] = packet_length & 0xFF;
+  for (uint16_t i = 0; i < length; i++) packet[size++] = payload[i];
+  uint16_t sum = 0;
+  for (uint16_t i = 6; i < size; i++) sum += packet[i];
+  packet[size++] = sum >> 8;
+  packet[size++] = sum & 0xFF;
+
+  // Work starts once the command has fully arrived
+  uint32_t byte_us = 10000000UL / baud;
+  uint32_t ready_us = rx_wire_us_ + busy_us;
+  if (!tx_.empty() && (int32_t)(tx_.back().ready_us - ready_us) > 0) ready_us = tx_.back().ready_us;
+  for (uint16_t i = 0; i < size; i++) {
+    ready_us += byte_us;
+    tx_.push_back({LineNoise(packet[i]), ready_us});
+  }
+}
+
+/* Garble the odd byte while the module runs faster than the line carries */
+uint8_t SimSensor::LineNoise(uint8_t byte) {
+  if (reliable_baud_ == 0 || baud_ <= reliable_baud_) return byte;
+  noise_ ^= noise_ << 13;
+  noise_ ^= noise_ >> 17;
+  noise_ ^= noise_ << 5;
+  return noise_ % kSimNoisyByteOdds == 0 ? (uint8_t)(byte ^ 0x10) : byte;
+}
+
+/* Limit the rate the wiring carries cleanly, as a long or noisy cable would */
+void SimSensor::SetReliableBaud(uint32_t baud) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  reliable_baud_ = baud;
+}
+
+uint32_t SimSensor::Baud() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return baud_;
+}
+
+/* Plug or unplug the module; unplugged, it ignores every packet */
+void SimSensor::SetConnected(bool connected) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  connected_ = connected;
+  if (!connected) tx_.clear();
+}
+
+/* Put a finger on the window and raise the wake line */
+void SimSensor::PlaceFinger(uint8_t finger) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finger_ = finger;
+  }
+  if (wake_pin_ >= 0) SimFireInterrupt(wake_pin_);
+}
+
+void SimSensor::LiftFinger() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  finger_ = 0;
+}
+
+/* Preload a template into the library */
+void SimSensor::Enroll(uint16_t page, uint8_t finger) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (page < kSimSensorCapacity) library_[page] = finger;
+}
+
+/* Wipe the library, as a replacement module arrives */
+void SimSensor::EmptyLibrary() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  memset(library_, 0, sizeof(library_));
+}
+
+/* Finger whose template is stored on a page, 0 if empty */
+uint8_t SimSensor::TemplateAt(uint16_t page) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return page < kSimSensorCapacity ? library_[page] : 0;
+}
+
+/* Answer the next instance of a command with an error status */
+void SimSensor::FailNext(uint8_t command, uint8_t status) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  fail_command_ = command;
+  fail_status_ = status;
+}
+
+uint16_t SimSensor::TemplateCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint16_t templates = 0;
+  for (uint16_t page = 0; page < kSimSensorCapacity; page++) templates += library_[page] != 0;
+  return templates;
+}
+
+SimSensorStats SimSensor::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
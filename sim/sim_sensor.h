@@ -0,0 +1,125 @@
+// sim_sensor.h
+//
+// Simulated R307/AS608-class fingerprint sensors, one per sensor shard. Each
+// parses command packets and answers with acknowledge packets after the
+// module's processing time plus the UART time at the configured baud rate.
+// A "finger" is a small non-zero integer; a template matches another when
+// they came from the same finger.
+
+#ifndef SIM_SENSOR_H_
+#define SIM_SENSOR_H_
+
+#include <Arduino.h>
+
+#include <deque>
+#include <mutex>
+
+// Template library size of the simulated module
+static const uint16_t kSimSensorCapacity = 1000;
+
+// Modules on the simulated board: UART2 (capture sensor) and UART1
+static const int kSimSensorCount = 2;
+
+// Nominal processing times, in microseconds
+static const uint32_t kSimGetImageUs = 130000;
+static const uint32_t kSimNoFingerUs = 25000;
+static const uint32_t kSimImage2TzUs = 280000;
+static const uint32_t kSimRegModelUs = 40000;
+static const uint32_t kSimStoreUs = 40000;
+static const uint32_t kSimLoadUs = 30000;
+static const uint32_t kSimMatchUs = 20000;
+static const uint32_t kSimSearchBaseUs = 30000;
+static const uint32_t kSimSearchPerTemplateUs = 1000;  // About 1 s over 1000 stored templates
+static const uint32_t kSimDeleteUs = 40000;
+static const uint32_t kSimEmptyUs = 100000;
+static const uint32_t kSimQuickUs = 5000;
+
+// Match score reported for the same finger
+static const uint16_t kSimMatchScore = 120;
+
+// Template transfers: 512-byte char files in 128-byte data packets
+static const uint16_t kSimTemplateBytes = 512;
+static const uint16_t kSimDataPacketBytes = 128;
+
+// Raw images: 256 x 288 pixels at 4 bits, sent in the same data packets
+static const uint32_t kSimImageBytes = 256 * 288 / 2;
+
+// UART rate the module starts at, and one byte in this many garbled above its reliable rate
+static const uint32_t kSimDefaultBaud = 57600;
+static const uint32_t kSimNoisyByteOdds = 2048;
+
+/* Command counts, for benchmarks to report traffic */
+struct SimSensorStats {
+  uint32_t commands;
+  uint32_t get_images;
+  uint32_t searches;
+  uint32_t bad_packets;
+};
+
+class SimSensor : public SimUartDevice {
+ public:
+  SimSensor();
+
+  // UART side
+  void Receive(const uint8_t* data, size_t size, uint32_t baud) override;
+  int Available() override;
+  int Read() override;
+  size_t Backlog() override;
+
+  // Scripting side, called from the benchmark driver
+  void SetConnected(bool connected);
+  void SetWakePin(int pin) { wake_pin_ = pin; }
+  void SetReliableBaud(uint32_t baud);  // Faster rates garble bytes; 0 for a clean line
+  uint32_t Baud();                      // Rate the module runs at
+  void PlaceFinger(uint8_t finger);
+  void LiftFinger();
+  void Enroll(uint16_t page, uint8_t finger);
+  void EmptyLibrary();
+  uint8_t TemplateAt(uint16_t page);
+  void FailNext(uint8_t command, uint8_t status);
+  uint16_t TemplateCount();
+  SimSensorStats stats();
+
+ private:
+  struct Byte {
+    uint8_t value;
+    uint32_t ready_us;
+  };
+
+  void HandlePacket(uint8_t command, const uint8_t* params, uint16_t length, uint32_t baud);
+  void HandleData(uint8_t pid, const uint8_t* data, uint16_t length);
+  void Reply(uint8_t status, const uint8_t* data, uint16_t length, uint32_t busy_us,
+             uint32_t baud);
+  void Transmit(uint8_t pid, const uint8_t* payload, uint16_t length, uint32_t busy_us,
+                uint32_t baud);
+  uint8_t LineNoise(uint8_t byte);  // The byte as it arrives over the line
+
+  std::mutex mutex_;
+  bool connected_;
+  int wake_pin_;
+  uint8_t finger_;             // Finger on the window, 0 if none
+  uint8_t image_;              // Finger in the image buffer
+  uint8_t char_buffer_[3];     // Finger in char buffers 1 and 2
+  uint8_t library_[kSimSensorCapacity];
+  uint8_t fail_command_;
+  uint8_t fail_status_;
+  uint32_t baud_;              // Rate set with SetSysPara; bytes at any other rate are lost
+  uint32_t reliable_baud_;
+  uint32_t noise_;             // xorshift state for garbled bytes
+  uint8_t download_slot_;      // Char buffer a DownChar is filling, 0 if none
+  uint16_t download_length_;
+  uint8_t download_[kSimTemplateBytes];
+  uint8_t rx_[160];
+  uint16_t rx_length_;
+  uint32_t rx_wire_us_;        // micros() when the last byte written has arrived
+  std::deque<Byte> tx_;
+  SimSensorStats stats_;
+};
+
+// Template bytes the simulated module produces for a finger
+uint8_t SimTemplateByte(uint8_t finger, uint16_t index);
+
+extern SimSensor sim_sensors[kSimSensorCount];  // Indexed by shard
+extern SimSensor& sim_sensor;                    // Shard 0, the one fingers touch
+
+#endif  // SIM_SENSOR_H_
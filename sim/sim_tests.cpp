@@ -0,0 +1,410 @@
+// sim_tests.cpp
+//
+// Tests of the --test run. Each one drives a firmware module directly against
+// the simulated sensor and flash, and reports one JSON line with its name and
+// whether every check in it passed.
+
+#include "sim_tests.h"
+
+#include <FS.h>
+#include <SPIFFS.h>
+
+#include "access_log.h"
+#include "enrollment.h"
+#include "finger_detect.h"
+#include "hardware.h"
+#include "sensor_baud.h"
+#include "sensor_shards.h"
+#include "sim_sensor.h"
+#include "user_directory.h"
+#include "user_store.h"
+
+// Enrollment scripting
+const uint8_t kTestFinger = 7;             // Finger the enrollment tests capture
+const uint8_t kTestOtherFinger = 8;        // A different finger, for a mismatched second image
+const uint16_t kTestEnrollId = 42;
+const char* const kTestEnrollName = "Test User";
+const uint32_t kTestStepLimitMs = 3000;    // Longest any scripted step may take
+const uint8_t kTestMaxEnrollEvents = 16;
+
+static int check_count = 0;
+static int check_failures = 0;
+
+bool SimCheck(bool passed, const char* condition, const char* file, int line) {
+  check_count++;
+  if (passed) return true;
+  check_failures++;
+
+  // Quotes in the condition would end the JSON string early
+  char text[160];
+  size_t length = 0;
+  for (; condition[length] != '\0' && length < sizeof(text) - 1; length++) {
+    text[length] = condition[length] == '"' ? '\'' : condition[length];
+  }
+  text[length] = '\0';
+  printf("{\"check\":\"%s\",\"file\":\"%s\",\"line\":%d,\"passed\":false}\n", text, file, line);
+  return false;
+}
+
+int SimCheckFailures() {
+  return check_failures;
+}
+
+/* Run one test and report whether its checks held */
+static void RunTest(const char* name, void (*test)()) {
+  int failures_before = check_failures;
+  int checks_before = check_count;
+  test();
+  printf("{\"test\":\"%s\",\"checks\":%d,\"passed\":%s}\n", name, check_count - checks_before,
+         check_failures == failures_before ? "true" : "false");
+}
+
+/* Name lookups are served from the directory without a single file system call */
+static void TestLookupDoesNoFileIo() {
+  UserDirectory& directory = user_directory;
+  directory.Clear();
+  SIM_CHECK(directory.Set(3, "Ada", 0, 3));
+  SIM_CHECK(directory.Set(kMaxUserId, "Last User", kSensorShardCount - 1, 0));
+
+  uint32_t calls_before = SimFsCalls();
+  SIM_CHECK(strcmp(GetUserNameByID(3), "Ada") == 0);
+  SIM_CHECK(strcmp(GetUserNameByID(kMaxUserId), "Last User") == 0);
+  SIM_CHECK(strcmp(GetUserNameByID(4), "Unknown User") == 0);
+  SIM_CHECK(directory.Find(3) != NULL && strcmp(directory.Find(3), "Ada") == 0);
+  SIM_CHECK(directory.Find(0) == NULL);
+  SIM_CHECK(directory.Find(kMaxUserId + 1) == NULL);
+  SIM_CHECK(SimFsCalls() == calls_before);
+
+  directory.Clear();
+}
+
+/* Injected wake edges start and stop capture passes, and contact bounce is dropped */
+static void TestWakeEdgeDebounce() {
+  SIM_CHECK(FINGER_WAKE_PIN >= 0);
+  FingerDetector detector;
+  detector.Begin(FINGER_WAKE_PIN, NULL);
+  SIM_CHECK(detector.has_wake_line());
+  SIM_CHECK(!detector.BeginPass());
+  SIM_CHECK(detector.IdleWaitMs() == kFingerWaitForever);
+
+  // One touch that chatters for 4 ms counts once, timed from its first edge
+  const uint32_t touch_us = 1000000;
+  detector.OnEdge(touch_us);
+  detector.OnEdge(touch_us + 1000);
+  detector.OnEdge(touch_us + kFingerDebounceUs - 1);
+  SIM_CHECK(detector.stats().bounces == 2);
+  SIM_CHECK(detector.BeginPass());
+  SIM_CHECK(detector.active());
+  SIM_CHECK(detector.stats().edges == 1);
+  detector.OnCaptureResult(true, touch_us + 200000);
+  SIM_CHECK(detector.stats().captures == 1);
+  SIM_CHECK(detector.stats().time_to_capture.count == 1);
+  SIM_CHECK(detector.stats().time_to_capture.max_us == 200000);
+
+  // Lift-off stops the passes until the next edge
+  detector.OnCaptureResult(false, touch_us + 250000);
+  SIM_CHECK(!detector.active());
+  detector.OnEdge(touch_us + kFingerDebounceUs + 100000);
+  SIM_CHECK(detector.BeginPass());
+  SIM_CHECK(detector.stats().edges == 2);
+  detector.OnCaptureResult(false, touch_us + 400000);
+  SIM_CHECK(!detector.BeginPass());
+
+  // The next touch, past the window, is a new edge
+  detector.OnEdge(touch_us + 500000);
+  detector.OnEdge(touch_us + 500000 + 10);
+  SIM_CHECK(detector.BeginPass());
+  SIM_CHECK(detector.stats().edges == 3);
+  SIM_CHECK(detector.stats().bounces == 3);
+
+  // The wake ISR on the configured pin feeds the shared detector
+  finger_detector.Begin(FINGER_WAKE_PIN, NULL);
+  uint32_t edges_before = finger_detector.stats().edges;
+  delay(kFingerDebounceUs / 1000 + 1);
+  SimFireInterrupt(FINGER_WAKE_PIN);
+  SIM_CHECK(finger_detector.BeginPass());
+  SIM_CHECK(finger_detector.stats().edges == edges_before + 1);
+}
+
+/* An append that comes up short is rewritten whole, and every user survives the next boot */
+static void TestUserLogShortWrite() {
+  SPIFFS.remove(USER_LOG_PATH);
+  SIM_CHECK(user_store.Begin(SPIFFS));
+  SIM_CHECK(user_store.Put(1, "Ada", 0, 1));
+  SIM_CHECK(user_store.Flush());
+
+  // The flash takes the first record of the batch and half of the second
+  SIM_CHECK(user_store.Put(2, "Bob", 0, 2));
+  SIM_CHECK(user_store.Put(3, "Cy", 0, 3));
+  SIM_CHECK(user_store.Put(4, "Dee", 0, 4));
+  uint32_t compactions = user_store.stats().compactions;
+  SimFsShortWrite(sizeof(UserRecord) + sizeof(UserRecord) / 2);
+  SIM_CHECK(user_store.Flush());
+  SIM_CHECK(user_store.stats().compactions == compactions + 1);
+
+  // Later appends land on a record boundary
+  SIM_CHECK(user_store.Put(5, "Eve", 0, 5));
+  SIM_CHECK(user_store.Remove(1));
+  SIM_CHECK(user_store.Flush());
+  File log = SPIFFS.open(USER_LOG_PATH, "r");
+  SIM_CHECK(log && log.size() % sizeof(UserRecord) == 0);
+  log.close();
+
+  SIM_CHECK(user_store.Begin(SPIFFS));
+  SIM_CHECK(user_directory.Count() == 4);
+  SIM_CHECK(!user_directory.Contains(1));
+  SIM_CHECK(user_directory.Find(3) != NULL && strcmp(user_directory.Find(3), "Cy") == 0);
+  SIM_CHECK(user_directory.Find(5) != NULL && strcmp(user_directory.Find(5), "Eve") == 0);
+
+  SPIFFS.remove(USER_LOG_PATH);
+  user_directory.Clear();
+}
+
+/* After a short write the log moves to a fresh segment, so later records stay readable */
+static void TestAccessLogShortWrite() {
+  char path[24];
+  for (uint8_t segment = 0; segment < kAccessLogSegments; segment++) {
+    snprintf(path, sizeof(path), ACCESS_LOG_SEGMENT_PATH, (unsigned)segment);
+    SPIFFS.remove(path);
+  }
+  SIM_CHECK(access_log.Begin(SPIFFS));
+  for (uint16_t user = 1; user <= 3; user++) access_log.Append(user, 100, kAccessGranted);
+  SIM_CHECK(access_log.Flush());
+
+  // One record and part of the next reach the flash; the rest of that batch is dropped
+  uint32_t rotations = access_log.stats().rotations;
+  for (uint16_t user = 4; user <= 7; user++) access_log.Append(user, 100, kAccessGranted);
+  SimFsShortWrite(sizeof(AccessRecord) + sizeof(AccessRecord) / 2);
+  SIM_CHECK(!access_log.Flush());
+  SIM_CHECK(access_log.stats().rotations == rotations + 1);
+
+  for (uint16_t user = 8; user <= 10; user++) access_log.Append(user, 100, kAccessGranted);
+  SIM_CHECK(access_log.Flush());
+  AccessRecord records[16];
+  uint16_t found = access_log.Recent(kAccessLogAllUsers, records, 16);
+  SIM_CHECK(found == 7);
+  const uint16_t expected[] = {10, 9, 8, 4, 3, 2, 1};
+  for (uint16_t i = 0; i < found && i < 7; i++) SIM_CHECK(records[i].user_id == expected[i]);
+
+  // The next boot resumes after the newest record
+  SIM_CHECK(access_log.Begin(SPIFFS));
+  access_log.Append(11, 100, kAccessDenied);
+  SIM_CHECK(access_log.Flush());
+  SIM_CHECK(access_log.Recent(kAccessLogAllUsers, records, 16) == 8);
+  SIM_CHECK(records[0].user_id == 11 && records[1].user_id == 10);
+}
+
+/* State changes of one enrollment run, as the sensor task would post them as events */
+struct EnrollTrace {
+  EnrollState states[kTestMaxEnrollEvents];
+  uint8_t count;
+};
+
+/* Poll the sensors and tick the machine until it reaches a state or stops */
+static bool DriveEnrollment(EnrollTrace* trace, EnrollState until) {
+  uint32_t started_ms = millis();
+  while (millis() - started_ms < kTestStepLimitMs) {
+    PollSensorShards(millis());
+    if (enrollment.Tick(millis()) && trace->count < kTestMaxEnrollEvents) {
+      trace->states[trace->count++] = enrollment.state();
+    }
+    if (enrollment.state() == until) return true;
+    if (!enrollment.active()) return false;
+    delay(1);
+  }
+  return false;
+}
+
+/* Let every reply still on the wire arrive, so the next test starts from a quiet sensor */
+static void DrainSensors() {
+  uint32_t started_ms = millis();
+  while (SensorShardsBusy() && millis() - started_ms < kTestStepLimitMs) {
+    PollSensorShards(millis());
+    delay(1);
+  }
+}
+
+/* Start enrolling kTestEnrollId on the capture shard with the window empty */
+static void StartEnrollment(EnrollTrace* trace) {
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    sensor_ports[shard]->begin(kSensorDefaultBaud);
+  }
+  sim_sensor.LiftFinger();
+  DrainSensors();
+  trace->count = 0;
+  enrollment.Start(kTestEnrollId, kCaptureShard, kTestEnrollId, kTestEnrollName, millis());
+}
+
+/* Template fed to a download, counting how often the client asks for more */
+struct DownloadSource {
+  uint8_t finger;
+  uint16_t offset;
+  uint8_t calls;
+};
+
+static uint16_t ReadSimTemplate(uint8_t* data, uint16_t length, void* context) {
+  DownloadSource* source = (DownloadSource*)context;
+  for (uint16_t i = 0; i < length; i++) {
+    data[i] = SimTemplateByte(source->finger, source->offset + i);
+  }
+  source->offset += length;
+  source->calls++;
+  return length;
+}
+
+static void StoreReply(const SensorReply& reply, void* context) {
+  *(uint8_t*)context = reply.status;
+}
+
+/* A download goes out at most one data packet per poll, and the template arrives whole */
+static void TestDownloadPacedPerPoll() {
+  const uint8_t shard = kSensorShardCount - 1;
+  const uint16_t page = 17;
+  SensorClient& client = *sensor_shards[shard];
+  sensor_ports[shard]->begin(kSensorDefaultBaud);
+  DrainSensors();
+
+  DownloadSource source = {kTestFinger, 0, 0};
+  uint8_t download_status = 0xFF;
+  uint8_t store_status = 0xFF;
+  SIM_CHECK(client.DownloadChar(1, ReadSimTemplate, &source, StoreReply, &download_status));
+  SIM_CHECK(client.StoreModel(page, 1, StoreReply, &store_status));
+
+  uint8_t most_per_poll = 0;
+  uint32_t started_ms = millis();
+  while (client.busy() && millis() - started_ms < kTestStepLimitMs) {
+    uint8_t calls_before = source.calls;
+    client.Poll(millis());
+    uint8_t calls = source.calls - calls_before;
+    if (calls > most_per_poll) most_per_poll = calls;
+    delay(1);
+  }
+  SIM_CHECK(most_per_poll == 1);
+  SIM_CHECK(source.calls == kSensorTemplateBytes / kSensorDataPacketBytes);
+  SIM_CHECK(download_status == FINGERPRINT_OK);
+  SIM_CHECK(store_status == FINGERPRINT_OK);
+  SIM_CHECK(sim_sensors[shard].TemplateAt(page) == kTestFinger);
+}
+
+/* Waiting states fail once their own deadline passes, with their own message */
+static void TestEnrollTimeouts() {
+  EnrollTrace trace;
+  StartEnrollment(&trace);
+  SIM_CHECK(DriveEnrollment(&trace, kEnrollWaitFirst));
+  SIM_CHECK(!enrollment.Tick(millis() + kEnrollFingerTimeoutMs - kEnrollPollIntervalMs));
+  SIM_CHECK(enrollment.Tick(millis() + kEnrollFingerTimeoutMs + 1));
+  SIM_CHECK(enrollment.state() == kEnrollFailed);
+  SIM_CHECK(strcmp(enrollment.message(), "Timed out, please try again.") == 0);
+  DrainSensors();
+
+  // The finger never leaves the window after the first image
+  StartEnrollment(&trace);
+  sim_sensor.PlaceFinger(kTestFinger);
+  SIM_CHECK(DriveEnrollment(&trace, kEnrollWaitLift));
+  SIM_CHECK(enrollment.Tick(millis() + kEnrollLiftTimeoutMs + 1));
+  SIM_CHECK(enrollment.state() == kEnrollFailed);
+  SIM_CHECK(strcmp(enrollment.message(), "Timed out waiting for finger removal.") == 0);
+
+  // Command states wait kEnrollCommandTimeoutMs for their reply
+  StartEnrollment(&trace);
+  sim_sensor.PlaceFinger(kTestFinger);
+  SIM_CHECK(DriveEnrollment(&trace, kEnrollConvert1));
+  SIM_CHECK(enrollment.Tick(millis() + kEnrollCommandTimeoutMs + 1));
+  SIM_CHECK(enrollment.state() == kEnrollFailed);
+  SIM_CHECK(strcmp(enrollment.message(), "Timed out, please try again.") == 0);
+  DrainSensors();
+}
+
+/* Cancel stops the machine from a command state, and it stays stopped */
+static void TestEnrollCancel() {
+  EnrollTrace trace;
+  StartEnrollment(&trace);
+  sim_sensor.PlaceFinger(kTestFinger);
+  SIM_CHECK(strcmp(enrollment.name(), kTestEnrollName) == 0);
+  SIM_CHECK(DriveEnrollment(&trace, kEnrollConvert1));
+  SIM_CHECK(trace.count == 2);
+  SIM_CHECK(trace.states[0] == kEnrollWaitFirst && trace.states[1] == kEnrollConvert1);
+
+  enrollment.Cancel();
+  SIM_CHECK(enrollment.state() == kEnrollCancelled);
+  SIM_CHECK(!enrollment.active());
+  SIM_CHECK(strcmp(enrollment.message(), "Enrollment cancelled.") == 0);
+  DrainSensors();
+  SIM_CHECK(!enrollment.Tick(millis()));
+  SIM_CHECK(enrollment.state() == kEnrollCancelled);
+}
+
+/* A reply owed to a cancelled run is dropped, not taken as the next run's reply */
+static void TestEnrollStaleReply() {
+  EnrollTrace trace;
+  StartEnrollment(&trace);
+  sim_sensor.PlaceFinger(kTestFinger);
+  SIM_CHECK(DriveEnrollment(&trace, kEnrollConvert1));
+  uint32_t deadline_ms = millis() + kTestStepLimitMs;
+  while (!SensorShardsBusy() && millis() < deadline_ms) {
+    PollSensorShards(millis());
+    enrollment.Tick(millis());
+  }
+  SIM_CHECK(SensorShardsBusy());  // The Image2Tz reply is still on the wire
+
+  // Restart at once; the old run's OK must not move the new one past DeleteOld
+  enrollment.Cancel();
+  sim_sensor.LiftFinger();
+  trace.count = 0;
+  enrollment.Start(kTestEnrollId, kCaptureShard, kTestEnrollId, kTestEnrollName, millis());
+  SIM_CHECK(DriveEnrollment(&trace, kEnrollWaitFirst));
+  for (uint8_t i = 0; i < 10; i++) {
+    PollSensorShards(millis());
+    enrollment.Tick(millis());
+    delay(kEnrollPollIntervalMs / 2);
+  }
+  SIM_CHECK(enrollment.state() == kEnrollWaitFirst);
+  SIM_CHECK(trace.count == 1 && trace.states[0] == kEnrollWaitFirst);
+  enrollment.Cancel();
+  DrainSensors();
+}
+
+/* An error status from the sensor fails the run with the state's message */
+static void TestEnrollSensorError() {
+  EnrollTrace trace;
+  StartEnrollment(&trace);
+  sim_sensor.FailNext(FINGERPRINT_IMAGE2TZ, FINGERPRINT_FEATUREFAIL);
+  sim_sensor.PlaceFinger(kTestFinger);
+  SIM_CHECK(!DriveEnrollment(&trace, kEnrollWaitLift));
+  SIM_CHECK(enrollment.state() == kEnrollFailed);
+  SIM_CHECK(strcmp(enrollment.message(), "Failed to process image.") == 0);
+  SIM_CHECK(trace.count == 3 && trace.states[2] == kEnrollFailed);
+  DrainSensors();
+}
+
+/* Two different fingers fail at regModel and nothing is stored */
+static void TestEnrollMismatch() {
+  EnrollTrace trace;
+  StartEnrollment(&trace);
+  sim_sensor.PlaceFinger(kTestFinger);
+  SIM_CHECK(DriveEnrollment(&trace, kEnrollWaitLift));
+  sim_sensor.LiftFinger();
+  SIM_CHECK(DriveEnrollment(&trace, kEnrollWaitSecond));
+  sim_sensor.PlaceFinger(kTestOtherFinger);
+  SIM_CHECK(!DriveEnrollment(&trace, kEnrollStore));
+  SIM_CHECK(enrollment.state() == kEnrollFailed);
+  SIM_CHECK(strcmp(enrollment.message(), "Fingerprints did not match.") == 0);
+  SIM_CHECK(trace.count >= 2 && trace.states[trace.count - 2] == kEnrollCreate);
+  SIM_CHECK(trace.states[trace.count - 1] == kEnrollFailed);
+  SIM_CHECK(sim_sensor.TemplateAt(kTestEnrollId) == 0);
+  sim_sensor.LiftFinger();
+  DrainSensors();
+}
+
+void RunSimTests() {
+  RunTest("lookup_no_file_io", TestLookupDoesNoFileIo);
+  RunTest("wake_edge_debounce", TestWakeEdgeDebounce);
+  RunTest("user_log_short_write", TestUserLogShortWrite);
+  RunTest("access_log_short_write", TestAccessLogShortWrite);
+  RunTest("download_paced_per_poll", TestDownloadPacedPerPoll);
+  RunTest("enroll_timeouts", TestEnrollTimeouts);
+  RunTest("enroll_cancel", TestEnrollCancel);
+  RunTest("enroll_stale_reply", TestEnrollStaleReply);
+  RunTest("enroll_sensor_error", TestEnrollSensorError);
+  RunTest("enroll_mismatch", TestEnrollMismatch);
+}
@@ -0,0 +1,19 @@
+// sim_tests.h
+//
+// Assertions for the native simulator. The --test run exercises firmware
+// modules directly, before setup() starts the sensor task, and the benchmark
+// run checks its own results with the same macro. A failed check prints a
+// JSON line on stdout; the program exits non-zero if any check failed.
+
+#ifndef SIM_TESTS_H_
+#define SIM_TESTS_H_
+
+#include <Arduino.h>
+
+#define SIM_CHECK(condition) SimCheck((condition), #condition, __FILE__, __LINE__)
+
+bool SimCheck(bool passed, const char* condition, const char* file, int line);
+int SimCheckFailures();  // Checks failed so far
+void RunSimTests();      // Every test of the --test run
+
+#endif  // SIM_TESTS_H_
@@ -0,0 +1,246 @@
+// access_log.cpp
+
+#include "access_log.h"
+
+// Log of every final scan result
+AccessLog access_log;
+
+// One flash page of records, shared by Begin() and queries off the stack
+static AccessRecord page_buffer[kAccessLogPageRecords];
+
+/* CRC-8 (polynomial 0x07) over a record, skipping the checksum byte */
+static uint8_t RecordChecksum(const AccessRecord& record) {
+  const uint8_t* bytes = (const uint8_t*)&record;
+  uint8_t crc = 0;
+  for (size_t i = 0; i < sizeof(AccessRecord); i++) {
+    if (i == offsetof(AccessRecord, checksum)) continue;
+    crc ^= bytes[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+/* Path of a segment file */
+static void SegmentPath(uint8_t segment, char* path, size_t length) {
+  snprintf(path, length, ACCESS_LOG_SEGMENT_PATH, (unsigned)segment);
+}
+
+AccessLog::AccessLog()
+    : fs_(NULL), enabled_(ACCESS_LOG != 0), ring_head_(0), ring_count_(0), last_append_ms_(0),
+      segment_(0), segment_records_(0), next_sequence_(0), boot_(0) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+/* Resume after the newest intact record in any segment */
+bool AccessLog::Begin(fs::FS& fs) {
+  fs_ = &fs;
+
+  bool found = false;
+  AccessRecord newest = {};
+  bool newest_torn = false;
+  for (uint8_t segment = 0; segment < kAccessLogSegments; segment++) {
+    char path[24];
+    SegmentPath(segment, path, sizeof(path));
+    if (!fs_->exists(path)) continue;
+    File file = fs_->open(path, "r");
+    if (!file) continue;
+
+    // The last record of a segment is its newest; step back over a torn tail
+    uint32_t records = file.size() / sizeof(AccessRecord);
+    bool torn = (file.size() % sizeof(AccessRecord)) != 0;
+    for (uint32_t back = 0; back < kAccessLogPageRecords && back < records; back++) {
+      AccessRecord record;
+      file.seek((records - 1 - back) * sizeof(AccessRecord));
+      if (file.read((uint8_t*)&record, sizeof(record)) != sizeof(record)) break;
+      if (record.checksum != RecordChecksum(record)) {
+        torn = true;
+        continue;
+      }
+      if (!found || record.sequence > newest.sequence) {
+        found = true;
+        newest = record;
+        newest_torn = torn;
+        segment_ = segment;
+        segment_records_ = records;
+      }
+      break;
+    }
+    file.close();
+  }
+
+  if (!found) {
+    Serial.println("Starting a new access log");
+    return StartSegment(0);
+  }
+
+  next_sequence_ = newest.sequence + 1;
+  boot_ = newest.boot + 1;
+  Serial.printf("Access log resumes at record %u (segment %u, boot %u)\n",
+                (unsigned)next_sequence_, (unsigned)segment_, (unsigned)boot_);
+
+  // Appending after a torn record would misalign every later one
+  if (newest_torn || segment_records_ >= kAccessLogSegmentRecords) {
+    return StartSegment((segment_ + 1) % kAccessLogSegments);
+  }
+  return true;
+}
+
+/* Truncate a segment and make it the one being appended to */
+bool AccessLog::StartSegment(uint8_t segment) {
+  char path[24];
+  SegmentPath(segment, path, sizeof(path));
+  File file = fs_->open(path, "w");
+  if (!file) {
+    Serial.println(F("Failed to start access log segment"));
+    return false;
+  }
+  file.close();
+  segment_ = segment;
+  segment_records_ = 0;
+  return true;
+}
+
+/* Buffer one access in RAM; never touches flash */
+void AccessLog::Append(uint16_t user_id, uint16_t confidence, AccessResult result) {
+  if (!enabled_) return;
+
+  if (ring_count_ == kAccessLogRingCapacity) {
+    // Poll() fell behind; keep the newest records
+    ring_head_ = (ring_head_ + 1) % kAccessLogRingCapacity;
+    ring_count_--;
+    stats_.dropped++;
+  }
+
+  AccessRecord& record = ring_[(ring_head_ + ring_count_) % kAccessLogRingCapacity];
+  record.sequence = next_sequence_++;
+  record.uptime_ms = millis();
+  record.boot = boot_;
+  record.user_id = user_id;
+  record.confidence = confidence;
+  record.result = result;
+  record.checksum = RecordChecksum(record);
+
+  ring_count_++;
+  stats_.appends++;
+  last_append_ms_ = record.uptime_ms;
+}
+
+/* Flush once the ring is nearly full, or once scans have paused */
+void AccessLog::Poll(uint32_t now_ms) {
+  if (ring_count_ == 0) return;
+  bool nearly_full = ring_count_ >= kAccessLogRingCapacity - kAccessLogPageRecords;
+  if (nearly_full || now_ms - last_append_ms_ >= kAccessLogIdleFlushMs) Flush();
+}
+
+/* Write every buffered record, in at most two contiguous runs of the ring */
+bool AccessLog::Flush() {
+  if (ring_count_ == 0) return true;
+  if (fs_ == NULL) return false;
+
+  uint16_t first_run = kAccessLogRingCapacity - ring_head_;
+  if (first_run > ring_count_) first_run = ring_count_;
+  bool ok = WriteRecords(&ring_[ring_head_], first_run);
+  if (ok && ring_count_ > first_run) WriteRecords(&ring_[0], ring_count_ - first_run);
+
+  // Records that could not be written are dropped rather than retried forever
+  ring_head_ = 0;
+  ring_count_ = 0;
+  stats_.flushes++;
+  return ok;
+}
+
+/* Append records to the current segment, moving on to the next one as each fills */
+bool AccessLog::WriteRecords(const AccessRecord* records, uint16_t count) {
+  while (count > 0) {
+    if (segment_records_ >= kAccessLogSegmentRecords) {
+      if (!StartSegment((segment_ + 1) % kAccessLogSegments)) return false;
+      stats_.rotations++;
+    }
+
+    uint32_t room = kAccessLogSegmentRecords - segment_records_;
+    uint16_t batch = count < room ? count : (uint16_t)room;
+
+    char path[24];
+    SegmentPath(segment_, path, sizeof(path));
+    File file = fs_->open(path, "a");
+    if (!file) {
+      Serial.println(F("Failed to open access log for appending"));
+      return false;
+    }
+    size_t length = batch * sizeof(AccessRecord);
+    size_t written = file.write((const uint8_t*)records, length);
+    file.close();
+
+    stats_.bytes_written += written;
+    segment_records_ += written / sizeof(AccessRecord);
+    if (written != length) {
+      // A partial record would shift every later one in this segment, so move on, as
+      // Begin() does after a torn tail; if that fails too, the next write tries again
+      Serial.println(F("Short write to access log, starting the next segment"));
+      segment_records_ = kAccessLogSegmentRecords;
+      if (StartSegment((segment_ + 1) % kAccessLogSegments)) stats_.rotations++;
+      return false;
+    }
+    records += batch;
+    count -= batch;
+  }
+  return true;
+}
+
+/* Collect matches from one segment, reading it backwards a page at a time */
+uint16_t AccessLog::ScanSegment(uint8_t segment, uint32_t end_record, uint16_t user_id,
+                                AccessRecord* out, uint16_t found, uint16_t max_records,
+                                uint16_t* budget) {
+  char path[24];
+  SegmentPath(segment, path, sizeof(path));
+  if (!fs_->exists(path)) return found;
+  File file = fs_->open(path, "r");
+  if (!file) return found;
+
+  uint32_t records = file.size() / sizeof(AccessRecord);
+  if (end_record > records) end_record = records;
+
+  while (end_record > 0 && found < max_records && *budget > 0) {
+    uint16_t batch = end_record < kAccessLogPageRecords ? end_record : kAccessLogPageRecords;
+    if (batch > *budget) batch = *budget;
+    end_record -= batch;
+    *budget -= batch;
+
+    file.seek(end_record * sizeof(AccessRecord));
+    size_t length = batch * sizeof(AccessRecord);
+    if (file.read((uint8_t*)page_buffer, length) != length) break;
+
+    for (int i = batch - 1; i >= 0 && found < max_records; i--) {
+      const AccessRecord& record = page_buffer[i];
+      if (record.checksum != RecordChecksum(record)) continue;
+      if (user_id == kAccessLogAllUsers || record.user_id == user_id) out[found++] = record;
+    }
+  }
+  file.close();
+  return found;
+}
+
+/* Newest records for a user (or kAccessLogAllUsers), looking at a bounded number */
+uint16_t AccessLog::Recent(uint16_t user_id, AccessRecord* out, uint16_t max_records) {
+  uint16_t found = 0;
+  uint16_t budget = kAccessLogQueryMaxRecords;
+
+  // Buffered records are the newest
+  for (int i = ring_count_ - 1; i >= 0 && found < max_records && budget > 0; i--, budget--) {
+    const AccessRecord& record = ring_[(ring_head_ + i) % kAccessLogRingCapacity];
+    if (user_id == kAccessLogAllUsers || record.user_id == user_id) out[found++] = record;
+  }
+  if (fs_ == NULL) return found;
+
+  // Then the segments, from the one being written back through older ones
+  found = ScanSegment(segment_, segment_records_, user_id, out, found, max_records, &budget);
+  for (uint8_t back = 1; back < kAccessLogSegments; back++) {
+    if (found >= max_records || budget == 0) break;
+    uint8_t segment = (segment_ + kAccessLogSegments - back) % kAccessLogSegments;
+    found = ScanSegment(segment, kAccessLogSegmentRecords, user_id, out, found, max_records,
+                        &budget);
+  }
+  return found;
+}
@@ -0,0 +1,101 @@
+// access_log.h
+
+#ifndef ACCESS_LOG_H_
+#define ACCESS_LOG_H_
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Set to 0 to keep scans out of flash entirely
+#ifndef ACCESS_LOG
+#define ACCESS_LOG 1
+#endif
+
+// Segment files, written in rotation; %u is the segment index
+#define ACCESS_LOG_SEGMENT_PATH "/access%u.log"
+
+// Log sizing
+const uint8_t kAccessLogSegments = 4;              // Segment files rotated through
+const uint16_t kAccessLogSegmentRecords = 1024;    // Records per segment (16 KB)
+const uint16_t kAccessLogRingCapacity = 64;        // Records buffered in RAM
+const uint16_t kAccessLogPageRecords = 16;         // Records per 256-byte flash page
+const uint32_t kAccessLogIdleFlushMs = 5000;       // Flush once no scan came in for this long
+const uint16_t kAccessLogQueryMaxRecords = 2048;   // Records a query may look at
+const uint16_t kAccessLogAllUsers = 0xFFFF;        // Query every entry, matched or not
+
+// Outcome of an access attempt
+enum AccessResult {
+  kAccessGranted = 1,  // Finger matched user_id
+  kAccessDenied = 2    // No enrolled finger matched, or not the claimed user_id's
+};
+
+/* Fixed-size binary record; there is no RTC, so time is boot number plus uptime */
+struct __attribute__((packed)) AccessRecord {
+  uint32_t sequence;    // Increases by one per record across boots and segments
+  uint32_t uptime_ms;   // millis() when the result was shown
+  uint16_t boot;        // Boot count, one more than the newest record found at Begin()
+  uint16_t user_id;     // Matched or claimed user, 0 when a 1:N scan was denied
+  uint16_t confidence;  // Match score reported by the sensor
+  uint8_t result;       // AccessResult
+  uint8_t checksum;     // CRC-8 over every other byte
+};
+
+/* Counters describing the flash traffic caused by the log */
+struct AccessLogStats {
+  uint32_t appends;        // Records added to the RAM ring
+  uint32_t dropped;        // Oldest records overwritten because the ring was full
+  uint32_t flushes;        // Batched writes to flash
+  uint32_t bytes_written;  // Total bytes written to flash
+  uint32_t rotations;      // Segments started over
+};
+
+/*
+ * Access log with a RAM ring in front of rotating flash segments.
+ *
+ * Append() only copies a record into the ring, so scans never wait on
+ * flash. Poll() writes the ring out in one batch when it is nearly full or
+ * after kAccessLogIdleFlushMs without a scan. Writes go to one segment file
+ * until it holds kAccessLogSegmentRecords, then the oldest segment is
+ * truncated and reused, which spreads writes over the whole log instead of
+ * rewriting one file. Queries read newest first and stop after
+ * kAccessLogQueryMaxRecords, so their cost does not grow with the log.
+ */
+class AccessLog {
+ public:
+  AccessLog();
+
+  bool Begin(fs::FS& fs);                      // Find the newest segment and record
+  void Append(uint16_t user_id, uint16_t confidence, AccessResult result);  // RAM only
+  void Poll(uint32_t now_ms);                  // Flush when nearly full or idle
+  bool Flush();                                // Write every buffered record now
+  uint16_t Recent(uint16_t user_id, AccessRecord* out, uint16_t max_records);  // Newest first
+
+  void SetEnabled(bool enabled) { enabled_ = enabled; }
+  bool enabled() const { return enabled_; }
+  uint16_t buffered() const { return ring_count_; }
+  const AccessLogStats& stats() const { return stats_; }
+
+ private:
+  bool WriteRecords(const AccessRecord* records, uint16_t count);
+  bool StartSegment(uint8_t segment);
+  uint16_t ScanSegment(uint8_t segment, uint32_t end_record, uint16_t user_id,
+                       AccessRecord* out, uint16_t found, uint16_t max_records,
+                       uint16_t* budget);
+
+  fs::FS* fs_;
+  bool enabled_;
+  AccessRecord ring_[kAccessLogRingCapacity];
+  uint16_t ring_head_;        // Index of the oldest buffered record
+  uint16_t ring_count_;
+  uint32_t last_append_ms_;
+  uint8_t segment_;           // Segment being appended to
+  uint32_t segment_records_;  // Records already in that segment
+  uint32_t next_sequence_;
+  uint16_t boot_;
+  AccessLogStats stats_;
+};
+
+// Log of every final scan result
+extern AccessLog access_log;
+
+#endif  // ACCESS_LOG_H_
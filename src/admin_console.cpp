@@ -0,0 +1,535 @@
+// admin_console.cpp
+
+#include "admin_console.h"
+#include "bulk_delete.h"
+#include "hardware.h"
+#include "image_stream.h"
+#include "perf_stats.h"
+#include "sensor_baud.h"
+#include "template_archive.h"
+#include "user_store.h"
+
+AdminConsole admin_console;
+
+AdminConsole::AdminConsole()
+    : line_length_(0), line_overflow_(false), import_expected_(0), import_received_(0),
+      import_error_line_(0), import_error_(NULL), last_line_ms_(0), waiting_(kWaitNone),
+      wait_started_ms_(0), request_tag_(0), replies_pending_(0), reply_failed_(false), index_shard_(0),
+      archive_to_serial_(false), streaming_(false), upload_remaining_(0), upload_received_(0) {
+  memset(templates_, 0, sizeof(templates_));
+  memset(index_bits_, 0, sizeof(index_bits_));
+}
+
+/* Collect console input into lines, run each one and finish requests that are due */
+void AdminConsole::Poll(uint32_t now_ms) {
+  if (streaming_) return;  // A reply now would land inside the raw bytes; input waits
+  if (waiting_ == kWaitUpload) ReceiveUpload(now_ms);
+
+  while (waiting_ != kWaitUpload && Serial.available() > 0) {
+    int c = Serial.read();
+    if (c < 0 || c == '\r') continue;
+    if (c != '\n') {
+      if (line_length_ < kAdminLineLength) {
+        line_[line_length_++] = (char)c;
+      } else {
+        line_overflow_ = true;
+      }
+      continue;
+    }
+
+    line_[line_length_] = '\0';
+    line_length_ = 0;
+    if (line_overflow_) {
+      line_overflow_ = false;
+      Serial.println("err line too long");
+      continue;
+    }
+    HandleLine(line_, now_ms);
+  }
+
+  // A host that stops halfway through a frame must not leave it open forever
+  if (import_expected_ > 0 && now_ms - last_line_ms_ > kAdminFrameTimeoutMs) {
+    import_expected_ = 0;
+    Serial.printf("err import timeout received=%u\n", (unsigned)import_received_);
+  }
+
+  if (waiting_ == kWaitDelete && !bulk_delete.busy()) {
+    FinishDelete();
+  } else if ((waiting_ == kWaitCount || waiting_ == kWaitIndex) &&
+             now_ms - wait_started_ms_ > kAdminReplyTimeoutMs) {
+    // Replies still on their way carry the old tag and are dropped
+    Serial.printf("err %s timeout\n", waiting_ == kWaitCount ? "count" : "index");
+    waiting_ = kWaitNone;
+  }
+}
+
+/* Dispatch one request line */
+void AdminConsole::HandleLine(const char* line, uint32_t now_ms) {
+  if (import_expected_ > 0) {
+    StageImportLine(line, now_ms);
+    return;
+  }
+  if (line[0] == '\0') return;
+  if (RunPerfCommand(line)) return;
+
+#if ADMIN_CONSOLE
+  if (waiting_ != kWaitNone) {
+    Serial.println("err busy");
+  } else if (strcmp(line, "count") == 0) {
+    StartCount(now_ms);
+  } else if (strncmp(line, "index ", 6) == 0) {
+    StartIndex(line + 6, now_ms);
+  } else if (strcmp(line, "export") == 0) {
+    Export();
+  } else if (strncmp(line, "import ", 7) == 0) {
+    StartImport(line + 7, now_ms);
+  } else if (strncmp(line, "delete ", 7) == 0) {
+    StartDelete(line + 7, now_ms);
+  } else if (strncmp(line, "baud ", 5) == 0) {
+    StartBaud(line + 5, now_ms);
+  } else if (strncmp(line, "image ", 6) == 0) {
+    StartImage(line + 6, now_ms);
+  } else if (strncmp(line, "backup ", 7) == 0) {
+    StartBackup(line + 7, now_ms);
+  } else if (strncmp(line, "restore ", 8) == 0) {
+    StartRestore(line + 8, now_ms);
+  } else {
+    Serial.printf("err unknown %s\n", line);
+  }
+#else
+  Serial.println("err admin disabled, build with ADMIN_CONSOLE=1");
+#endif
+}
+
+/* "import <n>": open a frame of n user lines */
+void AdminConsole::StartImport(const char* args, uint32_t now_ms) {
+  unsigned count = 0;
+  if (sscanf(args, "%u", &count) != 1 || count == 0 || count > kAdminBatchCapacity) {
+    Serial.printf("err import count must be 1..%u\n", (unsigned)kAdminBatchCapacity);
+    return;
+  }
+  import_expected_ = (uint8_t)count;
+  import_received_ = 0;
+  import_error_line_ = 0;
+  import_error_ = NULL;
+  last_line_ms_ = now_ms;
+}
+
+/* Check and stage one user line of an import frame; the last one commits it */
+void AdminConsole::StageImportLine(const char* line, uint32_t now_ms) {
+  last_line_ms_ = now_ms;
+  uint8_t index = import_received_++;
+
+  if (import_error_line_ == 0) {
+    const char* error = NULL;
+    unsigned id = 0;
+    unsigned shard = 0;
+    unsigned slot = 0;
+    int name_at = 0;
+
+    if (sscanf(line, "user %u %u %u %n", &id, &shard, &slot, &name_at) != 3 || name_at == 0 ||
+        line[name_at] == '\0') {
+      error = "format";
+    } else if (id == 0 || id > kMaxUserId) {
+      error = "id";
+    } else if (shard >= kSensorShardCount || slot >= kShardCapacity) {
+      error = "location";
+    } else if (strlen(line + name_at) > kMaxUserNameLength) {
+      error = "name";
+    } else {
+      uint16_t owner = user_directory.IdAt(shard, slot);
+      if (owner != 0 && owner != id) error = "page taken";
+      for (uint8_t i = 0; error == NULL && i < index; i++) {
+        if (staged_[i].id == id) error = "duplicate id";
+        if (staged_[i].shard == shard && staged_[i].slot == slot) error = "duplicate page";
+      }
+    }
+
+    if (error != NULL) {
+      import_error_line_ = index + 1;
+      import_error_ = error;
+    } else {
+      ImportEntry& entry = staged_[index];
+      entry.id = (uint16_t)id;
+      entry.shard = (uint8_t)shard;
+      entry.slot = (uint16_t)slot;
+      strncpy(entry.name, line + name_at, kMaxUserNameLength);
+      entry.name[kMaxUserNameLength] = '\0';
+    }
+  }
+
+  if (import_received_ < import_expected_) return;
+  import_expected_ = 0;
+  if (import_error_line_ != 0) {
+    Serial.printf("err import line=%u %s\n", (unsigned)import_error_line_, import_error_);
+    return;
+  }
+  CommitImport();
+}
+
+/* Apply a validated frame to the store as one batch */
+void AdminConsole::CommitImport() {
+  uint32_t started_ms = millis();
+  if (!user_store.BeginBatch()) {
+    Serial.println("err import store busy");
+    return;
+  }
+
+  for (uint8_t i = 0; i < import_received_; i++) {
+    const ImportEntry& entry = staged_[i];
+    if (!user_store.Put(entry.id, entry.name, entry.shard, entry.slot)) {
+      user_store.AbortBatch();
+      Serial.printf("err import line=%u rejected\n", (unsigned)(i + 1));
+      return;
+    }
+  }
+
+  if (!user_store.CommitBatch()) {
+    user_store.AbortBatch();
+    Serial.println("err import commit failed");
+    return;
+  }
+  Serial.printf("ok import users=%u total=%u ms=%u\n", (unsigned)import_received_,
+                (unsigned)user_directory.Count(), (unsigned)(millis() - started_ms));
+}
+
+/* "export": every user in the same form an import takes */
+void AdminConsole::Export() {
+  Serial.printf("ok export users=%u\n", (unsigned)user_directory.Count());
+  for (uint16_t id = user_directory.NextId(0); id != 0; id = user_directory.NextId(id)) {
+    uint8_t shard = 0;
+    uint16_t slot = 0;
+    user_directory.Locate(id, &shard, &slot);
+    Serial.printf("user %u %u %u %s\n", (unsigned)id, (unsigned)shard, (unsigned)slot,
+                  user_directory.Find(id));
+  }
+}
+
+/* "count": ask every shard for its template count */
+void AdminConsole::StartCount(uint32_t now_ms) {
+  request_tag_++;
+  replies_pending_ = 0;
+  reply_failed_ = false;
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    templates_[shard] = 0;
+    if (SendSensorCommand(kCmdCountTemplates, request_tag_, shard)) {
+      replies_pending_++;
+    } else {
+      reply_failed_ = true;
+    }
+  }
+  waiting_ = kWaitCount;
+  wait_started_ms_ = now_ms;
+  if (replies_pending_ == 0) FinishCount();
+}
+
+/* "index <shard>": read the shard's page bitmap, one group at a time */
+void AdminConsole::StartIndex(const char* args, uint32_t now_ms) {
+  unsigned shard = 0;
+  if (sscanf(args, "%u", &shard) != 1 || shard >= kSensorShardCount) {
+    Serial.printf("err index shard must be 0..%u\n", (unsigned)(kSensorShardCount - 1));
+    return;
+  }
+
+  index_shard_ = (uint8_t)shard;
+  memset(index_bits_, 0, sizeof(index_bits_));
+  request_tag_++;
+  replies_pending_ = 0;
+  reply_failed_ = false;
+  for (uint8_t group = 0; group < kAdminIndexGroups; group++) {
+    if (SendSensorCommand(kCmdReadIndex, request_tag_, index_shard_, group)) {
+      replies_pending_++;
+    } else {
+      reply_failed_ = true;
+    }
+  }
+  waiting_ = kWaitIndex;
+  wait_started_ms_ = now_ms;
+  if (replies_pending_ == 0) FinishIndex();
+}
+
+/* "delete <first> <last>": remove the range with one commit and as few sensor calls as possible */
+void AdminConsole::StartDelete(const char* args, uint32_t now_ms) {
+  unsigned first = 0;
+  unsigned last = 0;
+  if (sscanf(args, "%u %u", &first, &last) != 2 || first == 0 || first > last ||
+      last > kMaxUserId) {
+    Serial.printf("err delete range must be within 1..%u\n", (unsigned)kMaxUserId);
+    return;
+  }
+  if (bulk_delete.busy()) {
+    Serial.println("err delete busy");
+    return;
+  }
+
+  bulk_delete.Clear();
+  bulk_delete.SelectRange((uint16_t)first, (uint16_t)last);
+  if (!bulk_delete.Start()) {
+    Serial.println(bulk_delete.result().store_failed ? "err delete store failed"
+                                                     : "err delete no users");
+    return;
+  }
+  waiting_ = kWaitDelete;
+  wait_started_ms_ = now_ms;
+}
+
+/* "baud <shard> [max]": negotiate the shard's UART rate; the job answers with one event */
+void AdminConsole::StartBaud(const char* args, uint32_t now_ms) {
+  unsigned shard = 0;
+  unsigned max_baud = SENSOR_BAUD_MAX;
+  int fields = sscanf(args, "%u %u", &shard, &max_baud);
+  if (fields < 1 || shard >= kSensorShardCount || max_baud < kSensorBaudUnit) {
+    Serial.printf("err baud shard must be 0..%u, max at least %u\n",
+                  (unsigned)(kSensorShardCount - 1), (unsigned)kSensorBaudUnit);
+    return;
+  }
+  if (max_baud > SENSOR_BAUD_MAX) max_baud = SENSOR_BAUD_MAX;
+  if (!SendSensorCommand(kCmdSetBaud, 0, (uint8_t)shard, (uint16_t)(max_baud / kSensorBaudUnit))) {
+    Serial.println("err baud busy");
+    return;
+  }
+  waiting_ = kWaitBaud;
+  wait_started_ms_ = now_ms;
+}
+
+/* "image serial|file": capture one raw image on the capture sensor */
+void AdminConsole::StartImage(const char* args, uint32_t now_ms) {
+  ImageDestination destination;
+  if (strcmp(args, "serial") == 0) {
+    destination = kImageToSerial;
+  } else if (strcmp(args, "file") == 0) {
+    destination = kImageToFile;
+  } else {
+    Serial.println("err image destination must be serial or file");
+    return;
+  }
+  if (!SendSensorCommand(kCmdCaptureImage, 0, kCaptureShard, destination)) {
+    Serial.println("err image busy");
+    return;
+  }
+  streaming_ = (destination == kImageToSerial);  // The sensor task writes the bitmap itself
+  waiting_ = kWaitImage;
+  wait_started_ms_ = now_ms;
+}
+
+/* "backup file|serial": write the archive on SPIFFS, sending it to the console after */
+void AdminConsole::StartBackup(const char* args, uint32_t now_ms) {
+  if (strcmp(args, "file") != 0 && strcmp(args, "serial") != 0) {
+    Serial.println("err backup destination must be file or serial");
+    return;
+  }
+  if (!SendBackupCommand()) {
+    Serial.println("err backup busy");
+    return;
+  }
+  archive_to_serial_ = strcmp(args, "serial") == 0;
+  waiting_ = kWaitBackup;
+  wait_started_ms_ = now_ms;
+}
+
+/* "restore file" or "restore serial <n>": store the archive's templates on their sensors */
+void AdminConsole::StartRestore(const char* args, uint32_t now_ms) {
+  unsigned bytes = 0;
+  if (strcmp(args, "file") == 0) {
+    if (!SPIFFS.exists(TEMPLATE_ARCHIVE_PATH)) {
+      Serial.println("err restore no archive");
+    } else if (!SendSensorCommand(kCmdRestore)) {
+      Serial.println("err restore busy");
+    } else {
+      waiting_ = kWaitRestore;
+      wait_started_ms_ = now_ms;
+    }
+    return;
+  }
+  if (sscanf(args, "serial %u", &bytes) != 1 || bytes < sizeof(ArchiveHeader) ||
+      bytes > kArchiveMaxBytes) {
+    Serial.printf("err restore source must be file or serial <%u..%u>\n",
+                  (unsigned)sizeof(ArchiveHeader), (unsigned)kArchiveMaxBytes);
+    return;
+  }
+
+  // The upload goes beside the archive, which it replaces only once it is complete
+  upload_ = SPIFFS.open(TEMPLATE_UPLOAD_PATH, "w");
+  if (!upload_) {
+    Serial.println("err restore store");
+    return;
+  }
+  upload_remaining_ = bytes;
+  upload_received_ = 0;
+  last_line_ms_ = now_ms;
+  waiting_ = kWaitUpload;
+  wait_started_ms_ = now_ms;
+}
+
+/* Copy raw archive bytes from the console to SPIFFS; the last one starts the restore */
+void AdminConsole::ReceiveUpload(uint32_t now_ms) {
+  uint8_t chunk[64];
+  while (upload_remaining_ > 0 && Serial.available() > 0) {
+    size_t length = 0;
+    while (length < sizeof(chunk) && length < upload_remaining_ && Serial.available() > 0) {
+      chunk[length++] = (uint8_t)Serial.read();
+    }
+    upload_remaining_ -= length;
+    upload_received_ += length;
+    last_line_ms_ = now_ms;
+    if (upload_.write(chunk, length) != length) {
+      upload_.close();
+      SPIFFS.remove(TEMPLATE_UPLOAD_PATH);
+      waiting_ = kWaitNone;
+      Serial.println("err restore store");
+      return;
+    }
+  }
+
+  if (upload_remaining_ > 0) {
+    // A host that stops halfway must not leave the console swallowing input
+    if (now_ms - last_line_ms_ > kAdminFrameTimeoutMs) {
+      upload_.close();
+      SPIFFS.remove(TEMPLATE_UPLOAD_PATH);
+      waiting_ = kWaitNone;
+      Serial.printf("err restore timeout received=%u\n", (unsigned)upload_received_);
+    }
+    return;
+  }
+
+  upload_.close();
+  SPIFFS.remove(TEMPLATE_ARCHIVE_PATH);
+  if (!SPIFFS.rename(TEMPLATE_UPLOAD_PATH, TEMPLATE_ARCHIVE_PATH)) {
+    waiting_ = kWaitNone;
+    Serial.println("err restore store");
+    return;
+  }
+  if (!SendSensorCommand(kCmdRestore)) {
+    waiting_ = kWaitNone;
+    Serial.println("err restore busy");
+    return;
+  }
+  waiting_ = kWaitRestore;
+  wait_started_ms_ = now_ms;
+}
+
+/* Collect the replies of a count, index, baud, image, backup or restore request */
+void AdminConsole::OnSensorEvent(const SensorEvent& event) {
+  bool current = (event.id == request_tag_);  // Not a late reply to a timed-out request
+  if (event.type == kEvtTemplateCount && waiting_ == kWaitCount && current) {
+    if (event.status != FINGERPRINT_OK) reply_failed_ = true;
+    if (event.shard < kSensorShardCount) templates_[event.shard] = event.slot;
+    if (--replies_pending_ == 0) FinishCount();
+  } else if (event.type == kEvtTemplateIndex && waiting_ == kWaitIndex && current &&
+             event.shard == index_shard_) {
+    if (event.status != FINGERPRINT_OK) reply_failed_ = true;
+
+    // Keep the part of the 256-page group that lies within the shard
+    uint16_t first_byte = event.slot * kSensorIndexBytes;
+    for (uint16_t i = 0; i < kSensorIndexBytes && first_byte + i < sizeof(index_bits_); i++) {
+      index_bits_[first_byte + i] = (uint8_t)event.message[i];
+    }
+    if (--replies_pending_ == 0) FinishIndex();
+  } else if ((event.type == kEvtBaudDone && waiting_ == kWaitBaud) ||
+             (event.type == kEvtImageDone && waiting_ == kWaitImage)) {
+    FinishJob(event);
+  } else if (event.type == kEvtArchiveDone &&
+             (waiting_ == kWaitBackup || waiting_ == kWaitRestore)) {
+    FinishArchive(event);
+  }
+}
+
+/* Reply to "count" */
+void AdminConsole::FinishCount() {
+  waiting_ = kWaitNone;
+  if (reply_failed_) {
+    Serial.println("err count sensor");
+    return;
+  }
+  Serial.printf("ok count users=%u templates=", (unsigned)user_directory.Count());
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    Serial.printf("%s%u", shard ? "," : "", (unsigned)templates_[shard]);
+  }
+  Serial.println();
+}
+
+/* Reply to "index": the bitmap, plus pages the directory disagrees about */
+void AdminConsole::FinishIndex() {
+  waiting_ = kWaitNone;
+  if (reply_failed_) {
+    Serial.println("err index sensor");
+    return;
+  }
+
+  uint16_t templates = 0;
+  uint16_t orphans = 0;  // Template on the sensor, no user for it
+  uint16_t missing = 0;  // User in the directory, no template on the sensor
+  for (uint16_t page = 0; page < kShardCapacity; page++) {
+    bool stored = (index_bits_[page / 8] & (1 << (page % 8))) != 0;
+    bool owned = user_directory.IdAt(index_shard_, page) != 0;
+    templates += stored;
+    if (stored && !owned) orphans++;
+    if (owned && !stored) missing++;
+  }
+
+  Serial.printf("ok index shard=%u templates=%u orphans=%u missing=%u bits=",
+                (unsigned)index_shard_, (unsigned)templates, (unsigned)orphans,
+                (unsigned)missing);
+  for (size_t i = 0; i < sizeof(index_bits_); i++) Serial.printf("%02x", index_bits_[i]);
+  Serial.println();
+}
+
+/* Reply to "baud" or "image" with the job's summary */
+void AdminConsole::FinishJob(const SensorEvent& event) {
+  waiting_ = kWaitNone;
+  streaming_ = false;
+  if (event.type == kEvtBaudDone) {
+    Serial.printf("%s baud shard=%u %s\n", event.status == FINGERPRINT_OK ? "ok" : "err",
+                  (unsigned)event.shard, event.message);
+  } else if (event.status == FINGERPRINT_NOFINGER) {
+    Serial.println("err image no finger");
+  } else {
+    Serial.printf("%s image to=%s %s\n", event.status == FINGERPRINT_OK ? "ok" : "err",
+                  event.slot == kImageToFile ? "file" : "serial", event.message);
+  }
+}
+
+/* Reply to "backup" or "restore"; a serial backup streams the archive first */
+void AdminConsole::FinishArchive(const SensorEvent& event) {
+  bool backup = (waiting_ == kWaitBackup);
+  const char* command = backup ? "backup" : "restore";
+  waiting_ = kWaitNone;
+  if (event.status != FINGERPRINT_OK) {
+    Serial.printf("err %s templates=%u\n", command, (unsigned)event.id);
+    return;
+  }
+
+  File archive = SPIFFS.open(TEMPLATE_ARCHIVE_PATH, "r");
+  uint32_t bytes = archive ? archive.size() : 0;
+  if (backup && archive_to_serial_) {
+    // The host reads exactly the announced size, so pad a short read
+    streaming_ = true;
+    Serial.printf("archive bytes=%u\n", (unsigned)bytes);
+    uint8_t chunk[64];
+    for (uint32_t left = bytes; left > 0;) {
+      size_t length = left < sizeof(chunk) ? left : sizeof(chunk);
+      size_t read = archive.read(chunk, length);
+      memset(chunk + read, 0, length - read);
+      Serial.write(chunk, length);
+      left -= length;
+    }
+    streaming_ = false;
+  }
+  archive.close();
+  Serial.printf("ok %s templates=%u skipped=%u bytes=%u ms=%u\n", command,
+                (unsigned)event.id, (unsigned)event.slot, (unsigned)bytes,
+                (unsigned)(event.pipeline_us / 1000));
+}
+
+/* Reply to "delete" once the last sensor run finished */
+void AdminConsole::FinishDelete() {
+  waiting_ = kWaitNone;
+  const BulkDeleteResult& result = bulk_delete.result();
+  if (result.failed_runs > 0) {
+    Serial.printf("err delete users=%u runs=%u failed=%u\n", (unsigned)result.users,
+                  (unsigned)result.runs, (unsigned)result.failed_runs);
+    return;
+  }
+  Serial.printf("ok delete users=%u runs=%u ms=%u\n", (unsigned)result.users,
+                (unsigned)result.runs, (unsigned)(result.elapsed_us / 1000));
+}
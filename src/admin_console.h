@@ -0,0 +1,134 @@
+// admin_console.h
+
+#ifndef ADMIN_CONSOLE_H_
+#define ADMIN_CONSOLE_H_
+
+#include <Arduino.h>
+#include <FS.h>
+#include "sensor_client.h"
+#include "sensor_task.h"
+#include "user_directory.h"
+
+// Set to 0 to accept only the performance commands on the USB serial port
+#ifndef ADMIN_CONSOLE
+#define ADMIN_CONSOLE 1
+#endif
+
+// Protocol limits
+const uint8_t kAdminLineLength = 80;          // Longest request line, excluding the newline
+const uint8_t kAdminBatchCapacity = 64;       // User lines one import frame may carry
+const uint32_t kAdminFrameTimeoutMs = 2000;   // Max gap between the lines of an import frame
+const uint32_t kAdminReplyTimeoutMs = 5000;   // Max wait for the sensor to answer a query
+const uint8_t kAdminIndexGroups = (kShardCapacity + 255) / 256;  // ReadIndex groups per shard
+
+/*
+ * Line-based administration protocol on the USB serial port.
+ *
+ * Every request is one line and gets exactly one reply line starting with
+ * "ok <command>" or "err <command>", followed by key=value fields:
+ *
+ *   count                      templates stored on each shard and users known
+ *   index <shard>              used-page bitmap of a shard, checked against the directory
+ *   export                     "ok export users=<n>", then n user lines
+ *   import <n>                 followed by n user lines, applied as one transaction
+ *   delete <first> <last>      every user with an ID in first..last
+ *   baud <shard> [max]         negotiate the fastest reliable sensor UART rate, up to max
+ *   image serial|file          capture a raw image to the console or IMAGE_CAPTURE_PATH
+ *   backup file|serial         every template and name to TEMPLATE_ARCHIVE_PATH, then to the console
+ *   restore file               store every template in TEMPLATE_ARCHIVE_PATH on its sensor
+ *   restore serial <n>         followed by n raw archive bytes, which replace the archive first
+ *   stages, stages reset       stage timing, see perf_stats.h
+ *   ui                         LVGL heap, screen transitions, touch latency and SPI bus use
+ *   render [frames|reset]      frame render and flush cost per screen and widget, see render_profile.h
+ *   render overlay on|off      show frame statistics on the panel
+ *   heap                       free heap, largest block, minimum free, task stack high-water
+ *   cache                      recently-matched cache hit rate, probe and search cost, time saved
+ *
+ * A user line is "user <id> <shard> <slot> <name>", so an export can be fed
+ * back as an import. An import frame is staged in RAM and validated as a
+ * whole; only then is it applied in one user store batch, so a bad line
+ * leaves the store untouched. Range deletes go through BulkDelete. The host
+ * waits for each reply before sending the next request. A serial image is
+ * sent before its reply: an "image bytes=<n>" line followed by n raw bytes.
+ * A serial backup is sent the same way after an "archive bytes=<n>" line,
+ * and a restore serial reply comes once the uploaded archive is restored.
+ * While raw bytes may be on the port, streaming() is set: input waits, and
+ * the perf, boot and sensor event logs hold their lines until it clears.
+ * Restored users are saved like enrolled ones, so a new module can be
+ * loaded from a backup of the one it replaces.
+ */
+class AdminConsole {
+ public:
+  AdminConsole();
+
+  void Poll(uint32_t now_ms);                    // Read requests and finish pending ones
+  void OnSensorEvent(const SensorEvent& event);  // Template count, index and job replies
+  bool busy() const { return waiting_ != kWaitNone; }  // A request awaits the sensor
+  bool streaming() const { return streaming_; }  // Raw bytes own the port; hold other output
+
+ private:
+  enum Wait {
+    kWaitNone, kWaitCount, kWaitIndex, kWaitDelete, kWaitBaud, kWaitImage,
+    kWaitBackup, kWaitUpload, kWaitRestore
+  };
+
+  struct ImportEntry {
+    uint16_t id;
+    uint8_t shard;
+    uint16_t slot;
+    char name[kMaxUserNameLength + 1];
+  };
+
+  void HandleLine(const char* line, uint32_t now_ms);
+  void StartImport(const char* args, uint32_t now_ms);
+  void StageImportLine(const char* line, uint32_t now_ms);
+  void CommitImport();
+  void Export();
+  void StartCount(uint32_t now_ms);
+  void StartIndex(const char* args, uint32_t now_ms);
+  void StartDelete(const char* args, uint32_t now_ms);
+  void StartBaud(const char* args, uint32_t now_ms);
+  void StartImage(const char* args, uint32_t now_ms);
+  void StartBackup(const char* args, uint32_t now_ms);
+  void StartRestore(const char* args, uint32_t now_ms);
+  void ReceiveUpload(uint32_t now_ms);
+  void FinishCount();
+  void FinishIndex();
+  void FinishDelete();
+  void FinishJob(const SensorEvent& event);
+  void FinishArchive(const SensorEvent& event);
+
+  char line_[kAdminLineLength + 1];  // Request being received
+  uint8_t line_length_;
+  bool line_overflow_;               // Request too long; dropped at its newline
+
+  // Import frame being received
+  ImportEntry staged_[kAdminBatchCapacity];
+  uint8_t import_expected_;          // User lines announced, 0 when no frame is open
+  uint8_t import_received_;
+  uint8_t import_error_line_;        // First bad line, 0 if none
+  const char* import_error_;         // What was wrong with it
+  uint32_t last_line_ms_;
+
+  // Request waiting on the sensor task
+  Wait waiting_;
+  uint32_t wait_started_ms_;
+  uint16_t request_tag_;             // Sent as the id of count and index commands
+  uint8_t replies_pending_;
+  bool reply_failed_;                // A sensor command in the request failed
+  uint16_t templates_[kSensorShardCount];
+  uint8_t index_shard_;
+  uint8_t index_bits_[(kShardCapacity + 7) / 8];  // One bit per page, from ReadIndex
+  bool archive_to_serial_;           // Send the backup to the console once it is written
+  volatile bool streaming_;          // A serial image or archive is being sent; read on both cores
+
+  // Archive being received for "restore serial"
+  File upload_;
+  uint32_t upload_remaining_;        // Bytes still to come
+  uint32_t upload_received_;
+};
+
+// Console on the USB serial port
+extern AdminConsole admin_console;
+
+#endif  // ADMIN_CONSOLE_H_
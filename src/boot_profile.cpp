@@ -0,0 +1,60 @@
+// boot_profile.cpp
+
+#include "boot_profile.h"
+
+static BootPhaseTiming boot_phases[kBootPhaseCount];
+static bool boot_profile_printed = false;
+
+static const char* const kBootPhaseNames[kBootPhaseCount] = {
+  "serial", "display", "mount", "calibrate", "ui", "store", "sensor"
+};
+
+/* Mark the start of a phase */
+void BootPhaseStart(BootPhase phase) {
+  boot_phases[phase].start_us = micros();
+  boot_phases[phase].end_us = 0;
+}
+
+/* Mark the end of a phase; never 0, so a finished phase always reads as done */
+void BootPhaseEnd(BootPhase phase) {
+  uint32_t now_us = micros();
+  boot_phases[phase].end_us = now_us != 0 ? now_us : 1;
+}
+
+/* True once the phase has ended */
+bool BootPhaseDone(BootPhase phase) {
+  return boot_phases[phase].end_us != 0;
+}
+
+/* Start and end of one phase */
+const BootPhaseTiming& GetBootPhase(BootPhase phase) {
+  return boot_phases[phase];
+}
+
+/* Name used in the printed profile */
+const char* BootPhaseName(BootPhase phase) {
+  return kBootPhaseNames[phase];
+}
+
+/* When the device could first serve a scan: both the store and the handshake are done */
+uint32_t BootReadyUs() {
+  if (!BootPhaseDone(kBootStore) || !BootPhaseDone(kBootSensor)) return 0;
+  uint32_t store_us = boot_phases[kBootStore].end_us;
+  uint32_t sensor_us = boot_phases[kBootSensor].end_us;
+  return store_us > sensor_us ? store_us : sensor_us;
+}
+
+/* Print every phase and the ready time, once */
+bool PrintBootProfile(bool sensor_online) {
+  if (boot_profile_printed || BootReadyUs() == 0) return false;
+  boot_profile_printed = true;
+
+  for (uint8_t i = 0; i < kBootPhaseCount; i++) {
+    const BootPhaseTiming& timing = boot_phases[i];
+    Serial.printf("boot %s start_us=%u us=%u\n", kBootPhaseNames[i], (unsigned)timing.start_us,
+                  (unsigned)(timing.end_us - timing.start_us));
+  }
+  Serial.printf("boot ready us=%u sensor=%s\n", (unsigned)BootReadyUs(),
+                sensor_online ? "online" : "offline");
+  return true;
+}
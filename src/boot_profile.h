@@ -0,0 +1,43 @@
+// boot_profile.h
+
+#ifndef BOOT_PROFILE_H_
+#define BOOT_PROFILE_H_
+
+#include <Arduino.h>
+
+// Boot phases, in the order they start
+enum BootPhase {
+  kBootSerial,     // USB serial and the sensor UARTs
+  kBootDisplay,    // TFT init and DMA setup
+  kBootMount,      // The single SPIFFS mount, formatting on first boot
+  kBootCalibrate,  // Touch calibration, read from SPIFFS or run interactively
+  kBootUi,         // LVGL, the widgets and the first frame on the panel
+  kBootStore,      // User log replay and access log resume (UI core)
+  kBootSensor,     // Sensor handshake (sensor task, overlaps kBootStore)
+  kBootPhaseCount
+};
+
+/* micros() at both ends of one phase; end_us is 0 until it finished */
+struct BootPhaseTiming {
+  uint32_t start_us;
+  uint32_t end_us;
+};
+
+/*
+ * Boot-time profile, printed once the device can scan.
+ *
+ * Every phase is written by one task only, so the store phase on core 1 and
+ * the sensor handshake on core 0 can overlap. Once both are done the profile
+ * goes out as one "boot <phase> start_us=<t> us=<d>" line per phase and a
+ * "boot ready us=<t> sensor=online|offline" line: the time to first scan,
+ * or to the degraded screen when the sensor does not answer.
+ */
+void BootPhaseStart(BootPhase phase);
+void BootPhaseEnd(BootPhase phase);
+bool BootPhaseDone(BootPhase phase);
+const BootPhaseTiming& GetBootPhase(BootPhase phase);
+const char* BootPhaseName(BootPhase phase);
+uint32_t BootReadyUs();                    // End of the later of store and sensor, 0 until then
+bool PrintBootProfile(bool sensor_online);  // Print once both are done; true when printed
+
+#endif  // BOOT_PROFILE_H_
@@ -0,0 +1,156 @@
+// bulk_delete.cpp
+
+#include "bulk_delete.h"
+#include "user_store.h"
+
+#include <Adafruit_Fingerprint.h>
+
+BulkDelete bulk_delete;
+
+BulkDelete::BulkDelete()
+    : selected_count_(0), next_shard_(0), next_page_(0), busy_(false), started_us_(0) {
+  memset(selected_, 0, sizeof(selected_));
+  memset(pages_, 0, sizeof(pages_));
+  memset(empty_shard_, 0, sizeof(empty_shard_));
+  memset(&result_, 0, sizeof(result_));
+}
+
+/* Deselect everyone */
+void BulkDelete::Clear() {
+  memset(selected_, 0, sizeof(selected_));
+  selected_count_ = 0;
+}
+
+/* Add a user to the selection or take it out */
+void BulkDelete::Select(uint16_t id, bool selected) {
+  if (id == 0 || id > kMaxUserId || IsSelected(id) == selected) return;
+  uint8_t mask = (uint8_t)(1 << (id % 8));
+  if (selected) {
+    selected_[id / 8] |= mask;
+    selected_count_++;
+  } else {
+    selected_[id / 8] &= (uint8_t)~mask;
+    selected_count_--;
+  }
+}
+
+/* Select every user present in first..last */
+void BulkDelete::SelectRange(uint16_t first, uint16_t last) {
+  if (first == 0) first = 1;
+  for (uint16_t id = user_directory.NextId(first - 1); id != 0 && id <= last;
+       id = user_directory.NextId(id)) {
+    Select(id);
+  }
+}
+
+/* True if the user is part of the selection */
+bool BulkDelete::IsSelected(uint16_t id) const {
+  if (id > kMaxUserId) return false;
+  return (selected_[id / 8] & (1 << (id % 8))) != 0;
+}
+
+/* Remove the selection from the store in one commit and start clearing its templates */
+bool BulkDelete::Start() {
+  if (busy_) return false;
+  memset(&result_, 0, sizeof(result_));
+  if (selected_count_ == 0) return false;
+  if (!user_store.BeginBatch()) {
+    result_.store_failed = true;
+    return false;
+  }
+
+  memset(pages_, 0, sizeof(pages_));
+  started_us_ = micros();
+
+  // Mark the template pages first, while the directory still knows them
+  uint16_t loads[kSensorShardCount];
+  uint16_t doomed[kSensorShardCount] = {};
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    loads[shard] = user_directory.ShardLoad(shard);
+  }
+  for (uint16_t id = user_directory.NextId(0); id != 0; id = user_directory.NextId(id)) {
+    if (!IsSelected(id)) continue;
+    uint8_t shard = 0;
+    uint16_t slot = 0;
+    if (user_directory.Locate(id, &shard, &slot) && slot < kShardCapacity) {
+      pages_[shard][slot / 8] |= (uint8_t)(1 << (slot % 8));
+      doomed[shard]++;
+    }
+    user_store.Remove(id);
+    result_.users++;
+  }
+  Clear();
+  if (!user_store.CommitBatch()) {
+    // Flash still holds every user; put them back in RAM and leave their templates alone
+    user_store.AbortBatch();
+    result_.users = 0;
+    result_.store_failed = true;
+    Serial.println(F("Failed to commit bulk delete"));
+    return false;
+  }
+
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    empty_shard_[shard] = doomed[shard] > 0 && doomed[shard] == loads[shard];
+  }
+  next_shard_ = 0;
+  next_page_ = 0;
+  busy_ = SendNextRun();
+  if (!busy_) result_.elapsed_us = micros() - started_us_;
+  return true;
+}
+
+/* Send the next run of pages to clear; false once every shard is done */
+bool BulkDelete::SendNextRun() {
+  while (next_shard_ < kSensorShardCount) {
+    uint8_t shard = next_shard_;
+    const uint8_t* pages = pages_[shard];
+    uint16_t first = next_page_;
+
+    if (empty_shard_[shard]) {
+      // Every template on the shard goes: one command clears the library
+      empty_shard_[shard] = false;
+      next_shard_++;
+      next_page_ = 0;
+      result_.runs++;
+      if (SendSensorCommand(kCmdEmpty, kBulkDeleteTag, shard)) return true;
+      result_.failed_runs++;
+      continue;
+    }
+
+    while (first < kShardCapacity && !(pages[first / 8] & (1 << (first % 8)))) first++;
+    if (first == kShardCapacity) {
+      next_shard_++;
+      next_page_ = 0;
+      continue;
+    }
+
+    // Extend the run over marked pages and pages nobody owns, then trim the free tail
+    uint16_t end = first + 1;
+    while (end < kShardCapacity && ((pages[end / 8] & (1 << (end % 8))) ||
+                                    user_directory.IdAt(shard, end) == 0)) {
+      end++;
+    }
+    while (!(pages[(end - 1) / 8] & (1 << ((end - 1) % 8)))) end--;
+    next_page_ = end;
+
+    result_.runs++;
+    if (SendSensorCommand(kCmdDelete, kBulkDeleteTag, shard, first, end - first)) return true;
+    result_.failed_runs++;
+  }
+  return false;
+}
+
+/* Count a finished run and send the next one */
+bool BulkDelete::OnSensorEvent(const SensorEvent& event) {
+  if (event.type != kEvtDeleteDone || event.id != kBulkDeleteTag || !busy_) return false;
+  if (event.status != FINGERPRINT_OK) result_.failed_runs++;
+
+  busy_ = SendNextRun();
+  if (!busy_) {
+    result_.elapsed_us = micros() - started_us_;
+    Serial.printf("bulk delete users=%u runs=%u failed=%u ms=%u\n", (unsigned)result_.users,
+                  (unsigned)result_.runs, (unsigned)result_.failed_runs,
+                  (unsigned)(result_.elapsed_us / 1000));
+  }
+  return true;
+}
@@ -0,0 +1,68 @@
+// bulk_delete.h
+
+#ifndef BULK_DELETE_H_
+#define BULK_DELETE_H_
+
+#include <Arduino.h>
+#include "sensor_task.h"
+#include "user_directory.h"
+
+// ID carried by the sensor commands of a bulk delete; single deletes carry the user ID
+const uint16_t kBulkDeleteTag = 0;
+
+/* Outcome of the latest bulk delete */
+struct BulkDeleteResult {
+  uint16_t users;        // Users removed from the store
+  uint16_t runs;         // Sensor commands sent, one per contiguous page run or emptied shard
+  uint16_t failed_runs;  // Of those, commands that were dropped or rejected
+  uint32_t elapsed_us;   // Start() until the last sensor command finished
+  bool store_failed;     // The store could not persist the removal; nothing was deleted
+};
+
+/*
+ * Deletes a selection of users with as little flash and UART traffic as
+ * possible.
+ *
+ * Start() removes every selected user from the store inside one batch, so
+ * the user log is rewritten once however many users go. Their template
+ * pages are then cleared per shard in contiguous runs, one DeleteModel per
+ * run, or with a single EmptyLibrary when every template on a shard goes.
+ * A run may span pages no user owns, so IDs spread over shards still cost
+ * one command per shard. Runs are sent through the sensor task one at a
+ * time from the completion of the previous one, so a large selection never
+ * overflows its queue. If the batch cannot be committed, the store is
+ * reloaded from its log and no template is touched.
+ */
+class BulkDelete {
+ public:
+  BulkDelete();
+
+  void Clear();                                 // Deselect everyone
+  void Select(uint16_t id, bool selected = true);
+  void SelectRange(uint16_t first, uint16_t last);  // Every present user in first..last
+  bool IsSelected(uint16_t id) const;
+  uint16_t SelectedCount() const { return selected_count_; }
+
+  bool Start();  // Delete the selection; false if none, busy or the store failed
+  bool OnSensorEvent(const SensorEvent& event);  // Feed kEvtDeleteDone; true if it was ours
+  bool busy() const { return busy_; }
+  const BulkDeleteResult& result() const { return result_; }
+
+ private:
+  bool SendNextRun();
+
+  uint8_t selected_[kMaxUserId / 8 + 1];                   // One bit per user ID
+  uint8_t pages_[kSensorShardCount][(kShardCapacity + 7) / 8];  // Pages left to clear
+  bool empty_shard_[kSensorShardCount];  // Clear the whole shard with one command
+  uint16_t selected_count_;
+  uint8_t next_shard_;                   // Where the search for the next run resumes
+  uint16_t next_page_;
+  bool busy_;
+  uint32_t started_us_;
+  BulkDeleteResult result_;
+};
+
+// Bulk delete shared by the Delete screen and the admin console
+extern BulkDelete bulk_delete;
+
+#endif  // BULK_DELETE_H_
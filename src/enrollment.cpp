@@ -0,0 +1,279 @@
+// enrollment.cpp
+
+#include "enrollment.h"
+#include "hardware.h"
+#include "sensor_shards.h"
+
+// Enrollment machine driving the shared sensor
+Enrollment enrollment(sensor_client);
+
+Enrollment::Enrollment(SensorClient& sensor)
+    : sensor_(sensor), state_(kEnrollIdle), id_(0), shard_(kCaptureShard), slot_(0),
+      entered_ms_(0), last_poll_ms_(0), awaiting_(false), reply_ready_(false),
+      reply_status_(0), stale_replies_(0), template_length_(0) {
+  name_[0] = '\0';
+  message_[0] = '\0';
+}
+
+/* Begin enrolling a user onto a shard's page; the old template is deleted on the first tick */
+void Enrollment::Start(uint16_t id, uint8_t shard, uint16_t slot, const char* name,
+                       uint32_t now_ms) {
+  Stop();
+  id_ = id;
+  strncpy(name_, name, kMaxUserNameLength);
+  name_[kMaxUserNameLength] = '\0';
+  shard_ = shard < kSensorShardCount ? shard : kCaptureShard;
+  slot_ = slot;
+  Enter(kEnrollDeleteOld, now_ms);
+}
+
+/* Client of the shard the template is stored on */
+SensorClient& Enrollment::target() const {
+  return *sensor_shards[shard_];
+}
+
+/* Abort the enrollment from any state */
+void Enrollment::Cancel() {
+  if (!active()) return;
+  Serial.println("Enrollment cancelled.");
+  Stop();
+  state_ = kEnrollCancelled;
+  snprintf(message_, sizeof(message_), "Enrollment cancelled.");
+}
+
+/* Forget the command in flight; its reply will be dropped on arrival */
+void Enrollment::Stop() {
+  if (awaiting_) stale_replies_++;
+  awaiting_ = false;
+  reply_ready_ = false;
+}
+
+/* Completion callback from the sensor client */
+void Enrollment::OnReply(const SensorReply& reply, void* context) {
+  Enrollment* self = (Enrollment*)context;
+  if (self->stale_replies_ > 0) {
+    self->stale_replies_--;
+    return;
+  }
+  self->awaiting_ = false;
+  self->reply_ready_ = true;
+  self->reply_status_ = reply.status;
+}
+
+/* UpChar data from the capture shard */
+void Enrollment::StoreTemplateChunk(const uint8_t* data, uint16_t length, void* context) {
+  Enrollment* self = (Enrollment*)context;
+  uint16_t room = kSensorTemplateBytes - self->template_length_;
+  if (length > room) length = room;
+  memcpy(&self->template_[self->template_length_], data, length);
+  self->template_length_ += length;
+}
+
+/* DownChar data for the storing shard */
+uint16_t Enrollment::ReadTemplateChunk(uint8_t* data, uint16_t length, void* context) {
+  Enrollment* self = (Enrollment*)context;
+  uint16_t remaining = kSensorTemplateBytes - self->template_length_;
+  if (length > remaining) length = remaining;
+  memcpy(data, &self->template_[self->template_length_], length);
+  self->template_length_ += length;
+  return length;
+}
+
+/* Switch state and update the prompt shown for it */
+void Enrollment::Enter(EnrollState state, uint32_t now_ms) {
+  state_ = state;
+  entered_ms_ = now_ms;
+  last_poll_ms_ = now_ms - kEnrollPollIntervalMs;  // Poll on the next tick
+
+  switch (state) {
+    case kEnrollDeleteOld:
+    case kEnrollWaitFirst:
+      snprintf(message_, sizeof(message_), "Place finger to enroll as ID #%d", id_);
+      break;
+    case kEnrollConvert1:
+    case kEnrollConvert2:
+    case kEnrollCreate:
+    case kEnrollUpload:
+    case kEnrollDownload:
+    case kEnrollStore:
+      snprintf(message_, sizeof(message_), "Image taken, processing...");
+      break;
+    case kEnrollWaitLift:
+      snprintf(message_, sizeof(message_), "Remove finger and place it again.");
+      break;
+    case kEnrollWaitSecond:
+      snprintf(message_, sizeof(message_), "Place the same finger again.");
+      break;
+    case kEnrollDone:
+      snprintf(message_, sizeof(message_), "Fingerprint enrolled successfully as ID #%d", id_);
+      break;
+    default:
+      break;
+  }
+}
+
+/* Stop with an error message */
+void Enrollment::Fail(const char* reason) {
+  Serial.println(reason);
+  Stop();
+  state_ = kEnrollFailed;
+  snprintf(message_, sizeof(message_), "%s", reason);
+}
+
+/* Deadline for a state, measured from when it was entered */
+uint32_t Enrollment::TimeoutFor(EnrollState state) const {
+  switch (state) {
+    case kEnrollWaitFirst:
+    case kEnrollWaitSecond:
+      return kEnrollFingerTimeoutMs;
+    case kEnrollWaitLift:
+      return kEnrollLiftTimeoutMs;
+    default:
+      return kEnrollCommandTimeoutMs;
+  }
+}
+
+/* Submit the sensor command for the current state */
+bool Enrollment::IssueCommand() {
+  switch (state_) {
+    case kEnrollDeleteOld:
+      Serial.print("Deleting fingerprint for ID #");
+      Serial.println(id_);
+      return target().DeleteModel(slot_, 1, OnReply, this);
+    case kEnrollWaitFirst:
+    case kEnrollWaitLift:
+    case kEnrollWaitSecond:
+      return sensor_.GetImage(OnReply, this);
+    case kEnrollConvert1:
+      return sensor_.Image2Tz(1, OnReply, this);
+    case kEnrollConvert2:
+      return sensor_.Image2Tz(2, OnReply, this);
+    case kEnrollCreate:
+      return sensor_.CreateModel(OnReply, this);
+    case kEnrollUpload:
+      template_length_ = 0;
+      return sensor_.UploadChar(1, StoreTemplateChunk, this, OnReply, this);
+    case kEnrollDownload:
+      template_length_ = 0;
+      return target().DownloadChar(1, ReadTemplateChunk, this, OnReply, this);
+    case kEnrollStore:
+      return target().StoreModel(slot_, 1, OnReply, this);
+    default:
+      return false;
+  }
+}
+
+/* Move to the next state based on the reply to the current state's command */
+void Enrollment::HandleReply(uint8_t p, uint32_t now_ms) {
+  switch (state_) {
+    case kEnrollDeleteOld:
+      if (p == FINGERPRINT_OK) {
+        Serial.println("Existing fingerprint deleted.");
+      } else {
+        Serial.println("No existing fingerprint to delete.");
+      }
+      Enter(kEnrollWaitFirst, now_ms);
+      break;
+
+    case kEnrollWaitFirst:
+    case kEnrollWaitSecond:
+      if (p == FINGERPRINT_OK) {
+        Serial.println("Image taken");
+        Enter(state_ == kEnrollWaitFirst ? kEnrollConvert1 : kEnrollConvert2, now_ms);
+      } else if (p != FINGERPRINT_NOFINGER && p != FINGERPRINT_IMAGEFAIL) {
+        Fail("Error capturing image.");
+      }
+      break;
+
+    case kEnrollConvert1:
+      if (p == FINGERPRINT_OK) {
+        Serial.println("Remove finger and place it again.");
+        Enter(kEnrollWaitLift, now_ms);
+      } else {
+        Fail("Failed to process image.");
+      }
+      break;
+
+    case kEnrollWaitLift:
+      if (p == FINGERPRINT_NOFINGER) Enter(kEnrollWaitSecond, now_ms);
+      break;
+
+    case kEnrollConvert2:
+      if (p == FINGERPRINT_OK) {
+        Enter(kEnrollCreate, now_ms);
+      } else {
+        Fail("Failed to capture second image.");
+      }
+      break;
+
+    case kEnrollCreate:
+      if (p != FINGERPRINT_OK) {
+        Fail("Fingerprints did not match.");
+      } else {
+        Enter(shard_ == kCaptureShard ? kEnrollStore : kEnrollUpload, now_ms);
+      }
+      break;
+
+    case kEnrollUpload:
+      if (p == FINGERPRINT_OK && template_length_ == kSensorTemplateBytes) {
+        Enter(kEnrollDownload, now_ms);
+      } else {
+        Fail("Failed to read template from sensor.");
+      }
+      break;
+
+    case kEnrollDownload:
+      if (p == FINGERPRINT_OK) {
+        Enter(kEnrollStore, now_ms);
+      } else {
+        Fail("Failed to copy template to storage sensor.");
+      }
+      break;
+
+    case kEnrollStore:
+      if (p == FINGERPRINT_OK) {
+        Serial.println("Fingerprint enrolled successfully.");
+        Enter(kEnrollDone, now_ms);
+      } else {
+        Fail("Failed to store fingerprint.");
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/* Advance the machine: consume a reply or submit at most one command */
+bool Enrollment::Tick(uint32_t now_ms) {
+  if (!active()) return false;
+
+  EnrollState previous = state_;
+
+  if (now_ms - entered_ms_ > TimeoutFor(state_)) {
+    Fail(state_ == kEnrollWaitLift ? "Timed out waiting for finger removal."
+                                   : "Timed out, please try again.");
+    return true;
+  }
+
+  // The client enforces the per-command timeout; just wait for the reply
+  if (awaiting_) return false;
+
+  if (reply_ready_) {
+    reply_ready_ = false;
+    HandleReply(reply_status_, now_ms);
+    return state_ != previous;
+  }
+
+  // Waiting states poll the sensor at a fixed rate instead of every tick
+  bool waiting = state_ == kEnrollWaitFirst || state_ == kEnrollWaitLift ||
+                 state_ == kEnrollWaitSecond;
+  if (waiting) {
+    if (now_ms - last_poll_ms_ < kEnrollPollIntervalMs) return false;
+    last_poll_ms_ = now_ms;
+  }
+
+  // A full client queue just means trying again on the next tick
+  awaiting_ = IssueCommand();
+  return false;
+}
@@ -0,0 +1,95 @@
+// enrollment.h
+
+#ifndef ENROLLMENT_H_
+#define ENROLLMENT_H_
+
+#include <Arduino.h>
+#include "sensor_client.h"
+#include "user_directory.h"
+
+// Enrollment timing
+const uint32_t kEnrollPollIntervalMs = 100;     // Gap between getImage polls while waiting
+const uint32_t kEnrollFingerTimeoutMs = 15000;  // Max wait for a finger to be placed
+const uint32_t kEnrollLiftTimeoutMs = 10000;    // Max wait for the finger to be lifted
+const uint32_t kEnrollCommandTimeoutMs = 5000;  // Max time to get a command acknowledged
+
+// Enrollment states, in the order a successful enrollment visits them
+enum EnrollState {
+  kEnrollIdle,        // No enrollment running
+  kEnrollDeleteOld,   // Remove any template already stored under the ID
+  kEnrollWaitFirst,   // Poll for the first finger placement
+  kEnrollConvert1,    // Extract features of the first image into buffer 1
+  kEnrollWaitLift,    // Poll until the finger is lifted
+  kEnrollWaitSecond,  // Poll for the second finger placement
+  kEnrollConvert2,    // Extract features of the second image into buffer 2
+  kEnrollCreate,      // Combine both buffers into a model
+  kEnrollUpload,      // Read the model back when another shard stores it
+  kEnrollDownload,    // Write the model into the storing shard's buffer 1
+  kEnrollStore,       // Store the model on its shard and page
+  kEnrollDone,        // Template stored successfully
+  kEnrollFailed,      // Aborted by an error or timeout, see message()
+  kEnrollCancelled    // Aborted from the UI
+};
+
+/*
+ * Tick-driven fingerprint enrollment.
+ *
+ * Each call to Tick() either submits one sensor command through the async
+ * client or consumes its reply, so the sensor task never blocks on the UART.
+ * Every state has a deadline, and Cancel() stops the machine from any state;
+ * a reply still on the wire at that point is discarded when it arrives.
+ *
+ * Images are always captured on the capture shard. When the template
+ * belongs on another shard, the model is copied across with UpChar and
+ * DownChar before it is stored there.
+ */
+class Enrollment {
+ public:
+  Enrollment(SensorClient& sensor);
+
+  void Start(uint16_t id, uint8_t shard, uint16_t slot, const char* name,
+             uint32_t now_ms);                 // Begin enrolling a named user
+  void Cancel();                             // Abort from any state
+  bool Tick(uint32_t now_ms);                // Advance; true if the state changed
+
+  EnrollState state() const { return state_; }
+  uint16_t id() const { return id_; }
+  uint8_t shard() const { return shard_; }
+  uint16_t slot() const { return slot_; }
+  const char* name() const { return name_; }  // User the template is enrolled for
+  bool active() const { return state_ > kEnrollIdle && state_ < kEnrollDone; }
+  const char* message() const { return message_; }  // Prompt for the current state
+
+ private:
+  static void OnReply(const SensorReply& reply, void* context);
+  static void StoreTemplateChunk(const uint8_t* data, uint16_t length, void* context);
+  static uint16_t ReadTemplateChunk(uint8_t* data, uint16_t length, void* context);
+  SensorClient& target() const;
+  bool IssueCommand();
+  void HandleReply(uint8_t status, uint32_t now_ms);
+  void Enter(EnrollState state, uint32_t now_ms);
+  void Fail(const char* reason);
+  void Stop();
+  uint32_t TimeoutFor(EnrollState state) const;
+
+  SensorClient& sensor_;
+  EnrollState state_;
+  uint16_t id_;
+  uint8_t shard_;          // Shard the template is stored on
+  uint16_t slot_;          // Template page on that shard
+  char name_[kMaxUserNameLength + 1];
+  uint32_t entered_ms_;    // millis() when the current state was entered
+  uint32_t last_poll_ms_;  // millis() of the last getImage poll
+  bool awaiting_;          // A command for this run is on the wire
+  bool reply_ready_;       // reply_status_ holds an unconsumed reply
+  uint8_t reply_status_;
+  uint8_t stale_replies_;  // Replies still owed to cancelled runs
+  uint16_t template_length_;  // Bytes of template_ uploaded or downloaded
+  uint8_t template_[kSensorTemplateBytes];  // Model on its way to another shard
+  char message_[64];
+};
+
+// Enrollment machine driving the shared sensor
+extern Enrollment enrollment;
+
+#endif  // ENROLLMENT_H_
@@ -0,0 +1,91 @@
+// finger_detect.cpp
+
+#include "finger_detect.h"
+#include "hardware.h"
+
+// Detector used by the sensor task
+FingerDetector finger_detector;
+
+// Callback run from the wake ISR to rouse the sensor task
+static void (*wake_callback)() = NULL;
+
+/* GPIO interrupt on the sensor's touch/wake output */
+static void IRAM_ATTR WakeISR() {
+  finger_detector.OnEdge(micros());
+  if (wake_callback != NULL) wake_callback();
+}
+
+FingerDetector::FingerDetector()
+    : wake_pin_(-1), edge_pending_(false), edge_us_(0), edge_seen_(false), active_(false),
+      awaiting_capture_(false), backoff_ms_(kFingerPollMinMs) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+/* Attach the wake interrupt, or stay in polling mode when wake_pin is -1 */
+void FingerDetector::Begin(int8_t wake_pin, void (*on_wake)()) {
+  wake_pin_ = wake_pin;
+  wake_callback = on_wake;
+  if (wake_pin_ < 0) {
+    Serial.println("No finger wake line, polling with backoff");
+    return;
+  }
+
+  pinMode(wake_pin_, INPUT);
+  attachInterrupt(digitalPinToInterrupt(wake_pin_), WakeISR, FINGER_WAKE_EDGE);
+}
+
+/* Re-arm detection; the first pass checks for a finger already present */
+void FingerDetector::Reset() {
+  edge_pending_ = false;
+  active_ = true;
+  awaiting_capture_ = false;
+  backoff_ms_ = kFingerPollMinMs;
+}
+
+/* Record a wake edge, dropping contact bounce; safe to call from interrupt context */
+void IRAM_ATTR FingerDetector::OnEdge(uint32_t now_us) {
+  if (edge_seen_ && now_us - edge_us_ < kFingerDebounceUs) {
+    stats_.bounces++;
+    return;
+  }
+  edge_us_ = now_us;
+  edge_seen_ = true;
+  edge_pending_ = true;
+}
+
+/* Consume a pending edge and report whether a capture pass is due */
+bool FingerDetector::BeginPass() {
+  if (edge_pending_) {
+    edge_pending_ = false;
+    stats_.edges++;
+    if (!active_) awaiting_capture_ = true;
+    active_ = true;
+  }
+  return active_ || !has_wake_line();
+}
+
+/* Update detection state from the getImage outcome of a pass */
+void FingerDetector::OnCaptureResult(bool finger_present, uint32_t now_us) {
+  if (finger_present) {
+    stats_.captures++;
+    if (awaiting_capture_) {
+      stats_.time_to_capture.Add(now_us - edge_us_);
+      awaiting_capture_ = false;
+    }
+    active_ = true;
+    backoff_ms_ = kFingerPollMinMs;
+    return;
+  }
+
+  // Nobody on the sensor: this poll was idle traffic
+  stats_.idle_polls++;
+  active_ = false;
+  awaiting_capture_ = false;
+  if (backoff_ms_ < kFingerPollMaxMs) backoff_ms_ *= 2;
+  if (backoff_ms_ > kFingerPollMaxMs) backoff_ms_ = kFingerPollMaxMs;
+}
+
+/* How long the sensor task may sleep before the next pass */
+uint32_t FingerDetector::IdleWaitMs() const {
+  return has_wake_line() ? kFingerWaitForever : backoff_ms_;
+}
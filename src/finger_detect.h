@@ -0,0 +1,64 @@
+// finger_detect.h
+
+#ifndef FINGER_DETECT_H_
+#define FINGER_DETECT_H_
+
+#include <Arduino.h>
+#include "perf_stats.h"
+
+// Detection timing
+const uint32_t kFingerPollMinMs = 20;          // First poll interval after activity
+const uint32_t kFingerPollMaxMs = 320;         // Backoff ceiling while nobody touches
+const uint32_t kFingerWaitForever = 0xFFFFFFFF;  // Sleep until the wake line fires
+const uint32_t kFingerDebounceUs = 5000;       // Edges this soon after the last one are bounce
+const uint32_t kGetImageExchangeBytes = 24;    // 12-byte command + 12-byte ack on the UART
+
+/* Counters describing how much sensor traffic detection causes */
+struct FingerDetectStats {
+  uint32_t edges;              // Wake edges seen
+  uint32_t bounces;            // Edges dropped within kFingerDebounceUs of the previous one
+  uint32_t idle_polls;         // getImage calls that found no finger
+  uint32_t captures;           // getImage calls that found a finger
+  LatencyStat time_to_capture; // Wake edge to first successful capture
+};
+
+/*
+ * Decides when the sensor task should run a capture pass.
+ *
+ * With a wake line the task sleeps until an edge, captures while the finger
+ * stays down and sleeps again once it lifts. Without one, getImage is polled
+ * with an interval that doubles on every empty poll up to kFingerPollMaxMs.
+ * The wake output chatters as the finger settles, so edges closer than
+ * kFingerDebounceUs to the last accepted one are dropped. Edges come from the GPIO interrupt on hardware or from OnEdge() directly
+ * when simulated.
+ */
+class FingerDetector {
+ public:
+  FingerDetector();
+
+  void Begin(int8_t wake_pin, void (*on_wake)());  // Attach the wake ISR, -1 to poll
+  void Reset();                                    // Re-arm when scanning starts
+  void OnEdge(uint32_t now_us);                    // Wake edge, ISR safe
+  bool BeginPass();                                // True if a capture pass is due
+  void OnCaptureResult(bool finger_present, uint32_t now_us);  // Feed the getImage outcome
+  uint32_t IdleWaitMs() const;                     // Sleep allowed before the next pass
+
+  bool has_wake_line() const { return wake_pin_ >= 0; }
+  bool active() const { return active_; }
+  const FingerDetectStats& stats() const { return stats_; }
+
+ private:
+  int8_t wake_pin_;
+  volatile bool edge_pending_;   // Set by the ISR, consumed by BeginPass()
+  volatile uint32_t edge_us_;    // micros() of the latest accepted edge
+  volatile bool edge_seen_;      // edge_us_ is valid
+  bool active_;                  // Finger believed to be on the sensor
+  bool awaiting_capture_;        // Edge seen, first capture not yet timed
+  uint32_t backoff_ms_;          // Current polling interval
+  FingerDetectStats stats_;
+};
+
+// Detector used by the sensor task
+extern FingerDetector finger_detector;
+
+#endif  // FINGER_DETECT_H_
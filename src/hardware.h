@@ -9,30 +9,60 @@
 #include <Adafruit_Fingerprint.h>      // Library for fingerprint sensor
 #include <TFT_eSPI.h>                  // TFT display library
 #include <ArduinoJson.h>               // JSON library
+#include "sensor_client.h"             // Non-blocking sensor protocol client
+#include "user_directory.h"            // User ID and shard sizing
 
 // Hardware pin definitions
 #define RX_PIN 25    // Fingerprint sensor RX pin
 #define TX_PIN 33    // Fingerprint sensor TX pin
 #define TOUCH_CS 21  // Touch screen chip select pin
 
+// Touch controller pen IRQ output (T_IRQ); -1 when not wired (falls back to polling)
+#ifndef TOUCH_IRQ_PIN
+#define TOUCH_IRQ_PIN -1
+#endif
+
+// Second fingerprint sensor module on UART1 (SENSOR_SHARDS=2)
+#ifndef SHARD1_RX_PIN
+#define SHARD1_RX_PIN 26
+#endif
+#ifndef SHARD1_TX_PIN
+#define SHARD1_TX_PIN 27
+#endif
+
+// Fingerprint sensor touch/wake output; -1 when not wired (falls back to polling)
+#ifndef FINGER_WAKE_PIN
+#define FINGER_WAKE_PIN -1
+#endif
+#ifndef FINGER_WAKE_EDGE
+#define FINGER_WAKE_EDGE RISING  // Edge the wake output makes when touched
+#endif
+
 // Extern declarations for hardware instances
 extern TFT_eSPI tft;                 // TFT display instance
 extern HardwareSerial mySerial;      // Hardware serial for fingerprint sensor
-extern Adafruit_Fingerprint finger;  // Fingerprint sensor instance
+extern SensorClient sensor_client;   // Async client for the capture sensor (shard 0)
+#if SENSOR_SHARDS > 1
+extern HardwareSerial shard_serial;  // Hardware serial for the second sensor module
+extern SensorClient shard_client;    // Async client for the second sensor module (shard 1)
+#endif
 
 // Screen resolution constants
 const uint32_t kScreenWidth = 320;   // Screen width in pixels
 const uint32_t kScreenHeight = 240;  // Screen height in pixels
 
+// Height of each LVGL draw buffer in lines; override with -D DRAW_BUF_LINES=<n>
+#ifndef DRAW_BUF_LINES
+#define DRAW_BUF_LINES 20
+#endif
+const uint32_t kDrawBufLines = DRAW_BUF_LINES;
+
 // Function declarations for hardware-related functions
 void TouchCalibrate();                // Function to calibrate touch screen
-void InitializeHardware();            // Function to initialize hardware components
-uint8_t GetFingerprintID();           // Function to get the fingerprint ID
-void DeleteUserFromJSON(uint8_t id);  // Function to delete user data from JSON file
-void SaveUserToJSON(uint8_t id, const char* name);  // Function to save user data to JSON file
-const char* GetUserNameByID(uint8_t id);            // Function to get user name by ID
-String ReadUsersFromJSON();           // Function to read users from JSON file
-String GetUserListForDropdown();      // Function to get user list for dropdown menu
-void DeleteFingerprint(uint8_t id);   // Function to delete fingerprint from sensor
+void InitializeHardware();            // Function to initialize what the first frame needs
+void LoadUserData();                  // Function to load users and the access log from SPIFFS
+void DeleteUser(uint16_t id);         // Function to delete user data from the user store
+void SaveUser(uint16_t id, const char* name, uint8_t shard, uint16_t slot);  // Function to save user data and template location
+const char* GetUserNameByID(uint16_t id);     // Function to get user name by ID
 
 #endif  // HARDWARE_H_
@@ -0,0 +1,76 @@
+// image_stream.cpp
+
+#include "image_stream.h"
+#include "hardware.h"
+#include "sensor_baud.h"
+#include "sensor_shards.h"
+
+/* Upload progress straight into the destination stream */
+struct ImageSinkState {
+  Stream* out;
+  ImageStreamStats* stats;
+};
+
+static void WriteImageChunk(const uint8_t* data, uint16_t length, void* context) {
+  ImageSinkState* state = (ImageSinkState*)context;
+  uint32_t room = kSensorImageBytes - state->stats->bytes;
+  if (length > room) length = (uint16_t)room;  // Never past the announced size
+  state->out->write(data, length);
+  state->stats->bytes += length;
+  state->stats->packets++;
+}
+
+/* Wait for a finger and take its picture into the sensor's image buffer */
+static bool CaptureImage(SensorClient& sensor, ImageStreamStats* stats) {
+  uint32_t waited_from_ms = millis();
+  for (;;) {
+    uint32_t started_ms = millis();
+    uint8_t p = sensor.Call(FINGERPRINT_GETIMAGE, NULL, 0, kSensorDefaultTimeoutMs);
+    if (p == FINGERPRINT_OK) {
+      stats->capture_ms = millis() - started_ms;
+      return true;
+    }
+    if (p != FINGERPRINT_NOFINGER || millis() - waited_from_ms > kImageFingerWaitMs) return false;
+    delay(kImagePollMs);
+  }
+}
+
+/* Capture one image on the capture sensor and stream it to the destination */
+bool StreamSensorImage(ImageDestination destination, ImageStreamStats* stats) {
+  memset(stats, 0, sizeof(ImageStreamStats));
+  SensorClient& sensor = *sensor_shards[kCaptureShard];
+  stats->baud = SensorBaud(kCaptureShard);
+  if (!CaptureImage(sensor, stats)) return false;
+
+  File file;
+  Stream* out = &Serial;
+  if (destination == kImageToFile) {
+    file = SPIFFS.open(IMAGE_CAPTURE_PATH, "w");
+    if (!file) return false;
+    out = &file;
+  } else {
+    Serial.printf("image bytes=%u width=%u height=%u bpp=4\n", (unsigned)kSensorImageBytes,
+                  (unsigned)kSensorImageWidth, (unsigned)kSensorImageHeight);
+  }
+
+  ImageSinkState state = {out, stats};
+  uint32_t started_ms = millis();
+  uint8_t p = sensor.Call(FINGERPRINT_UPIMAGE, NULL, 0, kSensorDefaultTimeoutMs, NULL,
+                          WriteImageChunk, NULL, &state);
+  stats->transfer_ms = millis() - started_ms;
+  bool ok = p == FINGERPRINT_OK && stats->bytes == kSensorImageBytes;
+
+  if (destination == kImageToFile) {
+    file.close();
+    if (!ok) SPIFFS.remove(IMAGE_CAPTURE_PATH);  // No half images left behind
+  } else {
+    // The host reads exactly the announced size, so pad a broken transfer
+    static const uint8_t kPadding[kSensorDataPacketBytes] = {};
+    for (uint32_t left = kSensorImageBytes - stats->bytes; left > 0;) {
+      uint32_t length = left < sizeof(kPadding) ? left : sizeof(kPadding);
+      Serial.write(kPadding, length);
+      left -= length;
+    }
+  }
+  return ok;
+}
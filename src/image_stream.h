@@ -0,0 +1,51 @@
+// image_stream.h
+
+#ifndef IMAGE_STREAM_H_
+#define IMAGE_STREAM_H_
+
+#include <Arduino.h>
+#include "sensor_client.h"
+
+// Where a file capture goes on SPIFFS; each capture replaces the last one
+#define IMAGE_CAPTURE_PATH "/image.raw"
+
+// Capture settings
+const uint32_t kImageFingerWaitMs = 10000;  // How long a capture waits for a finger
+const uint32_t kImagePollMs = 50;           // getImage interval while waiting
+
+// Destinations of a raw image
+enum ImageDestination {
+  kImageToSerial = 0,  // USB serial port: an "image bytes=" line, then the raw bitmap
+  kImageToFile = 1     // IMAGE_CAPTURE_PATH
+};
+
+/* Outcome of one capture */
+struct ImageStreamStats {
+  uint32_t bytes;        // Bitmap bytes received from the sensor
+  uint16_t packets;      // Data packets they came in
+  uint32_t baud;         // Rate of the capture sensor's UART
+  uint32_t capture_ms;   // The getImage that took the picture
+  uint32_t transfer_ms;  // UpImage, from command to end packet
+
+  // Captures a minute the link sustains once a finger is down, in tenths
+  uint32_t PerMinuteX10() const {
+    uint32_t ms = capture_ms + transfer_ms;
+    return ms ? 600000 / ms : 0;
+  }
+};
+
+/*
+ * Raw fingerprint image capture for investigating false rejects.
+ *
+ * Waits for a finger on the capture sensor, takes a picture with getImage
+ * and streams the image buffer out with UpImage. Each data packet is
+ * written to the destination as it arrives, so the 36 KB bitmap is never
+ * held in RAM. A serial capture is announced with an "image bytes=<n>
+ * width=<w> height=<h> bpp=4" line and always followed by exactly n bytes,
+ * zero-padded if the transfer broke off. Runs on the sensor task and blocks
+ * it for the duration; the UART's RX buffer (kSensorRxBufferBytes) absorbs
+ * the packets that arrive while a flash write is in progress.
+ */
+bool StreamSensorImage(ImageDestination destination, ImageStreamStats* stats);
+
+#endif  // IMAGE_STREAM_H_
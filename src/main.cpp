@@ -12,18 +12,30 @@
  * the configurations specified in hardware.h.
  */
 
+#include "access_log.h"
+#include "admin_console.h"
+#include "boot_profile.h"
 #include "hardware.h"
+#include "perf_stats.h"
+#include "render_profile.h"
+#include "sensor_task.h"
+#include "touch_input.h"
 #include "ui.h"
+#include "user_store.h"
 #include <lvgl.h>
 
 /* Main setup function */
 void setup() {
-  // Initialize hardware components
+  // Initialize what the first frame needs: serial ports, display, SPIFFS and touch
   InitializeHardware();
 
+  BootPhaseStart(kBootUi);
+  // LVGL renders pre-swapped pixels unless LV_COLOR_16_SWAP is disabled
+  tft.setSwapBytes(LV_COLOR_16_SWAP == 0);
+
   // Initialize LVGL library
   lv_init();
-  lv_disp_draw_buf_init(&draw_buf, buf, NULL, kScreenWidth * 10);
+  lv_disp_draw_buf_init(&draw_buf, buf1, buf2, kScreenWidth * kDrawBufLines);
 
   // Set up the display driver
   static lv_disp_drv_t disp_drv;
@@ -32,32 +44,52 @@ void setup() {
   disp_drv.ver_res = kScreenHeight;
   disp_drv.flush_cb = MyDispFlush;
   disp_drv.draw_buf = &draw_buf;
+  render_profiler.Attach(&disp_drv, RenderSceneName);  // Frame cost per screen
   lv_disp_drv_register(&disp_drv);
 
-  // Set up the touch input device driver
+  // Set up the touch input device driver, fed from the pen IRQ line when wired
+  touch_input.Begin(TOUCH_IRQ_PIN);
   static lv_indev_drv_t indev_drv;
   lv_indev_drv_init(&indev_drv);
   indev_drv.type = LV_INDEV_TYPE_POINTER;
   indev_drv.read_cb = LVGLPortTPRead;
   lv_indev_drv_register(&indev_drv);
 
-  // Set up the UI components
+  // Set up the UI components and put the first frame on the panel
   SetupUI();
+  if (RENDER_OVERLAY) render_profiler.SetOverlay(true);
+  lv_timer_handler();
+  BootPhaseEnd(kBootUi);
+  RunDisplayBenchmark();
+
+  // Move the sensor pipeline onto the other core; it handshakes while the users load here
+  StartSensorTask();
+  LoadUserData();
 }
 
-/* Main loop function */
+/* Main loop function, runs the UI task on core 1 */
 void loop() {
+  // Sample the touch panel between DMA transfers, before LVGL reads it
+  touch_input.Poll(millis());
+
   // Refresh LVGL GUI
+  uint32_t frame_start_us = micros();
   lv_timer_handler();
-  delay(5);
+  uint32_t frame_end_us = micros();
+  frame_time_stat.Add(frame_end_us - frame_start_us);
+  render_profiler.OnHandler(frame_end_us - frame_start_us, frame_end_us);
+
+  // Apply scan and enrollment results from the sensor task
+  ProcessSensorEvents();
 
-  // If in scanning mode, continuously check fingerprint
-  if (scanning_mode) {
-    ScanFingerprint();
-  }
+  // Write queued user changes to flash in the background
+  user_store.Poll(millis());
+  access_log.Poll(millis());
 
-  // If in enrolling mode, handle fingerprint enrollment
-  if (enrolling_mode) {
-    HandleFingerprintEnrollment();
-  }
+  PollPerfLog(millis());
+  render_profiler.Poll(millis());
+
+  // Serve admin and performance requests typed on the USB serial port
+  admin_console.Poll(millis());
+  delay(5);
 }
@@ -0,0 +1,118 @@
+// match_cache.cpp
+
+#include "match_cache.h"
+
+// Cache consulted by the sensor task's scans
+MatchCache match_cache((MatchCachePolicy)MATCH_CACHE_POLICY, kMatchCacheSize);
+
+MatchCache::MatchCache(MatchCachePolicy policy, uint8_t size) {
+  Reset(policy, size);
+}
+
+/* Start over with another policy or size; the stats restart too */
+void MatchCache::Reset(MatchCachePolicy policy, uint8_t size) {
+  policy_ = policy;
+  size_ = size < kMatchCacheMaxSize ? size : kMatchCacheMaxSize;
+  memset(&stats_, 0, sizeof(stats_));
+  memset(kind_probes_, 0, sizeof(kind_probes_));
+  memset(kind_probe_us_, 0, sizeof(kind_probe_us_));
+  passes_ = 0;
+  memset(rank_hits_, 0, sizeof(rank_hits_));
+  Clear();
+}
+
+/* Forget every cached template */
+void MatchCache::Clear() {
+  count_ = 0;
+  matches_ = 0;
+}
+
+/* Count a scan pass, the denominator of every rank's hit rate */
+void MatchCache::BeginPass() {
+  if (size_ == 0 || passes_ == 0xFFFF) return;
+  passes_++;
+}
+
+/* Rank a template that a scan just matched, found by a search taking search_us or by a probe (0) */
+void MatchCache::OnMatch(uint8_t shard, uint16_t slot, uint32_t search_us) {
+  if (size_ == 0) return;
+
+  // Old counts fade so the cache follows who comes in now
+  if (++matches_ >= kMatchCacheAgingMatches) {
+    for (uint8_t i = 0; i < count_; i++) entries_[i].hits /= 2;
+    for (uint8_t rank = 0; rank < kMatchCacheMaxSize; rank++) rank_hits_[rank] /= 2;
+    passes_ /= 2;
+    matches_ = 0;
+  }
+
+  for (uint8_t rank = 0; rank < count_; rank++) {
+    if (entries_[rank].shard == shard && entries_[rank].slot == slot) {
+      if (rank_hits_[rank] < passes_) rank_hits_[rank]++;  // A probe here would have hit
+      if (entries_[rank].hits < 0xFFFF) entries_[rank].hits++;
+      if (search_us != 0) entries_[rank].search_us = search_us;
+      Promote(rank);
+      return;
+    }
+  }
+
+  if (count_ == size_) count_--;  // The last entry is the one the policy ranks lowest
+  MatchCacheEntry& entry = entries_[count_];
+  entry.shard = shard;
+  entry.slot = slot;
+  entry.hits = 1;
+  entry.search_us = search_us;
+  Promote(count_++);
+}
+
+/* Move an entry up: to the front when ranking by recency, past fewer or equal hits otherwise */
+void MatchCache::Promote(uint8_t rank) {
+  MatchCacheEntry entry = entries_[rank];
+  while (rank > 0 &&
+         (policy_ == kMatchCacheRecent || entries_[rank - 1].hits <= entry.hits)) {
+    entries_[rank] = entries_[rank - 1];
+    rank--;
+  }
+  entries_[rank] = entry;
+}
+
+/* Drop the entries for a run of deleted pages, keeping the order of the rest */
+void MatchCache::Remove(uint8_t shard, uint16_t first_slot, uint16_t count) {
+  uint8_t kept = 0;
+  for (uint8_t rank = 0; rank < count_; rank++) {
+    const MatchCacheEntry& entry = entries_[rank];
+    bool deleted = entry.shard == shard && entry.slot >= first_slot &&
+                   (uint32_t)entry.slot < (uint32_t)first_slot + count;
+    if (!deleted) entries_[kept++] = entry;
+  }
+  count_ = kept;
+}
+
+/* True if probing the entry at rank stays within budget and is expected to save time */
+bool MatchCache::ProbeFits(uint8_t rank, uint32_t spent_us, bool moves_features) const {
+  uint8_t kind = moves_features ? 1 : 0;
+  uint32_t probe_us = kind_probes_[kind] ? (uint32_t)(kind_probe_us_[kind] / kind_probes_[kind])
+                                         : 0;  // Not timed yet: try one
+  if (spent_us + probe_us > kMatchCacheBudgetUs) return false;
+
+  // A hit saves the search that found the entry; the hit rate is counted
+  // from one hit in two passes so a fresh cache gets a chance
+  uint32_t search_us = entries_[rank].search_us;
+  return (uint64_t)search_us * (rank_hits_[rank] + 1) >= (uint64_t)probe_us * (passes_ + 2);
+}
+
+void MatchCache::AddLookup(bool hit) {
+  stats_.lookups++;
+  if (hit) stats_.hits++;
+}
+
+void MatchCache::AddProbe(uint32_t us, bool moved_features) {
+  stats_.probes++;
+  stats_.probe_us += us;
+  kind_probes_[moved_features ? 1 : 0]++;
+  kind_probe_us_[moved_features ? 1 : 0] += us;
+}
+
+void MatchCache::AddSearch(uint32_t us) {
+  stats_.searches++;
+  stats_.search_us += us;
+}
@@ -0,0 +1,117 @@
+// match_cache.h
+
+#ifndef MATCH_CACHE_H_
+#define MATCH_CACHE_H_
+
+#include <Arduino.h>
+
+// Templates of recently matched users tried 1:1 before a full search; 0 disables
+#ifndef MATCH_CACHE_SIZE
+#define MATCH_CACHE_SIZE 8
+#endif
+
+// Order in which cached templates are tried and evicted: 0 most recent, 1 most frequent
+#ifndef MATCH_CACHE_POLICY
+#define MATCH_CACHE_POLICY 0
+#endif
+
+// Time a scan pass may spend on cached templates before it searches the library
+#ifndef MATCH_CACHE_BUDGET_MS
+#define MATCH_CACHE_BUDGET_MS 150
+#endif
+
+// Cache sizing
+const uint8_t kMatchCacheMaxSize = 32;             // Largest MATCH_CACHE_SIZE, kept for traces
+const uint8_t kMatchCacheSize = MATCH_CACHE_SIZE;
+const uint32_t kMatchCacheBudgetUs = (uint32_t)MATCH_CACHE_BUDGET_MS * 1000;
+const uint16_t kMatchCacheAgingMatches = 256;      // Hit counts are halved after this many matches
+static_assert(MATCH_CACHE_SIZE <= kMatchCacheMaxSize, "MATCH_CACHE_SIZE must be at most 32");
+
+// Which cached template goes first and which one is evicted
+enum MatchCachePolicy {
+  kMatchCacheRecent = 0,   // Least recently matched is evicted
+  kMatchCacheFrequent = 1  // Fewest matches is evicted; one-off visitors do not push out regulars
+};
+
+/* A cached template location and how often it matched */
+struct MatchCacheEntry {
+  uint8_t shard;
+  uint16_t slot;
+  uint16_t hits;       // Matches since it entered the cache, halved every kMatchCacheAgingMatches
+  uint32_t search_us;  // Time the library search took to find it, which a hit saves
+};
+
+/* Counters describing what the cache saved */
+struct MatchCacheStats {
+  uint32_t lookups;       // Scan passes that tried at least one cached template
+  uint32_t hits;          // Of those, passes answered by a cached template
+  uint32_t probes;        // 1:1 matches run
+  uint64_t probe_us;      // Time spent in them
+  uint32_t skips;         // Passes that left entries untried, short of time or expected gain
+  uint32_t searches;      // Full library searches run
+  uint64_t search_us;     // Time spent in them
+
+  uint32_t MeanSearchUs() const { return searches ? (uint32_t)(search_us / searches) : 0; }
+  uint32_t MeanProbeUs() const { return probes ? (uint32_t)(probe_us / probes) : 0; }
+
+  // Searches avoided by hits, less every probe that ran; negative while the cache costs time
+  int64_t SavedUs() const {
+    return (int64_t)hits * MeanSearchUs() - (int64_t)probe_us;
+  }
+};
+
+/*
+ * Short list of template locations that matched recently, kept in the order
+ * they should be tried.
+ *
+ * A scan pass walks the list with 1:1 matches and falls back to the full
+ * library search on a miss. ProbeFits() skips a probe that would overrun
+ * the time budget, or whose expected saving is negative: OnMatch() notes at
+ * which rank every matched template sat, probed or not, and a rank is only
+ * worth probing while its hit rate times the time the search took to find
+ * that entry's template exceeds the mean probe time. Probes that first
+ * have to move the capture's features to another sensor module cost far
+ * more than local ones, so the two are timed apart. The list holds at
+ * most kMatchCacheSize entries and is reordered on every match, so the
+ * front is always the best candidate. Only the sensor task touches it.
+ */
+class MatchCache {
+ public:
+  MatchCache(MatchCachePolicy policy, uint8_t size);
+
+  void Reset(MatchCachePolicy policy, uint8_t size);  // Empty it, clear the stats
+  void Clear();                                       // Forget every entry, keep the stats
+  void BeginPass();                                   // A scan pass is about to look up
+  void OnMatch(uint8_t shard, uint16_t slot, uint32_t search_us);  // The pass matched it
+  void Remove(uint8_t shard, uint16_t first_slot, uint16_t count);  // Templates deleted
+
+  bool ProbeFits(uint8_t rank, uint32_t spent_us, bool moves_features) const;
+  void AddLookup(bool hit);
+  void AddProbe(uint32_t us, bool moved_features);
+  void AddSkip() { stats_.skips++; }
+  void AddSearch(uint32_t us);
+
+  uint8_t count() const { return count_; }
+  const MatchCacheEntry& at(uint8_t rank) const { return entries_[rank]; }
+  MatchCachePolicy policy() const { return policy_; }
+  const MatchCacheStats& stats() const { return stats_; }
+
+ private:
+  void Promote(uint8_t rank);  // Move an entry up to where the policy ranks it
+
+  MatchCachePolicy policy_;
+  uint8_t size_;
+  uint8_t count_;
+  uint16_t matches_;  // Since the last aging pass
+  uint32_t kind_probes_[2];   // Local probes, then probes that moved the features first
+  uint64_t kind_probe_us_[2];
+  uint16_t passes_;                           // Scan passes seen, halved with the hit counts
+  uint16_t rank_hits_[kMatchCacheMaxSize];    // Of those, matched the entry at each rank
+  MatchCacheEntry entries_[kMatchCacheMaxSize];
+  MatchCacheStats stats_;
+};
+
+// Cache consulted by the sensor task's scans
+extern MatchCache match_cache;
+
+#endif  // MATCH_CACHE_H_
@@ -0,0 +1,170 @@
+// perf_stats.cpp
+
+#include "perf_stats.h"
+
+#include <lvgl.h>
+
+#include "admin_console.h"
+#include "finger_detect.h"
+#include "match_cache.h"
+#include "render_profile.h"
+#include "sensor_task.h"
+#include "spi_bus.h"
+#include "stage_timing.h"
+#include "touch_input.h"
+#include "ui_binding.h"
+
+LatencyStat frame_time_stat;
+LatencyStat scan_pipeline_stat;
+LatencyStat scan_latency_stat;
+uint32_t flushed_pixels = 0;
+LatencyStat screen_build_stat;
+LatencyStat screen_load_stat;
+LatencyStat touch_to_flush_stat;
+
+/* Print one stat as "name count mean max" */
+static void PrintStat(const char* name, const LatencyStat& stat) {
+  Serial.printf("perf %s n=%u mean_us=%u max_us=%u\n", name, (unsigned)stat.count,
+                (unsigned)stat.MeanUs(), (unsigned)stat.max_us);
+}
+
+/* Print heap headroom and the stack high-water mark of each task */
+static void PrintHeap() {
+  // A heap that stays flat keeps free and largest steady; min_free only ever falls
+  Serial.printf("perf heap free=%u largest=%u min_free=%u\n", (unsigned)ESP.getFreeHeap(),
+                (unsigned)ESP.getMaxAllocHeap(), (unsigned)ESP.getMinFreeHeap());
+  Serial.printf("perf stack task=ui free_min=%u\n", (unsigned)uxTaskGetStackHighWaterMark(NULL));
+  Serial.printf("perf stack task=sensor free_min=%u\n", (unsigned)SensorTaskStackHighWater());
+}
+
+/* Print touch activity and what kept the shared SPI bus busy */
+static void PrintTouch() {
+  const TouchStats& touch = touch_input.stats();
+  const SpiBusStats& bus = spi_bus.stats();
+  Serial.printf("perf touch irq=%u presses=%u samples=%u rejected=%u\n",
+                touch_input.has_irq_line() ? 1 : 0, (unsigned)touch.presses,
+                (unsigned)touch.samples, (unsigned)touch.rejected);
+  Serial.printf("perf bus display_us=%u touch_reads=%u touch_us=%u touch_deferred=%u "
+                "dma_waits=%u\n",
+                (unsigned)bus.DisplayUs(), (unsigned)bus.touch_reads, (unsigned)bus.touch_us,
+                (unsigned)bus.touch_deferred, (unsigned)bus.dma_waits);
+  PrintStat("touch_to_flush", touch_to_flush_stat);
+}
+
+/* Print how often the recently-matched cache answered a scan and the time it saved */
+static void PrintMatchCache() {
+  // Counters are cumulative and written by the sensor task
+  const MatchCacheStats& cache = match_cache.stats();
+  Serial.printf("perf cache policy=%s size=%u entries=%u lookups=%u hits=%u hit_pct=%u "
+                "skips=%u\n",
+                match_cache.policy() == kMatchCacheFrequent ? "frequent" : "recent",
+                (unsigned)kMatchCacheSize, (unsigned)match_cache.count(),
+                (unsigned)cache.lookups, (unsigned)cache.hits,
+                (unsigned)(cache.lookups ? cache.hits * 100 / cache.lookups : 0),
+                (unsigned)cache.skips);
+  Serial.printf("perf cache probes=%u probe_mean_us=%u searches=%u search_mean_us=%u "
+                "saved_ms=%d\n",
+                (unsigned)cache.probes, (unsigned)cache.MeanProbeUs(), (unsigned)cache.searches,
+                (unsigned)cache.MeanSearchUs(), (int)(cache.SavedUs() / 1000));
+}
+
+/* Print and reset the stats every PERF_LOG_INTERVAL_MS */
+void PollPerfLog(uint32_t now_ms) {
+#if PERF_LOG_INTERVAL_MS > 0
+  static uint32_t last_log_ms = 0;
+  uint32_t elapsed_ms = now_ms - last_log_ms;
+  if (elapsed_ms < PERF_LOG_INTERVAL_MS || admin_console.streaming()) return;
+  last_log_ms = now_ms;
+
+  PrintStat("frame", frame_time_stat);
+  PrintStat("scan_pipeline", scan_pipeline_stat);
+  PrintStat("scan_latency", scan_latency_stat);
+  Serial.printf("perf flush pixels_per_s=%u labels_applied=%u labels_suppressed=%u\n",
+                (unsigned)((uint64_t)flushed_pixels * 1000 / elapsed_ms),
+                (unsigned)ui_binding_stats.applied, (unsigned)ui_binding_stats.suppressed);
+
+  // Detection counters are cumulative and written by the sensor task
+  const FingerDetectStats& detect = finger_detector.stats();
+  Serial.printf("perf detect edges=%u bounces=%u idle_polls=%u idle_uart_bytes=%u captures=%u\n",
+                (unsigned)detect.edges, (unsigned)detect.bounces, (unsigned)detect.idle_polls,
+                (unsigned)(detect.idle_polls * kGetImageExchangeBytes),
+                (unsigned)detect.captures);
+  PrintStat("time_to_capture", detect.time_to_capture);
+
+  const ScanSessionStats& session = GetScanSessionStats();
+  Serial.printf("perf session placements=%u searches=%u max_per_placement=%u\n",
+                (unsigned)session.placements, (unsigned)session.searches,
+                (unsigned)session.max_searches);
+  PrintMatchCache();
+  PrintTouch();
+  PrintHeap();
+
+  frame_time_stat.Reset();
+  scan_pipeline_stat.Reset();
+  scan_latency_stat.Reset();
+  flushed_pixels = 0;
+  touch_to_flush_stat.Reset();
+  spi_bus.ResetStats();
+#else
+  (void)now_ms;
+#endif
+}
+
+/* Run a console command that reports performance data */
+bool RunPerfCommand(const char* line) {
+  if (strcmp(line, "stages") == 0) {
+#if STAGE_TIMING
+    DumpStageHistograms();
+#else
+    Serial.println("stages disabled, build with STAGE_TIMING=1");
+#endif
+    return true;
+  }
+  if (strcmp(line, "stages reset") == 0) {
+#if STAGE_TIMING
+    ResetStageHistograms();
+#endif
+    Serial.println("stages reset");
+    return true;
+  }
+  if (strcmp(line, "ui") == 0) {
+    // LVGL heap in bytes; max_used is the high-water mark since boot
+    lv_mem_monitor_t mem;
+    lv_mem_monitor(&mem);
+    Serial.printf("perf ui heap_used=%u heap_max_used=%u free_biggest=%u frag_pct=%u\n",
+                  (unsigned)(mem.total_size - mem.free_size), (unsigned)mem.max_used,
+                  (unsigned)mem.free_biggest_size, (unsigned)mem.frag_pct);
+    PrintStat("screen_build", screen_build_stat);
+    PrintStat("screen_load", screen_load_stat);
+    PrintTouch();
+    return true;
+  }
+  if (strcmp(line, "render") == 0) {
+    render_profiler.Dump();
+    PrintStat("touch_to_flush", touch_to_flush_stat);
+    return true;
+  }
+  if (strcmp(line, "render frames") == 0) {
+    render_profiler.DumpFrames();
+    return true;
+  }
+  if (strcmp(line, "render reset") == 0) {
+    render_profiler.Reset();
+    Serial.println("render reset");
+    return true;
+  }
+  if (strcmp(line, "render overlay on") == 0 || strcmp(line, "render overlay off") == 0) {
+    render_profiler.SetOverlay(strcmp(line, "render overlay on") == 0);
+    Serial.printf("render overlay %s\n", render_profiler.overlay_shown() ? "on" : "off");
+    return true;
+  }
+  if (strcmp(line, "heap") == 0) {
+    PrintHeap();
+    return true;
+  }
+  if (strcmp(line, "cache") == 0) {
+    PrintMatchCache();
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,40 @@
+// perf_stats.h
+
+#ifndef PERF_STATS_H_
+#define PERF_STATS_H_
+
+#include <Arduino.h>
+
+// Interval between performance reports on Serial; 0 disables reporting
+#ifndef PERF_LOG_INTERVAL_MS
+#define PERF_LOG_INTERVAL_MS 0
+#endif
+
+/* Running count, mean and maximum of a duration in microseconds */
+struct LatencyStat {
+  uint32_t count;
+  uint64_t total_us;
+  uint32_t max_us;
+
+  void Add(uint32_t us) {
+    count++;
+    total_us += us;
+    if (us > max_us) max_us = us;
+  }
+  uint32_t MeanUs() const { return count ? (uint32_t)(total_us / count) : 0; }
+  void Reset() { count = 0; total_us = 0; max_us = 0; }
+};
+
+// Statistics updated from the UI task only
+extern LatencyStat frame_time_stat;     // Duration of each lv_timer_handler() call
+extern LatencyStat scan_pipeline_stat;  // Sensor time for a scan pass that produced a result
+extern LatencyStat scan_latency_stat;   // Scan pass start to label updated
+extern uint32_t flushed_pixels;         // Pixels sent to the panel by MyDispFlush()
+extern LatencyStat screen_build_stat;   // First visit of a screen: built, loaded and on the panel
+extern LatencyStat screen_load_stat;    // Later visits: loaded and on the panel
+extern LatencyStat touch_to_flush_stat; // Press seen (pen IRQ edge or first sample) to next flush
+
+void PollPerfLog(uint32_t now_ms);      // Print and reset the stats every interval
+bool RunPerfCommand(const char* line);  // Run "stages", "ui", "render", "heap", "cache", false if not one
+
+#endif  // PERF_STATS_H_
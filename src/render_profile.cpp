@@ -0,0 +1,242 @@
+// render_profile.cpp
+
+#include "render_profile.h"
+
+// Profiler of the one display
+RenderProfiler render_profiler;
+
+RenderProfiler::RenderProfiler()
+    : scene_fn_(NULL), in_frame_(false), frame_started_us_(0), history_next_(0), frames_(0),
+      scene_count_(0), widget_count_(0), handler_us_(0), handler_from_us_(0),
+      handler_to_us_(0), overlay_shown_(false), overlay_last_ms_(0), window_frames_(0),
+      window_render_us_(0), window_flush_us_(0), window_pushed_px_(0), last_touch_us_(0) {
+  memset(&frame_, 0, sizeof(frame_));
+  memset(history_, 0, sizeof(history_));
+  memset(scenes_, 0, sizeof(scenes_));
+  memset(widgets_, 0, sizeof(widgets_));
+}
+
+/* Hook the driver's refresh callbacks; the driver is registered afterwards */
+void RenderProfiler::Attach(lv_disp_drv_t* driver, RenderSceneFn scene) {
+#if RENDER_PROFILE
+  scene_fn_ = scene;
+  driver->render_start_cb = OnRenderStart;
+  driver->monitor_cb = OnMonitor;
+#else
+  (void)driver;
+  (void)scene;
+#endif
+}
+
+/* Time a widget from its first draw event to its last, children included */
+void RenderProfiler::TrackWidget(lv_obj_t* obj, const char* name) {
+#if RENDER_PROFILE
+  if (widget_count_ == kRenderWidgetMax) return;
+  RenderWidgetStats& widget = widgets_[widget_count_++];
+  widget.name = name;
+  widget.obj = obj;
+  lv_obj_add_event_cb(obj, OnWidgetDraw, LV_EVENT_DRAW_MAIN_BEGIN, &widget);
+  lv_obj_add_event_cb(obj, OnWidgetDraw, LV_EVENT_DRAW_POST_END, &widget);
+#else
+  (void)obj;
+  (void)name;
+#endif
+}
+
+void RenderProfiler::OnWidgetDraw(lv_event_t* e) {
+  RenderWidgetStats* widget = (RenderWidgetStats*)lv_event_get_user_data(e);
+  if (lv_event_get_code(e) == LV_EVENT_DRAW_MAIN_BEGIN) {
+    widget->started_us = micros();
+  } else if (widget->started_us != 0) {
+    widget->frame_us += micros() - widget->started_us;
+    widget->started_us = 0;
+  }
+}
+
+/* Invalidated areas are joined by now; count the ones that will be drawn */
+void RenderProfiler::OnRenderStart(lv_disp_drv_t* driver) {
+  RenderProfiler& self = render_profiler;
+  memset(&self.frame_, 0, sizeof(self.frame_));
+  self.frame_.scene = self.scene_fn_ ? self.scene_fn_() : "";
+
+  lv_disp_t* disp = _lv_refr_get_disp_refreshing();
+  if (disp != NULL) {
+    for (uint16_t i = 0; i < disp->inv_p; i++) {
+      if (!disp->inv_area_joined[i]) self.frame_.areas++;
+    }
+  }
+  self.in_frame_ = true;
+  self.frame_started_us_ = micros();
+}
+
+/* Account one stripe sent to the panel */
+void RenderProfiler::OnFlush(uint32_t pixels, uint32_t flush_us, uint32_t touch_us) {
+  if (!in_frame_) return;
+  frame_.flush_us += flush_us;
+  frame_.pushed_px += pixels;
+  if (frame_.flushes < 0xFF) frame_.flushes++;
+  if (touch_us != 0 && frame_.touch_us == 0) frame_.touch_us = touch_us;
+}
+
+/* LVGL's end of refresh; px is the area of the invalidated regions */
+void RenderProfiler::OnMonitor(lv_disp_drv_t* driver, uint32_t time_ms, uint32_t px) {
+  RenderProfiler& self = render_profiler;
+  if (!self.in_frame_) return;
+  uint32_t span_us = micros() - self.frame_started_us_;
+  self.frame_.render_us = span_us > self.frame_.flush_us ? span_us - self.frame_.flush_us : 0;
+  self.frame_.invalid_px = px;
+  self.EndFrame();
+}
+
+/* Fold the finished frame into the totals, its scene, its widgets and the history */
+void RenderProfiler::EndFrame() {
+  in_frame_ = false;
+  frames_++;
+  render_.Add(frame_.render_us);
+  flush_.Add(frame_.flush_us);
+
+  RenderSceneStats* scene = FindScene(frame_.scene);
+  if (scene != NULL) {
+    scene->render.Add(frame_.render_us);
+    scene->flush.Add(frame_.flush_us);
+    scene->invalid_px += frame_.invalid_px;
+    scene->pushed_px += frame_.pushed_px;
+  }
+
+  for (uint8_t i = 0; i < widget_count_; i++) {
+    if (widgets_[i].frame_us == 0) continue;
+    widgets_[i].draw.Add(widgets_[i].frame_us);
+    widgets_[i].frame_us = 0;
+  }
+
+  history_[history_next_] = frame_;
+  history_next_ = (history_next_ + 1) % kRenderFrameHistory;
+
+  window_frames_++;
+  window_render_us_ += frame_.render_us;
+  window_flush_us_ += frame_.flush_us;
+  window_pushed_px_ += frame_.pushed_px;
+  if (frame_.touch_us != 0) last_touch_us_ = frame_.touch_us;
+}
+
+/* Scene record for a name, added on first sight; NULL once the table is full */
+RenderSceneStats* RenderProfiler::FindScene(const char* name) {
+  for (uint8_t i = 0; i < scene_count_; i++) {
+    if (scenes_[i].name == name || strcmp(scenes_[i].name, name) == 0) return &scenes_[i];
+  }
+  if (scene_count_ == kRenderSceneMax) return NULL;
+  RenderSceneStats* scene = &scenes_[scene_count_++];
+  memset(scene, 0, sizeof(*scene));
+  scene->name = name;
+  return scene;
+}
+
+/* Time spent in lv_timer_handler() against the time the UI task ran */
+void RenderProfiler::OnHandler(uint32_t handler_us, uint32_t now_us) {
+  if (handler_from_us_ == 0) handler_from_us_ = now_us - handler_us;
+  handler_to_us_ = now_us;
+  handler_us_ += handler_us;
+}
+
+/* Show or hide the overlay, creating its label on first use */
+void RenderProfiler::SetOverlay(bool shown) {
+  if (shown && overlay_text_.obj() == NULL) {
+    lv_obj_t* label = lv_label_create(lv_layer_top());
+    lv_obj_set_style_bg_color(label, lv_color_black(), 0);
+    lv_obj_set_style_bg_opa(label, LV_OPA_70, 0);
+    lv_obj_set_style_text_color(label, lv_color_white(), 0);
+    lv_obj_set_style_pad_all(label, 2, 0);
+    overlay_text_.Bind(label);
+    overlay_text_.SetText("render: waiting");
+    overlay_text_.Align(LV_ALIGN_BOTTOM_RIGHT, 0, 0);
+  }
+  overlay_shown_ = shown;
+  if (overlay_text_.obj() != NULL) overlay_text_.SetVisible(shown);
+  overlay_last_ms_ = millis();
+  window_frames_ = 0;
+  window_render_us_ = 0;
+  window_flush_us_ = 0;
+  window_pushed_px_ = 0;
+}
+
+/* Rewrite the overlay with the frames drawn since its last refresh */
+void RenderProfiler::Poll(uint32_t now_ms) {
+  if (!overlay_shown_) return;
+  uint32_t elapsed_ms = now_ms - overlay_last_ms_;
+  if (elapsed_ms < kRenderOverlayMs) return;
+
+  uint32_t frames = window_frames_;
+  overlay_text_.SetTextFmt("%u fps r %u f %u us\n%u px/f t2f %u ms",
+                           (unsigned)(frames * 1000 / elapsed_ms),
+                           (unsigned)(frames ? window_render_us_ / frames : 0),
+                           (unsigned)(frames ? window_flush_us_ / frames : 0),
+                           (unsigned)(frames ? window_pushed_px_ / frames : 0),
+                           (unsigned)(last_touch_us_ / 1000));
+  overlay_last_ms_ = now_ms;
+  window_frames_ = 0;
+  window_render_us_ = 0;
+  window_flush_us_ = 0;
+  window_pushed_px_ = 0;
+}
+
+/* Print totals as "perf render", then one "perf render_scene" and "perf render_widget" each */
+void RenderProfiler::Dump() {
+#if RENDER_PROFILE
+  uint32_t wall_us = handler_to_us_ - handler_from_us_;
+  Serial.printf("perf render frames=%u render_mean_us=%u render_max_us=%u flush_mean_us=%u "
+                "flush_max_us=%u handler_pct=%u overlay=%u\n",
+                (unsigned)frames_, (unsigned)render_.MeanUs(), (unsigned)render_.max_us,
+                (unsigned)flush_.MeanUs(), (unsigned)flush_.max_us,
+                (unsigned)(wall_us ? handler_us_ * 100 / wall_us : 0),
+                overlay_shown_ ? 1 : 0);
+  for (uint8_t i = 0; i < scene_count_; i++) {
+    const RenderSceneStats& scene = scenes_[i];
+    uint32_t frames = scene.render.count;
+    Serial.printf("perf render_scene scene=%s frames=%u render_mean_us=%u render_max_us=%u "
+                  "flush_mean_us=%u flush_max_us=%u invalid_px=%u pushed_px=%u\n",
+                  scene.name, (unsigned)frames, (unsigned)scene.render.MeanUs(),
+                  (unsigned)scene.render.max_us, (unsigned)scene.flush.MeanUs(),
+                  (unsigned)scene.flush.max_us,
+                  (unsigned)(frames ? scene.invalid_px / frames : 0),
+                  (unsigned)(frames ? scene.pushed_px / frames : 0));
+  }
+  for (uint8_t i = 0; i < widget_count_; i++) {
+    const RenderWidgetStats& widget = widgets_[i];
+    Serial.printf("perf render_widget widget=%s frames=%u draw_mean_us=%u draw_max_us=%u\n",
+                  widget.name, (unsigned)widget.draw.count, (unsigned)widget.draw.MeanUs(),
+                  (unsigned)widget.draw.max_us);
+  }
+#else
+  Serial.println("render disabled, build with RENDER_PROFILE=1");
+#endif
+}
+
+/* Print the recent frames as one "perf frame" line each, oldest first */
+void RenderProfiler::DumpFrames() {
+  uint8_t count = frames_ < kRenderFrameHistory ? (uint8_t)frames_ : kRenderFrameHistory;
+  uint8_t first = (history_next_ + kRenderFrameHistory - count) % kRenderFrameHistory;
+  for (uint8_t i = 0; i < count; i++) {
+    const RenderFrame& frame = history_[(first + i) % kRenderFrameHistory];
+    Serial.printf("perf frame scene=%s render_us=%u flush_us=%u areas=%u invalid_px=%u "
+                  "pushed_px=%u flushes=%u touch_us=%u\n",
+                  frame.scene, (unsigned)frame.render_us, (unsigned)frame.flush_us,
+                  (unsigned)frame.areas, (unsigned)frame.invalid_px, (unsigned)frame.pushed_px,
+                  (unsigned)frame.flushes, (unsigned)frame.touch_us);
+  }
+}
+
+/* Forget every frame; tracked widgets stay tracked */
+void RenderProfiler::Reset() {
+  frames_ = 0;
+  history_next_ = 0;
+  scene_count_ = 0;
+  render_.Reset();
+  flush_.Reset();
+  for (uint8_t i = 0; i < widget_count_; i++) {
+    widgets_[i].draw.Reset();
+    widgets_[i].frame_us = 0;
+  }
+  handler_us_ = 0;
+  handler_from_us_ = 0;
+  handler_to_us_ = 0;
+}
@@ -0,0 +1,134 @@
+// render_profile.h
+
+#ifndef RENDER_PROFILE_H_
+#define RENDER_PROFILE_H_
+
+#include <Arduino.h>
+#include <lvgl.h>
+#include "perf_stats.h"
+#include "ui_binding.h"
+
+// Set to 0 to leave LVGL's refresh cycle unhooked; "render" then reports nothing
+#ifndef RENDER_PROFILE
+#define RENDER_PROFILE 1
+#endif
+
+// Set to 1 to show the render overlay from boot; "render overlay on|off" toggles it
+#ifndef RENDER_OVERLAY
+#define RENDER_OVERLAY 0
+#endif
+
+// Profiler sizes
+const uint8_t kRenderSceneMax = 12;        // Distinct scenes tracked; later ones go unattributed
+const uint8_t kRenderWidgetMax = 6;        // Widgets whose draw time is tracked
+const uint8_t kRenderFrameHistory = 32;    // Most recent frames kept for "render frames"
+const uint32_t kRenderOverlayMs = 500;     // Overlay refresh interval
+
+/* Name of what is on screen, for attributing a frame; must return static strings */
+typedef const char* (*RenderSceneFn)();
+
+/* One LVGL refresh, from render start to the last stripe flushed */
+struct RenderFrame {
+  const char* scene;
+  uint32_t render_us;      // Drawing into the buffers, flushes excluded
+  uint32_t flush_us;       // Spent in MyDispFlush()
+  uint32_t invalid_px;     // Area of the invalidated regions after joining
+  uint32_t pushed_px;      // Pixels handed to the panel
+  uint32_t touch_us;       // Press to this frame, 0 if it answered no press
+  uint8_t areas;           // Invalidated regions drawn
+  uint8_t flushes;         // Stripes sent
+};
+
+/* Cost of the frames drawn while one scene was on screen */
+struct RenderSceneStats {
+  const char* name;
+  LatencyStat render;
+  LatencyStat flush;
+  uint64_t invalid_px;
+  uint64_t pushed_px;
+};
+
+/* Draw time of one widget, summed over the stripes of each frame it was drawn in */
+struct RenderWidgetStats {
+  const char* name;
+  lv_obj_t* obj;
+  LatencyStat draw;
+  uint32_t started_us;  // micros() of the draw in progress
+  uint32_t frame_us;    // Drawn so far in the current frame
+};
+
+/*
+ * Per-frame render and flush cost of the LVGL display.
+ *
+ * Attach() installs the driver's render_start_cb and monitor_cb, which
+ * bracket every refresh; MyDispFlush() reports each stripe with OnFlush(),
+ * so a frame's render time is its span minus the time spent flushing. A
+ * frame is attributed to the scene named by the RenderSceneFn at render
+ * start, so a screen with the keyboard up is its own scene. TrackWidget()
+ * times one widget's draw events; the time is summed over the stripes the
+ * widget spans and counted once per frame. loop() reports each
+ * lv_timer_handler() call with OnHandler() to give the share of the UI
+ * task spent in LVGL. The overlay is a label on the top layer, so its own
+ * redraw every kRenderOverlayMs shows up in the frames it measures. UI task
+ * only.
+ */
+class RenderProfiler {
+ public:
+  RenderProfiler();
+
+  void Attach(lv_disp_drv_t* driver, RenderSceneFn scene);  // Before lv_disp_drv_register()
+  void TrackWidget(lv_obj_t* obj, const char* name);        // Time the widget's draws
+  void OnFlush(uint32_t pixels, uint32_t flush_us, uint32_t touch_us);  // One MyDispFlush() call
+  void OnHandler(uint32_t handler_us, uint32_t now_us);     // One lv_timer_handler() call
+  void Poll(uint32_t now_ms);                               // Refresh the overlay when due
+  void SetOverlay(bool shown);
+
+  void Dump();        // Totals, every scene and widget on Serial
+  void DumpFrames();  // The last kRenderFrameHistory frames, oldest first
+  void Reset();
+
+  uint8_t scene_count() const { return scene_count_; }
+  const RenderSceneStats& scene(uint8_t index) const { return scenes_[index]; }
+  uint8_t widget_count() const { return widget_count_; }
+  const RenderWidgetStats& widget(uint8_t index) const { return widgets_[index]; }
+  bool overlay_shown() const { return overlay_shown_; }
+
+ private:
+  static void OnRenderStart(lv_disp_drv_t* driver);
+  static void OnMonitor(lv_disp_drv_t* driver, uint32_t time_ms, uint32_t px);
+  static void OnWidgetDraw(lv_event_t* e);
+  void EndFrame();
+  RenderSceneStats* FindScene(const char* name);
+
+  RenderSceneFn scene_fn_;
+  bool in_frame_;
+  uint32_t frame_started_us_;
+  RenderFrame frame_;                           // Frame being drawn
+  RenderFrame history_[kRenderFrameHistory];    // Ring of finished frames
+  uint8_t history_next_;
+  uint32_t frames_;
+  RenderSceneStats scenes_[kRenderSceneMax];
+  uint8_t scene_count_;
+  RenderWidgetStats widgets_[kRenderWidgetMax];
+  uint8_t widget_count_;
+  LatencyStat render_;
+  LatencyStat flush_;
+  uint64_t handler_us_;       // lv_timer_handler() time since the first OnHandler()
+  uint32_t handler_from_us_;  // micros() of the first OnHandler() since the reset, 0 if none
+  uint32_t handler_to_us_;
+
+  // Overlay and the window it summarises
+  bool overlay_shown_;
+  LabelBinding overlay_text_;
+  uint32_t overlay_last_ms_;
+  uint32_t window_frames_;
+  uint64_t window_render_us_;
+  uint64_t window_flush_us_;
+  uint64_t window_pushed_px_;
+  uint32_t last_touch_us_;
+};
+
+// Profiler of the one display
+extern RenderProfiler render_profiler;
+
+#endif  // RENDER_PROFILE_H_
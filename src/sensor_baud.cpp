@@ -0,0 +1,172 @@
+// sensor_baud.cpp
+
+#include "sensor_baud.h"
+#include "hardware.h"
+
+// Rate each module was last negotiated to, 0 for the factory rate
+static uint32_t saved_bauds[kSensorShardCount];
+
+/* True for a rate the module accepts */
+static bool IsSensorBaud(uint32_t baud) {
+  for (uint8_t i = 0; i < kSensorBaudRateCount; i++) {
+    if (kSensorBaudRates[i] == baud) return true;
+  }
+  return false;
+}
+
+/* Rate the module should be running at after a reboot */
+static uint32_t SavedBaud(uint8_t shard) {
+  return saved_bauds[shard] != 0 ? saved_bauds[shard] : kSensorDefaultBaud;
+}
+
+/* Write the saved rates back to SPIFFS */
+static void SaveSensorBauds() {
+  File f = SPIFFS.open(SENSOR_BAUD_PATH, "w");
+  if (!f) {
+    Serial.println("Failed to save the sensor baud rates");
+    return;
+  }
+  f.write((const uint8_t*)saved_bauds, sizeof(saved_bauds));
+  f.close();
+}
+
+/* Open every sensor UART at the rate its module was last set to */
+void LoadSensorBauds() {
+  if (SPIFFS.exists(SENSOR_BAUD_PATH)) {
+    File f = SPIFFS.open(SENSOR_BAUD_PATH, "r");
+    if (f) {
+      // A file from a build with fewer shards leaves the others at the factory rate
+      f.readBytes((char*)saved_bauds, sizeof(saved_bauds));
+      f.close();
+    }
+  }
+
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    if (!IsSensorBaud(saved_bauds[shard])) saved_bauds[shard] = 0;
+    uint32_t baud = SavedBaud(shard);
+    if (sensor_ports[shard]->baudRate() == baud) continue;
+    sensor_ports[shard]->updateBaudRate(baud);
+    Serial.printf("Fingerprint sensor shard %u at %u baud\n", (unsigned)shard, (unsigned)baud);
+  }
+}
+
+uint32_t SensorBaud(uint8_t shard) {
+  return sensor_ports[shard]->baudRate();
+}
+
+/* Check the module answers at the UART's current rate */
+static bool Handshake(uint8_t shard) {
+  uint8_t params[] = {0x00, 0x00, 0x00, 0x00};
+  for (uint8_t i = 0; i < kSensorBaudHandshakes; i++) {
+    if (sensor_shards[shard]->Call(FINGERPRINT_VERIFYPASSWORD, params, sizeof(params),
+                                   kSensorDefaultTimeoutMs) == FINGERPRINT_OK) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Ask the module for another rate and follow it; the ack still comes at the old one */
+static bool SwitchModuleBaud(uint8_t shard, uint32_t baud) {
+  uint8_t params[] = {FINGERPRINT_BAUD_REG_ADDR, (uint8_t)(baud / kSensorBaudUnit)};
+  uint8_t p = sensor_shards[shard]->Call(FINGERPRINT_SETSYSPARAM, params, sizeof(params),
+                                         kSensorDefaultTimeoutMs);
+  if (p != FINGERPRINT_OK) return false;
+  sensor_ports[shard]->updateBaudRate(baud);
+  delay(kSensorBaudSettleMs);
+  return true;
+}
+
+/* Discard the rest of a transfer the client gave up on, until the line is quiet */
+static void DrainPort(uint8_t shard) {
+  HardwareSerial& port = *sensor_ports[shard];
+  uint32_t started_ms = millis();
+  uint32_t quiet_ms = started_ms;
+  while (millis() - started_ms < kSensorBaudDrainMs) {
+    if (port.available()) {
+      while (port.available()) port.read();
+      quiet_ms = millis();
+    } else if (millis() - quiet_ms >= kSensorBaudSettleMs) {
+      return;
+    }
+    delay(1);
+  }
+}
+
+/* Look for the module at every rate, fastest first */
+static bool FindModule(uint8_t shard) {
+  for (uint8_t i = 0; i < kSensorBaudRateCount; i++) {
+    sensor_ports[shard]->updateBaudRate(kSensorBaudRates[i]);
+    delay(kSensorBaudSettleMs);
+    if (Handshake(shard)) return true;
+  }
+  return false;
+}
+
+static void CountImageBytes(const uint8_t* data, uint16_t length, void* context) {
+  *(uint32_t*)context += length;
+}
+
+/* A whole raw image upload is the longest transfer the link has to carry */
+static bool CheckImageLink(uint8_t shard) {
+  uint32_t bytes = 0;
+  uint8_t p = sensor_shards[shard]->Call(FINGERPRINT_UPIMAGE, NULL, 0, kSensorDefaultTimeoutMs,
+                                         NULL, CountImageBytes, NULL, &bytes);
+  return p == FINGERPRINT_OK && bytes == kSensorImageBytes;
+}
+
+/* Settle on the fastest rate up to ceiling that carries a raw image intact */
+bool NegotiateSensorBaud(uint8_t shard, uint32_t ceiling, SensorBaudResult* result) {
+  uint32_t started_ms = millis();
+  memset(result, 0, sizeof(SensorBaudResult));
+  HardwareSerial& port = *sensor_ports[shard];
+
+  bool found = Handshake(shard) || FindModule(shard);
+  bool verified = false;
+  uint32_t good = port.baudRate();  // Rate the module last answered at
+  for (uint8_t i = 0; found && i < kSensorBaudRateCount; i++) {
+    uint32_t baud = kSensorBaudRates[i];
+    if (baud > ceiling || baud > SENSOR_BAUD_MAX) continue;
+    result->tried++;
+
+    bool switched = baud == port.baudRate() ||
+                    (SwitchModuleBaud(shard, baud) && Handshake(shard));
+    if (switched && CheckImageLink(shard)) {
+      verified = true;
+      break;
+    }
+
+    // Back out: the module may be at either rate, so look for it if it does not answer
+    result->failed++;
+    DrainPort(shard);
+    if (port.baudRate() != good) SwitchModuleBaud(shard, good);
+    found = Handshake(shard) || FindModule(shard);
+    good = port.baudRate();
+  }
+
+  result->baud = port.baudRate();
+  result->elapsed_ms = millis() - started_ms;
+  if (!found || !verified) return false;
+
+  saved_bauds[shard] = result->baud;
+  SaveSensorBauds();
+  return true;
+}
+
+/* Alternate between the saved rate and the factory rate while the module is silent */
+void FallBackSensorBaud(uint8_t shard) {
+  HardwareSerial& port = *sensor_ports[shard];
+  uint32_t baud = port.baudRate() != SavedBaud(shard) ? SavedBaud(shard) : kSensorDefaultBaud;
+  if (baud == port.baudRate()) return;
+  port.updateBaudRate(baud);
+  Serial.printf("Trying fingerprint sensor shard %u at %u baud\n", (unsigned)shard,
+                (unsigned)baud);
+}
+
+/* Remember a rate the module answered at after a fallback */
+void KeepSensorBaud(uint8_t shard) {
+  uint32_t baud = sensor_ports[shard]->baudRate();
+  if (baud == SavedBaud(shard)) return;
+  saved_bauds[shard] = baud;
+  SaveSensorBauds();
+}
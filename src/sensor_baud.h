@@ -0,0 +1,57 @@
+// sensor_baud.h
+
+#ifndef SENSOR_BAUD_H_
+#define SENSOR_BAUD_H_
+
+#include <Arduino.h>
+#include "sensor_client.h"
+#include "sensor_shards.h"
+
+// Fastest sensor UART rate negotiation may pick; R307/AS608 modules stop at 115200
+#ifndef SENSOR_BAUD_MAX
+#define SENSOR_BAUD_MAX 115200
+#endif
+
+// Rates chosen by the last negotiation, one uint32_t per shard, on SPIFFS
+#define SENSOR_BAUD_PATH "/sensor_baud"
+
+// Link settings
+const uint32_t kSensorDefaultBaud = 57600;   // Factory rate of the modules
+const uint32_t kSensorBaudUnit = 9600;       // The module takes its rate as a multiple of this
+const uint32_t kSensorBaudRates[] = {115200, 57600, 38400, 19200, 9600};  // Fastest first
+const uint8_t kSensorBaudRateCount = sizeof(kSensorBaudRates) / sizeof(kSensorBaudRates[0]);
+const uint32_t kSensorBaudSettleMs = 20;     // Quiet time after a switch before the next command
+const uint8_t kSensorBaudHandshakes = 3;     // Handshakes tried at a rate before giving up on it
+const uint32_t kSensorBaudDrainMs = 8000;    // Longest wait for an aborted transfer to end
+const size_t kSensorRxBufferBytes = 4096;    // UART RX buffer; rides out flash writes mid-stream
+
+/* Outcome of one negotiation */
+struct SensorBaudResult {
+  uint32_t baud;        // Rate the link runs at afterwards
+  uint8_t tried;        // Rates whose link was checked
+  uint8_t failed;       // Of those, rates that lost packets and were backed out of
+  uint32_t elapsed_ms;
+};
+
+/*
+ * Baud rate of each sensor UART, negotiated with the module and persisted.
+ *
+ * The module keeps its rate in its own flash, so the ESP32 has to open the
+ * UART at the same rate on the next boot: LoadSensorBauds() applies the
+ * rates saved by the last negotiation before the sensor task handshakes.
+ * NegotiateSensorBaud() tries the rates from the fastest down. Each one is
+ * set with SetSysPara, followed on the ESP32 side, and only kept if a
+ * handshake and a whole raw image upload come through intact. A rate that
+ * loses packets is backed out of by setting the last good rate again, or by
+ * scanning every rate with handshakes if the module went quiet. If a saved
+ * rate stops answering (a replaced module starts at 57600),
+ * FallBackSensorBaud() alternates between it and the factory rate. Only
+ * the sensor task calls these after boot; negotiation blocks it.
+ */
+void LoadSensorBauds();  // Apply the saved rates; SPIFFS must be mounted
+bool NegotiateSensorBaud(uint8_t shard, uint32_t ceiling, SensorBaudResult* result);
+void FallBackSensorBaud(uint8_t shard);  // Try the other of the saved and the factory rate
+void KeepSensorBaud(uint8_t shard);      // The current rate answered; save it if it is new
+uint32_t SensorBaud(uint8_t shard);      // Rate the ESP32 side of the UART runs at
+
+#endif  // SENSOR_BAUD_H_
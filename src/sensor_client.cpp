@@ -0,0 +1,349 @@
+// sensor_client.cpp
+
+#include "sensor_client.h"
+
+SensorClient::SensorClient(Stream& port, uint32_t address)
+    : port_(port), address_(address), head_(0), count_(0), in_flight_(false),
+      receiving_data_(false), sending_data_(false), sent_ms_(0), rx_length_(0), rx_expected_(0),
+      tx_length_(0), tx_sent_(0), data_offset_(0), data_status_(FINGERPRINT_OK) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+/* Queue a command; false if the queue is full or the parameters too long */
+bool SensorClient::Submit(uint8_t command, const uint8_t* params, uint8_t length,
+                          uint32_t timeout_ms, SensorCallback callback, void* context,
+                          SensorDataSink sink, SensorDataSource source, void* data_context) {
+  if (count_ == kSensorClientQueueDepth || length > kSensorMaxParams) return false;
+
+  Request& request = queue_[(head_ + count_) % kSensorClientQueueDepth];
+  request.command = command;
+  if (length > 0) memcpy(request.params, params, length);
+  request.length = length;
+  request.timeout_ms = timeout_ms;
+  request.callback = callback;
+  request.context = context;
+  request.sink = sink;
+  request.source = source;
+  request.data_context = data_context;
+  count_++;
+  return true;
+}
+
+/* Frame one packet into out; returns its size */
+uint16_t SensorClient::FramePacket(uint8_t pid, const uint8_t* payload, uint16_t length,
+                                   uint8_t* out) const {
+  uint16_t packet_length = length + 2;  // Payload + checksum
+  uint8_t header[kSensorHeaderBytes] = {
+      (uint8_t)(FINGERPRINT_STARTCODE >> 8), (uint8_t)(FINGERPRINT_STARTCODE & 0xFF),
+      (uint8_t)(address_ >> 24), (uint8_t)(address_ >> 16),
+      (uint8_t)(address_ >> 8), (uint8_t)address_,
+      pid, (uint8_t)(packet_length >> 8), (uint8_t)(packet_length & 0xFF)};
+
+  uint16_t sum = pid + (packet_length >> 8) + (packet_length & 0xFF);
+  for (uint16_t i = 0; i < length; i++) sum += payload[i];
+
+  memcpy(out, header, sizeof(header));
+  memcpy(out + sizeof(header), payload, length);
+  out[sizeof(header) + length] = (uint8_t)(sum >> 8);
+  out[sizeof(header) + length + 1] = (uint8_t)(sum & 0xFF);
+  return sizeof(header) + length + 2;
+}
+
+/* Frame and write a command packet; it fits the UART's transmit FIFO */
+void SensorClient::Send(const Request& request) {
+  uint8_t payload[1 + kSensorMaxParams];  // Instruction + parameters
+  payload[0] = request.command;
+  if (request.length > 0) memcpy(&payload[1], request.params, request.length);
+
+  uint8_t packet[kSensorHeaderBytes + sizeof(payload) + 2];
+  port_.write(packet, FramePacket(FINGERPRINT_COMMANDPACKET, payload, 1 + request.length, packet));
+}
+
+/*
+ * Push a download's data packets from its source, framing at most one new
+ * packet per call and writing only what the UART has room for. A short read
+ * is padded and reported. True once the end packet has been written.
+ */
+bool SensorClient::SendData(const Request& request, uint32_t now_ms) {
+  if (tx_sent_ == tx_length_) {
+    if (data_offset_ >= kSensorTemplateBytes) return true;
+
+    uint8_t packet[kSensorDataPacketBytes];
+    uint16_t filled = 0;
+    if (data_status_ == FINGERPRINT_OK) {
+      filled = request.source(packet, kSensorDataPacketBytes, request.data_context);
+    }
+    if (filled < kSensorDataPacketBytes) {
+      // The sensor still expects a whole template, so finish the transfer
+      memset(packet + filled, 0, kSensorDataPacketBytes - filled);
+      data_status_ = FINGERPRINT_PACKETRECIEVEERR;
+    }
+
+    data_offset_ += kSensorDataPacketBytes;
+    bool last = data_offset_ >= kSensorTemplateBytes;
+    tx_length_ = FramePacket(last ? FINGERPRINT_ENDDATAPACKET : FINGERPRINT_DATAPACKET, packet,
+                             kSensorDataPacketBytes, tx_);
+    tx_sent_ = 0;
+  }
+
+  int room = port_.availableForWrite();
+  if (room <= 0) return false;
+  uint8_t chunk = tx_length_ - tx_sent_;
+  if (room < chunk) chunk = room;
+  port_.write(tx_ + tx_sent_, chunk);
+  tx_sent_ += chunk;
+  sent_ms_ = now_ms;  // The timeout covers a stalled transmitter, not the whole transfer
+  return tx_sent_ == tx_length_ && data_offset_ >= kSensorTemplateBytes;
+}
+
+/* Add one received byte to the packet being assembled */
+bool SensorClient::FeedByte(uint8_t byte) {
+  // Resynchronise on the start code after noise or a dropped packet
+  if (rx_length_ == 0 && byte != (FINGERPRINT_STARTCODE >> 8)) return false;
+  if (rx_length_ == 1 && byte != (FINGERPRINT_STARTCODE & 0xFF)) {
+    rx_length_ = (byte == (FINGERPRINT_STARTCODE >> 8)) ? 1 : 0;
+    return false;
+  }
+
+  rx_[rx_length_++] = byte;
+
+  if (rx_length_ == kSensorHeaderBytes) {
+    uint16_t length = (rx_[7] << 8) | rx_[8];
+    if (length < 3 || length > kSensorMaxPayload + 2) {
+      stats_.bad_packets++;
+      rx_length_ = 0;
+      return false;
+    }
+    rx_expected_ = kSensorHeaderBytes + length;
+  }
+
+  return rx_length_ > kSensorHeaderBytes && rx_length_ == rx_expected_;
+}
+
+/* Pop the command in flight and run its callback */
+void SensorClient::Complete(uint8_t status) {
+  Request request = queue_[head_];
+  head_ = (head_ + 1) % kSensorClientQueueDepth;
+  count_--;
+  in_flight_ = false;
+  receiving_data_ = false;
+  sending_data_ = false;
+
+#if STAGE_TIMING
+  RecordSensorStage(request.command, StageCycles() - sent_cycles_);
+#endif
+
+  SensorReply reply = {request.command, status, 0, 0};
+  if (status != FINGERPRINT_TIMEOUT && status != FINGERPRINT_BADPACKET &&
+      rx_[6] == FINGERPRINT_ACKPACKET) {
+    const uint8_t* payload = &rx_[kSensorHeaderBytes];
+    uint8_t payload_length = rx_expected_ - kSensorHeaderBytes - 2;
+    if (payload_length >= 3) reply.value = (payload[1] << 8) | payload[2];
+    if (payload_length >= 5) reply.score = (payload[3] << 8) | payload[4];
+  }
+
+  // The callback may submit the next command of a chain
+  if (request.callback != NULL) request.callback(reply, request.context);
+}
+
+/* Advance the pipeline: send, receive, time out and complete */
+void SensorClient::Poll(uint32_t now_ms) {
+  while (count_ > 0) {
+    if (!in_flight_) {
+      while (port_.available()) port_.read();  // Drop stray bytes from earlier commands
+      rx_length_ = 0;
+      Send(queue_[head_]);
+      in_flight_ = true;
+      sent_ms_ = now_ms;
+#if STAGE_TIMING
+      sent_cycles_ = StageCycles();
+#endif
+    }
+
+    if (sending_data_) {
+      if (SendData(queue_[head_], now_ms)) {
+        Complete(data_status_);
+        continue;
+      }
+      if (now_ms - sent_ms_ > queue_[head_].timeout_ms) {
+        stats_.timeouts++;
+        Complete(FINGERPRINT_TIMEOUT);
+        continue;
+      }
+      return;  // The rest goes out on later polls
+    }
+
+    bool complete = false;
+    while (!complete && port_.available()) complete = FeedByte((uint8_t)port_.read());
+
+    if (complete) {
+      rx_length_ = 0;
+
+      // Verify the checksum over PID, length and payload
+      uint16_t sum = 0;
+      for (uint8_t i = 6; i < rx_expected_ - 2; i++) sum += rx_[i];
+      uint16_t expected_sum = (rx_[rx_expected_ - 2] << 8) | rx_[rx_expected_ - 1];
+
+      Request& request = queue_[head_];
+      uint8_t pid = rx_[6];
+      bool expected_pid = receiving_data_ ? (pid == FINGERPRINT_DATAPACKET ||
+                                             pid == FINGERPRINT_ENDDATAPACKET)
+                                          : pid == FINGERPRINT_ACKPACKET;
+
+      if (!expected_pid || sum != expected_sum) {
+        stats_.bad_packets++;
+        Complete(FINGERPRINT_BADPACKET);
+      } else if (receiving_data_) {
+        // Hand each data packet over as it arrives; the end packet completes
+        request.sink(&rx_[kSensorHeaderBytes], rx_expected_ - kSensorHeaderBytes - 2,
+                     request.data_context);
+        sent_ms_ = now_ms;
+        if (pid == FINGERPRINT_ENDDATAPACKET) Complete(FINGERPRINT_OK);
+      } else {
+        stats_.commands++;
+        uint8_t status = rx_[kSensorHeaderBytes];
+        if (status == FINGERPRINT_OK && request.command == FINGERPRINT_READINDEX) {
+          // The index table is the rest of the ack payload
+          request.sink(&rx_[kSensorHeaderBytes + 1], rx_expected_ - kSensorHeaderBytes - 3,
+                       request.data_context);
+        } else if (status == FINGERPRINT_OK && request.sink != NULL) {
+          receiving_data_ = true;  // Upload data follows the ack
+          sent_ms_ = now_ms;
+          continue;
+        }
+        if (status == FINGERPRINT_OK && request.source != NULL) {
+          sending_data_ = true;  // Download data follows the ack
+          tx_length_ = 0;
+          tx_sent_ = 0;
+          data_offset_ = 0;
+          data_status_ = FINGERPRINT_OK;
+          sent_ms_ = now_ms;
+          continue;
+        }
+        Complete(status);
+      }
+      continue;  // Start the next queued command right away
+    }
+
+    if (now_ms - sent_ms_ > queue_[head_].timeout_ms) {
+      stats_.timeouts++;
+      Complete(FINGERPRINT_TIMEOUT);
+      continue;
+    }
+    return;  // Waiting for more bytes
+  }
+}
+
+/* Blocking wrapper for callers outside the sensor task's event loop */
+uint8_t SensorClient::Call(uint8_t command, const uint8_t* params, uint8_t length,
+                           uint32_t timeout_ms, SensorReply* reply, SensorDataSink sink,
+                           SensorDataSource source, void* data_context) {
+  struct Waiter {
+    bool done;
+    SensorReply reply;
+  } waiter = {false, {command, FINGERPRINT_PACKETRECIEVEERR, 0, 0}};
+
+  bool queued = Submit(command, params, length, timeout_ms, [](const SensorReply& r, void* context) {
+    Waiter* w = (Waiter*)context;
+    w->reply = r;
+    w->done = true;
+  }, &waiter, sink, source, data_context);
+
+  while (queued && !waiter.done) {
+    Poll(millis());
+    if (!waiter.done) delay(1);
+  }
+
+  if (reply != NULL) *reply = waiter.reply;
+  return waiter.reply.status;
+}
+
+/* Handshake: check the module answers and accepts the default password */
+bool SensorClient::VerifyPassword(SensorCallback callback, void* context) {
+  uint8_t params[] = {0x00, 0x00, 0x00, 0x00};
+  return Submit(FINGERPRINT_VERIFYPASSWORD, params, sizeof(params), kSensorDefaultTimeoutMs,
+                callback, context);
+}
+
+/* Capture an image into the image buffer */
+bool SensorClient::GetImage(SensorCallback callback, void* context) {
+  return Submit(FINGERPRINT_GETIMAGE, NULL, 0, kSensorDefaultTimeoutMs, callback, context);
+}
+
+/* Extract features from the image buffer into a char buffer slot */
+bool SensorClient::Image2Tz(uint8_t slot, SensorCallback callback, void* context) {
+  return Submit(FINGERPRINT_IMAGE2TZ, &slot, 1, kSensorDefaultTimeoutMs, callback, context);
+}
+
+/* Search pages start..start+count-1 for the features in a slot */
+bool SensorClient::Search(uint8_t slot, uint16_t start, uint16_t count, SensorCallback callback,
+                          void* context) {
+  uint8_t params[] = {slot, (uint8_t)(start >> 8), (uint8_t)(start & 0xFF),
+                      (uint8_t)(count >> 8), (uint8_t)(count & 0xFF)};
+  return Submit(FINGERPRINT_SEARCH, params, sizeof(params), kSensorSearchTimeoutMs, callback,
+                context);
+}
+
+/* Combine both char buffers into a template */
+bool SensorClient::CreateModel(SensorCallback callback, void* context) {
+  return Submit(FINGERPRINT_REGMODEL, NULL, 0, kSensorDefaultTimeoutMs, callback, context);
+}
+
+/* Store the template in a slot under a page ID */
+bool SensorClient::StoreModel(uint16_t id, uint8_t slot, SensorCallback callback, void* context) {
+  uint8_t params[] = {slot, (uint8_t)(id >> 8), (uint8_t)(id & 0xFF)};
+  return Submit(FINGERPRINT_STORE, params, sizeof(params), kSensorDefaultTimeoutMs, callback,
+                context);
+}
+
+/* Delete count templates starting at a page ID */
+bool SensorClient::DeleteModel(uint16_t id, uint16_t count, SensorCallback callback,
+                               void* context) {
+  uint8_t params[] = {(uint8_t)(id >> 8), (uint8_t)(id & 0xFF), (uint8_t)(count >> 8),
+                      (uint8_t)(count & 0xFF)};
+  return Submit(FINGERPRINT_DELETE, params, sizeof(params), kSensorDefaultTimeoutMs, callback,
+                context);
+}
+
+/* Load the template stored under a page ID into a char buffer slot */
+bool SensorClient::LoadModel(uint16_t id, uint8_t slot, SensorCallback callback, void* context) {
+  uint8_t params[] = {slot, (uint8_t)(id >> 8), (uint8_t)(id & 0xFF)};
+  return Submit(FINGERPRINT_LOAD, params, sizeof(params), kSensorDefaultTimeoutMs, callback,
+                context);
+}
+
+/* Compare char buffers 1 and 2; the score arrives in reply.value */
+bool SensorClient::Match(SensorCallback callback, void* context) {
+  return Submit(FINGERPRINT_MATCH, NULL, 0, kSensorDefaultTimeoutMs, callback, context);
+}
+
+/* Delete every template on the module */
+bool SensorClient::EmptyLibrary(SensorCallback callback, void* context) {
+  return Submit(FINGERPRINT_EMPTY, NULL, 0, kSensorDefaultTimeoutMs, callback, context);
+}
+
+/* Count the templates stored on the module; the count arrives in reply.value */
+bool SensorClient::CountTemplates(SensorCallback callback, void* context) {
+  return Submit(FINGERPRINT_TEMPLATECOUNT, NULL, 0, kSensorDefaultTimeoutMs, callback, context);
+}
+
+/* Read which pages of a 256-page group hold a template, one bit per page */
+bool SensorClient::ReadIndex(uint8_t group, SensorDataSink sink, void* data_context,
+                             SensorCallback callback, void* context) {
+  return Submit(FINGERPRINT_READINDEX, &group, 1, kSensorDefaultTimeoutMs, callback, context,
+                sink, NULL, data_context);
+}
+
+/* Stream the template in a char buffer slot out to a sink */
+bool SensorClient::UploadChar(uint8_t slot, SensorDataSink sink, void* data_context,
+                              SensorCallback callback, void* context) {
+  return Submit(FINGERPRINT_UPLOAD, &slot, 1, kSensorDefaultTimeoutMs, callback, context, sink,
+                NULL, data_context);
+}
+
+/* Stream a template from a source into a char buffer slot */
+bool SensorClient::DownloadChar(uint8_t slot, SensorDataSource source, void* data_context,
+                                SensorCallback callback, void* context) {
+  return Submit(FINGERPRINT_DOWNCHAR, &slot, 1, kSensorDefaultTimeoutMs, callback, context, NULL,
+                source, data_context);
+}
@@ -0,0 +1,159 @@
+// sensor_client.h
+
+#ifndef SENSOR_CLIENT_H_
+#define SENSOR_CLIENT_H_
+
+#include <Arduino.h>
+#include <Adafruit_Fingerprint.h>
+#include "stage_timing.h"
+
+// Client limits
+const uint8_t kSensorClientQueueDepth = 8;   // Commands queued, including the one in flight
+const uint8_t kSensorMaxParams = 12;         // Largest command parameter block
+const uint8_t kSensorMaxPayload = 128;       // Largest ack or data payload accepted
+const uint8_t kSensorHeaderBytes = 9;        // Start code, address, PID, length
+
+// Template transfers (UpChar/DownChar)
+const uint16_t kSensorTemplateBytes = 512;   // Size of one char buffer / template
+const uint8_t kSensorDataPacketBytes = 128;  // Data packet size the sensor is set to
+
+// Instructions the Adafruit library has no constant for
+#ifndef FINGERPRINT_DOWNCHAR
+#define FINGERPRINT_DOWNCHAR 0x09            // Download a template into a char buffer
+#endif
+#ifndef FINGERPRINT_READINDEX
+#define FINGERPRINT_READINDEX 0x1F           // Read the used-page bitmap of one page group
+#endif
+#ifndef FINGERPRINT_UPIMAGE
+#define FINGERPRINT_UPIMAGE 0x0A             // Upload the image buffer
+#endif
+const uint8_t kSensorIndexBytes = 32;        // Bitmap bytes per index group (256 pages)
+
+// Raw images (UpImage): 4 bits per pixel, two pixels per byte, in the same data packets
+const uint16_t kSensorImageWidth = 256;
+const uint16_t kSensorImageHeight = 288;
+const uint32_t kSensorImageBytes = (uint32_t)kSensorImageWidth * kSensorImageHeight / 2;
+
+// Per-command timeouts
+const uint32_t kSensorDefaultTimeoutMs = 1000;  // Matches Adafruit's default packet timeout
+const uint32_t kSensorSearchTimeoutMs = 3000;   // Library search time grows with enrollments
+
+/* Completion of one sensor command */
+struct SensorReply {
+  uint8_t command;  // Instruction code that was sent
+  uint8_t status;   // Confirmation code, FINGERPRINT_TIMEOUT or FINGERPRINT_BADPACKET
+  uint16_t value;   // Page ID for searches, template count for count queries
+  uint16_t score;   // Match score for searches
+};
+
+typedef void (*SensorCallback)(const SensorReply& reply, void* context);
+
+// Template data streamed out of (sink) or into (source) the sensor, one packet at a time
+typedef void (*SensorDataSink)(const uint8_t* data, uint16_t length, void* context);
+typedef uint16_t (*SensorDataSource)(uint8_t* data, uint16_t length, void* context);
+
+/* Counters describing traffic through the client */
+struct SensorClientStats {
+  uint32_t commands;     // Commands completed with an ack
+  uint32_t timeouts;     // Commands with no ack before their deadline
+  uint32_t bad_packets;  // Acks dropped for a bad checksum or length
+};
+
+/*
+ * Non-blocking client for the fingerprint sensor's UART packet protocol.
+ *
+ * Commands are framed exactly like Adafruit_Fingerprint frames them, but
+ * Submit() only queues them. Poll() writes the next command once the
+ * sensor is free, assembles the ack from whatever bytes have arrived,
+ * enforces the command's timeout and runs its completion callback. The
+ * sensor handles one command at a time, so at most one is on the wire.
+ *
+ * Commands with a data phase take a sink or a source. After the ack, the
+ * data packets that follow an upload are passed to the sink as they
+ * arrive, and a download's data packets are filled from the source, so a
+ * template never has to be held in RAM as a whole. A download writes at
+ * most one data packet per Poll(), and only as much of it as the UART's
+ * availableForWrite() takes, so Poll() never waits on the transmitter. ReadIndex is the one
+ * command whose data comes in the ack itself; its sink gets the bitmap.
+ */
+class SensorClient {
+ public:
+  SensorClient(Stream& port, uint32_t address = 0xFFFFFFFF);
+
+  bool Submit(uint8_t command, const uint8_t* params, uint8_t length, uint32_t timeout_ms,
+              SensorCallback callback, void* context, SensorDataSink sink = NULL,
+              SensorDataSource source = NULL, void* data_context = NULL);
+  void Poll(uint32_t now_ms);  // Send, receive and complete without blocking
+  uint8_t Call(uint8_t command, const uint8_t* params, uint8_t length, uint32_t timeout_ms,
+               SensorReply* reply = NULL, SensorDataSink sink = NULL,
+               SensorDataSource source = NULL, void* data_context = NULL);  // Submit and poll until done
+
+  // Typed helpers for the commands the firmware uses
+  bool VerifyPassword(SensorCallback callback, void* context);
+  bool GetImage(SensorCallback callback, void* context);
+  bool Image2Tz(uint8_t slot, SensorCallback callback, void* context);
+  bool Search(uint8_t slot, uint16_t start, uint16_t count, SensorCallback callback,
+              void* context);
+  bool CreateModel(SensorCallback callback, void* context);
+  bool StoreModel(uint16_t id, uint8_t slot, SensorCallback callback, void* context);
+  bool DeleteModel(uint16_t id, uint16_t count, SensorCallback callback, void* context);
+  bool LoadModel(uint16_t id, uint8_t slot, SensorCallback callback, void* context);
+  bool Match(SensorCallback callback, void* context);
+  bool EmptyLibrary(SensorCallback callback, void* context);
+  bool CountTemplates(SensorCallback callback, void* context);
+  bool ReadIndex(uint8_t group, SensorDataSink sink, void* data_context,
+                 SensorCallback callback, void* context);
+  bool UploadChar(uint8_t slot, SensorDataSink sink, void* data_context,
+                  SensorCallback callback, void* context);
+  bool DownloadChar(uint8_t slot, SensorDataSource source, void* data_context,
+                    SensorCallback callback, void* context);
+
+  bool busy() const { return count_ > 0; }
+  const SensorClientStats& stats() const { return stats_; }
+
+ private:
+  struct Request {
+    uint8_t command;
+    uint8_t params[kSensorMaxParams];
+    uint8_t length;
+    uint32_t timeout_ms;
+    SensorCallback callback;
+    void* context;
+    SensorDataSink sink;      // Upload: receives the data packets after the ack
+    SensorDataSource source;  // Download: fills the data packets after the ack
+    void* data_context;
+  };
+
+  void Send(const Request& request);
+  uint16_t FramePacket(uint8_t pid, const uint8_t* payload, uint16_t length, uint8_t* out) const;
+  bool SendData(const Request& request, uint32_t now_ms);  // Download data phase; true once sent
+  bool FeedByte(uint8_t byte);  // True once a whole packet is buffered
+  void Complete(uint8_t status);
+
+  Stream& port_;
+  uint32_t address_;
+  Request queue_[kSensorClientQueueDepth];  // Ring buffer; head is in flight once sent
+  uint8_t head_;
+  uint8_t count_;
+  bool in_flight_;                          // Head has been written to the port
+  bool receiving_data_;                     // Head was acked; its data packets follow
+  bool sending_data_;                       // Head was acked; its data packets are going out
+  uint32_t sent_ms_;                        // millis() when the head was written
+#if STAGE_TIMING
+  uint32_t sent_cycles_;                    // Cycle count when the head was written
+#endif
+  uint8_t rx_[kSensorHeaderBytes + kSensorMaxPayload + 2];
+  uint8_t rx_length_;                       // Bytes of the current packet received
+  uint8_t rx_expected_;                     // Packet size once the header is known
+  uint8_t tx_[kSensorHeaderBytes + kSensorDataPacketBytes + 2];  // Data packet being written
+  uint8_t tx_length_;
+  uint8_t tx_sent_;                         // Bytes of tx_ the UART has taken
+  uint16_t data_offset_;                    // Template bytes framed so far
+  uint8_t data_status_;                     // Outcome of the download so far
+  SensorClientStats stats_;
+};
+
+// Client on the fingerprint sensor UART
+extern SensorClient sensor_client;
+
+#endif  // SENSOR_CLIENT_H_
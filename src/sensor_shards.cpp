@@ -0,0 +1,33 @@
+// sensor_shards.cpp
+
+#include "sensor_shards.h"
+#include "hardware.h"
+
+// Client per shard, in shard order; shard 0 is the original sensor on UART2
+SensorClient* const sensor_shards[kSensorShardCount] = {
+    &sensor_client,
+#if SENSOR_SHARDS > 1
+    &shard_client,
+#endif
+};
+
+// Their UARTs, for baud rate changes
+HardwareSerial* const sensor_ports[kSensorShardCount] = {
+    &mySerial,
+#if SENSOR_SHARDS > 1
+    &shard_serial,
+#endif
+};
+
+void PollSensorShards(uint32_t now_ms) {
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    sensor_shards[shard]->Poll(now_ms);
+  }
+}
+
+bool SensorShardsBusy() {
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    if (sensor_shards[shard]->busy()) return true;
+  }
+  return false;
+}
@@ -0,0 +1,35 @@
+// sensor_shards.h
+
+#ifndef SENSOR_SHARDS_H_
+#define SENSOR_SHARDS_H_
+
+#include <Arduino.h>
+#include "sensor_client.h"
+#include "user_directory.h"
+
+// UART0 is the USB console, so an ESP32 has room for two sensor modules
+static_assert(SENSOR_SHARDS >= 1 && SENSOR_SHARDS <= 2, "SENSOR_SHARDS must be 1 or 2");
+
+// Lowest search score accepted as a hit when several shards are searched
+#ifndef SHARD_MIN_CONFIDENCE
+#define SHARD_MIN_CONFIDENCE 50
+#endif
+const uint16_t kShardMinConfidence = SHARD_MIN_CONFIDENCE;
+
+const uint8_t kCaptureShard = 0;  // Module whose window users touch
+
+/*
+ * Sensor modules on separate UARTs, each holding part of the user ID space.
+ *
+ * Fingers are captured on kCaptureShard. With more than one shard, the
+ * capture's features are uploaded once and downloaded into every other
+ * module, and all shards search their own library at the same time. The
+ * user directory records which shard and page each template lives on.
+ */
+extern SensorClient* const sensor_shards[kSensorShardCount];
+extern HardwareSerial* const sensor_ports[kSensorShardCount];  // UART under each client
+
+void PollSensorShards(uint32_t now_ms);  // Poll every shard's client
+bool SensorShardsBusy();                 // A command is queued on any shard
+
+#endif  // SENSOR_SHARDS_H_
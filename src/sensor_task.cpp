@@ -0,0 +1,898 @@
+// sensor_task.cpp
+
+#include "sensor_task.h"
+#include "admin_console.h"
+#include "boot_profile.h"
+#include "enrollment.h"
+#include "finger_detect.h"
+#include "hardware.h"
+#include "image_stream.h"
+#include "match_cache.h"
+#include "sensor_baud.h"
+#include "sensor_shards.h"
+#include "template_archive.h"
+#include "user_directory.h"
+
+// Operating mode, owned by the sensor task
+enum SensorMode {
+  kModeIdle,
+  kModeScanning,
+  kModeEnrolling
+};
+
+static QueueHandle_t command_queue = NULL;  // UI task -> sensor task
+static QueueHandle_t event_queue = NULL;    // Sensor task -> UI task
+static TaskHandle_t sensor_task_handle = NULL;  // For its stack high-water mark
+static SensorMode mode = kModeIdle;
+
+// Link state of the capture sensor
+static bool sensor_online = false;
+static bool probe_pending = false;        // VerifyPassword on the wire
+static bool offline_reported = false;     // Offline status already posted
+static uint32_t next_probe_ms = 0;        // millis() of the next handshake while offline
+
+// Presence session: one match per finger placement
+static bool placement_held = false;      // Result reported, waiting for lift-off
+static uint8_t placement_searches = 0;   // Searches run for the current placement
+static uint32_t last_search_ms = 0;      // millis() of the latest search
+static bool idle_reported = false;       // "No finger" already posted this scan
+static ScanSessionStats session_stats;
+
+// Steps of the asynchronous capture -> convert -> search chain
+enum ScanStep {
+  kScanStepIdle,     // No scan command on the wire
+  kScanStepCapture,  // getImage sent
+  kScanStepConvert,  // image2Tz sent
+  kScanStepSearch,   // search sent, on every shard when there are several
+  kScanStepPair      // loadChar and match sent for a verify or a cache probe
+};
+static ScanStep scan_step = kScanStepIdle;
+static uint32_t scan_started_us = 0;     // micros() when the chain's getImage was queued
+
+static uint32_t search_started_us = 0;   // micros() when a library search began, 0 if none
+
+// Claimed identity while verifying; verify_id is 0 for 1:N scans
+static uint16_t verify_id = 0;
+static uint8_t verify_shard = 0;
+static uint16_t verify_slot = 0;
+
+// 1:1 match of the capture against one stored template, for a verify or a cache probe
+enum PairStep {
+  kPairStepLoad,      // loadChar of the template into buffer 2
+  kPairStepUpload,    // UpChar of the capture's features, template on another shard
+  kPairStepDownload,  // DownChar of those features into the template shard's buffer 1
+  kPairStepMatch      // match of buffer 1 against buffer 2
+};
+static uint8_t pair_shard = 0;
+static uint16_t pair_slot = 0;
+static uint8_t pair_pending = 0;          // Commands of the current step on the wire
+static uint8_t pair_status = FINGERPRINT_OK;  // First failure among them
+static uint32_t pair_started_us = 0;
+static bool pair_moves_features = false;  // The features had to be sent to pair_shard
+static uint8_t cache_rank = 0;            // Next cached template to consider
+static uint8_t cache_probes = 0;          // Cached templates probed this pass
+static uint32_t cache_started_us = 0;     // micros() when this pass started probing
+
+// Fan-out of one capture's features to every shard
+enum ShardStep {
+  kShardStepIdle,
+  kShardStepDownload,  // DownChar of the features sent
+  kShardStepSearch     // search sent
+};
+static ShardStep shard_steps[kSensorShardCount];
+static uint16_t shard_offsets[kSensorShardCount];   // Feature bytes sent to each shard
+static uint8_t shard_features[kSensorTemplateBytes];
+static uint16_t shard_features_length = 0;
+static uint8_t shard_searches_pending = 0;  // Uploads, downloads and searches on the wire
+static bool shard_hit_reported = false;   // A confident hit was already posted
+static SensorReply shard_best_reply;      // Best hit below kShardMinConfidence so far
+static uint8_t shard_best = 0;            // Shard of shard_best_reply
+static uint8_t features_shards = 0;       // Bit per shard whose buffer 1 holds the capture
+
+/* Post an event to the UI task, dropping it if the UI falls behind for longer than wait */
+static void PostEvent(const SensorEvent& event, TickType_t wait = 0) {
+  if (xQueueSend(event_queue, &event, wait) != pdTRUE && !admin_console.streaming()) {
+    Serial.println("Sensor event queue full, event dropped");
+  }
+}
+
+/* Post an enrollment event carrying the machine's current prompt, or the user's name once done */
+static void PostEnrollEvent(SensorEventType type) {
+  SensorEvent event = {};
+  event.type = type;
+  event.id = enrollment.id();
+  event.shard = enrollment.shard();
+  event.slot = enrollment.slot();
+  const char* text = (type == kEvtEnrollDone) ? enrollment.name() : enrollment.message();
+  strncpy(event.message, text, sizeof(event.message) - 1);
+  PostEvent(event);
+}
+
+// Index table of the latest ReadIndex, copied into its event
+static uint8_t index_bits[kSensorIndexBytes];
+
+/* Pack the command a reply belongs to into its callback context */
+static void* ReplyContext(const SensorCommand& command) {
+  return (void*)(uintptr_t)(((uint32_t)command.id << 16) | ((uint32_t)command.shard << 8));
+}
+
+/* Post the completion of a shard query or delete as an event */
+static void PostReplyEvent(SensorEventType type, const SensorReply& reply, void* context,
+                           uint16_t slot) {
+  SensorEvent event = {};
+  event.type = type;
+  event.status = reply.status;
+  event.id = (uint16_t)((uintptr_t)context >> 16);
+  event.shard = (uint8_t)((uintptr_t)context >> 8);
+  event.slot = slot;
+  if (type == kEvtTemplateIndex) memcpy(event.message, index_bits, sizeof(index_bits));
+  PostEvent(event, portMAX_DELAY);  // Bulk operations count every completion
+}
+
+/* Completion of a template delete or library empty */
+static void OnDeleteReply(const SensorReply& reply, void* context) {
+  if (reply.status == FINGERPRINT_OK) {
+    Serial.println("Fingerprint deleted from sensor.");
+  } else {
+    Serial.println("Failed to delete fingerprint from sensor.");
+  }
+  PostReplyEvent(kEvtDeleteDone, reply, context, 0);
+}
+
+/* Completion of a template count */
+static void OnCountReply(const SensorReply& reply, void* context) {
+  PostReplyEvent(kEvtTemplateCount, reply, context, reply.value);
+}
+
+/* ReadIndex ack payload: the group's bitmap */
+static void StoreIndexBits(const uint8_t* data, uint16_t length, void* context) {
+  memset(index_bits, 0, sizeof(index_bits));
+  memcpy(index_bits, data, length < sizeof(index_bits) ? length : sizeof(index_bits));
+}
+
+/* Completion of an index read; the group travels in the low byte of the context */
+static void OnIndexReply(const SensorReply& reply, void* context) {
+  if (reply.status != FINGERPRINT_OK) memset(index_bits, 0, sizeof(index_bits));
+  PostReplyEvent(kEvtTemplateIndex, reply, context, (uint8_t)(uintptr_t)context);
+}
+
+/* Hand a restored user to the UI task, which owns the user store */
+static void OnUserRestored(uint16_t id, const char* name, uint8_t shard, uint16_t slot,
+                           void* context) {
+  SensorEvent event = {};
+  event.type = kEvtUserRestored;
+  event.id = id;
+  event.shard = shard;
+  event.slot = slot;
+  strncpy(event.message, name, sizeof(event.message) - 1);
+  PostEvent(event, portMAX_DELAY);  // Every name must reach the store
+}
+
+// Users a backup covers, copied from the directory by the UI task in SendBackupCommand()
+static ArchiveEntry backup_users[kMaxUserId];
+static uint16_t backup_user_count = 0;
+static volatile bool backup_pending = false;  // Set by the UI task, cleared once the job is done
+
+/* Run a backup or restore against the archive on SPIFFS */
+static void RunArchiveJob(SensorCommandType type) {
+  bool backup = (type == kCmdBackup);
+  ArchiveStats stats = {};
+  bool ok = false;
+
+  File file = SPIFFS.open(TEMPLATE_ARCHIVE_PATH, backup ? "w" : "r");
+  if (file) {
+    ok = backup ? BackupTemplates(backup_users, backup_user_count, file, &stats)
+                : RestoreTemplates(file, OnUserRestored, NULL, &stats);
+    file.close();
+  }
+  if (backup) backup_pending = false;
+
+  SensorEvent event = {};
+  event.type = kEvtArchiveDone;
+  event.status = ok ? FINGERPRINT_OK : FINGERPRINT_PACKETRECIEVEERR;
+  event.id = stats.templates;
+  event.slot = stats.skipped;
+  event.pipeline_us = stats.elapsed_ms * 1000;
+  if (ok) {
+    snprintf(event.message, sizeof(event.message), "%s %u templates (%u skipped) in %u ms",
+             backup ? "Backed up" : "Restored", (unsigned)stats.templates,
+             (unsigned)stats.skipped, (unsigned)stats.elapsed_ms);
+  } else {
+    snprintf(event.message, sizeof(event.message), "Template %s failed after %u templates",
+             backup ? "backup" : "restore", (unsigned)stats.templates);
+  }
+  Serial.printf("archive %s ok=%u templates=%u skipped=%u bytes=%u ms=%u\n",
+                backup ? "backup" : "restore", (unsigned)ok, (unsigned)stats.templates,
+                (unsigned)stats.skipped, (unsigned)stats.bytes, (unsigned)stats.elapsed_ms);
+  PostEvent(event, portMAX_DELAY);
+}
+
+/* Negotiate a shard's UART rate */
+static void RunBaudJob(const SensorCommand& command) {
+  uint32_t ceiling = command.slot != 0 ? (uint32_t)command.slot * kSensorBaudUnit
+                                       : (uint32_t)SENSOR_BAUD_MAX;
+  SensorBaudResult result = {};
+  bool ok = command.shard < kSensorShardCount &&
+            NegotiateSensorBaud(command.shard, ceiling, &result);
+
+  SensorEvent event = {};
+  event.type = kEvtBaudDone;
+  event.status = ok ? FINGERPRINT_OK : FINGERPRINT_PACKETRECIEVEERR;
+  event.shard = command.shard;
+  event.pipeline_us = result.elapsed_ms * 1000;
+  snprintf(event.message, sizeof(event.message), "baud=%u tried=%u failed=%u ms=%u",
+           (unsigned)result.baud, (unsigned)result.tried, (unsigned)result.failed,
+           (unsigned)result.elapsed_ms);
+  PostEvent(event, portMAX_DELAY);
+}
+
+/* Capture a raw image and stream it out */
+static void RunImageJob(const SensorCommand& command) {
+  ImageStreamStats stats = {};
+  bool ok = StreamSensorImage((ImageDestination)command.slot, &stats);
+
+  SensorEvent event = {};
+  event.type = kEvtImageDone;
+  if (ok) {
+    event.status = FINGERPRINT_OK;
+  } else {
+    event.status = stats.capture_ms == 0 ? FINGERPRINT_NOFINGER : FINGERPRINT_PACKETRECIEVEERR;
+  }
+  event.slot = command.slot;
+  event.pipeline_us = (stats.capture_ms + stats.transfer_ms) * 1000;
+  snprintf(event.message, sizeof(event.message), "bytes=%u baud=%u ms=%u per_min_x10=%u",
+           (unsigned)stats.bytes, (unsigned)stats.baud,
+           (unsigned)(stats.capture_ms + stats.transfer_ms), (unsigned)stats.PerMinuteX10());
+  PostEvent(event, portMAX_DELAY);
+}
+
+/* Tell the UI task the capture sensor came online or went offline */
+static void PostSensorStatus(bool online) {
+  SensorEvent event = {};
+  event.type = kEvtSensorStatus;
+  event.status = online ? FINGERPRINT_OK : FINGERPRINT_PACKETRECIEVEERR;
+  event.shard = kCaptureShard;
+  PostEvent(event, portMAX_DELAY);  // The UI must never miss a state change
+}
+
+/* Stop treating the capture sensor as present and schedule a handshake */
+static void MarkSensorOffline() {
+  sensor_online = false;
+  next_probe_ms = millis() + kSensorRetryMs;
+  if (offline_reported) return;
+  offline_reported = true;
+  Serial.println("Fingerprint sensor not answering, retrying");
+  PostSensorStatus(false);
+}
+
+/* Completion of a capture sensor handshake */
+static void OnProbeReply(const SensorReply& reply, void* context) {
+  probe_pending = false;
+  if (!BootPhaseDone(kBootSensor)) BootPhaseEnd(kBootSensor);
+  if (reply.status != FINGERPRINT_OK) {
+    MarkSensorOffline();
+    FallBackSensorBaud(kCaptureShard);  // A replaced module starts at the factory rate
+    return;
+  }
+
+  Serial.println("Found fingerprint sensor!");
+  KeepSensorBaud(kCaptureShard);
+  sensor_online = true;
+  offline_reported = false;
+  if (mode == kModeScanning) finger_detector.Reset();  // Resume with a fresh placement
+  PostSensorStatus(true);
+}
+
+/* Handshake with the capture sensor while it is offline, every kSensorRetryMs */
+static void ProbeSensor() {
+  if (sensor_online || probe_pending || (int32_t)(millis() - next_probe_ms) < 0) return;
+  if (sensor_shards[kCaptureShard]->VerifyPassword(OnProbeReply, NULL)) {
+    probe_pending = true;
+  } else {
+    next_probe_ms = millis() + kSensorRetryMs;
+  }
+}
+
+/* Completion of the boot handshake with another shard; it only stores and searches */
+static void OnShardProbeReply(const SensorReply& reply, void* context) {
+  if (reply.status == FINGERPRINT_OK) {
+    Serial.printf("Found fingerprint sensor shard %u\n", (unsigned)(uintptr_t)context);
+  } else {
+    Serial.printf("Fingerprint sensor shard %u not found, its users cannot be matched\n",
+                  (unsigned)(uintptr_t)context);
+  }
+}
+
+/* Apply one command from the UI task */
+static void HandleCommand(const SensorCommand& command) {
+  switch (command.type) {
+    case kCmdStartScan:
+    case kCmdStartVerify:
+      mode = kModeScanning;
+      verify_id = (command.type == kCmdStartVerify) ? command.id : 0;
+      verify_shard = command.shard < kSensorShardCount ? command.shard : kCaptureShard;
+      verify_slot = command.slot;
+      placement_held = false;
+      placement_searches = 0;
+      idle_reported = false;
+      finger_detector.Reset();
+      break;
+    case kCmdStartEnroll:
+      if (!sensor_online) {
+        SensorEvent event = {};
+        event.type = kEvtEnrollFailed;
+        event.id = command.id;
+        strncpy(event.message, "Sensor offline, try again later.", sizeof(event.message) - 1);
+        PostEvent(event);
+        break;
+      }
+      enrollment.Start(command.id, command.shard, command.slot, command.name, millis());
+      mode = kModeEnrolling;
+      PostEnrollEvent(kEvtEnrollPrompt);
+      break;
+    case kCmdStop:
+      enrollment.Cancel();
+      mode = kModeIdle;
+      break;
+    case kCmdDelete:
+      match_cache.Remove(command.shard, command.slot, command.count);
+      if (command.shard >= kSensorShardCount ||
+          !sensor_shards[command.shard]->DeleteModel(command.slot, command.count, OnDeleteReply,
+                                                     ReplyContext(command))) {
+        Serial.println("Sensor queue full, delete dropped");
+      }
+      break;
+    case kCmdEmpty:
+      match_cache.Remove(command.shard, 0, kShardCapacity);
+      if (command.shard >= kSensorShardCount ||
+          !sensor_shards[command.shard]->EmptyLibrary(OnDeleteReply, ReplyContext(command))) {
+        Serial.println("Sensor queue full, empty dropped");
+      }
+      break;
+    case kCmdCountTemplates:
+      if (command.shard >= kSensorShardCount ||
+          !sensor_shards[command.shard]->CountTemplates(OnCountReply, ReplyContext(command))) {
+        Serial.println("Sensor queue full, template count dropped");
+      }
+      break;
+    case kCmdReadIndex: {
+      void* context = (void*)((uintptr_t)ReplyContext(command) | (uint8_t)command.slot);
+      if (command.shard >= kSensorShardCount ||
+          !sensor_shards[command.shard]->ReadIndex((uint8_t)command.slot, StoreIndexBits, NULL,
+                                                   OnIndexReply, context)) {
+        Serial.println("Sensor queue full, index read dropped");
+      }
+      break;
+    }
+    case kCmdWake:
+      break;  // Only wakes the task; the detector already saw the edge
+    case kCmdBackup:
+    case kCmdRestore:
+      // Archive jobs use the scan slot and block the task, so stop everything else
+      enrollment.Cancel();
+      mode = kModeIdle;
+      if (command.type == kCmdRestore) match_cache.Clear();
+      RunArchiveJob(command.type);
+      break;
+    case kCmdSetBaud:
+    case kCmdCaptureImage:
+      // Like archive jobs, these block the task on the sensor UARTs
+      enrollment.Cancel();
+      mode = kModeIdle;
+      if (command.type == kCmdSetBaud) {
+        RunBaudJob(command);
+      } else {
+        RunImageJob(command);
+      }
+      break;
+  }
+}
+
+/* Close the current placement and account for its searches */
+static void EndPlacement() {
+  if (placement_searches > 0) {
+    session_stats.placements++;
+    if (placement_searches > session_stats.max_searches) {
+      session_stats.max_searches = placement_searches;
+    }
+  }
+  placement_held = false;
+  placement_searches = 0;
+}
+
+/* Post a scan outcome to the UI task */
+static void PostScanResult(uint8_t status, uint8_t shard, uint16_t slot, uint16_t confidence) {
+  SensorEvent event = {};
+  event.type = kEvtScanResult;
+  event.status = status;
+  event.shard = shard;
+  event.slot = slot;
+  event.id = verify_id;
+  event.confidence = confidence;
+  event.started_us = scan_started_us;
+  event.pipeline_us = micros() - scan_started_us;
+  PostEvent(event);
+}
+
+/* Account for a finished search and report it if no retry is due */
+static void FinishSearch(uint8_t status, uint8_t shard, uint16_t slot, uint16_t confidence) {
+  placement_searches++;
+  session_stats.searches++;
+  last_search_ms = millis();
+  uint32_t search_us = 0;  // Stays 0 when a cache probe found the user
+  if (search_started_us != 0) {
+    search_us = micros() - search_started_us;
+    match_cache.AddSearch(search_us);
+    search_started_us = 0;
+  }
+  if (status == FINGERPRINT_OK && verify_id == 0) match_cache.OnMatch(shard, slot, search_us);
+
+  // Report a match at once; report a failure only when no retries remain
+  if (status != FINGERPRINT_OK && placement_searches < SCAN_MATCH_ATTEMPTS) return;
+  if (status != FINGERPRINT_OK) status = FINGERPRINT_NOTFOUND;
+
+  PostScanResult(status, shard, slot, confidence);
+  placement_held = true;
+  idle_reported = false;
+}
+
+/* UpChar data: the capture's features, kept for the other shards */
+static void StoreShardFeatures(const uint8_t* data, uint16_t length, void* context) {
+  uint16_t room = kSensorTemplateBytes - shard_features_length;
+  if (length > room) length = room;
+  memcpy(&shard_features[shard_features_length], data, length);
+  shard_features_length += length;
+}
+
+/* DownChar data: the same features, once per shard */
+static uint16_t ReadShardFeatures(uint8_t* data, uint16_t length, void* context) {
+  uint16_t* offset = (uint16_t*)context;
+  uint16_t remaining = kSensorTemplateBytes - *offset;
+  if (length > remaining) length = remaining;
+  memcpy(data, &shard_features[*offset], length);
+  *offset += length;
+  return length;
+}
+
+/* Report the pass once every shard has answered, unless a confident hit already was */
+static void SettleShardSearches() {
+  if (shard_searches_pending > 0) return;
+  scan_step = kScanStepIdle;
+  if (mode != kModeScanning || shard_hit_reported) return;
+
+  // No confident hit anywhere: settle for the best one, if any
+  FinishSearch(shard_best_reply.status, shard_best, shard_best_reply.value,
+               shard_best_reply.score);
+}
+
+/* One shard's download or search finished; the first confident hit wins */
+static void OnShardReply(const SensorReply& reply, void* context) {
+  uint8_t shard = (uint8_t)(uintptr_t)context;
+  ShardStep step = shard_steps[shard];
+  shard_steps[shard] = kShardStepIdle;
+
+  // Features are in the shard's buffer 1: search its library unless a hit already came in
+  if (step == kShardStepDownload && reply.status == FINGERPRINT_OK) {
+    features_shards |= 1 << shard;
+  }
+  if (step == kShardStepDownload && reply.status == FINGERPRINT_OK &&
+      mode == kModeScanning && !shard_hit_reported &&
+      sensor_shards[shard]->Search(1, 0, kShardCapacity, OnShardReply, context)) {
+    shard_steps[shard] = kShardStepSearch;
+    return;
+  }
+
+  shard_searches_pending--;
+  if (step == kShardStepSearch && reply.status == FINGERPRINT_OK &&
+      mode == kModeScanning && !shard_hit_reported) {
+    if (reply.score >= kShardMinConfidence) {
+      shard_hit_reported = true;
+      FinishSearch(FINGERPRINT_OK, shard, reply.value, reply.score);
+    } else if (shard_best_reply.status != FINGERPRINT_OK ||
+               reply.score > shard_best_reply.score) {
+      shard_best_reply = reply;
+      shard_best = shard;
+    }
+  }
+  SettleShardSearches();
+}
+
+/* Hand the read-back features to every shard that does not hold them yet */
+static void DownloadShardFeatures() {
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    if (features_shards & (1 << shard)) continue;
+    shard_offsets[shard] = 0;
+    if (sensor_shards[shard]->DownloadChar(1, ReadShardFeatures, &shard_offsets[shard],
+                                           OnShardReply, (void*)(uintptr_t)shard)) {
+      shard_steps[shard] = kShardStepDownload;
+      shard_searches_pending++;
+    }
+  }
+}
+
+/* Features read back from the capture shard: hand them to every other shard */
+static void OnFeaturesUploaded(const SensorReply& reply, void* context) {
+  shard_searches_pending--;
+  bool uploaded = reply.status == FINGERPRINT_OK &&
+                  shard_features_length == kSensorTemplateBytes;
+
+  if (uploaded && mode == kModeScanning && !shard_hit_reported) DownloadShardFeatures();
+  SettleShardSearches();
+}
+
+/*
+ * Search every shard with one capture. Shards already holding the features,
+ * always the capture shard and any shard a cache probe moved them to, search
+ * straight away. The features are read back from the capture shard, unless
+ * a probe already did, and the remaining shards get them and search in
+ * parallel.
+ */
+static void StartShardSearches() {
+  shard_hit_reported = false;
+  shard_best_reply = SensorReply();
+  shard_best_reply.status = FINGERPRINT_NOTFOUND;
+  shard_searches_pending = 0;
+
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    if (!(features_shards & (1 << shard))) continue;
+    if (sensor_shards[shard]->Search(1, 0, kShardCapacity, OnShardReply, (void*)(uintptr_t)shard)) {
+      shard_steps[shard] = kShardStepSearch;
+      shard_searches_pending++;
+    }
+  }
+  if (features_shards != (1 << kSensorShardCount) - 1) {
+    if (shard_features_length == kSensorTemplateBytes) {
+      DownloadShardFeatures();
+    } else if (sensor_shards[kCaptureShard]->UploadChar(1, StoreShardFeatures, NULL,
+                                                         OnFeaturesUploaded, NULL)) {
+      shard_searches_pending++;
+    }
+  }
+
+  if (shard_searches_pending > 0) {
+    scan_step = kScanStepSearch;
+  } else {
+    FinishSearch(FINGERPRINT_PACKETRECIEVEERR, 0, 0, 0);
+  }
+}
+
+static void OnScanReply(const SensorReply& reply, void* context);
+static void StartPair(uint8_t shard, uint16_t slot);
+
+/* Search the whole library once the cache had no answer, timed for its savings estimate */
+static void StartLibrarySearch() {
+  search_started_us = micros();
+  if (kSensorShardCount > 1) {
+    StartShardSearches();
+  } else if (sensor_shards[kCaptureShard]->Search(1, 0, kShardCapacity, OnScanReply, NULL)) {
+    scan_step = kScanStepSearch;
+  }
+}
+
+/* Probe the next cached template the budget allows, else search the library */
+static void ProbeCacheOrSearch() {
+  bool skipped = false;
+  while (cache_rank < match_cache.count()) {
+    const MatchCacheEntry& entry = match_cache.at(cache_rank);
+    bool moves_features = !(features_shards & (1 << entry.shard));
+    if (match_cache.ProbeFits(cache_rank++, micros() - cache_started_us, moves_features)) {
+      cache_probes++;
+      StartPair(entry.shard, entry.slot);
+      return;
+    }
+    skipped = true;
+  }
+  if (skipped) match_cache.AddSkip();
+  if (cache_probes > 0) match_cache.AddLookup(false);
+  StartLibrarySearch();
+}
+
+/* A 1:1 match finished: report a verify, or go on with the cache probes */
+static void FinishPair(uint8_t status, uint16_t score) {
+  if (verify_id != 0) {
+    FinishSearch(status, pair_shard, pair_slot, score);
+    return;
+  }
+
+  match_cache.AddProbe(micros() - pair_started_us, pair_moves_features);
+  if (status == FINGERPRINT_OK) {
+    match_cache.AddLookup(true);
+    FinishSearch(status, pair_shard, pair_slot, score);
+    return;
+  }
+  if (status == FINGERPRINT_DBREADFAIL) {
+    // The page was emptied behind the cache's back: do not try it again
+    match_cache.Remove(pair_shard, pair_slot, 1);
+    cache_rank--;
+  }
+  ProbeCacheOrSearch();
+}
+
+/* One command of a 1:1 match finished; run the match once both buffers are filled */
+static void OnPairReply(const SensorReply& reply, void* context) {
+  PairStep step = (PairStep)(uintptr_t)context;
+  SensorClient& target = *sensor_shards[pair_shard];
+  pair_pending--;
+  if (reply.status != FINGERPRINT_OK && pair_status == FINGERPRINT_OK) {
+    pair_status = reply.status;
+  }
+
+  if (mode != kModeScanning) {
+    if (pair_pending == 0) scan_step = kScanStepIdle;  // Stopped while on the wire
+    return;
+  }
+
+  if (step == kPairStepDownload && reply.status == FINGERPRINT_OK) {
+    features_shards |= 1 << pair_shard;
+  }
+  if (step == kPairStepUpload && pair_status == FINGERPRINT_OK) {
+    // Features are out of the capture shard: put them in the template shard's buffer 1
+    shard_offsets[pair_shard] = 0;
+    if (shard_features_length == kSensorTemplateBytes &&
+        target.DownloadChar(1, ReadShardFeatures, &shard_offsets[pair_shard], OnPairReply,
+                            (void*)(uintptr_t)kPairStepDownload)) {
+      pair_pending++;
+    } else {
+      pair_status = FINGERPRINT_PACKETRECIEVEERR;
+    }
+  }
+  if (pair_pending > 0) return;
+
+  scan_step = kScanStepIdle;
+  if (step == kPairStepMatch) {
+    // A 1:1 match carries its score where a search carries the page
+    FinishPair(pair_status, reply.value);
+  } else if (pair_status != FINGERPRINT_OK) {
+    FinishPair(pair_status, 0);
+  } else if (target.Match(OnPairReply, (void*)(uintptr_t)kPairStepMatch)) {
+    pair_pending++;
+    scan_step = kScanStepPair;
+  } else {
+    FinishPair(FINGERPRINT_PACKETRECIEVEERR, 0);
+  }
+}
+
+/*
+ * Match the capture against one stored template. The template is loaded
+ * into buffer 2 of its shard while, if that shard does not hold the
+ * features yet, they travel there into buffer 1; then one match runs. The
+ * cost does not grow with the number of templates stored.
+ */
+static void StartPair(uint8_t shard, uint16_t slot) {
+  SensorClient& target = *sensor_shards[shard];
+  pair_shard = shard;
+  pair_slot = slot;
+  pair_pending = 0;
+  pair_status = FINGERPRINT_OK;
+  pair_started_us = micros();
+  pair_moves_features = !(features_shards & (1 << shard));
+
+  if (target.LoadModel(slot, 2, OnPairReply, (void*)(uintptr_t)kPairStepLoad)) {
+    pair_pending++;
+  } else {
+    pair_status = FINGERPRINT_PACKETRECIEVEERR;
+  }
+  if (pair_moves_features && pair_status == FINGERPRINT_OK) {
+    bool uploaded = shard_features_length == kSensorTemplateBytes;
+    shard_offsets[shard] = 0;
+    if (uploaded ? target.DownloadChar(1, ReadShardFeatures, &shard_offsets[shard], OnPairReply,
+                                       (void*)(uintptr_t)kPairStepDownload)
+                 : sensor_shards[kCaptureShard]->UploadChar(1, StoreShardFeatures, NULL,
+                                                            OnPairReply,
+                                                            (void*)(uintptr_t)kPairStepUpload)) {
+      pair_pending++;
+    } else {
+      pair_status = FINGERPRINT_PACKETRECIEVEERR;
+    }
+  }
+
+  if (pair_pending > 0) {
+    scan_step = kScanStepPair;
+  } else {
+    FinishPair(pair_status, 0);
+  }
+}
+
+/* Completion of each command in the scan chain; queues the next one */
+static void OnScanReply(const SensorReply& reply, void* context) {
+  ScanStep step = scan_step;
+  scan_step = kScanStepIdle;
+  if (mode != kModeScanning) return;  // Scanning stopped while on the wire
+
+  SensorClient& capture = *sensor_shards[kCaptureShard];
+  switch (step) {
+    case kScanStepCapture:
+      if (reply.status == FINGERPRINT_TIMEOUT) {
+        MarkSensorOffline();  // Resumes from the handshake once it answers again
+        return;
+      }
+      finger_detector.OnCaptureResult(reply.status != FINGERPRINT_NOFINGER, micros());
+
+      if (reply.status == FINGERPRINT_NOFINGER) {
+        // Lift-off: re-arm, leaving the last result on screen
+        EndPlacement();
+        if (!idle_reported) {
+          PostScanResult(FINGERPRINT_NOFINGER, 0, 0, 0);
+          idle_reported = true;
+        }
+        return;
+      }
+
+      // Same finger still down after a final result, or a bad capture to retry
+      if (placement_held || reply.status != FINGERPRINT_OK) return;
+      if (placement_searches > 0 && millis() - last_search_ms < kScanRetryIntervalMs) return;
+
+      if (capture.Image2Tz(1, OnScanReply, NULL)) scan_step = kScanStepConvert;
+      break;
+
+    case kScanStepConvert:
+      if (reply.status != FINGERPRINT_OK) {
+        FinishSearch(reply.status, 0, 0, 0);
+        break;
+      }
+
+      // Fresh features, so far only in the capture shard's buffer 1
+      features_shards = 1 << kCaptureShard;
+      shard_features_length = 0;
+      search_started_us = 0;
+      if (verify_id != 0) {
+        StartPair(verify_shard, verify_slot);
+      } else {
+        cache_rank = 0;
+        cache_probes = 0;
+        cache_started_us = micros();
+        match_cache.BeginPass();
+        ProbeCacheOrSearch();
+      }
+      break;
+
+    case kScanStepSearch:
+      FinishSearch(reply.status, kCaptureShard, reply.value, reply.score);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/*
+ * Start one scan pass. A new placement is searched once; a failed search is
+ * retried up to SCAN_MATCH_ATTEMPTS times while the finger stays down.
+ * After that only a cheap getImage runs until the finger lifts.
+ */
+static void RunScan() {
+  scan_started_us = micros();
+  if (sensor_shards[kCaptureShard]->GetImage(OnScanReply, NULL)) scan_step = kScanStepCapture;
+}
+
+/* Wait before the next scan pass, given where the placement stands */
+static TickType_t ScanWaitTicks() {
+  if (placement_held) return pdMS_TO_TICKS(kScanLiftPollMs);
+  if (placement_searches > 0) return pdMS_TO_TICKS(kScanRetryIntervalMs);
+  if (finger_detector.active()) return pdMS_TO_TICKS(kSensorPollMs);
+
+  // Nobody on the sensor: sleep until the wake line fires or the next poll
+  uint32_t idle_ms = finger_detector.IdleWaitMs();
+  return (idle_ms == kFingerWaitForever) ? portMAX_DELAY : pdMS_TO_TICKS(idle_ms);
+}
+
+/* One enrollment step, reporting every state change */
+static void RunEnrollment() {
+  if (!enrollment.Tick(millis())) return;
+
+  switch (enrollment.state()) {
+    case kEnrollDone:
+      PostEnrollEvent(kEvtEnrollDone);
+      mode = kModeIdle;
+      break;
+    case kEnrollFailed:
+      PostEnrollEvent(kEvtEnrollFailed);
+      mode = kModeIdle;
+      break;
+    default:
+      PostEnrollEvent(kEvtEnrollPrompt);
+      break;
+  }
+}
+
+/* Task body: block while idle, otherwise interleave commands, UART polling and passes */
+static void SensorTask(void* param) {
+  SensorCommand command;
+
+  // Handshake here rather than in setup(), so the UI is up while the sensors answer
+  BootPhaseStart(kBootSensor);
+  ProbeSensor();
+  for (uint8_t shard = 0; shard < kSensorShardCount; shard++) {
+    if (shard == kCaptureShard) continue;
+    sensor_shards[shard]->VerifyPassword(OnShardProbeReply, (void*)(uintptr_t)shard);
+  }
+
+  for (;;) {
+    TickType_t wait = pdMS_TO_TICKS(kSensorPollMs);
+    if (SensorShardsBusy()) {
+      wait = 1;  // A reply is due; keep polling the UARTs
+    } else if (!sensor_online) {
+      int32_t probe_in_ms = (int32_t)(next_probe_ms - millis());
+      wait = probe_in_ms > 0 ? pdMS_TO_TICKS(probe_in_ms) : 0;
+    } else if (mode == kModeIdle) {
+      wait = portMAX_DELAY;
+    } else if (mode == kModeScanning) {
+      wait = ScanWaitTicks();
+    }
+
+    while (xQueueReceive(command_queue, &command, wait) == pdTRUE) {
+      HandleCommand(command);
+      wait = 0;  // Drain the rest without waiting
+    }
+
+    PollSensorShards(millis());
+
+    if (!sensor_online) {
+      ProbeSensor();
+    } else if (mode == kModeScanning) {
+      if (scan_step == kScanStepIdle && finger_detector.BeginPass()) RunScan();
+    } else if (mode == kModeEnrolling) {
+      RunEnrollment();
+    }
+
+    // Put anything just queued on the wire without waiting a tick
+    PollSensorShards(millis());
+  }
+}
+
+/* Wake ISR hook: rouse the sensor task through its command queue */
+static void IRAM_ATTR WakeSensorTaskFromISR() {
+  SensorCommand command = {kCmdWake, 0, 0, 0, 0};
+  BaseType_t higher_priority_woken = pdFALSE;
+  xQueueSendFromISR(command_queue, &command, &higher_priority_woken);
+  if (higher_priority_woken) portYIELD_FROM_ISR();
+}
+
+/* Create the message queues and start the pinned sensor task */
+void StartSensorTask() {
+  command_queue = xQueueCreate(kSensorQueueLength, sizeof(SensorCommand));
+  event_queue = xQueueCreate(kSensorQueueLength, sizeof(SensorEvent));
+  finger_detector.Begin(FINGER_WAKE_PIN, WakeSensorTaskFromISR);
+
+  xTaskCreatePinnedToCore(SensorTask, "sensor", kSensorTaskStackSize, NULL,
+                          kSensorTaskPriority, &sensor_task_handle, kSensorTaskCore);
+}
+
+/* Stack high-water mark of the sensor task; ESP-IDF counts it in bytes */
+UBaseType_t SensorTaskStackHighWater() {
+  return sensor_task_handle != NULL ? uxTaskGetStackHighWaterMark(sensor_task_handle) : 0;
+}
+
+/* Post a command to the sensor task; called from the UI task only */
+bool SendSensorCommand(SensorCommandType type, uint16_t id, uint8_t shard, uint16_t slot,
+                       uint16_t count) {
+  SensorCommand command = {type, id, shard, slot, count};
+  return xQueueSend(command_queue, &command, 0) == pdTRUE;
+}
+
+/* Queue an enrollment; the name travels with it so the UI can save it when it is done */
+bool SendEnrollCommand(uint16_t id, uint8_t shard, uint16_t slot, const char* name) {
+  SensorCommand command = {kCmdStartEnroll, id, shard, slot, 1};
+  strncpy(command.name, name, kMaxUserNameLength);
+  return xQueueSend(command_queue, &command, 0) == pdTRUE;
+}
+
+/* Snapshot the users and queue a backup of their templates; called from the UI task only */
+bool SendBackupCommand() {
+  if (backup_pending) return false;  // The running backup still reads the snapshot
+  backup_user_count = SnapshotArchiveUsers(backup_users);
+  backup_pending = true;
+  if (SendSensorCommand(kCmdBackup)) return true;
+  backup_pending = false;
+  return false;
+}
+
+/* Pop the next sensor event without blocking; called from the UI task only */
+bool ReceiveSensorEvent(SensorEvent* event) {
+  return xQueueReceive(event_queue, event, 0) == pdTRUE;
+}
+
+/* Searches-per-placement counters, written by the sensor task */
+const ScanSessionStats& GetScanSessionStats() {
+  return session_stats;
+}
@@ -0,0 +1,112 @@
+// sensor_task.h
+
+#ifndef SENSOR_TASK_H_
+#define SENSOR_TASK_H_
+
+#include <Arduino.h>
+#include "user_directory.h"
+
+// Sensor task configuration
+const BaseType_t kSensorTaskCore = 0;        // Core 0; loop() and LVGL run on core 1
+const uint32_t kSensorTaskStackSize = 4096;  // Stack size in bytes
+const UBaseType_t kSensorTaskPriority = 2;   // Above the Arduino loop task
+const uint32_t kSensorPollMs = 5;            // Gap between sensor passes while active
+const uint8_t kSensorQueueLength = 8;        // Depth of each message queue
+const uint32_t kSensorRetryMs = 2000;        // Gap between handshakes while the sensor is offline
+
+// Scan session policy
+#ifndef SCAN_MATCH_ATTEMPTS
+#define SCAN_MATCH_ATTEMPTS 3                // Searches per placement before "No Match"
+#endif
+const uint32_t kScanRetryIntervalMs = 150;   // Pause between searches of one placement
+const uint32_t kScanLiftPollMs = 50;         // getImage interval while waiting for lift-off
+
+// Requests sent from the UI task to the sensor task
+enum SensorCommandType {
+  kCmdStartScan,    // Start continuous 1:N matching
+  kCmdStartVerify,  // Start continuous 1:1 matching of command.id against its shard/slot
+  kCmdStartEnroll,  // Start enrolling command.id onto command.shard/slot
+  kCmdStop,         // Stop scanning or cancel enrollment
+  kCmdDelete,       // Delete command.count templates from command.shard/slot on
+  kCmdEmpty,        // Delete every template on command.shard
+  kCmdCountTemplates,  // Count the templates stored on command.shard; the reply echoes id
+  kCmdReadIndex,    // Read the used-page bitmap of group command.slot on command.shard, echoing id
+  kCmdWake,         // Finger touched the sensor (posted by the wake ISR)
+  kCmdBackup,       // Write the snapshot's templates and names to TEMPLATE_ARCHIVE_PATH
+  kCmdRestore,      // Store every template in TEMPLATE_ARCHIVE_PATH on the sensor
+  kCmdSetBaud,      // Negotiate command.shard's UART rate, at most command.slot * 9600 (0: any)
+  kCmdCaptureImage  // Stream a raw image to the ImageDestination in command.slot
+};
+
+struct SensorCommand {
+  SensorCommandType type;
+  uint16_t id;     // User ID for enroll and verify
+  uint8_t shard;   // Sensor module for enroll, verify and delete
+  uint16_t slot;   // Template page on that module
+  uint16_t count;  // Templates to delete
+  char name[kMaxUserNameLength + 1];  // User being enrolled, returned in the done event
+};
+
+// Notifications sent from the sensor task to the UI task
+enum SensorEventType {
+  kEvtScanResult,     // Scan status changed, see status/shard/slot/confidence
+  kEvtEnrollPrompt,   // Enrollment moved to a new state, see message
+  kEvtEnrollDone,     // Template for id stored at shard/slot, user named in message
+  kEvtEnrollFailed,   // Enrollment stopped, see message
+  kEvtUserRestored,   // Template for id restored at shard/slot, user named in message
+  kEvtArchiveDone,    // Backup or restore finished, see status/id (count)/slot (skipped)/message
+  kEvtDeleteDone,     // Delete or empty on shard finished, see status; id echoes the command
+  kEvtTemplateCount,  // Template count of shard in slot, see status; id echoes the command
+  kEvtTemplateIndex,  // Index group slot of shard, bitmap in message, see status; id echoes it
+  kEvtSensorStatus,   // Capture sensor came online (status FINGERPRINT_OK) or stopped answering
+  kEvtBaudDone,       // Rate negotiation on shard finished, see status; summary in message
+  kEvtImageDone       // Raw image capture finished, see status; summary in message
+};
+
+struct SensorEvent {
+  SensorEventType type;
+  uint8_t status;        // FINGERPRINT_* status for scan results
+  uint16_t id;           // Enrolled or restored user ID, claimed user of a verify result,
+                         // or the command's id for deletes, counts and index reads
+  uint8_t shard;         // Sensor module of the matched or stored template
+  uint16_t slot;         // Template page on that module
+  uint16_t confidence;   // Match confidence reported by the sensor
+  uint32_t started_us;   // micros() when the sensor pass began
+  uint32_t pipeline_us;  // Time spent in sensor commands for this pass
+  char message[64];      // Prompt text for enrollment events, name or summary for archives,
+                         // bitmap for index events, key=value fields for baud and image jobs
+};
+
+/* Counters for the one-match-per-placement scan sessions */
+struct ScanSessionStats {
+  uint32_t placements;    // Finger placements that were searched
+  uint32_t searches;      // image2Tz + fingerSearch passes run
+  uint8_t max_searches;   // Most searches spent on a single placement
+};
+
+/*
+ * Sensor pipeline pinned to the core LVGL does not use.
+ *
+ * The task owns every call into the fingerprint sensor. The UI task drives
+ * it with SendSensorCommand() and drains results with ReceiveSensorEvent(),
+ * so no LVGL call is ever made from the sensor task and no state is shared
+ * between the two besides the queues. A backup reads a snapshot of the
+ * users that SendBackupCommand() takes before posting it, never the live
+ * directory; restored names go back as events.
+ * Archive, baud and image jobs block the task until they finish.
+ * Templates are addressed by shard and page; the UI maps them to user IDs.
+ * The task handshakes with the sensor itself, so boot never waits on it;
+ * while the capture sensor does not answer, it retries every kSensorRetryMs
+ * and holds scans and enrollments back.
+ */
+void StartSensorTask();                              // Create queues and the task
+bool SendSensorCommand(SensorCommandType type, uint16_t id = 0, uint8_t shard = 0,
+                       uint16_t slot = 0, uint16_t count = 1);  // Post a command
+bool SendEnrollCommand(uint16_t id, uint8_t shard, uint16_t slot,
+                       const char* name);                // Post kCmdStartEnroll for a named user
+bool SendBackupCommand();                            // Snapshot the users, post kCmdBackup
+bool ReceiveSensorEvent(SensorEvent* event);         // Pop one event, non-blocking
+const ScanSessionStats& GetScanSessionStats();       // Searches-per-placement counters
+UBaseType_t SensorTaskStackHighWater();              // Least stack the task has had free, in bytes
+
+#endif  // SENSOR_TASK_H_
@@ -0,0 +1,47 @@
+// spi_bus.cpp
+
+#include "spi_bus.h"
+#include "hardware.h"
+
+// Arbiter for the display and touch SPI bus
+SpiBusArbiter spi_bus;
+
+SpiBusArbiter::SpiBusArbiter() : owner_(kOwnerNone) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+/* Open the display transaction; it stays open across flushes */
+void SpiBusArbiter::AcquireDisplay() {
+  if (owner_ == kOwnerDisplay) return;
+  tft.startWrite();
+  owner_ = kOwnerDisplay;
+}
+
+/* Wait for the last DMA transfer and hand the bus back */
+void SpiBusArbiter::ReleaseDisplay() {
+  if (owner_ != kOwnerDisplay) return;
+  if (tft.dmaBusy()) stats_.dma_waits++;
+  tft.dmaWait();
+  tft.endWrite();
+  owner_ = kOwnerNone;
+}
+
+/* Take the bus for one touch read, unless a DMA transfer still holds it */
+bool SpiBusArbiter::TryAcquireTouch() {
+  if (owner_ == kOwnerDisplay) {
+    if (tft.dmaBusy()) {
+      stats_.touch_deferred++;
+      return false;
+    }
+    tft.endWrite();  // Transfer done: closing the transaction does not wait
+  }
+  owner_ = kOwnerTouch;
+  return true;
+}
+
+/* Give the bus back after a touch read and account for it */
+void SpiBusArbiter::ReleaseTouch(uint32_t started_us) {
+  stats_.touch_reads++;
+  stats_.touch_us += micros() - started_us;
+  owner_ = kOwnerNone;
+}
@@ -0,0 +1,61 @@
+// spi_bus.h
+
+#ifndef SPI_BUS_H_
+#define SPI_BUS_H_
+
+#include <Arduino.h>
+
+// Display SPI clock, used to turn flushed pixels into bus time
+#ifndef DISPLAY_SPI_HZ
+#define DISPLAY_SPI_HZ 40000000
+#endif
+
+/* Counters describing who kept the shared SPI bus busy */
+struct SpiBusStats {
+  uint32_t display_pixels;   // Pixels sent by DMA
+  uint32_t touch_reads;      // Touch controller transactions
+  uint32_t touch_us;         // Time spent in them
+  uint32_t touch_deferred;   // Touch reads skipped because a DMA transfer was in flight
+  uint32_t dma_waits;        // Times the display bus had to wait for DMA before closing
+
+  // Bus time of the DMA transfers at 16 bits per pixel
+  uint32_t DisplayUs() const {
+    return (uint32_t)((uint64_t)display_pixels * 16 * 1000000 / DISPLAY_SPI_HZ);
+  }
+};
+
+/*
+ * Hands the SPI bus shared by the panel and the touch controller to one of
+ * them at a time.
+ *
+ * The display keeps the bus across flushes so consecutive stripes do not
+ * reopen the transaction. Touch never waits for it: TryAcquireTouch() only
+ * succeeds when no DMA transfer is in flight, closes the display transaction
+ * and returns, so a touch read neither preempts a transfer nor stalls the UI
+ * task behind one. A refused read is simply retried on the next loop pass.
+ * Both users run on the UI task, so no lock is needed.
+ */
+class SpiBusArbiter {
+ public:
+  SpiBusArbiter();
+
+  void AcquireDisplay();        // Open the display transaction if it is not already
+  void AddDisplayPixels(uint32_t pixels) { stats_.display_pixels += pixels; }
+  void ReleaseDisplay();        // Wait for the last transfer and close the transaction
+  bool TryAcquireTouch();       // False while a DMA transfer is in flight
+  void ReleaseTouch(uint32_t started_us);  // End a touch read begun at started_us
+
+  const SpiBusStats& stats() const { return stats_; }
+  void ResetStats() { memset(&stats_, 0, sizeof(stats_)); }
+
+ private:
+  enum Owner { kOwnerNone, kOwnerDisplay, kOwnerTouch };
+
+  Owner owner_;
+  SpiBusStats stats_;
+};
+
+// Arbiter for the display and touch SPI bus
+extern SpiBusArbiter spi_bus;
+
+#endif  // SPI_BUS_H_
@@ -0,0 +1,88 @@
+// stage_timing.cpp
+
+#include "stage_timing.h"
+
+#if STAGE_TIMING
+
+#include <Adafruit_Fingerprint.h>
+
+// Stage names as printed by DumpStageHistograms()
+static const char* const kStageNames[kStageCount] = {
+    "capture", "extract", "search", "match", "transfer",
+    "model", "store", "lookup", "label", "flush"};
+
+static StageHistogram histograms[kStageCount];
+
+/* Add one duration, measured in CPU cycles, to a stage's histogram */
+void RecordStage(Stage stage, uint32_t cycles) {
+  uint32_t us = cycles / ESP.getCpuFreqMHz();
+
+  // Bucket = position of the highest set bit, so the cost is a few instructions
+  uint8_t bucket = 0;
+  for (uint32_t v = us >> 1; v != 0 && bucket < kStageBuckets - 1; v >>= 1) bucket++;
+
+  StageHistogram& histogram = histograms[stage];
+  histogram.count++;
+  histogram.total_us += us;
+  if (us > histogram.max_us) histogram.max_us = us;
+  histogram.buckets[bucket]++;
+}
+
+/* Record a completed sensor command under the stage it belongs to */
+void RecordSensorStage(uint8_t command, uint32_t cycles) {
+  switch (command) {
+    case FINGERPRINT_GETIMAGE:
+      RecordStage(kStageCapture, cycles);
+      break;
+    case FINGERPRINT_IMAGE2TZ:
+      RecordStage(kStageExtract, cycles);
+      break;
+    case FINGERPRINT_SEARCH:
+    case FINGERPRINT_HISPEEDSEARCH:
+      RecordStage(kStageSearch, cycles);
+      break;
+    case FINGERPRINT_MATCH:
+      RecordStage(kStageMatch, cycles);
+      break;
+    case FINGERPRINT_UPLOAD:
+    case FINGERPRINT_DOWNCHAR:
+    case FINGERPRINT_LOAD:
+      RecordStage(kStageTransfer, cycles);
+      break;
+    case FINGERPRINT_REGMODEL:
+      RecordStage(kStageModel, cycles);
+      break;
+    case FINGERPRINT_STORE:
+      RecordStage(kStageStore, cycles);
+      break;
+    default:
+      break;  // Deletes, counts and handshakes are not pipeline stages
+  }
+}
+
+/*
+ * One line per stage, "stage <name> n=<count> mean_us=<..> max_us=<..> hist=<b0>,<b1>,..",
+ * where bucket i counts durations in [2^i, 2^(i+1)) us. Counters are read
+ * while the tasks keep writing them, so a line may be one sample behind.
+ */
+void DumpStageHistograms() {
+  Serial.printf("stages buckets=%u unit=us base=2\n", (unsigned)kStageBuckets);
+  for (uint8_t stage = 0; stage < kStageCount; stage++) {
+    const StageHistogram& histogram = histograms[stage];
+    Serial.printf("stage %s n=%u mean_us=%u max_us=%u hist=", kStageNames[stage],
+                  (unsigned)histogram.count,
+                  (unsigned)(histogram.count ? histogram.total_us / histogram.count : 0),
+                  (unsigned)histogram.max_us);
+    for (uint8_t bucket = 0; bucket < kStageBuckets; bucket++) {
+      Serial.printf(bucket ? ",%u" : "%u", (unsigned)histogram.buckets[bucket]);
+    }
+    Serial.println();
+  }
+  Serial.println("stages end");
+}
+
+void ResetStageHistograms() {
+  memset(histograms, 0, sizeof(histograms));
+}
+
+#endif  // STAGE_TIMING
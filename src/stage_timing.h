@@ -0,0 +1,59 @@
+// stage_timing.h
+
+#ifndef STAGE_TIMING_H_
+#define STAGE_TIMING_H_
+
+#include <Arduino.h>
+
+// Set to 1 to time every pipeline stage; at 0 the macros below compile to nothing
+#ifndef STAGE_TIMING
+#define STAGE_TIMING 0
+#endif
+
+// Histogram buckets: bucket 0 is under 2 us, bucket i covers [2^i, 2^(i+1)) us
+const uint8_t kStageBuckets = 22;  // The last bucket collects everything from ~2 s up
+
+// Pipeline stages, each written by one task only
+enum Stage {
+  kStageCapture,   // getImage on the sensor (sensor task)
+  kStageExtract,   // image2Tz (sensor task)
+  kStageSearch,    // search on one shard (sensor task)
+  kStageMatch,     // 1:1 match against a claimed user's template (sensor task)
+  kStageTransfer,  // UpChar/DownChar of features or a template, loadChar (sensor task)
+  kStageModel,     // regModel while enrolling (sensor task)
+  kStageStore,     // store while enrolling or restoring (sensor task)
+  kStageLookup,    // Shard/page to user ID and name (UI task)
+  kStageLabel,     // Result label update (UI task)
+  kStageFlush,     // One MyDispFlush() call (UI task)
+  kStageCount
+};
+
+/* Fixed-bucket histogram of one stage's durations */
+struct StageHistogram {
+  uint32_t count;
+  uint64_t total_us;
+  uint32_t max_us;
+  uint32_t buckets[kStageBuckets];
+};
+
+#if STAGE_TIMING
+
+/* CPU cycle counter of the calling core; stages start and stop on the same core */
+inline uint32_t StageCycles() { return ESP.getCycleCount(); }
+
+void RecordStage(Stage stage, uint32_t cycles);               // Add one duration
+void RecordSensorStage(uint8_t command, uint32_t cycles);     // Stage chosen by instruction
+void DumpStageHistograms();                                   // Print every stage on Serial
+void ResetStageHistograms();
+
+#define STAGE_TIMER_START(timer) uint32_t timer = StageCycles()
+#define STAGE_TIMER_STOP(stage, timer) RecordStage(stage, StageCycles() - (timer))
+
+#else
+
+#define STAGE_TIMER_START(timer)
+#define STAGE_TIMER_STOP(stage, timer)
+
+#endif  // STAGE_TIMING
+
+#endif  // STAGE_TIMING_H_
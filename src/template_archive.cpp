@@ -0,0 +1,201 @@
+// template_archive.cpp
+
+#include "template_archive.h"
+
+// Char buffer used for transfers; slot 1 is also the scan slot, so jobs stop scanning first
+const uint8_t kArchiveSlot = 1;
+
+// One template, off the sensor task's stack
+static uint8_t template_buffer[kSensorTemplateBytes];
+
+/* CRC-16/CCITT-FALSE, continued from a previous value */
+static uint16_t Crc16(uint16_t crc, const uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+/* Upload progress into template_buffer */
+struct UploadState {
+  uint16_t length;
+};
+
+static void StoreUploadChunk(const uint8_t* data, uint16_t length, void* context) {
+  UploadState* state = (UploadState*)context;
+  uint16_t room = kSensorTemplateBytes - state->length;
+  if (length > room) length = room;
+  memcpy(&template_buffer[state->length], data, length);
+  state->length += length;
+}
+
+/* Download progress straight out of the archive stream */
+struct DownloadState {
+  Stream* in;
+  uint16_t remaining;  // Template bytes not yet read from the stream
+  uint16_t crc;
+};
+
+static uint16_t ReadDownloadChunk(uint8_t* data, uint16_t length, void* context) {
+  DownloadState* state = (DownloadState*)context;
+  if (length > state->remaining) length = state->remaining;
+  uint16_t read = state->in->readBytes((char*)data, length);
+  state->remaining -= read;
+  state->crc = Crc16(state->crc, data, read);
+  return read;
+}
+
+/* Copy the directory's users into archive entries; called from the UI task only */
+uint16_t SnapshotArchiveUsers(ArchiveEntry* users) {
+  uint16_t count = 0;
+  for (uint16_t id = user_directory.NextId(0); id != 0; id = user_directory.NextId(id)) {
+    uint8_t shard = 0;
+    uint16_t slot = 0;
+    user_directory.Locate(id, &shard, &slot);
+
+    // Fields are set one by one; the entry is packed, so no pointers into it
+    ArchiveEntry& entry = users[count++];
+    memset(&entry, 0, sizeof(entry));
+    entry.id = id;
+    entry.shard = shard;
+    entry.slot = slot;
+    strncpy(entry.name, user_directory.Find(id), kMaxUserNameLength);
+  }
+  return count;
+}
+
+/* Write the template of every user in a snapshot, with its name, to an archive stream */
+bool BackupTemplates(const ArchiveEntry* users, uint16_t count, Stream& out,
+                     ArchiveStats* stats) {
+  uint32_t started_ms = millis();
+  memset(stats, 0, sizeof(ArchiveStats));
+
+  ArchiveHeader header = {kArchiveMagic, kArchiveVersion, kSensorTemplateBytes};
+  if (out.write((const uint8_t*)&header, sizeof(header)) != sizeof(header)) return false;
+  stats->bytes += sizeof(header);
+
+  for (uint16_t i = 0; i < count; i++) {
+    const ArchiveEntry& entry = users[i];
+    uint16_t id = entry.id;
+    uint16_t slot = entry.slot;
+    SensorClient& sensor = *sensor_shards[entry.shard];
+
+    // loadModel into the slot, then getModel streams it back out
+    uint8_t load_params[] = {kArchiveSlot, (uint8_t)(slot >> 8), (uint8_t)(slot & 0xFF)};
+    UploadState upload = {0};
+    uint8_t p = sensor.Call(FINGERPRINT_LOAD, load_params, sizeof(load_params),
+                            kSensorDefaultTimeoutMs);
+    if (p == FINGERPRINT_OK) {
+      p = sensor.Call(FINGERPRINT_UPLOAD, &kArchiveSlot, 1, kSensorDefaultTimeoutMs, NULL,
+                      StoreUploadChunk, NULL, &upload);
+    }
+    if (p != FINGERPRINT_OK || upload.length != kSensorTemplateBytes) {
+      Serial.printf("Backup skipped ID %u (status 0x%02X)\n", (unsigned)id, p);
+      stats->skipped++;
+      continue;
+    }
+
+    uint16_t crc = Crc16(0xFFFF, (const uint8_t*)&entry, sizeof(entry));
+    crc = Crc16(crc, template_buffer, kSensorTemplateBytes);
+    size_t written = out.write((const uint8_t*)&entry, sizeof(entry));
+    written += out.write(template_buffer, kSensorTemplateBytes);
+    written += out.write((const uint8_t*)&crc, sizeof(crc));
+    stats->bytes += written;
+    if (written != sizeof(entry) + kSensorTemplateBytes + sizeof(crc)) return false;
+    stats->templates++;
+  }
+
+  uint16_t trailer[] = {kArchiveEndId, stats->templates};
+  if (out.write((const uint8_t*)trailer, sizeof(trailer)) != sizeof(trailer)) return false;
+  stats->bytes += sizeof(trailer);
+  stats->elapsed_ms = millis() - started_ms;
+  return true;
+}
+
+/* Download and store every template in an archive stream */
+bool RestoreTemplates(Stream& in, ArchiveRestoreCallback on_restored, void* context,
+                      ArchiveStats* stats) {
+  uint32_t started_ms = millis();
+  memset(stats, 0, sizeof(ArchiveStats));
+
+  ArchiveHeader header;
+  if (in.readBytes((char*)&header, sizeof(header)) != sizeof(header) ||
+      header.magic != kArchiveMagic || header.version == 0 || header.version > kArchiveVersion ||
+      header.template_bytes != kSensorTemplateBytes) {
+    Serial.println("Template archive header is invalid");
+    return false;
+  }
+  stats->bytes += sizeof(header);
+
+  for (;;) {
+    ArchiveEntry entry;
+    if (in.readBytes((char*)&entry.id, sizeof(entry.id)) != sizeof(entry.id)) break;
+    if (entry.id == kArchiveEndId) {
+      uint16_t count = 0;
+      in.readBytes((char*)&count, sizeof(count));
+      stats->bytes += sizeof(entry.id) + sizeof(count);
+      stats->elapsed_ms = millis() - started_ms;
+      return count == stats->templates + stats->skipped;
+    }
+    uint16_t entry_crc = Crc16(0xFFFF, (const uint8_t*)&entry.id, sizeof(entry.id));
+    if (header.version >= 2) {
+      size_t placement = sizeof(entry.shard) + sizeof(entry.slot);
+      if (in.readBytes((char*)&entry.shard, placement) != placement) break;
+      entry_crc = Crc16(entry_crc, (const uint8_t*)&entry.shard, placement);
+    } else {
+      entry.shard = 0;
+      entry.slot = entry.id;
+    }
+    if (in.readBytes(entry.name, sizeof(entry.name)) != sizeof(entry.name)) break;
+    entry_crc = Crc16(entry_crc, (const uint8_t*)entry.name, sizeof(entry.name));
+    entry.name[kMaxUserNameLength] = '\0';
+    size_t entry_bytes = header.version >= 2 ? sizeof(entry) : sizeof(entry.id) + sizeof(entry.name);
+
+    // The sensor pulls the template out of the stream packet by packet
+    bool placeable = entry.id != 0 && entry.id <= kMaxUserId &&
+                     entry.shard < kSensorShardCount && entry.slot < kShardCapacity;
+    DownloadState download = {&in, kSensorTemplateBytes, entry_crc};
+    uint8_t p = FINGERPRINT_BADLOCATION;
+    if (placeable) {
+      p = sensor_shards[entry.shard]->Call(FINGERPRINT_DOWNCHAR, &kArchiveSlot, 1,
+                                           kSensorDefaultTimeoutMs, NULL, NULL,
+                                           ReadDownloadChunk, &download);
+    }
+
+    // Stay aligned with the next entry even if the download was refused
+    while (download.remaining > 0) {
+      uint16_t chunk = download.remaining < sizeof(template_buffer) ? download.remaining
+                                                                    : sizeof(template_buffer);
+      if (ReadDownloadChunk(template_buffer, chunk, &download) != chunk) break;
+    }
+    uint16_t crc = 0;
+    if (download.remaining > 0 || in.readBytes((char*)&crc, sizeof(crc)) != sizeof(crc)) break;
+    stats->bytes += entry_bytes + kSensorTemplateBytes + sizeof(crc);
+
+    if (p != FINGERPRINT_OK || crc != download.crc) {
+      Serial.printf("Restore skipped ID %u (status 0x%02X)\n", (unsigned)entry.id, p);
+      stats->skipped++;
+      continue;
+    }
+
+    uint8_t store_params[] = {kArchiveSlot, (uint8_t)(entry.slot >> 8),
+                              (uint8_t)(entry.slot & 0xFF)};
+    p = sensor_shards[entry.shard]->Call(FINGERPRINT_STORE, store_params, sizeof(store_params),
+                                         kSensorDefaultTimeoutMs);
+    if (p != FINGERPRINT_OK) {
+      stats->skipped++;
+      continue;
+    }
+    stats->templates++;
+    if (on_restored != NULL) {
+      on_restored(entry.id, entry.name, entry.shard, entry.slot, context);
+    }
+  }
+
+  Serial.println("Template archive is truncated");
+  stats->elapsed_ms = millis() - started_ms;
+  return false;
+}
@@ -0,0 +1,75 @@
+// template_archive.h
+
+#ifndef TEMPLATE_ARCHIVE_H_
+#define TEMPLATE_ARCHIVE_H_
+
+#include <Arduino.h>
+#include "sensor_client.h"
+#include "sensor_shards.h"
+#include "user_directory.h"
+
+// Archive location on SPIFFS for the sensor task's backup/restore commands
+#define TEMPLATE_ARCHIVE_PATH "/templates.bak"
+#define TEMPLATE_UPLOAD_PATH "/templates.up"  // Archive being received over serial
+
+// Archive format
+const uint32_t kArchiveMagic = 0x4B425046;  // "FPBK" little-endian
+const uint16_t kArchiveVersion = 2;         // Version 1 entries have no shard or slot
+const uint16_t kArchiveEndId = 0xFFFF;      // Entry ID that marks the trailer
+
+/*
+ * Archive layout, all little-endian:
+ *   ArchiveHeader
+ *   per user: ArchiveEntry, kSensorTemplateBytes of template, CRC-16 of both
+ *   trailer:  uint16_t kArchiveEndId, uint16_t entry count
+ */
+struct __attribute__((packed)) ArchiveHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t template_bytes;  // Must equal kSensorTemplateBytes to restore
+};
+
+struct __attribute__((packed)) ArchiveEntry {
+  uint16_t id;                          // User ID
+  uint8_t shard;                        // Sensor module the template is stored on
+  uint16_t slot;                        // Template page on that module
+  char name[kMaxUserNameLength + 1];    // NUL-terminated user name
+};
+
+// Largest archive a backup can produce, with every user ID enrolled
+const uint32_t kArchiveMaxBytes =
+    sizeof(ArchiveHeader) +
+    (uint32_t)kMaxUserId * (sizeof(ArchiveEntry) + kSensorTemplateBytes + sizeof(uint16_t)) +
+    2 * sizeof(uint16_t);
+
+/* Outcome of one backup or restore */
+struct ArchiveStats {
+  uint16_t templates;   // Templates written to or stored from the archive
+  uint16_t skipped;     // Users or entries that could not be transferred
+  uint32_t bytes;       // Archive bytes written or read
+  uint32_t elapsed_ms;  // Wall time of the whole job
+};
+
+// Called for each user restored, after its template is stored on its sensor
+typedef void (*ArchiveRestoreCallback)(uint16_t id, const char* name, uint8_t shard,
+                                       uint16_t slot, void* context);
+
+/*
+ * Template backup and restore through the sensor's UpChar/DownChar data path.
+ *
+ * Both run on the sensor task and block it for the duration of the job.
+ * A backup works from a copy of the directory's entries taken by the UI
+ * task, which owns the directory, so users changed meanwhile cannot race it.
+ * Templates stream one at a time between the sensor and the archive, so
+ * RAM use does not depend on how many users are enrolled. Restore checks
+ * each entry's CRC after the download and only stores templates that
+ * arrived intact. Templates go back to the shard and page they were
+ * backed up from; version 1 archives restore to shard 0 with page = ID.
+ */
+uint16_t SnapshotArchiveUsers(ArchiveEntry* users);  // Copy every user, up to kMaxUserId
+bool BackupTemplates(const ArchiveEntry* users, uint16_t count, Stream& out,
+                     ArchiveStats* stats);
+bool RestoreTemplates(Stream& in, ArchiveRestoreCallback on_restored, void* context,
+                      ArchiveStats* stats);
+
+#endif  // TEMPLATE_ARCHIVE_H_
@@ -0,0 +1,111 @@
+// touch_input.cpp
+
+#include "touch_input.h"
+#include "hardware.h"
+#include "spi_bus.h"
+
+// Touch input read by LVGL
+TouchInput touch_input;
+
+/* GPIO interrupt on the touch controller's pen IRQ output */
+static void IRAM_ATTR PenIrqISR() {
+  touch_input.OnPenIrq(micros());
+}
+
+TouchInput::TouchInput()
+    : irq_pin_(-1), pen_pending_(false), pen_us_(0), pressed_(false), x_(0), y_(0),
+      last_sample_ms_(0), press_us_(0) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+/* Attach the pen IRQ, or poll the controller when irq_pin is -1 */
+void TouchInput::Begin(int8_t irq_pin) {
+  irq_pin_ = irq_pin;
+  pen_pending_ = false;
+  if (irq_pin_ < 0) {
+    Serial.println("No touch IRQ line, polling the touch controller");
+    return;
+  }
+
+  // The line is open drain and pulled low while the panel is pressed
+  pinMode(irq_pin_, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(irq_pin_), PenIrqISR, FALLING);
+}
+
+/* Record a pen-down edge; safe to call from interrupt context */
+void IRAM_ATTR TouchInput::OnPenIrq(uint32_t now_us) {
+  pen_us_ = now_us;
+  pen_pending_ = true;
+}
+
+/* Sample the controller when a press started or is still going on */
+void TouchInput::Poll(uint32_t now_ms) {
+  bool edge = pen_pending_;
+  if (has_irq_line()) {
+    if (!edge && digitalRead(irq_pin_) != LOW) {
+      pressed_ = false;  // Line released: no need to ask the controller
+      return;
+    }
+    if (!edge && now_ms - last_sample_ms_ < kTouchSampleMs) return;
+  } else if (now_ms - last_sample_ms_ < (pressed_ ? kTouchSampleMs : kTouchPollMs)) {
+    return;
+  }
+
+  // A press is timed from its edge when there is one, else from the sample that saw it
+  uint32_t started_us = edge ? pen_us_ : micros();
+  if (!Sample(started_us)) return;  // Bus busy with DMA; retried on the next pass
+  if (edge) pen_pending_ = false;
+  last_sample_ms_ = now_ms;
+}
+
+/* Report the start of a press once, for touch-to-flush latency */
+uint32_t TouchInput::TakePressUs() {
+  uint32_t press_us = press_us_;
+  press_us_ = 0;
+  return press_us;
+}
+
+/* Read pressure and an averaged point from the controller */
+bool TouchInput::Sample(uint32_t started_us) {
+  if (!spi_bus.TryAcquireTouch()) return false;
+  uint32_t bus_started_us = micros();
+  stats_.samples++;
+
+  bool down = tft.getTouchRawZ() >= kTouchPressureMin;
+  uint32_t sum_x = 0;
+  uint32_t sum_y = 0;
+  uint16_t min_x = 0xFFFF, max_x = 0, min_y = 0xFFFF, max_y = 0;
+  for (uint8_t i = 0; down && i < kTouchSamples; i++) {
+    uint16_t raw_x = 0;
+    uint16_t raw_y = 0;
+    tft.getTouchRaw(&raw_x, &raw_y);
+    sum_x += raw_x;
+    sum_y += raw_y;
+    if (raw_x < min_x) min_x = raw_x;
+    if (raw_x > max_x) max_x = raw_x;
+    if (raw_y < min_y) min_y = raw_y;
+    if (raw_y > max_y) max_y = raw_y;
+  }
+  spi_bus.ReleaseTouch(bus_started_us);
+
+  if (!down) {
+    pressed_ = false;
+    return true;
+  }
+  if (max_x - min_x > kTouchMaxSpread || max_y - min_y > kTouchMaxSpread) {
+    stats_.rejected++;  // Pen moving or bouncing; keep the previous state
+    return true;
+  }
+
+  uint16_t x = (uint16_t)(sum_x / kTouchSamples);
+  uint16_t y = (uint16_t)(sum_y / kTouchSamples);
+  tft.convertRawXY(&x, &y);
+  x_ = x;
+  y_ = y;
+  if (!pressed_) {
+    pressed_ = true;
+    press_us_ = started_us;
+    stats_.presses++;
+  }
+  return true;
+}
@@ -0,0 +1,64 @@
+// touch_input.h
+
+#ifndef TOUCH_INPUT_H_
+#define TOUCH_INPUT_H_
+
+#include <Arduino.h>
+
+// Touch sampling
+const uint32_t kTouchSampleMs = 10;      // Sample interval while the panel is pressed
+const uint32_t kTouchPollMs = 30;        // Presence check interval without a pen IRQ line
+const uint16_t kTouchPressureMin = 600;  // Raw Z below this is no touch, as in getTouch()
+const uint8_t kTouchSamples = 4;         // Raw X/Y readings averaged into one point
+const uint16_t kTouchMaxSpread = 64;     // Raw readings further apart than this are noise
+
+/* Counters describing touch activity */
+struct TouchStats {
+  uint32_t presses;   // Releases followed by a press
+  uint32_t samples;   // Reads of the touch controller
+  uint32_t rejected;  // Samples whose readings spread too far to use
+};
+
+/*
+ * Samples the resistive touch controller and caches the filtered point.
+ *
+ * With the controller's pen IRQ line wired, nothing is read while the panel
+ * is untouched: the falling edge of the line starts sampling, which repeats
+ * every kTouchSampleMs while the line stays low and stops once it rises.
+ * Without the line the controller is checked every kTouchPollMs. Each sample
+ * takes the bus through spi_bus, so it is deferred rather than delayed while
+ * a flush is in flight. LVGL's read callback only copies the cached point.
+ */
+class TouchInput {
+ public:
+  TouchInput();
+
+  void Begin(int8_t irq_pin);        // Attach the pen IRQ, -1 to poll
+  void OnPenIrq(uint32_t now_us);    // Pen IRQ edge, ISR safe
+  void Poll(uint32_t now_ms);        // Sample when due; UI task only
+  uint32_t TakePressUs();            // micros() of a press not yet reported, 0 if none
+
+  bool has_irq_line() const { return irq_pin_ >= 0; }
+  bool pressed() const { return pressed_; }
+  uint16_t x() const { return x_; }
+  uint16_t y() const { return y_; }
+  const TouchStats& stats() const { return stats_; }
+
+ private:
+  bool Sample(uint32_t started_us);  // False if the bus was not available
+
+  int8_t irq_pin_;
+  volatile bool pen_pending_;  // Set by the ISR, consumed by Poll()
+  volatile uint32_t pen_us_;   // micros() of the latest edge
+  bool pressed_;
+  uint16_t x_;                 // Last filtered point, in screen coordinates
+  uint16_t y_;
+  uint32_t last_sample_ms_;
+  uint32_t press_us_;          // Start of the current press until TakePressUs()
+  TouchStats stats_;
+};
+
+// Touch input read by LVGL
+extern TouchInput touch_input;
+
+#endif  // TOUCH_INPUT_H_
@@ -1,97 +1,207 @@
 // ui.cpp
 
 #include "ui.h"
-
-// Global LVGL objects
+#include "access_log.h"
+#include "admin_console.h"
+#include "boot_profile.h"
+#include "bulk_delete.h"
+#include "perf_stats.h"
+#include "render_profile.h"
+#include "spi_bus.h"
+#include "stage_timing.h"
+#include "touch_input.h"
+#include "ui_binding.h"
+#include "user_list_view.h"
+
+// Global LVGL objects, NULL until the screen they live on is first shown
 lv_obj_t* finger_label;
 lv_obj_t* dropdown_menu;
 lv_obj_t* input_text_area;
 lv_obj_t* keyboard;
 lv_obj_t* return_button;
-lv_obj_t* user_dropdown;
 lv_obj_t* delete_button;
+lv_obj_t* select_all_button;
 lv_obj_t* password_area;
-lv_obj_t* password_keyboard;
 lv_obj_t* status_label;
 
 // Global variables
-uint8_t id = 0;
-bool enrolling_mode = false;
-bool scanning_mode = false;
-String user_name = "";
-
-// LVGL display buffer
+char user_name[kMaxUserNameLength + 1] = "";
+
+// UI task state; the sensor task only learns about it through commands
+enum UiMode {
+  kUiIdle,       // Menus, password or delete screen
+  kUiScanning,   // Showing scan results
+  kUiEnrolling   // Showing enrollment prompts
+};
+static UiMode ui_mode = kUiIdle;
+static uint16_t id = 0;  // User ID being entered
+static bool verify_entry = false;       // The Enroll screen's ID entry claims an identity instead
+static bool bulk_delete_shown = false;  // The Delete screen waits for bulk_delete
+static bool sensor_offline = false;     // The capture sensor stopped answering its handshake
+static const char* const kSensorOfflineText = "Sensor offline, retrying...";
+
+// Screens, each built on its first visit and kept for the later ones
+enum UiScreen {
+  kScreenMain,      // Dropdown menu and status line
+  kScreenEnroll,    // ID and name entry, then the enrollment prompts
+  kScreenScan,      // Scan results
+  kScreenDelete,    // User list with the Delete and All buttons
+  kScreenPassword,  // Password entry
+  kScreenCount
+};
+static lv_obj_t* screens[kScreenCount];
+static UiScreen current_screen = kScreenMain;
+static uint32_t transition_started_us = 0;  // micros() of a screen load not yet on the panel
+static bool transition_built = false;       // That load built its screen first
+
+static void OnUserSelected(uint16_t user_id, void* context);
+
+// LVGL display buffers
 lv_disp_draw_buf_t draw_buf;
-lv_color_t buf[kScreenWidth * 10];
+lv_color_t buf1[kScreenWidth * kDrawBufLines];
+lv_color_t buf2[kScreenWidth * kDrawBufLines];
+
+// LVGL must render byte-swapped RGB565 so DMA can send buffers untouched
+#if LV_COLOR_16_SWAP == 0
+#warning "LV_COLOR_16_SWAP is 0: TFT_eSPI will byte-swap every pixel in software"
+#endif
+
+/* Main menu prompt, or the degraded notice while the sensor is offline */
+static const char* WelcomeText() {
+  return sensor_offline ? kSensorOfflineText : "Welcome! Please select an option.";
+}
 
-/* Function to initialize the LVGL UI */
+/* Function to initialize the LVGL UI; only the main menu is built up front */
 void SetupUI() {
+  screens[kScreenMain] = lv_scr_act();
+
   // Create the dropdown menu
-  dropdown_menu = lv_dropdown_create(lv_scr_act());
-  lv_dropdown_set_options(dropdown_menu, "Enroll\nScan\nDelete\nPassword");
+  dropdown_menu = lv_dropdown_create(screens[kScreenMain]);
+  lv_dropdown_set_options(dropdown_menu, "Enroll\nScan\nVerify\nDelete\nPassword");
   lv_obj_set_size(dropdown_menu, 100, 30);  // Adjust size as needed
   lv_obj_align(dropdown_menu, LV_ALIGN_TOP_RIGHT, -10, 10);  // Top right corner
 
   // Attach event handler for dropdown
   lv_obj_add_event_cb(dropdown_menu, DropdownEventHandler, LV_EVENT_VALUE_CHANGED, NULL);
-
-  // Initial finger label setup (hidden by default)
-  finger_label = lv_label_create(lv_scr_act());
-  lv_label_set_text(finger_label, "");
-  lv_obj_align(finger_label, LV_ALIGN_CENTER, 0, -40);
-  lv_obj_add_flag(finger_label, LV_OBJ_FLAG_HIDDEN);  // Initially hidden
+  render_profiler.TrackWidget(dropdown_menu, "dropdown");
 
   // Initial status label setup
-  status_label = lv_label_create(lv_scr_act());
-  lv_label_set_text(status_label, "Welcome! Please select an option.");
-  lv_obj_align(status_label, LV_ALIGN_CENTER, 0, -40);
-
-  // Create Delete button (initially hidden)
-  delete_button = lv_btn_create(lv_scr_act());
-  lv_obj_set_size(delete_button, 80, 40);
-  lv_obj_align(delete_button, LV_ALIGN_CENTER, 0, 80);
-  lv_obj_t* delete_label = lv_label_create(delete_button);
-  lv_label_set_text(delete_label, "Delete");
-  lv_obj_center(delete_label);
-  lv_obj_add_flag(delete_button, LV_OBJ_FLAG_HIDDEN);  // Initially hidden
-  lv_obj_add_event_cb(delete_button, DeleteButtonEventHandler, LV_EVENT_CLICKED, NULL);
-
-  // Initialize user_dropdown to NULL
-  user_dropdown = NULL;
-
-  // Create input text area (initially hidden)
-  input_text_area = lv_textarea_create(lv_scr_act());
-  lv_obj_align(input_text_area, LV_ALIGN_CENTER, 0, 0);
-  lv_obj_add_flag(input_text_area, LV_OBJ_FLAG_HIDDEN);
+  status_label = lv_label_create(screens[kScreenMain]);
+  status_text.Bind(status_label);
+  status_text.SetText(WelcomeText());
+  status_text.Align(LV_ALIGN_CENTER, 0, -40);
+}
 
-  // Create keyboard (initially hidden)
-  keyboard = lv_keyboard_create(lv_scr_act());
-  lv_keyboard_set_textarea(keyboard, input_text_area);
-  lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
-  lv_obj_add_event_cb(keyboard, KeyboardEventHandler, LV_EVENT_READY, NULL);
-
-  // Create password text area (initially hidden)
-  password_area = lv_textarea_create(lv_scr_act());
-  lv_textarea_set_password_mode(password_area, true);  // Enable password mode
-  lv_obj_set_width(password_area, 150);
-  lv_obj_align(password_area, LV_ALIGN_CENTER, 0, -40);
-  lv_obj_add_flag(password_area, LV_OBJ_FLAG_HIDDEN);
-
-  // Create password keyboard (initially hidden)
-  password_keyboard = lv_keyboard_create(lv_scr_act());
-  lv_keyboard_set_textarea(password_keyboard, password_area);
-  lv_obj_add_flag(password_keyboard, LV_OBJ_FLAG_HIDDEN);
-  lv_obj_add_event_cb(password_keyboard, PassKeyboardEventHandler, LV_EVENT_READY, NULL);
-
-  // Create Return button (initially hidden)
-  return_button = lv_btn_create(lv_scr_act());
+/* Return (Back) button in the top-left corner */
+static void CreateReturnButton(lv_obj_t* screen) {
+  return_button = lv_btn_create(screen);
   lv_obj_set_size(return_button, 60, 40);  // Width 60px, Height 40px
   lv_obj_set_style_pad_all(return_button, 5, 0);  // Add padding
   lv_obj_align(return_button, LV_ALIGN_TOP_LEFT, 10, 10);
   lv_obj_t* return_label = lv_label_create(return_button);
   lv_label_set_text(return_label, "Back");
   lv_obj_add_event_cb(return_button, ReturnButtonEventHandler, LV_EVENT_CLICKED, NULL);
-  lv_obj_add_flag(return_button, LV_OBJ_FLAG_HIDDEN);  // Hide Return button initially
+}
+
+/* Delete screen: the user list, the Delete button and the All button */
+static void BuildDeleteScreen(lv_obj_t* screen) {
+  user_list_view.Create(screen, 260, OnUserSelected, NULL);
+
+  // Delete button, captioned with the number of selected users
+  delete_button = lv_btn_create(screen);
+  lv_obj_set_size(delete_button, 110, 40);
+  lv_obj_align(delete_button, LV_ALIGN_CENTER, 40, 80);
+  lv_obj_t* delete_label = lv_label_create(delete_button);
+  delete_text.Bind(delete_label);
+  delete_text.SetText("Delete");
+  lv_obj_center(delete_label);
+  lv_obj_add_event_cb(delete_button, DeleteButtonEventHandler, LV_EVENT_CLICKED, NULL);
+
+  // All button next to it, selecting every user or none
+  select_all_button = lv_btn_create(screen);
+  lv_obj_set_size(select_all_button, 70, 40);
+  lv_obj_align(select_all_button, LV_ALIGN_CENTER, -60, 80);
+  lv_obj_t* select_all_label = lv_label_create(select_all_button);
+  lv_label_set_text(select_all_label, "All");
+  lv_obj_center(select_all_label);
+  lv_obj_add_event_cb(select_all_button, SelectAllButtonEventHandler, LV_EVENT_CLICKED, NULL);
+}
+
+/* Build the widgets of a screen on its first visit */
+static void BuildScreen(UiScreen screen) {
+  lv_obj_t* scr = lv_obj_create(NULL);
+  screens[screen] = scr;
+
+  switch (screen) {
+    case kScreenEnroll:
+      input_text_area = lv_textarea_create(scr);
+      lv_obj_align(input_text_area, LV_ALIGN_CENTER, 0, 0);
+      render_profiler.TrackWidget(input_text_area, "id_entry");
+      break;
+    case kScreenDelete:
+      BuildDeleteScreen(scr);
+      break;
+    case kScreenPassword:
+      password_area = lv_textarea_create(scr);
+      lv_textarea_set_password_mode(password_area, true);  // Enable password mode
+      lv_obj_set_width(password_area, 150);
+      lv_obj_align(password_area, LV_ALIGN_CENTER, 0, -40);
+      render_profiler.TrackWidget(password_area, "password");
+      break;
+    default:
+      break;
+  }
+}
+
+/* Build a screen on first use, bring the shared widgets over and load it */
+static void ShowScreen(UiScreen screen) {
+  transition_started_us = micros();
+  transition_built = (screens[screen] == NULL);
+  if (transition_built) BuildScreen(screen);
+  lv_obj_t* scr = screens[screen];
+
+  // Main and Password talk through the status label, the other screens through the finger label
+  if (screen == kScreenMain || screen == kScreenPassword) {
+    lv_obj_set_parent(status_label, scr);
+  } else {
+    if (finger_label == NULL) {
+      finger_label = lv_label_create(scr);
+      finger_text.Bind(finger_label);
+      finger_text.Align(LV_ALIGN_CENTER, 0, -40);
+    }
+    lv_obj_set_parent(finger_label, scr);
+  }
+
+  // One Back button follows every screen but the main menu
+  if (screen != kScreenMain) {
+    if (return_button == NULL) CreateReturnButton(scr);
+    lv_obj_set_parent(return_button, scr);
+  }
+
+  current_screen = screen;
+  lv_scr_load(scr);
+}
+
+/* Enter on the shared keyboard, handled by the screen it is on */
+static void SharedKeyboardEventHandler(lv_event_t* e) {
+  if (current_screen == kScreenPassword) {
+    PassKeyboardEventHandler(e);
+  } else {
+    KeyboardEventHandler(e);
+  }
+}
+
+/* Move the one keyboard onto an input screen and point it at that screen's text area */
+static void AttachKeyboard(lv_obj_t* screen, lv_obj_t* text_area) {
+  if (keyboard == NULL) {
+    keyboard = lv_keyboard_create(screen);
+    lv_obj_add_event_cb(keyboard, SharedKeyboardEventHandler, LV_EVENT_READY, NULL);
+    render_profiler.TrackWidget(keyboard, "keyboard");
+  } else {
+    lv_obj_set_parent(keyboard, screen);
+  }
+  lv_keyboard_set_textarea(keyboard, text_area);
+  lv_obj_clear_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
 }
 
 /* Function to handle the Return button event */
@@ -100,31 +210,7 @@ void ReturnButtonEventHandler(lv_event_t* e) {
 
   if (code == LV_EVENT_CLICKED) {
     Serial.println("Return button clicked.");
-
-    // Show the main menu dropdown
-    lv_obj_clear_flag(dropdown_menu, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(return_button, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(finger_label, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(status_label, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(input_text_area, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(password_area, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(password_keyboard, LV_OBJ_FLAG_HIDDEN);
-    if (delete_button != NULL) lv_obj_add_flag(delete_button, LV_OBJ_FLAG_HIDDEN);
-    if (user_dropdown != NULL) lv_obj_add_flag(user_dropdown, LV_OBJ_FLAG_HIDDEN);
-
-    // Stop enrolling and scanning modes
-    enrolling_mode = false;
-    scanning_mode = false;
-
-    // Reset ID and Name for future enrollments
-    id = 0;
-    user_name = "";
-
-    // Reset status label message
-    lv_label_set_text(status_label, "Welcome! Please select an option.");
-    lv_obj_align(status_label, LV_ALIGN_CENTER, 0, -40);
-    lv_obj_clear_flag(status_label, LV_OBJ_FLAG_HIDDEN);
+    ReturnToMainMenu();
   }
 }
 
@@ -143,6 +229,9 @@ void DropdownEventHandler(lv_event_t* e) {
     } else if (strcmp(buf, "Scan") == 0) {
       // Call scan function
       ScanAction();
+    } else if (strcmp(buf, "Verify") == 0) {
+      // Call verify function
+      VerifyAction();
     } else if (strcmp(buf, "Delete") == 0) {
       // Call delete function
       DeleteAction();
@@ -153,100 +242,97 @@ void DropdownEventHandler(lv_event_t* e) {
   }
 }
 
-/* Function for Enroll action */
-void EnrollAction() {
-  lv_obj_clear_flag(finger_label, LV_OBJ_FLAG_HIDDEN);
-  lv_label_set_text(finger_label, "Enrolling, please enter the ID:");
+/* Show the Enroll screen's ID entry, for enrolling or for claiming an identity */
+static void ShowIdEntry(const char* prompt) {
+  ShowScreen(kScreenEnroll);
+  finger_text.SetVisible(true);
+  finger_text.SetText(prompt);
 
-  // Hide the dropdown menu and show input area
-  lv_obj_add_flag(dropdown_menu, LV_OBJ_FLAG_HIDDEN);
+  // Show the input area with the keyboard under it
+  lv_textarea_set_text(input_text_area, "");
   lv_obj_clear_flag(input_text_area, LV_OBJ_FLAG_HIDDEN);
-  lv_obj_clear_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
-
-  // Show the Return button
-  lv_obj_clear_flag(return_button, LV_OBJ_FLAG_HIDDEN);
+  AttachKeyboard(screens[kScreenEnroll], input_text_area);
 
   // Reposition label above keyboard
   RepositionLabelAboveKeyboard();
+}
 
-  // Move the Return button to top-left corner
-  lv_obj_align(return_button, LV_ALIGN_TOP_LEFT, 10, 10);
-
-  // Hide the status label
-  lv_obj_add_flag(status_label, LV_OBJ_FLAG_HIDDEN);
+/* Function for Enroll action */
+void EnrollAction() {
+  verify_entry = false;
+  ShowIdEntry("Enrolling, please enter the ID:");
 }
 
 /* Function for Scan action */
 void ScanAction() {
-  scanning_mode = true;
-  lv_label_set_text(finger_label, "Scanning...");
-
-  // Hide the dropdown menu and show the Return button
-  lv_obj_add_flag(dropdown_menu, LV_OBJ_FLAG_HIDDEN);
-  lv_obj_clear_flag(return_button, LV_OBJ_FLAG_HIDDEN);
-
-  // Start continuous scanning
-  lv_obj_clear_flag(finger_label, LV_OBJ_FLAG_HIDDEN);
-
-  // Move the Return button to top-left corner
-  lv_obj_align(return_button, LV_ALIGN_TOP_LEFT, 10, 10);
-
-  // Hide the status label
-  lv_obj_add_flag(status_label, LV_OBJ_FLAG_HIDDEN);
+  SendSensorCommand(kCmdStartScan);
+  ui_mode = kUiScanning;
+  ShowScreen(kScreenScan);
+  finger_text.SetText(sensor_offline ? kSensorOfflineText : "Scanning...");
+  finger_text.SetVisible(true);
 }
 
-/* Function for Delete action */
-void DeleteAction() {
-  // Hide the dropdown menu
-  lv_obj_add_flag(dropdown_menu, LV_OBJ_FLAG_HIDDEN);
-
-  // Hide the status label
-  lv_obj_add_flag(status_label, LV_OBJ_FLAG_HIDDEN);
-
-  // Show the Return button
-  lv_obj_clear_flag(return_button, LV_OBJ_FLAG_HIDDEN);
-  lv_obj_align(return_button, LV_ALIGN_TOP_LEFT, 10, 10);
+/* Function for Verify action: 1:1 match against the template of an entered ID */
+void VerifyAction() {
+  verify_entry = true;
+  ShowIdEntry("Verifying, please enter your ID:");
+}
 
-  // Create and show the user dropdown
-  if (user_dropdown == NULL) {
-    user_dropdown = lv_dropdown_create(lv_scr_act());
-    lv_obj_set_width(user_dropdown, 200);
-    lv_obj_align(user_dropdown, LV_ALIGN_TOP_MID, 0, 60);
-    lv_obj_add_event_cb(user_dropdown, UserDropdownEventHandler, LV_EVENT_VALUE_CHANGED, NULL);
-  } else {
-    lv_obj_clear_flag(user_dropdown, LV_OBJ_FLAG_HIDDEN);
+/* Start matching every placement against the claimed user's template only */
+static void StartVerify(uint16_t user_id) {
+  uint8_t shard = 0;
+  uint16_t slot = 0;
+  if (!user_directory.Locate(user_id, &shard, &slot)) {
+    finger_text.SetText("Unknown ID, please try again.");
+    return;
   }
 
-  // Populate the user dropdown with users from JSON
-  String user_list = GetUserListForDropdown();
-  if (user_list.length() > 0) {
-    lv_dropdown_set_options(user_dropdown, user_list.c_str());
-  } else {
-    lv_dropdown_set_options(user_dropdown, "No users found.");
-  }
+  lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);  // Hide the keyboard
+  lv_obj_add_flag(input_text_area, LV_OBJ_FLAG_HIDDEN);
+  lv_textarea_set_text(input_text_area, "");
+  RepositionLabelAboveKeyboard();
+
+  SendSensorCommand(kCmdStartVerify, user_id, shard, slot);
+  ui_mode = kUiScanning;
+  finger_text.SetTextFmt("Verifying ID #%u, place your finger", (unsigned)user_id);
+}
 
-  // Hide the Delete button initially
-  if (delete_button != NULL) {
+/* Show the Delete button with the selection size, or hide it when nothing is selected */
+static void UpdateDeleteButton() {
+  uint16_t selected = user_list_view.SelectedCount();
+  if (selected == 0) {
     lv_obj_add_flag(delete_button, LV_OBJ_FLAG_HIDDEN);
+    return;
   }
+  delete_text.SetTextFmt("Delete (%u)", (unsigned)selected);
+  lv_obj_clear_flag(delete_button, LV_OBJ_FLAG_HIDDEN);
 }
 
-/* Event handler for the user dropdown in delete action */
-void UserDropdownEventHandler(lv_event_t* e) {
-  lv_event_code_t code = lv_event_get_code(e);
-  lv_obj_t* dropdown = lv_event_get_target(e);
+/* A user was tapped in the Delete screen's list */
+static void OnUserSelected(uint16_t user_id, void* context) {
+  UpdateDeleteButton();  // The row toggled its user; no text to parse
+}
 
-  if (code == LV_EVENT_VALUE_CHANGED) {
-    // Get selected user
-    char selected_user[64];
-    lv_dropdown_get_selected_str(dropdown, selected_user, sizeof(selected_user));
+/* Function for Delete action */
+void DeleteAction() {
+  ShowScreen(kScreenDelete);
+  finger_text.SetVisible(false);  // Holds the outcome of a delete
 
-    // Parse the selected user to extract ID
-    sscanf(selected_user, "ID: %hhu", &id);  // Extract the ID
+  // Show only the first window of users
+  user_list_view.Show();
 
-    // Show the Delete button
-    lv_obj_clear_flag(delete_button, LV_OBJ_FLAG_HIDDEN);
-  }
+  // Hide the Delete button until users are selected; All is always offered
+  lv_obj_add_flag(delete_button, LV_OBJ_FLAG_HIDDEN);
+  lv_obj_clear_flag(select_all_button, LV_OBJ_FLAG_HIDDEN);
+}
+
+/* Event handler for the All button: select every user, or none once all are */
+void SelectAllButtonEventHandler(lv_event_t* e) {
+  if (lv_event_get_code(e) != LV_EVENT_CLICKED) return;
+
+  bool all = user_list_view.SelectedCount() == user_directory.Count();
+  user_list_view.SelectAll(!all);
+  UpdateDeleteButton();
 }
 
 /* Event handler for the Delete button */
@@ -254,54 +340,66 @@ void DeleteButtonEventHandler(lv_event_t* e) {
   lv_event_code_t code = lv_event_get_code(e);
 
   if (code == LV_EVENT_CLICKED) {
-    // Delete the user from the fingerprint sensor
-    DeleteFingerprint(id);
+    DeleteSelectedUsers();
+  }
+}
 
-    // Delete the user from JSON
-    DeleteUserFromJSON(id);
+/* Function to delete every selected user with one store commit and ranged sensor deletes */
+void DeleteSelectedUsers() {
+  if (bulk_delete.busy()) return;  // The admin console is deleting
 
-    // Display confirmation message
-    lv_label_set_text_fmt(finger_label, "User ID #%d deleted.", id);
-    lv_obj_clear_flag(finger_label, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_align(finger_label, LV_ALIGN_CENTER, 0, -40);
+  bulk_delete.Clear();
+  for (uint16_t user = user_directory.NextId(0); user != 0; user = user_directory.NextId(user)) {
+    if (user_list_view.IsSelected(user)) bulk_delete.Select(user);
+  }
+  if (!bulk_delete.Start()) {
+    if (bulk_delete.result().store_failed) finger_text.SetText("Failed to delete users.");
+    return;
+  }
 
-    // Hide the Delete button and user dropdown
-    lv_obj_add_flag(delete_button, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(user_dropdown, LV_OBJ_FLAG_HIDDEN);
+  // Hide the Delete and All buttons and the user list while the sensors catch up
+  lv_obj_add_flag(delete_button, LV_OBJ_FLAG_HIDDEN);
+  lv_obj_add_flag(select_all_button, LV_OBJ_FLAG_HIDDEN);
+  user_list_view.Hide();
+
+  finger_text.SetText("Deleting selected users...");
+  finger_text.SetVisible(true);
 
-    // Reset ID
-    id = 0;
+  bulk_delete_shown = true;
+  if (!bulk_delete.busy()) ShowBulkDeleteResult();  // No template to clear
+}
+
+/* Function to show a bulk delete started from the Delete screen once it finished */
+void ShowBulkDeleteResult() {
+  if (!bulk_delete_shown) return;  // Started by the admin console, or screen left
+  bulk_delete_shown = false;
+
+  const BulkDeleteResult& result = bulk_delete.result();
+  if (result.failed_runs > 0) {
+    finger_text.SetTextFmt("%u users deleted, %u sensor deletes failed.",
+                           (unsigned)result.users, (unsigned)result.failed_runs);
+  } else if (result.users == 1) {
+    finger_text.SetText("1 user deleted.");
+  } else {
+    finger_text.SetTextFmt("%u users deleted.", (unsigned)result.users);
   }
 }
 
 /* Function for Password action */
 void PasswordAction() {
-  // Hide the dropdown menu and show the password screen
-  lv_obj_add_flag(dropdown_menu, LV_OBJ_FLAG_HIDDEN);
+  ShowScreen(kScreenPassword);
   ShowPasswordScreen();
-
-  // Hide other labels if necessary
-  lv_obj_add_flag(finger_label, LV_OBJ_FLAG_HIDDEN);
-
-  // Ensure status_label is visible
-  lv_obj_clear_flag(status_label, LV_OBJ_FLAG_HIDDEN);
-
-  // Show the Return button
-  lv_obj_clear_flag(return_button, LV_OBJ_FLAG_HIDDEN);
-
-  // Move the Return button to top-left corner
-  lv_obj_align(return_button, LV_ALIGN_TOP_LEFT, 10, 10);
 }
 
 /* Function to show the password input screen */
 void ShowPasswordScreen() {
-  lv_label_set_text(status_label, "Enter Password:");
-  lv_obj_align(status_label, LV_ALIGN_BOTTOM_MID, 0, -10);
-  lv_obj_clear_flag(status_label, LV_OBJ_FLAG_HIDDEN);
+  status_text.SetText("Enter Password:");
+  status_text.Align(LV_ALIGN_BOTTOM_MID, 0, -10);
+  status_text.SetVisible(true);
 
-  // Show the password area and keyboard
+  // Show the password area with the keyboard under it
   lv_obj_clear_flag(password_area, LV_OBJ_FLAG_HIDDEN);
-  lv_obj_clear_flag(password_keyboard, LV_OBJ_FLAG_HIDDEN);
+  AttachKeyboard(screens[kScreenPassword], password_area);
 }
 
 /* Event handler for the password keyboard input */
@@ -312,16 +410,16 @@ void PassKeyboardEventHandler(lv_event_t* e) {
   if (code == LV_EVENT_READY) {  // When the "Enter" button is pressed
     const char* input = lv_textarea_get_text(password_area);
 
-    // Make sure the status_label is visible
-    lv_obj_clear_flag(status_label, LV_OBJ_FLAG_HIDDEN);
+    // Make sure the status label is visible
+    status_text.SetVisible(true);
 
     if (strcmp(input, "0000") == 0) {
-      lv_label_set_text(status_label, "Welcome Varad!");
-      lv_obj_align(status_label, LV_ALIGN_BOTTOM_MID, 0, -10);
+      status_text.SetText("Welcome Varad!");
+      status_text.Align(LV_ALIGN_BOTTOM_MID, 0, -10);
 
       // Hide the keyboard and password text area
       lv_obj_add_flag(password_area, LV_OBJ_FLAG_HIDDEN);
-      lv_obj_add_flag(password_keyboard, LV_OBJ_FLAG_HIDDEN);
+      lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
 
       // After 2 seconds, go back to the initial screen
       lv_timer_t* timer = lv_timer_create([](lv_timer_t* t) {
@@ -331,10 +429,10 @@ void PassKeyboardEventHandler(lv_event_t* e) {
     } else {
       // Hide the keyboard and password text area
       lv_obj_add_flag(password_area, LV_OBJ_FLAG_HIDDEN);
-      lv_obj_add_flag(password_keyboard, LV_OBJ_FLAG_HIDDEN);
+      lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
 
-      lv_label_set_text(status_label, "Wrong Password!");
-      lv_obj_align(status_label, LV_ALIGN_BOTTOM_MID, 0, -10);
+      status_text.SetText("Wrong Password!");
+      status_text.Align(LV_ALIGN_BOTTOM_MID, 0, -10);
 
       // After 2 seconds, go back to the initial screen
       lv_timer_t* timer = lv_timer_create([](lv_timer_t* t) {
@@ -346,6 +444,14 @@ void PassKeyboardEventHandler(lv_event_t* e) {
   }
 }
 
+/* Keep a re-enrolled user's page, otherwise take a free page on the least loaded shard */
+static bool ChooseTemplateLocation(uint16_t user_id, uint8_t* shard, uint16_t* slot) {
+  if (user_directory.Locate(user_id, shard, slot)) return true;
+  *shard = user_directory.LeastLoadedShard();
+  *slot = user_directory.FreeSlot(*shard, user_id);
+  return *slot != kNoSlot;
+}
+
 /* Event handler for the keyboard input */
 void KeyboardEventHandler(lv_event_t* e) {
   lv_event_code_t code = lv_event_get_code(e);
@@ -354,205 +460,278 @@ void KeyboardEventHandler(lv_event_t* e) {
     const char* input = lv_textarea_get_text(input_text_area);
 
     if (id == 0) {  // Capture ID first
-      id = atoi(input);  // Convert input to integer ID
-      if (id > 0 && id <= 127) {
-        lv_label_set_text_fmt(finger_label, "ID #%d entered. Now, enter your Name:", id);
+      long entered = atol(input);  // Convert input to integer ID
+      id = (entered > 0 && entered <= kMaxUserId) ? (uint16_t)entered : 0;
+      if (id != 0 && verify_entry) {
+        StartVerify(id);
+        id = 0;  // Another ID may be claimed after an unknown one
+      } else if (id != 0) {
+        finger_text.SetTextFmt("ID #%d entered. Now, enter your Name:", id);
         lv_textarea_set_text(input_text_area, "");  // Clear text area for Name input
         RepositionLabelAboveKeyboard();  // Adjust label position
       } else {
-        lv_label_set_text(finger_label, "Invalid ID, please try again.");
+        finger_text.SetText("Invalid ID, please try again.");
         id = 0;  // Reset ID for re-entry
       }
     } else {  // After ID, capture the Name
-      user_name = String(input);  // Store the entered Name
-      lv_label_set_text_fmt(finger_label, "Enrolling ID #%d, Name: %s", id, user_name.c_str());
+      uint8_t shard = 0;
+      uint16_t slot = 0;
+      if (!ChooseTemplateLocation(id, &shard, &slot)) {
+        finger_text.SetText("Fingerprint storage is full.");
+        return;
+      }
+
+      strncpy(user_name, input, kMaxUserNameLength);  // Store the entered Name
+      user_name[kMaxUserNameLength] = '\0';
+      finger_text.SetTextFmt("Enrolling ID #%d, Name: %s", id, user_name);
       lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);  // Hide the keyboard
       lv_obj_add_flag(input_text_area, LV_OBJ_FLAG_HIDDEN);
 
       RepositionLabelAboveKeyboard();  // Adjust label position back to normal
 
-      // Now save to JSON file
-      SaveUserToJSON(id, user_name.c_str());
-
       lv_textarea_set_text(input_text_area, "");  // Clear text area
 
-      enrolling_mode = true;
+      // Start the enrollment; the user is saved once the template is stored
+      SendEnrollCommand(id, shard, slot, user_name);
+      ui_mode = kUiEnrolling;
     }
   }
 }
 
 /* Function to reposition the label when keyboard is shown */
 void RepositionLabelAboveKeyboard() {
-  if (lv_obj_has_flag(keyboard, LV_OBJ_FLAG_HIDDEN)) {
+  if (keyboard == NULL || lv_obj_has_flag(keyboard, LV_OBJ_FLAG_HIDDEN)) {
     // Keyboard is hidden, restore the label's default position
-    lv_obj_align(finger_label, LV_ALIGN_CENTER, 0, -40);  // Original position
+    finger_text.Align(LV_ALIGN_CENTER, 0, -40);  // Original position
   } else {
     // Keyboard is visible, move the label higher
-    lv_obj_align(finger_label, LV_ALIGN_CENTER, 0, -80);  // Move it higher
+    finger_text.Align(LV_ALIGN_CENTER, 0, -80);  // Move it higher
   }
 }
 
 /* Touchpad input handler for LVGL */
 void LVGLPortTPRead(lv_indev_drv_t* indev, lv_indev_data_t* data) {
-  uint16_t touch_x, touch_y;
-  bool touched = tft.getTouch(&touch_x, &touch_y);
+  // Sampled by touch_input.Poll() from loop(); no bus traffic here
+  data->state = touch_input.pressed() ? LV_INDEV_STATE_PR : LV_INDEV_STATE_REL;
+  data->point.x = touch_input.x();
+  data->point.y = touch_input.y();
+}
 
-  if (!touched) {
-    data->state = LV_INDEV_STATE_REL;
-  } else {
-    data->state = LV_INDEV_STATE_PR;
-    data->point.x = touch_x;
-    data->point.y = touch_y;
-  }
+/* Screen on the panel, with "+kb" while the shared keyboard is up on it */
+const char* RenderSceneName() {
+  static const char* const kNames[kScreenCount] = {"main", "enroll", "scan", "delete",
+                                                   "password"};
+  static const char* const kKeyboardNames[kScreenCount] = {"main+kb", "enroll+kb", "scan+kb",
+                                                           "delete+kb", "password+kb"};
+  bool keyboard_up = keyboard != NULL && lv_obj_get_parent(keyboard) == lv_scr_act() &&
+                     !lv_obj_has_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+  return keyboard_up ? kKeyboardNames[current_screen] : kNames[current_screen];
 }
 
-/* Display flushing function for LVGL */
+/* Display flushing function for LVGL, sends the stripe by DMA */
 void MyDispFlush(lv_disp_drv_t* disp, const lv_area_t* area, lv_color_t* color_p) {
+  STAGE_TIMER_START(flush_timer);
+  uint32_t flush_started_us = micros();
   uint32_t w = (area->x2 - area->x1 + 1);
   uint32_t h = (area->y2 - area->y1 + 1);
+  flushed_pixels += w * h;
+
+  // Keep the bus across flushes; touch only takes it between transfers
+  spi_bus.AcquireDisplay();
+  spi_bus.AddDisplayPixels(w * h);
+
+  // pushImageDMA waits for the previous transfer, which used the other
+  // buffer, so LVGL can render into that buffer as soon as we return
+  tft.pushImageDMA(area->x1, area->y1, w, h, (uint16_t*)&color_p->full);
+  STAGE_TIMER_STOP(kStageFlush, flush_timer);
+
+  // The last stripe of the first frame after a screen load ends the transition
+  if (transition_started_us != 0 && lv_disp_flush_is_last(disp)) {
+    LatencyStat& stat = transition_built ? screen_build_stat : screen_load_stat;
+    stat.Add(micros() - transition_started_us);
+    transition_started_us = 0;
+  }
+
+  // The first frame drawn after a press is the visible response to it
+  uint32_t press_us = touch_input.TakePressUs();
+  uint32_t touch_us = press_us != 0 ? micros() - press_us : 0;
+  if (press_us != 0) touch_to_flush_stat.Add(touch_us);
 
-  tft.startWrite();
-  tft.setAddrWindow(area->x1, area->y1, w, h);
-  tft.pushColors((uint16_t*)&color_p->full, w * h, true);
-  tft.endWrite();
+  render_profiler.OnFlush(w * h, micros() - flush_started_us, touch_us);
 
   lv_disp_flush_ready(disp);
 }
 
-/* Function to handle fingerprint enrollment */
-void HandleFingerprintEnrollment() {
-  if (!enrolling_mode || id == 0) return;
+/* Wait for the last DMA transfer and hand the SPI bus back */
+void ReleaseDisplayBus() {
+  spi_bus.ReleaseDisplay();
+}
 
-  // Delete the existing fingerprint template for the ID before enrolling
-  Serial.print("Deleting fingerprint for ID #");
-  Serial.println(id);
-  int delete_status = finger.deleteModel(id);
-  if (delete_status == FINGERPRINT_OK) {
-    Serial.println("Existing fingerprint deleted.");
-  } else {
-    Serial.println("No existing fingerprint to delete.");
+/* Time full-screen redraws for the configured draw buffer height */
+void RunDisplayBenchmark() {
+#ifdef DISPLAY_BENCHMARK
+  const uint32_t kFrames = 50;
+  uint32_t start_us = micros();
+  for (uint32_t i = 0; i < kFrames; i++) {
+    lv_obj_invalidate(lv_scr_act());
+    lv_refr_now(NULL);
   }
+  ReleaseDisplayBus();
+  uint32_t frame_us = (micros() - start_us) / kFrames;
 
-  lv_label_set_text_fmt(finger_label, "Place finger to enroll as ID #%d", id);
-  lv_timer_handler();  // Ensure display updates after setting the message
-  delay(200);
+  Serial.printf("display_bench lines=%u frame_us=%u fps=%u\n", (unsigned)kDrawBufLines,
+                (unsigned)frame_us, (unsigned)(1000000UL / frame_us));
+#endif
+}
 
-  int p = finger.getImage();
-  if (p == FINGERPRINT_NOFINGER) {
-    Serial.println("No finger detected.");
-    return;
+/* Drain results posted by the sensor task and reflect them on screen */
+void ProcessSensorEvents() {
+  SensorEvent event;
+  while (ReceiveSensorEvent(&event)) {
+    switch (event.type) {
+      case kEvtScanResult:
+        LogAccess(event);
+        ShowScanResult(event);
+        break;
+      case kEvtUserRestored:
+        SaveUser(event.id, event.message, event.shard, event.slot);  // Persisted by the UI task only
+        break;
+      case kEvtArchiveDone:
+        ShowArchiveResult(event);
+        admin_console.OnSensorEvent(event);  // Answers a console backup or restore, if any
+        break;
+      case kEvtDeleteDone:
+        if (bulk_delete.OnSensorEvent(event) && !bulk_delete.busy()) ShowBulkDeleteResult();
+        break;
+      case kEvtTemplateCount:
+      case kEvtTemplateIndex:
+      case kEvtBaudDone:
+      case kEvtImageDone:
+        admin_console.OnSensorEvent(event);
+        break;
+      case kEvtSensorStatus:
+        ShowSensorStatus(event);
+        break;
+      default:
+        ShowEnrollmentEvent(event);
+        break;
+    }
   }
+}
 
-  if (p == FINGERPRINT_OK) {
-    Serial.println("Image taken");
-    lv_label_set_text(finger_label, "Image taken, processing...");
-    lv_timer_handler();  // Refresh the display immediately
-    delay(200);
-
-    p = finger.image2Tz(1);
-    if (p == FINGERPRINT_OK) {
-      Serial.println("Remove finger and place it again.");
-      lv_label_set_text(finger_label, "Remove finger and place it again.");
-      lv_timer_handler();
-      delay(2000);
-
-      while (finger.getImage() != FINGERPRINT_NOFINGER) {
-        delay(100);
-      }
-
-      lv_label_set_text(finger_label, "Place the same finger again.");
-      lv_timer_handler();
-      delay(500);
+/* Function to record a final scan result; capture errors are not access attempts */
+void LogAccess(const SensorEvent& event) {
+  if (event.status == FINGERPRINT_OK) {
+    uint16_t user_id = user_directory.IdAt(event.shard, event.slot);
+    access_log.Append(user_id, event.confidence, kAccessGranted);
+  } else if (event.status == FINGERPRINT_NOTFOUND) {
+    access_log.Append(event.id, 0, kAccessDenied);  // Claimed user of a failed verify, else 0
+  }
+}
 
-      while (finger.getImage() != FINGERPRINT_OK) {
-        delay(100);
-      }
+/* Function to show enrollment progress reported by the sensor task */
+void ShowEnrollmentEvent(const SensorEvent& event) {
+  if (event.type == kEvtEnrollDone) {
+    // Persist the name only once the template is actually stored; the event names the user
+    // the enrollment was started for, whatever the UI has entered since
+    SaveUser(event.id, event.message, event.shard, event.slot);
+  }
+  if (ui_mode != kUiEnrolling) return;  // Enrollment screen already left
 
-      p = finger.image2Tz(2);
-      if (p == FINGERPRINT_OK) {
-        p = finger.createModel();
-        if (p == FINGERPRINT_OK) {
-          p = finger.storeModel(id);
-          if (p == FINGERPRINT_OK) {
-            Serial.println("Fingerprint enrolled successfully.");
-            lv_label_set_text_fmt(finger_label, "Fingerprint enrolled successfully as ID #%d", id);
-            lv_timer_handler();
-            delay(2000);
-            ReturnToMainMenu();
-          } else {
-            lv_label_set_text(finger_label, "Failed to store fingerprint.");
-            lv_timer_handler();
-          }
-        } else {
-          lv_label_set_text(finger_label, "Fingerprints did not match.");
-          lv_timer_handler();
-        }
-      } else {
-        lv_label_set_text(finger_label, "Failed to capture second image.");
-        lv_timer_handler();
-      }
-    } else {
-      lv_label_set_text(finger_label, "Failed to process image.");
-      lv_timer_handler();
-    }
+  if (event.type == kEvtEnrollDone) {
+    finger_text.SetTextFmt("Fingerprint enrolled successfully as ID #%d", event.id);
   } else {
-    lv_label_set_text(finger_label, "Error capturing image.");
-    lv_timer_handler();
+    finger_text.SetText(event.message);
+  }
+
+  if (event.type == kEvtEnrollDone) {
+    ui_mode = kUiIdle;
+
+    // After 2 seconds, go back to the initial screen
+    lv_timer_create([](lv_timer_t* t) {
+      ReturnToMainMenu();
+      lv_timer_del(t);  // Delete the timer after execution
+    }, 2000, NULL);  // 2000 milliseconds = 2 seconds
+  } else if (event.type == kEvtEnrollFailed) {
+    // Leave the error on screen until the user presses Back
+    ui_mode = kUiIdle;
   }
 }
 
-/* Function to scan for fingerprints */
-void ScanFingerprint() {
-  uint8_t fingerprint_id = GetFingerprintID();
-  switch (fingerprint_id) {
+/* Function to show a scan result reported by the sensor task */
+void ShowScanResult(const SensorEvent& event) {
+  if (ui_mode != kUiScanning) return;  // Scan screen already left
+
+  switch (event.status) {
     case FINGERPRINT_NOFINGER:
-      lv_label_set_text(finger_label, "No Finger Detected");
+      finger_text.SetText("No Finger Detected");
       Serial.println("No Finger Detected");
       break;
     case FINGERPRINT_NOTFOUND:
-      lv_label_set_text(finger_label, "No Match Found");
+      finger_text.SetText("No Match Found");
       Serial.println("No Match Found");
       break;
-    default:
-      if (fingerprint_id >= 0) {
-        // Get the user's name based on the fingerprint ID from the JSON file
-        const char* user_name = GetUserNameByID(fingerprint_id);
-
-        // Display fingerprint ID and user name on the label
-        String msg = "ID: " + String(fingerprint_id) + ", Name: " + String(user_name);
-        lv_label_set_text(finger_label, msg.c_str());
-        Serial.println(msg);
-      }
+    case FINGERPRINT_OK: {
+      // Map the matched shard and page back to the user, then get the name
+      STAGE_TIMER_START(lookup_timer);
+      uint16_t user_id = user_directory.IdAt(event.shard, event.slot);
+      const char* user_name = GetUserNameByID(user_id);
+      STAGE_TIMER_STOP(kStageLookup, lookup_timer);
+
+      // Display user ID and user name on the label
+      STAGE_TIMER_START(label_timer);
+      finger_text.SetTextFmt("ID: %u, Name: %s", (unsigned)user_id, user_name);
+      STAGE_TIMER_STOP(kStageLabel, label_timer);
+      Serial.println(finger_text.text());
       break;
+    }
+    default:
+      // Transient capture errors leave the previous result on screen
+      return;
+  }
+
+  scan_pipeline_stat.Add(event.pipeline_us);
+  scan_latency_stat.Add(micros() - event.started_us);
+}
+
+/* Function to show the outcome of a template backup or restore */
+void ShowArchiveResult(const SensorEvent& event) {
+  Serial.println(event.message);
+  if (current_screen != kScreenMain) return;  // Do not cover another screen's text
+
+  status_text.SetText(event.message);
+  status_text.SetVisible(true);
+}
+
+/* Function to show the sensor going offline or coming back; scans resume on their own */
+void ShowSensorStatus(const SensorEvent& event) {
+  sensor_offline = (event.status != FINGERPRINT_OK);
+  // The first status ends the boot; the next one prints it if a raw stream had the port
+  if (!admin_console.streaming()) PrintBootProfile(!sensor_offline);
+
+  if (ui_mode == kUiScanning) {
+    finger_text.SetText(sensor_offline ? kSensorOfflineText : "Scanning...");
+  } else if (current_screen == kScreenMain) {
+    status_text.SetText(WelcomeText());
   }
 }
 
 /* Function to return to the main menu */
 void ReturnToMainMenu() {
-  // Show the main menu (dropdown_menu)
-  lv_obj_clear_flag(dropdown_menu, LV_OBJ_FLAG_HIDDEN);
-  lv_obj_add_flag(return_button, LV_OBJ_FLAG_HIDDEN);
-
-  // Hide text labels and input fields
-  lv_obj_add_flag(finger_label, LV_OBJ_FLAG_HIDDEN);
-  lv_obj_add_flag(status_label, LV_OBJ_FLAG_HIDDEN);
-  lv_obj_add_flag(input_text_area, LV_OBJ_FLAG_HIDDEN);
-  lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
-  lv_obj_add_flag(password_area, LV_OBJ_FLAG_HIDDEN);
-  lv_obj_add_flag(password_keyboard, LV_OBJ_FLAG_HIDDEN);
-  if (delete_button != NULL) lv_obj_add_flag(delete_button, LV_OBJ_FLAG_HIDDEN);
-  if (user_dropdown != NULL) lv_obj_add_flag(user_dropdown, LV_OBJ_FLAG_HIDDEN);
+  bulk_delete_shown = false;
 
-  // Stop enrolling and scanning modes
-  enrolling_mode = false;
-  scanning_mode = false;
+  // Stop enrolling and scanning on the sensor task
+  SendSensorCommand(kCmdStop);
+  ui_mode = kUiIdle;
 
   // Reset ID and Name for future enrollments
   id = 0;
-  user_name = "";
-
-  // Reset status label message
-  lv_label_set_text(status_label, "Welcome! Please select an option.");
-  lv_obj_align(status_label, LV_ALIGN_CENTER, 0, -40);
-  lv_obj_clear_flag(status_label, LV_OBJ_FLAG_HIDDEN);
+  verify_entry = false;
+  user_name[0] = '\0';
+
+  // Load the main menu and reset its status message
+  ShowScreen(kScreenMain);
+  status_text.SetText(WelcomeText());
+  status_text.Align(LV_ALIGN_CENTER, 0, -40);
+  status_text.SetVisible(true);
 }
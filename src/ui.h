@@ -6,47 +6,55 @@
 // Include LVGL library and hardware definitions
 #include <lvgl.h>
 #include "hardware.h"
+#include "sensor_task.h"
 
-// Extern declarations for UI objects
-extern lv_obj_t* finger_label;        // Label to display fingerprint messages
+// Extern declarations for UI objects, NULL until their screen is first shown
+extern lv_obj_t* finger_label;        // Label to display fingerprint messages, moved between screens
 extern lv_obj_t* dropdown_menu;       // Dropdown menu for main options
 extern lv_obj_t* input_text_area;     // Text area for input
-extern lv_obj_t* keyboard;            // On-screen keyboard
-extern lv_obj_t* return_button;       // Return (Back) button
-extern lv_obj_t* user_dropdown;       // Dropdown menu for user selection (delete action)
+extern lv_obj_t* keyboard;            // On-screen keyboard, shared by the input screens
+extern lv_obj_t* return_button;       // Return (Back) button, moved between screens
 extern lv_obj_t* delete_button;       // Delete button in delete action
+extern lv_obj_t* select_all_button;   // Select all / none button in delete action
 extern lv_obj_t* password_area;       // Text area for password input
-extern lv_obj_t* password_keyboard;   // On-screen keyboard for password input
-extern lv_obj_t* status_label;        // Label to display status messages
+extern lv_obj_t* status_label;        // Label to display status messages, moved between screens
 
 // Global variables
-extern uint8_t id;         // Fingerprint ID to be enrolled or deleted
-extern bool enrolling_mode;  // Flag indicating if enrolling mode is active
-extern bool scanning_mode;   // Flag indicating if scanning mode is active
-extern String user_name;     // Variable to store the user's name
+extern char user_name[];     // Name being enrolled, NUL-terminated
 
-// LVGL display buffer
+// LVGL display buffers, rendered into alternately while the other is sent by DMA
 extern lv_disp_draw_buf_t draw_buf;  // LVGL display buffer
-extern lv_color_t buf[];             // Buffer for LVGL display
+extern lv_color_t buf1[];            // First draw buffer
+extern lv_color_t buf2[];            // Second draw buffer
 
 // Function declarations for UI-related functions
 void SetupUI();                      // Function to initialize the LVGL UI
 void ReturnToMainMenu();             // Function to return to the main menu
 void EnrollAction();                 // Function for Enroll action
 void ScanAction();                   // Function for Scan action
+void VerifyAction();                 // Function for Verify action
 void DeleteAction();                 // Function for Delete action
 void PasswordAction();               // Function for Password action
 void ShowPasswordScreen();           // Function to show the password input screen
 void KeyboardEventHandler(lv_event_t* e);      // Event handler for keyboard input
-void PassKeyboardEventHandler(lv_event_t* e);  // Event handler for password keyboard input
+void PassKeyboardEventHandler(lv_event_t* e);  // Event handler for keyboard input on the password screen
 void DropdownEventHandler(lv_event_t* e);      // Event handler for dropdown menu
 void ReturnButtonEventHandler(lv_event_t* e);  // Event handler for Return button
 void DeleteButtonEventHandler(lv_event_t* e);  // Event handler for Delete button
-void UserDropdownEventHandler(lv_event_t* e);  // Event handler for user dropdown in delete action
+void SelectAllButtonEventHandler(lv_event_t* e);  // Event handler for the All button
+void DeleteSelectedUsers();                    // Function to delete every selected user
+void ShowBulkDeleteResult();                   // Function to show a finished bulk delete
 void RepositionLabelAboveKeyboard();           // Function to reposition label when keyboard is shown
 void LVGLPortTPRead(lv_indev_drv_t* indev, lv_indev_data_t* data);  // Touchpad input handler
 void MyDispFlush(lv_disp_drv_t* disp, const lv_area_t* area, lv_color_t* color_p);  // Display flushing
-void HandleFingerprintEnrollment();            // Function to handle fingerprint enrollment
-void ScanFingerprint();                        // Function to scan for fingerprints
+void ReleaseDisplayBus();                      // Function to finish DMA and free the SPI bus
+const char* RenderSceneName();                 // Function to name the screen being drawn, for profiling
+void RunDisplayBenchmark();                    // Function to time full-screen redraws
+void ProcessSensorEvents();                    // Function to apply results from the sensor task
+void ShowEnrollmentEvent(const SensorEvent& event);  // Function to show enrollment progress
+void LogAccess(const SensorEvent& event);            // Function to record a scan in the access log
+void ShowScanResult(const SensorEvent& event);       // Function to show a scan result
+void ShowArchiveResult(const SensorEvent& event);    // Function to show a backup/restore outcome
+void ShowSensorStatus(const SensorEvent& event);     // Function to show the sensor going offline or back
 
 #endif  // UI_H_
@@ -0,0 +1,82 @@
+// ui_binding.cpp
+
+#include "ui_binding.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+LabelBinding finger_text;
+LabelBinding status_text;
+LabelBinding delete_text;
+UiBindingStats ui_binding_stats = {0, 0};
+
+LabelBinding::LabelBinding()
+    : label_(NULL), align_(LV_ALIGN_DEFAULT), x_ofs_(0), y_ofs_(0), aligned_(false),
+      visible_(true) {
+  text_[0] = '\0';
+  scratch_[0] = '\0';
+}
+
+/* Attach to a label and adopt its current state */
+void LabelBinding::Bind(lv_obj_t* label) {
+  label_ = label;
+  text_[0] = '\0';
+  aligned_ = false;
+  visible_ = !lv_obj_has_flag(label, LV_OBJ_FLAG_HIDDEN);
+  lv_label_set_text_static(label_, text_);
+}
+
+/* Count an update as applied or suppressed */
+bool LabelBinding::Apply(bool changed) {
+  if (changed) {
+    ui_binding_stats.applied++;
+  } else {
+    ui_binding_stats.suppressed++;
+  }
+  return changed;
+}
+
+/* Replace the label text if it differs from what is shown */
+bool LabelBinding::SetText(const char* text) {
+  if (strncmp(text_, text, sizeof(text_) - 1) == 0) return Apply(false);
+
+  strncpy(text_, text, sizeof(text_) - 1);
+  text_[sizeof(text_) - 1] = '\0';
+  lv_label_set_text_static(label_, text_);  // Same pointer: LVGL re-reads the text
+  return Apply(true);
+}
+
+/* Format straight into a fixed buffer, then update only on change */
+bool LabelBinding::SetTextFmt(const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(scratch_, sizeof(scratch_), fmt, args);
+  va_end(args);
+  return SetText(scratch_);
+}
+
+/* Re-align the label if the alignment differs from the current one */
+bool LabelBinding::Align(lv_align_t align, lv_coord_t x_ofs, lv_coord_t y_ofs) {
+  if (aligned_ && align == align_ && x_ofs == x_ofs_ && y_ofs == y_ofs_) return Apply(false);
+
+  align_ = align;
+  x_ofs_ = x_ofs;
+  y_ofs_ = y_ofs;
+  aligned_ = true;
+  lv_obj_align(label_, align, x_ofs, y_ofs);
+  return Apply(true);
+}
+
+/* Show or hide the label if its visibility differs */
+bool LabelBinding::SetVisible(bool visible) {
+  if (visible == visible_) return Apply(false);
+
+  visible_ = visible;
+  if (visible) {
+    lv_obj_clear_flag(label_, LV_OBJ_FLAG_HIDDEN);
+  } else {
+    lv_obj_add_flag(label_, LV_OBJ_FLAG_HIDDEN);
+  }
+  return Apply(true);
+}
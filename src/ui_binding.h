@@ -0,0 +1,57 @@
+// ui_binding.h
+
+#ifndef UI_BINDING_H_
+#define UI_BINDING_H_
+
+#include <lvgl.h>
+
+const size_t kLabelTextCapacity = 96;  // Longest label text kept, including terminator
+
+/* Counters showing how many label updates reached LVGL */
+struct UiBindingStats {
+  uint32_t applied;     // Updates that changed the label and invalidated it
+  uint32_t suppressed;  // Updates dropped because nothing changed
+};
+
+/*
+ * Owns the text, alignment and visibility of one LVGL label.
+ *
+ * Every setter compares against the cached state and only calls into LVGL
+ * when something actually changed, so repeated updates with the same content
+ * never invalidate the label or cause a flush. The label displays the
+ * binding's own buffer through lv_label_set_text_static, so LVGL does not
+ * allocate a copy of the text.
+ */
+class LabelBinding {
+ public:
+  LabelBinding();
+
+  void Bind(lv_obj_t* label);                          // Attach to a created label
+  bool SetText(const char* text);                      // True if the label changed
+  bool SetTextFmt(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+  bool Align(lv_align_t align, lv_coord_t x_ofs, lv_coord_t y_ofs);
+  bool SetVisible(bool visible);
+
+  const char* text() const { return text_; }
+  lv_obj_t* obj() const { return label_; }
+
+ private:
+  bool Apply(bool changed);
+
+  lv_obj_t* label_;
+  char text_[kLabelTextCapacity];     // Text currently shown by the label
+  char scratch_[kLabelTextCapacity];  // Formatting target before comparison
+  lv_align_t align_;
+  lv_coord_t x_ofs_;
+  lv_coord_t y_ofs_;
+  bool aligned_;                      // Align() has been applied at least once
+  bool visible_;
+};
+
+// Bindings for the labels managed by ui.cpp
+extern LabelBinding finger_text;
+extern LabelBinding status_text;
+extern LabelBinding delete_text;  // Delete button caption with the selection size
+extern UiBindingStats ui_binding_stats;
+
+#endif  // UI_BINDING_H_
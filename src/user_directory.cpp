@@ -0,0 +1,121 @@
+// user_directory.cpp
+
+#include "user_directory.h"
+
+#include <string.h>
+
+// Directory instance loaded at boot by the user store
+UserDirectory user_directory;
+
+UserDirectory::UserDirectory() {
+  Clear();
+}
+
+/* Remove every user from the directory */
+void UserDirectory::Clear() {
+  memset(entries_, 0, sizeof(entries_));
+  memset(owners_, 0, sizeof(owners_));
+  memset(loads_, 0, sizeof(loads_));
+  count_ = 0;
+}
+
+/* Add or replace the user stored under an ID, and the page holding its template */
+bool UserDirectory::Set(uint16_t id, const char* name, uint8_t shard, uint16_t slot) {
+  if (id == 0 || id > kMaxUserId || name == NULL) return false;
+  if (shard >= kSensorShardCount || slot >= kShardCapacity) return false;
+  if (owners_[shard][slot] != 0 && owners_[shard][slot] != id) return false;  // Page taken
+
+  Entry& entry = entries_[id];
+  if (entry.used) {
+    owners_[entry.shard][entry.slot] = 0;
+    loads_[entry.shard]--;
+  } else {
+    count_++;
+  }
+  entry.used = true;
+  entry.shard = shard;
+  entry.slot = slot;
+  owners_[shard][slot] = id;
+  loads_[shard]++;
+
+  // Copy the name into the slot, truncating anything that does not fit
+  strncpy(entry.name, name, kMaxUserNameLength);
+  entry.name[kMaxUserNameLength] = '\0';
+  return true;
+}
+
+/* Remove the user stored under an ID */
+bool UserDirectory::Remove(uint16_t id) {
+  if (id == 0 || id > kMaxUserId || !entries_[id].used) return false;
+
+  Entry& entry = entries_[id];
+  owners_[entry.shard][entry.slot] = 0;
+  loads_[entry.shard]--;
+  entry.used = false;
+  entry.name[0] = '\0';
+  count_--;
+  return true;
+}
+
+/* Look up the user name for an ID without touching the file system */
+const char* UserDirectory::Find(uint16_t id) const {
+  if (id == 0 || id > kMaxUserId || !entries_[id].used) return NULL;
+  return entries_[id].name;
+}
+
+/* Iterate used IDs in ascending order; pass 0 to start, stops at 0 */
+uint16_t UserDirectory::NextId(uint16_t after) const {
+  for (uint16_t id = after + 1; id <= kMaxUserId; id++) {
+    if (entries_[id].used) return id;
+  }
+  return 0;
+}
+
+/* Iterate used IDs in descending order; stops at 0 */
+uint16_t UserDirectory::PrevId(uint16_t before) const {
+  uint16_t id = before > kMaxUserId ? kMaxUserId + 1 : before;
+  while (id > 1) {
+    id--;
+    if (entries_[id].used) return id;
+  }
+  return 0;
+}
+
+/* Shard and page of a user's template */
+bool UserDirectory::Locate(uint16_t id, uint8_t* shard, uint16_t* slot) const {
+  if (Find(id) == NULL) return false;
+  *shard = entries_[id].shard;
+  *slot = entries_[id].slot;
+  return true;
+}
+
+/* Map a search hit on a shard back to the user ID */
+uint16_t UserDirectory::IdAt(uint8_t shard, uint16_t slot) const {
+  if (shard >= kSensorShardCount || slot >= kShardCapacity) return 0;
+  return owners_[shard][slot];
+}
+
+uint16_t UserDirectory::ShardLoad(uint8_t shard) const {
+  return shard < kSensorShardCount ? loads_[shard] : 0;
+}
+
+/* Shard with the fewest templates; ties go to the lowest index */
+uint8_t UserDirectory::LeastLoadedShard() const {
+  uint8_t best = 0;
+  for (uint8_t shard = 1; shard < kSensorShardCount; shard++) {
+    if (loads_[shard] < loads_[best]) best = shard;
+  }
+  return best;
+}
+
+/* A free page on a shard, the preferred one if it is free (keeps page == ID on one sensor) */
+uint16_t UserDirectory::FreeSlot(uint8_t shard, uint16_t preferred) const {
+  if (shard >= kSensorShardCount) return kNoSlot;
+  if (preferred < kShardCapacity && owners_[shard][preferred] == 0) return preferred;
+
+  // Pages start at 1, as IDs always have
+  for (uint16_t slot = 1; slot < kShardCapacity; slot++) {
+    if (owners_[shard][slot] == 0) return slot;
+  }
+  return kNoSlot;
+}
@@ -0,0 +1,77 @@
+// user_directory.h
+
+#ifndef USER_DIRECTORY_H_
+#define USER_DIRECTORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Highest user ID; raise it with -D MAX_USER_ID=<n> when several sensors are fitted
+#ifndef MAX_USER_ID
+#define MAX_USER_ID 127
+#endif
+
+// Sensor modules sharing the user ID space, and template pages used on each
+#ifndef SENSOR_SHARDS
+#define SENSOR_SHARDS 1
+#endif
+#ifndef SENSOR_SHARD_CAPACITY
+#define SENSOR_SHARD_CAPACITY 128
+#endif
+
+// Directory sizing constants
+const uint16_t kMaxUserId = MAX_USER_ID;            // Highest user ID accepted
+const size_t kMaxUserNameLength = 31;               // Longest stored name, excluding terminator
+const uint8_t kSensorShardCount = SENSOR_SHARDS;    // Sensor modules holding templates
+const uint16_t kShardCapacity = SENSOR_SHARD_CAPACITY;  // Template pages 0..n-1 per module
+const uint16_t kNoSlot = 0xFFFF;                    // No free page on a shard
+
+/*
+ * In-RAM user directory indexed directly by user ID.
+ *
+ * The table is dense (one slot per possible ID) and names live inside the
+ * slots, so lookups are O(1), never allocate and never touch the file system.
+ * Pointers returned by Find() stay valid until that ID is changed or removed.
+ *
+ * Each user also records where its template lives: a shard (sensor module)
+ * and a page on that module. A reverse table maps a search hit back to the
+ * user ID in O(1) as well.
+ */
+class UserDirectory {
+ public:
+  UserDirectory();
+
+  void Clear();                                // Remove every user
+  bool Set(uint16_t id, const char* name, uint8_t shard, uint16_t slot);  // Add or replace
+  bool Remove(uint16_t id);                    // Remove a user, false if absent
+  const char* Find(uint16_t id) const;         // Name for an ID, or NULL
+  bool Contains(uint16_t id) const { return Find(id) != NULL; }
+  uint16_t Count() const { return count_; }    // Number of users present
+  uint16_t NextId(uint16_t after) const;       // Next used ID above after, or 0
+  uint16_t PrevId(uint16_t before) const;      // Previous used ID below before, or 0
+
+  // Template placement
+  bool Locate(uint16_t id, uint8_t* shard, uint16_t* slot) const;  // Where a template lives
+  uint16_t IdAt(uint8_t shard, uint16_t slot) const;  // User stored on a page, or 0
+  uint16_t ShardLoad(uint8_t shard) const;     // Templates stored on a shard
+  uint8_t LeastLoadedShard() const;            // Shard new users should go to
+  uint16_t FreeSlot(uint8_t shard, uint16_t preferred) const;  // Free page, or kNoSlot
+
+ private:
+  struct Entry {
+    bool used;                             // Slot holds a user
+    uint8_t shard;                         // Sensor module holding the template
+    uint16_t slot;                         // Template page on that module
+    char name[kMaxUserNameLength + 1];     // NUL-terminated user name
+  };
+
+  Entry entries_[kMaxUserId + 1];  // Slot 0 is unused, IDs start at 1
+  uint16_t owners_[kSensorShardCount][kShardCapacity];  // User ID per page, 0 if free
+  uint16_t loads_[kSensorShardCount];
+  uint16_t count_;
+};
+
+// Directory shared by the scan, enroll and delete paths
+extern UserDirectory user_directory;
+
+#endif  // USER_DIRECTORY_H_
@@ -0,0 +1,205 @@
+// user_list_view.cpp
+
+#include "user_list_view.h"
+#include <stdio.h>
+#include <string.h>
+
+// List shown by the Delete screen
+UserListView user_list_view;
+
+UserListView::UserListView()
+    : container_(NULL), up_button_(NULL), down_button_(NULL), first_id_(0), last_id_(0),
+      selected_count_(0), on_selected_(NULL), context_(NULL) {
+  memset(selected_, 0, sizeof(selected_));
+  memset(rows_, 0, sizeof(rows_));
+  memset(row_labels_, 0, sizeof(row_labels_));
+  memset(row_text_, 0, sizeof(row_text_));
+}
+
+/* Build the container, the row pool and the page buttons */
+void UserListView::Create(lv_obj_t* parent, lv_coord_t width, UserSelectedCallback on_selected,
+                          void* context) {
+  on_selected_ = on_selected;
+  context_ = context;
+
+  // Rows are positioned by hand, so the container itself never scrolls
+  container_ = lv_obj_create(parent);
+  lv_obj_set_size(container_, width, kUserListRows * kUserListRowHeight + 8);
+  lv_obj_align(container_, LV_ALIGN_TOP_MID, 0, 48);  // Clear of Back and Delete
+  lv_obj_set_style_pad_all(container_, 4, 0);
+  lv_obj_clear_flag(container_, LV_OBJ_FLAG_SCROLLABLE);
+  lv_obj_add_event_cb(container_, ScrollEventHandler, LV_EVENT_GESTURE, this);
+
+  for (uint8_t i = 0; i < kUserListRows; i++) {
+    rows_[i] = lv_btn_create(container_);
+    lv_obj_set_size(rows_[i], width - 48, kUserListRowHeight - 4);
+    lv_obj_set_pos(rows_[i], 0, i * kUserListRowHeight);
+    lv_obj_add_event_cb(rows_[i], RowEventHandler, LV_EVENT_CLICKED, this);
+
+    row_labels_[i] = lv_label_create(rows_[i]);
+    lv_label_set_long_mode(row_labels_[i], LV_LABEL_LONG_DOT);
+    lv_obj_set_width(row_labels_[i], width - 64);
+    lv_obj_align(row_labels_[i], LV_ALIGN_LEFT_MID, 0, 0);
+    lv_label_set_text_static(row_labels_[i], row_text_[i]);
+  }
+
+  up_button_ = lv_btn_create(container_);
+  lv_obj_set_size(up_button_, 32, kUserListRowHeight * 2 - 6);
+  lv_obj_align(up_button_, LV_ALIGN_TOP_RIGHT, 0, 0);
+  lv_obj_add_event_cb(up_button_, ScrollEventHandler, LV_EVENT_CLICKED, this);
+  lv_obj_t* up_label = lv_label_create(up_button_);
+  lv_label_set_text(up_label, LV_SYMBOL_UP);
+  lv_obj_center(up_label);
+
+  down_button_ = lv_btn_create(container_);
+  lv_obj_set_size(down_button_, 32, kUserListRowHeight * 2 - 6);
+  lv_obj_align(down_button_, LV_ALIGN_BOTTOM_RIGHT, 0, 0);
+  lv_obj_add_event_cb(down_button_, ScrollEventHandler, LV_EVENT_CLICKED, this);
+  lv_obj_t* down_label = lv_label_create(down_button_);
+  lv_label_set_text(down_label, LV_SYMBOL_DOWN);
+  lv_obj_center(down_label);
+}
+
+/* Show the list from the first user with nothing selected */
+void UserListView::Show() {
+  memset(selected_, 0, sizeof(selected_));
+  selected_count_ = 0;
+  Fill(user_directory.NextId(0));
+  lv_obj_clear_flag(container_, LV_OBJ_FLAG_HIDDEN);
+}
+
+void UserListView::Hide() {
+  if (container_ != NULL) lv_obj_add_flag(container_, LV_OBJ_FLAG_HIDDEN);
+}
+
+/* Refill the current window; it starts at the next user if the top one is gone */
+void UserListView::Refresh() {
+  for (uint16_t id = 1; id <= kMaxUserId; id++) {
+    if (IsSelected(id) && !user_directory.Contains(id)) Select(id, false);
+  }
+  uint16_t first = user_directory.Contains(first_id_) ? first_id_
+                                                      : user_directory.NextId(first_id_);
+  if (first == 0) first = user_directory.PrevId(first_id_);
+  Fill(first);
+}
+
+/* Load the window starting at first_id into the row pool */
+void UserListView::Fill(uint16_t first_id) {
+  first_id_ = first_id;
+  last_id_ = first_id;
+
+  uint16_t id = first_id;
+  for (uint8_t i = 0; i < kUserListRows; i++) {
+    lv_obj_t* row = rows_[i];
+    if (id != 0) {
+      snprintf(row_text_[i], kUserListRowText, "ID: %u, Name: %s", (unsigned)id,
+               user_directory.Find(id));
+      last_id_ = id;
+    } else {
+      snprintf(row_text_[i], kUserListRowText, "%s", i == 0 ? "No users found." : "");
+    }
+
+    // The row carries its user ID; empty rows carry 0 and ignore taps
+    lv_obj_set_user_data(row, (void*)(uintptr_t)id);
+    if (id != 0 && IsSelected(id)) {
+      lv_obj_add_state(row, LV_STATE_CHECKED);
+    } else {
+      lv_obj_clear_state(row, LV_STATE_CHECKED);
+    }
+    if (id != 0 || i == 0) {
+      lv_obj_clear_flag(row, LV_OBJ_FLAG_HIDDEN);
+    } else {
+      lv_obj_add_flag(row, LV_OBJ_FLAG_HIDDEN);
+    }
+    lv_label_set_text_static(row_labels_[i], row_text_[i]);  // Text changed in place
+
+    if (id != 0) id = user_directory.NextId(id);
+  }
+}
+
+/* Move the window one page towards higher IDs */
+void UserListView::PageDown() {
+  uint16_t next = user_directory.NextId(last_id_);
+  if (first_id_ != 0 && next != 0) Fill(next);
+}
+
+/* Move the window one page towards lower IDs */
+void UserListView::PageUp() {
+  uint16_t first = first_id_;
+  for (uint8_t i = 0; i < kUserListRows; i++) {
+    uint16_t previous = user_directory.PrevId(first);
+    if (previous == 0) break;
+    first = previous;
+  }
+  if (first != first_id_) Fill(first);
+}
+
+/* Add a user to the selection or take it out; visible rows follow */
+void UserListView::Select(uint16_t id, bool selected) {
+  if (id == 0 || id > kMaxUserId || IsSelected(id) == selected) return;
+  uint8_t mask = (uint8_t)(1 << (id % 8));
+  if (selected) {
+    selected_[id / 8] |= mask;
+    selected_count_++;
+  } else {
+    selected_[id / 8] &= (uint8_t)~mask;
+    selected_count_--;
+  }
+
+  for (uint8_t i = 0; i < kUserListRows && container_ != NULL; i++) {
+    if ((uint16_t)(uintptr_t)lv_obj_get_user_data(rows_[i]) != id) continue;
+    if (selected) {
+      lv_obj_add_state(rows_[i], LV_STATE_CHECKED);
+    } else {
+      lv_obj_clear_state(rows_[i], LV_STATE_CHECKED);
+    }
+  }
+}
+
+/* Select every user in the directory, or clear the selection */
+void UserListView::SelectAll(bool selected) {
+  memset(selected_, 0, sizeof(selected_));
+  selected_count_ = 0;
+  if (selected) {
+    for (uint16_t id = user_directory.NextId(0); id != 0; id = user_directory.NextId(id)) {
+      selected_[id / 8] |= (uint8_t)(1 << (id % 8));
+      selected_count_++;
+    }
+  }
+  if (container_ != NULL) Fill(first_id_);
+}
+
+/* True if the user is part of the selection */
+bool UserListView::IsSelected(uint16_t id) const {
+  if (id > kMaxUserId) return false;
+  return (selected_[id / 8] & (1 << (id % 8))) != 0;
+}
+
+/* A row was tapped: toggle the user it carries */
+void UserListView::RowEventHandler(lv_event_t* e) {
+  UserListView* self = (UserListView*)lv_event_get_user_data(e);
+  lv_obj_t* row = lv_event_get_target(e);
+  uint16_t id = (uint16_t)(uintptr_t)lv_obj_get_user_data(row);
+
+  if (id == 0) {
+    lv_obj_clear_state(row, LV_STATE_CHECKED);
+    return;
+  }
+  self->Select(id, !self->IsSelected(id));
+  if (self->on_selected_ != NULL) self->on_selected_(id, self->context_);
+}
+
+/* Arrow buttons and vertical swipes page through the directory */
+void UserListView::ScrollEventHandler(lv_event_t* e) {
+  UserListView* self = (UserListView*)lv_event_get_user_data(e);
+
+  if (lv_event_get_code(e) == LV_EVENT_GESTURE) {
+    lv_dir_t dir = lv_indev_get_gesture_dir(lv_indev_get_act());
+    if (dir == LV_DIR_TOP) self->PageDown();
+    if (dir == LV_DIR_BOTTOM) self->PageUp();
+  } else if (lv_event_get_target(e) == self->down_button_) {
+    self->PageDown();
+  } else {
+    self->PageUp();
+  }
+}
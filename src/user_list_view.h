@@ -0,0 +1,74 @@
+// user_list_view.h
+
+#ifndef USER_LIST_VIEW_H_
+#define USER_LIST_VIEW_H_
+
+#include <lvgl.h>
+#include "user_directory.h"
+
+// List geometry
+const uint8_t kUserListRows = 4;            // Rows on screen, and users fetched per window
+const lv_coord_t kUserListRowHeight = 30;   // Height of each row in pixels
+const size_t kUserListRowText = kMaxUserNameLength + 16;  // "ID: n, Name: " plus the name
+
+// Called when a row is tapped, with the user ID stored on that row
+typedef void (*UserSelectedCallback)(uint16_t id, void* context);
+
+// Bytes of the selection bitmap, one bit per user ID
+const size_t kUserListSelectionBytes = kMaxUserId / 8 + 1;
+
+/*
+ * Virtualized user list for the Delete screen.
+ *
+ * A fixed pool of kUserListRows rows is created once and refilled from the
+ * user directory with only the window being shown, so opening the list
+ * costs the same with ten users as with hundreds. The window moves a page
+ * at a time with the arrow buttons or a vertical swipe. Each row keeps its
+ * user ID as LVGL user data and displays text from the view's own buffers,
+ * so selecting a row never parses text and refilling never allocates.
+ *
+ * Tapping a row toggles that user in a selection bitmap kept by the view,
+ * so users stay selected while paging and any number can be picked.
+ */
+class UserListView {
+ public:
+  UserListView();
+
+  void Create(lv_obj_t* parent, lv_coord_t width, UserSelectedCallback on_selected,
+              void* context);  // Build the row pool; call once
+  void Show();                 // Show from the first user, nothing selected
+  void Hide();
+  void Refresh();              // Drop deleted users from the selection and refill
+
+  void Select(uint16_t id, bool selected);  // Change one user's selection
+  void SelectAll(bool selected);            // Select every user, or none
+  bool IsSelected(uint16_t id) const;
+  uint16_t SelectedCount() const { return selected_count_; }
+
+  bool created() const { return container_ != NULL; }
+
+ private:
+  static void RowEventHandler(lv_event_t* e);
+  static void ScrollEventHandler(lv_event_t* e);
+  void Fill(uint16_t first_id);
+  void PageDown();
+  void PageUp();
+
+  lv_obj_t* container_;
+  lv_obj_t* rows_[kUserListRows];
+  lv_obj_t* row_labels_[kUserListRows];
+  lv_obj_t* up_button_;
+  lv_obj_t* down_button_;
+  char row_text_[kUserListRows][kUserListRowText];  // Text shown by each row's label
+  uint16_t first_id_;     // User on the top row, 0 if the directory is empty
+  uint16_t last_id_;      // User on the last filled row
+  uint8_t selected_[kUserListSelectionBytes];  // Selected user IDs, one bit each
+  uint16_t selected_count_;
+  UserSelectedCallback on_selected_;
+  void* context_;
+};
+
+// List shown by the Delete screen
+extern UserListView user_list_view;
+
+#endif  // USER_LIST_VIEW_H_
@@ -0,0 +1,312 @@
+// user_store.cpp
+
+#include "user_store.h"
+
+#include <ArduinoJson.h>
+
+// Store instance backing user_directory
+UserStore user_store(user_directory);
+
+/* CRC-8 (polynomial 0x07) over a record, skipping the checksum byte */
+static uint8_t RecordChecksum(const UserRecord& record) {
+  const uint8_t* bytes = (const uint8_t*)&record;
+  uint8_t crc = 0;
+  for (size_t i = 0; i < sizeof(UserRecord); i++) {
+    if (i == offsetof(UserRecord, checksum)) continue;
+    crc ^= bytes[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+/* Build a sealed record ready to be written */
+static void MakeRecord(UserRecord* record, uint16_t id, uint8_t flags, const char* name,
+                       uint8_t shard, uint16_t slot) {
+  memset(record, 0, sizeof(UserRecord));
+  record->id = id;
+  record->flags = flags;
+  record->shard = shard;
+  record->slot = slot;
+  if (name != NULL) strncpy(record->name, name, kMaxUserNameLength);
+  record->checksum = RecordChecksum(*record);
+}
+
+/* Record layout of the first log version: one sensor, template page == ID */
+struct __attribute__((packed)) UserRecordV1 {
+  uint16_t id;
+  uint8_t flags;
+  uint8_t checksum;
+  char name[kMaxUserNameLength + 1];
+};
+
+/* CRC-8 of a version 1 record, as RecordChecksum() computed it then */
+static uint8_t RecordChecksumV1(const UserRecordV1& record) {
+  const uint8_t* bytes = (const uint8_t*)&record;
+  uint8_t crc = 0;
+  for (size_t i = 0; i < sizeof(UserRecordV1); i++) {
+    if (i == offsetof(UserRecordV1, checksum)) continue;
+    crc ^= bytes[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+UserStore::UserStore(UserDirectory& directory)
+    : directory_(directory), fs_(NULL), pending_count_(0), oldest_pending_ms_(0),
+      batching_(false), log_torn_(false) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+/* Load the directory from the log, migrating users.json on first boot */
+bool UserStore::Begin(fs::FS& fs) {
+  fs_ = &fs;
+  pending_count_ = 0;
+  batching_ = false;
+  log_torn_ = false;
+  directory_.Clear();
+
+  // Finish a compaction that lost power between remove and rename
+  if (!fs_->exists(USER_LOG_PATH) && fs_->exists(USER_LOG_TMP_PATH)) {
+    fs_->rename(USER_LOG_TMP_PATH, USER_LOG_PATH);
+  }
+
+  if (!fs_->exists(USER_LOG_PATH) && fs_->exists(USER_LOG_V1_PATH)) {
+    return MigrateLogV1();
+  }
+  if (!fs_->exists(USER_LOG_PATH) && fs_->exists(LEGACY_USERS_PATH)) {
+    return MigrateLegacyJSON();
+  }
+  return Replay();
+}
+
+/* Read every intact record from the log into the directory */
+bool UserStore::Replay() {
+  File file = fs_->open(USER_LOG_PATH, "r");
+  if (!file) return true;  // No log yet: empty directory
+
+  UserRecord record;
+  uint16_t records = 0;
+  bool torn = false;
+
+  while (file.available()) {
+    // A short read or a bad checksum marks a torn tail from a power loss
+    if (file.read((uint8_t*)&record, sizeof(record)) != sizeof(record) ||
+        record.checksum != RecordChecksum(record)) {
+      torn = true;
+      break;
+    }
+    record.name[kMaxUserNameLength] = '\0';
+    if (record.flags & kUserRecordLive) {
+      directory_.Set(record.id, record.name, record.shard, record.slot);
+    } else {
+      directory_.Remove(record.id);
+    }
+    records++;
+  }
+  file.close();
+  stats_.log_records = records;
+
+  Serial.print("Replayed user records: ");
+  Serial.println(records);
+
+  // Rewrite the log so later appends do not land after garbage
+  if (torn) {
+    Serial.println("User log has a torn tail, compacting");
+    log_torn_ = true;
+    return Compact();
+  }
+  return true;
+}
+
+/* Import a version 1 log into a fresh log, placing every template on shard 0 */
+bool UserStore::MigrateLogV1() {
+  File file = fs_->open(USER_LOG_V1_PATH, "r");
+  if (!file) return false;
+
+  // Same replay rules as Replay(): stop at the first torn record
+  UserRecordV1 record;
+  while (file.read((uint8_t*)&record, sizeof(record)) == sizeof(record) &&
+         record.checksum == RecordChecksumV1(record)) {
+    record.name[kMaxUserNameLength] = '\0';
+    if (record.flags & kUserRecordLive) {
+      directory_.Set(record.id, record.name, 0, record.id);
+    } else {
+      directory_.Remove(record.id);
+    }
+  }
+  file.close();
+
+  if (!Compact()) return false;
+  fs_->remove(USER_LOG_V1_PATH);
+  Serial.println("Migrated user log to record version 2.");
+  return true;
+}
+
+/* Import the legacy users.json file into a fresh log */
+bool UserStore::MigrateLegacyJSON() {
+  File file = fs_->open(LEGACY_USERS_PATH, "r");
+  if (!file) return false;
+
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, file);
+  file.close();
+
+  if (error) {
+    Serial.println(F("Failed to read users.json, starting empty"));
+  } else {
+    for (JsonPair kv : doc.as<JsonObject>()) {
+      uint16_t id = kv.value()["id"];
+      directory_.Set(id, kv.value()["name"].as<const char*>(), 0, id);
+    }
+  }
+
+  if (!Compact()) return false;
+  fs_->remove(LEGACY_USERS_PATH);
+  Serial.println("Migrated users.json to binary user log.");
+  return true;
+}
+
+/* Queue a record, replacing any queued record for the same ID */
+bool UserStore::Enqueue(uint16_t id, uint8_t flags, const char* name, uint8_t shard,
+                        uint16_t slot) {
+  for (uint8_t i = 0; i < pending_count_; i++) {
+    if (pending_[i].id == id) {
+      MakeRecord(&pending_[i], id, flags, name, shard, slot);
+      return true;
+    }
+  }
+
+  // Queue full: make room by writing the batch out now
+  if (pending_count_ == kUserStorePendingCapacity && !Flush()) return false;
+
+  if (pending_count_ == 0) oldest_pending_ms_ = millis();
+  MakeRecord(&pending_[pending_count_++], id, flags, name, shard, slot);
+  return true;
+}
+
+/* Add or replace a user; visible immediately, persisted by the next flush */
+bool UserStore::Put(uint16_t id, const char* name, uint8_t shard, uint16_t slot) {
+  if (!directory_.Set(id, name, shard, slot)) return false;
+  if (batching_) return true;
+  return Enqueue(id, kUserRecordLive, name, shard, slot);
+}
+
+/* Delete a user; visible immediately, persisted by the next flush */
+bool UserStore::Remove(uint16_t id) {
+  if (!directory_.Remove(id)) return false;
+  if (batching_) return true;
+  return Enqueue(id, 0, NULL, 0, 0);
+}
+
+/* Flush queued records once the oldest has waited long enough */
+void UserStore::Poll(uint32_t now_ms) {
+  if (pending_count_ == 0) return;
+  if (now_ms - oldest_pending_ms_ < kUserStoreFlushDelayMs) return;
+  Flush();
+}
+
+/* Append every queued record to the log in one write */
+bool UserStore::Flush() {
+  if (pending_count_ == 0) return true;
+  if (fs_ == NULL) return false;
+
+  // A partial record ends the log; appending after it would hide every later one
+  if (log_torn_) return Compact();
+
+  File file = fs_->open(USER_LOG_PATH, "a");
+  if (!file) {
+    Serial.println(F("Failed to open user log for appending"));
+    return false;
+  }
+
+  size_t length = pending_count_ * sizeof(UserRecord);
+  size_t written = file.write((const uint8_t*)pending_, length);
+  file.close();
+
+  stats_.bytes_written += written;
+  if (written != length) {
+    // The directory already holds the batch, so a rewrite persists it without the torn bytes
+    Serial.println(F("Short write to user log, compacting"));
+    log_torn_ = true;
+    return Compact();
+  }
+
+  stats_.appends += pending_count_;
+  stats_.flushes++;
+  stats_.log_records += pending_count_;
+  pending_count_ = 0;
+
+  // Reclaim space once dead records dominate the log
+  if (stats_.log_records > directory_.Count() + kUserStoreCompactSlack) {
+    return Compact();
+  }
+  return true;
+}
+
+/* Rewrite the log with one record per live user */
+bool UserStore::Compact() {
+  if (fs_ == NULL) return false;
+
+  File file = fs_->open(USER_LOG_TMP_PATH, "w");
+  if (!file) {
+    Serial.println(F("Failed to open user log for compaction"));
+    return false;
+  }
+
+  UserRecord record;
+  uint16_t records = 0;
+  for (uint16_t id = directory_.NextId(0); id != 0; id = directory_.NextId(id)) {
+    uint8_t shard = 0;
+    uint16_t slot = 0;
+    directory_.Locate(id, &shard, &slot);
+    MakeRecord(&record, id, kUserRecordLive, directory_.Find(id), shard, slot);
+    size_t written = file.write((const uint8_t*)&record, sizeof(record));
+    stats_.bytes_written += written;
+    if (written != sizeof(record)) {
+      // Flash full or failing: keep the live log, it still holds every user
+      file.close();
+      fs_->remove(USER_LOG_TMP_PATH);
+      Serial.println(F("Short write while compacting user log"));
+      return false;
+    }
+    records++;
+  }
+  file.close();
+
+  // Swap the compacted log in; queued records are now part of it
+  fs_->remove(USER_LOG_PATH);
+  if (!fs_->rename(USER_LOG_TMP_PATH, USER_LOG_PATH)) {
+    Serial.println(F("Failed to replace user log"));
+    return false;
+  }
+
+  pending_count_ = 0;
+  log_torn_ = false;
+  stats_.log_records = records;
+  stats_.compactions++;
+  return true;
+}
+
+/* Start a batch; queued records are written first so an abort cannot lose them */
+bool UserStore::BeginBatch() {
+  if (batching_ || !Flush()) return false;
+  batching_ = true;
+  return true;
+}
+
+/* Persist every change made since BeginBatch() with one log rewrite; a failure leaves it open */
+bool UserStore::CommitBatch() {
+  if (!batching_ || !Compact()) return false;
+  batching_ = false;
+  return true;
+}
+
+/* Forget the batch by replaying the log, which does not contain it yet */
+bool UserStore::AbortBatch() {
+  if (!batching_ || fs_ == NULL) return false;
+  return Begin(*fs_);
+}
@@ -0,0 +1,96 @@
+// user_store.h
+
+#ifndef USER_STORE_H_
+#define USER_STORE_H_
+
+#include <Arduino.h>
+#include <FS.h>
+#include "user_directory.h"
+
+// Store file locations
+#define USER_LOG_PATH "/users2.log"          // Append-only record log
+#define USER_LOG_TMP_PATH "/users2.log.tmp"  // Compaction output before rename
+#define USER_LOG_V1_PATH "/users.log"        // Log without template locations, migrated once
+#define LEGACY_USERS_PATH "/users.json"      // Pre-log JSON store, migrated once
+
+// Write-behind tuning
+const uint8_t kUserStorePendingCapacity = 16;  // Coalesced records held in RAM
+const uint32_t kUserStoreFlushDelayMs = 1000;  // Max age of an unflushed record
+const uint16_t kUserStoreCompactSlack = 64;    // Dead records tolerated before compaction
+
+// Record flags
+const uint8_t kUserRecordLive = 0x01;  // Record adds/replaces a user; clear means delete
+
+/* Fixed-size binary record appended to the user log */
+struct __attribute__((packed)) UserRecord {
+  uint16_t id;                          // User ID
+  uint8_t flags;                        // kUserRecordLive or tombstone
+  uint8_t checksum;                     // CRC-8 over every other byte
+  uint8_t shard;                        // Sensor module holding the template
+  uint8_t reserved;
+  uint16_t slot;                        // Template page on that module
+  char name[kMaxUserNameLength + 1];    // NUL-terminated user name
+};
+
+/* Counters describing the flash traffic caused by the store */
+struct UserStoreStats {
+  uint32_t appends;        // Records appended to the log
+  uint32_t flushes;        // Batched append operations
+  uint32_t compactions;    // Full log rewrites
+  uint32_t bytes_written;  // Total bytes written to flash
+  uint16_t log_records;    // Records currently in the log file
+};
+
+/*
+ * Log-structured user store with write-behind.
+ *
+ * Every change is applied to the in-RAM directory immediately and queued as
+ * a fixed-size record. Queued records for the same ID are coalesced, and the
+ * queue is appended to the log in one write by Poll() or Flush(). Replay at
+ * boot stops at the first torn or corrupt record, and the log is compacted
+ * when dead records outnumber live ones by kUserStoreCompactSlack. An
+ * append that comes up short is followed by a compaction, never by another
+ * append, so the log stays record-aligned.
+ *
+ * Bulk changes go between BeginBatch() and CommitBatch(). They reach the
+ * directory at once but are persisted together by a single compaction, whose
+ * rename either lands the whole batch or none of it; AbortBatch() reloads
+ * the directory from the log instead. A CommitBatch() that fails leaves the
+ * batch open, so the caller can abort it and keep RAM in step with flash.
+ */
+class UserStore {
+ public:
+  UserStore(UserDirectory& directory);
+
+  bool Begin(fs::FS& fs);                     // Replay the log into the directory
+  bool Put(uint16_t id, const char* name, uint8_t shard, uint16_t slot);  // Add or replace
+  bool Remove(uint16_t id);                   // Delete a user
+  void Poll(uint32_t now_ms);                 // Flush queued records once they age out
+  bool Flush();                               // Append every queued record now
+  bool Compact();                             // Rewrite the log with live users only
+  bool BeginBatch();                          // Hold changes for one atomic commit
+  bool CommitBatch();                         // Persist the batch in one rewrite
+  bool AbortBatch();                          // Drop the batch, reloading from the log
+  bool batching() const { return batching_; }
+  const UserStoreStats& stats() const { return stats_; }
+
+ private:
+  bool Enqueue(uint16_t id, uint8_t flags, const char* name, uint8_t shard, uint16_t slot);
+  bool Replay();
+  bool MigrateLogV1();
+  bool MigrateLegacyJSON();
+
+  UserDirectory& directory_;
+  fs::FS* fs_;
+  UserRecord pending_[kUserStorePendingCapacity];  // Records awaiting flush
+  uint8_t pending_count_;
+  uint32_t oldest_pending_ms_;                     // millis() of first queued record
+  bool batching_;                                  // Changes wait for CommitBatch()
+  bool log_torn_;                                  // Log ends in a partial record; compact
+  UserStoreStats stats_;
+};
+
+// Store backing the shared user directory
+extern UserStore user_store;
+
+#endif  // USER_STORE_H_